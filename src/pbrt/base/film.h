@@ -19,6 +19,7 @@ class VisibleSurface;
 class RGBFilm;
 class GBufferFilm;
 class Sensor;
+struct FilmState;
 
 // FilmHandle Definition
 class FilmHandle : public TaggedPointer<RGBFilm, GBufferFilm> {
@@ -46,6 +47,9 @@ class FilmHandle : public TaggedPointer<RGBFilm, GBufferFilm> {
     void WriteImage(ImageMetadata metadata, Float splatScale = 1);
     Image GetImage(ImageMetadata *metadata, Float splatScale = 1);
 
+    FilmState GetState() const;
+    void SetState(const FilmState &state);
+
     using TaggedPointer::TaggedPointer;
 
     static FilmHandle Create(const std::string &name,
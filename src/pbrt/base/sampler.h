@@ -7,6 +7,7 @@
 
 #include <pbrt/pbrt.h>
 
+#include <pbrt/util/pstd.h>
 #include <pbrt/util/taggedptr.h>
 #include <pbrt/util/vecmath.h>
 
@@ -31,14 +32,15 @@ class PMJ02BNSampler;
 class RandomSampler;
 class SobolSampler;
 class StratifiedSampler;
+class ZSobolSampler;
 class MLTSampler;
 class DebugMLTSampler;
 
 // SamplerHandle Definition
 class SamplerHandle
     : public TaggedPointer<HaltonSampler, PaddedSobolSampler, PMJ02BNSampler,
-                           RandomSampler, SobolSampler, StratifiedSampler, MLTSampler,
-                           DebugMLTSampler> {
+                           RandomSampler, SobolSampler, StratifiedSampler, ZSobolSampler,
+                           MLTSampler, DebugMLTSampler> {
   public:
     // Sampler Interface
     using TaggedPointer::TaggedPointer;
@@ -55,6 +57,9 @@ class SamplerHandle
 
     PBRT_CPU_GPU inline Float Get1D();
     PBRT_CPU_GPU inline Point2f Get2D();
+    // Fills in _u_ with the next _u.size()_ 1D sample values, with a single
+    // dispatch to the underlying sampler.
+    PBRT_CPU_GPU inline void GetND(pstd::span<Float> u);
 
     std::vector<SamplerHandle> Clone(int n, Allocator alloc);
 
@@ -47,6 +47,12 @@ CameraTransform::CameraTransform(const AnimatedTransform &worldFromCamera) {
     default:
         LOG_FATAL("Unhandled rendering coordinate space");
     }
+    *this = CameraTransform(worldFromCamera, worldFromRender);
+}
+
+CameraTransform::CameraTransform(const AnimatedTransform &worldFromCamera,
+                                 const Transform &worldFromRender)
+    : worldFromRender(worldFromRender) {
     // Compute _renderFromCamera_ transformation
     Transform renderFromWorld = Inverse(worldFromRender);
     Transform rfc[2] = {renderFromWorld * worldFromCamera.startTransform,
@@ -55,6 +61,13 @@ CameraTransform::CameraTransform(const AnimatedTransform &worldFromCamera) {
                                          worldFromCamera.endTime);
 }
 
+AnimatedTransform CameraTransform::WorldFromCamera() const {
+    return AnimatedTransform(worldFromRender * renderFromCamera.startTransform,
+                             renderFromCamera.startTime,
+                             worldFromRender * renderFromCamera.endTransform,
+                             renderFromCamera.endTime);
+}
+
 std::string CameraTransform::ToString() const {
     return StringPrintf("[ CameraTransform renderFromCamera: %s worldFromRender: %s ]",
                         renderFromCamera, worldFromRender);
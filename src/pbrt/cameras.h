@@ -28,6 +28,8 @@ class CameraTransform {
     // CameraTransform Public Methods
     CameraTransform() = default;
     explicit CameraTransform(const AnimatedTransform &worldFromCamera);
+    CameraTransform(const AnimatedTransform &worldFromCamera,
+                    const Transform &worldFromRender);
 
     PBRT_CPU_GPU
     Point3f RenderFromCamera(const Point3f &p, Float time) const {
@@ -45,6 +47,9 @@ class CameraTransform {
     PBRT_CPU_GPU
     Transform RenderFromWorld() const { return Inverse(worldFromRender); }
     PBRT_CPU_GPU
+    Transform WorldFromRender() const { return worldFromRender; }
+    AnimatedTransform WorldFromCamera() const;
+    PBRT_CPU_GPU
     Transform CameraFromRender(Float time) const {
         return Inverse(renderFromCamera.Interpolate(time));
     }
@@ -4,6 +4,7 @@
 
 #include <pbrt/pbrt.h>
 
+#include <pbrt/film.h>
 #include <pbrt/filters.h>
 #include <pbrt/options.h>
 #include <pbrt/util/args.h>
@@ -14,6 +15,7 @@
 #include <pbrt/util/image.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/math.h>
+#include <pbrt/util/mipmap.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/rng.h>
@@ -65,6 +67,10 @@ static std::map<std::string, CommandUsage> commandUsage = {
     --outfile          Output image filename.
 )")}},
     {"average", {"average [options] <filename base>", std::string(R"(
+    --maxmemory <MB>   Average the images a band of scanlines at a time, using
+                       roughly the given amount of memory for pixels. The
+                       images and the output must be OpenEXR, PFM, or .praw
+                       files. Default: 0 (read the images in full).
     --outfile          Output image filename.
 )")}},
     {"cat", {"cat [options] <filename>", std::string(R"(
@@ -99,7 +105,15 @@ static std::map<std::string, CommandUsage> commandUsage = {
     --gamma <v>        Apply a gamma curve with exponent v. (Default: 1 (none)).
     --maxluminance <n> Luminance value mapped to white by tonemapping.
                        Default: 1
-    --outfile          Output image filename.
+    --maxmemory <MB>   Convert the image a band of scanlines at a time, using
+                       roughly the given amount of memory for pixels. The
+                       image and the output must be OpenEXR, PFM, or .praw
+                       files. Can't be used with --despike, --flipy, or
+                       --repeatpix.
+                       Default: 0 (read the image in full).
+    --outfile          Output image filename. Images written with the ".praw"
+                       extension store 32-bit float pixels that are used
+                       directly from the file when they are read.
     --preservecolors   By default, out-of-gammut colors have each component
                        clamped to [0,1] when written to non-HDR formats. With
                        this option enabled, such colors are scaled by their
@@ -114,6 +128,10 @@ static std::map<std::string, CommandUsage> commandUsage = {
     --crop <x0,x1,y0,y1> Crop images before performing diff.
     --difftol <v>      Acceptable image difference percentage before differences
                        are reported. Default: 0
+    --maxmemory <MB>   Compare the images a band of scanlines at a time, using
+                       roughly the given amount of memory for pixels. The
+                       images and any --outfile must be OpenEXR, PFM, or
+                       .praw files. Default: 0 (read the images in full).
     --metric <name>    Error metric to use. (Options: "L1", "MSE", "MRSE")
     --outfile <name>   Filename to use for saving an image that encodes the
                        absolute value of per-pixel differences.
@@ -133,6 +151,10 @@ static std::map<std::string, CommandUsage> commandUsage = {
       std::string(R"(
    --crop <x0,x1,y0,y1> Crop images before performing diff.
    --errorfile <name>   Output average error image.
+   --maxmemory <MB>     Compute errors a band of scanlines at a time, using
+                        roughly the given amount of memory for pixels. The
+                        images and any --errorfile must be OpenEXR, PFM, or
+                        .praw files. Default: 0 (read the images in full).
    --metric <name>      Error metric to use. (Options: "L1", MSE", "MRSE")
    --reference <name>   Reference image filename.
 )")}},
@@ -150,6 +172,15 @@ static std::map<std::string, CommandUsage> commandUsage = {
     {"makeemitters", {"makeemitters [options] <filename>", std::string(R"(
     --downsample <n>   Downsample the image by a factor of n in both dimensions
                        (using simple box filtering). Default: 1.
+)")}},
+    {"makemip", {"makemip [options] <filename>", std::string(R"(
+    --encoding <e>     Color encoding of 8-bit images ("linear", "sRGB", or
+                       "gamma <v>"). Default: sRGB for PNG files, linear otherwise.
+    --outfile <name>   Filename for the MIP pyramid file. When the default is
+                       used, pbrt uses it in place of the image for textures
+                       with matching parameters. Default: <filename>.mip
+    --wrap <mode>      Wrap mode used to filter the pyramid ("repeat", "clamp",
+                       "black", or "octahedralsphere"). Default: repeat
 )")}},
     {"makesky", {"makesky [options] <filename>", std::string(R"(
     --albedo <a>       Albedo of ground-plane (range 0-1). Default: 0.5
@@ -157,6 +188,12 @@ static std::map<std::string, CommandUsage> commandUsage = {
     --outfile <name>   Filename to store environment map in.
     --turbidity <t>    Atmospheric turbidity (range 1.7-10). Default: 3
     --resolution <r>   Resolution of generated environment map. Default: 2048
+)")}},
+    {"merge", {"merge [options] <filenames...>", std::string(R"(
+    --outfile <name>   Filename for the image computed from the merged film
+                       states.
+    --statefile <name> Filename to store the merged film state in, so that it
+                       can be merged with further results later.
 )")}},
     {"whitebalance", {"whitebalance [options] <filename>", std::string(R"(
     --illuminant <n>   Apply white balance for the given standard illuminant
@@ -525,20 +562,21 @@ int cat(int argc, char *argv[]) {
     return 0;
 }
 
-static bool checkImageCompatibility(const std::string &fn1, const Image &im1,
-                                    const std::string &fn2, const Image &im2) {
-    if (im1.Resolution() != im2.Resolution()) {
+static bool checkImageCompatibility(const std::string &fn1, Point2i res1,
+                                    const std::vector<std::string> &channels1,
+                                    const std::string &fn2, Point2i res2,
+                                    const std::vector<std::string> &channels2) {
+    if (res1 != res2) {
         fprintf(stderr, "%s: image resolution (%d, %d) doesn't match \"%s\" (%d, %d).",
-                fn1.c_str(), im1.Resolution().x, im1.Resolution().y, fn2.c_str(),
-                im2.Resolution().x, im2.Resolution().y);
+                fn1.c_str(), res1.x, res1.y, fn2.c_str(), res2.x, res2.y);
         return false;
     }
-    if (im1.NChannels() != im2.NChannels()) {
+    if (channels1.size() != channels2.size()) {
         fprintf(stderr, "%s: image channel count %d doesn't match \"%s\", %d.",
-                fn1.c_str(), im1.NChannels(), fn2.c_str(), im2.NChannels());
+                fn1.c_str(), int(channels1.size()), fn2.c_str(), int(channels2.size()));
         return false;
     }
-    if (im1.ChannelNames() != im2.ChannelNames()) {
+    if (channels1 != channels2) {
         auto print = [](const std::vector<std::string> &n) {
             std::string s = n[0];
             for (size_t i = 1; i < n.size(); ++i) {
@@ -550,8 +588,8 @@ static bool checkImageCompatibility(const std::string &fn1, const Image &im1,
         fprintf(stderr,
                 "%s: warning: image channel names \"%s\" don't match \"%s\" "
                 "with \"%s\".",
-                fn1.c_str(), print(im1.ChannelNames()).c_str(), fn2.c_str(),
-                print(im2.ChannelNames()).c_str());
+                fn1.c_str(), print(channels1).c_str(), fn2.c_str(),
+                print(channels2).c_str());
     }
 
 #if 0
@@ -562,8 +600,184 @@ static bool checkImageCompatibility(const std::string &fn1, const Image &im1,
     return true;
 }
 
+static bool checkImageCompatibility(const std::string &fn1, const Image &im1,
+                                    const std::string &fn2, const Image &im2) {
+    return checkImageCompatibility(fn1, im1.Resolution(), im1.ChannelNames(), fn2,
+                                   im2.Resolution(), im2.ChannelNames());
+}
+
+// Streaming Helper Functions
+// With --maxmemory, the diff, average, convert, and error commands read
+// their images a band of scanlines at a time, so that the memory they use
+// is bounded by the given amount rather than by the size of the images.
+// average and error process a band's images in parallel; convert and diff
+// process each band on a single thread, as they do whole images.
+
+// Returns the number of scanlines in a band such that _nBuffers_ buffers
+// of scanlines with _scanlineBytes_ bytes each fit in _maxMemoryMB_.
+static int bandHeight(int maxMemoryMB, size_t scanlineBytes, int nBuffers) {
+    int64_t bytes = int64_t(maxMemoryMB) * 1024 * 1024;
+    return std::max<int64_t>(1, bytes / (int64_t(scanlineBytes) * nBuffers));
+}
+
+// Returns the part of the image given by a --crop window, or all of it if
+// none was specified.
+static Bounds2i cropBounds(std::array<int, 4> cropWindow, Point2i resolution) {
+    // If last 2 are negative, they're taken as deltas
+    if (cropWindow[1] < 0)
+        cropWindow[1] = cropWindow[0] - cropWindow[1];
+    if (cropWindow[3] < 0)
+        cropWindow[3] = cropWindow[2] - cropWindow[3];
+    Bounds2i bounds({0, 0}, resolution);
+    if (cropWindow[0] >= 0 && cropWindow[2] >= 0)
+        bounds = Intersect(bounds, Bounds2i({cropWindow[0], cropWindow[2]},
+                                            {cropWindow[1], cropWindow[3]}));
+    return bounds;
+}
+
+// Returns the scanlines $[y_0,y_1)$ of the image, cropped to the x extent
+// of _bounds_.
+static Image readScanlines(ImageScanlineReader *reader, const Bounds2i &bounds, int y0,
+                           int y1) {
+    Image band = reader->ReadScanlines(y0, y1);
+    if (bounds.pMin.x > 0 || bounds.pMax.x < reader->Resolution().x)
+        band = band.Crop(Bounds2i({bounds.pMin.x, 0}, {bounds.pMax.x, y1 - y0}));
+    return band;
+}
+
+// Opens the file for --maxmemory processing. Formats that can't be read
+// incrementally would be decoded in full when they're opened, which would
+// defeat the memory bound, so they're rejected.
+static std::unique_ptr<ImageScanlineReader> openScanlineReader(
+    const std::string &filename) {
+    if (!ImageScanlineReader::ReadsIncrementally(filename)) {
+        fprintf(stderr,
+                "%s: --maxmemory can only be used with OpenEXR, PFM, and .praw "
+                "images.\n",
+                filename.c_str());
+        return nullptr;
+    }
+    return ImageScanlineReader::Open(filename);
+}
+
+// Checks that the file can be written for --maxmemory processing. As with
+// inputs, formats that are buffered in memory until the whole image has
+// been written would defeat the memory bound, so they're rejected.
+static bool checkScanlineWriter(const std::string &filename) {
+    if (ImageScanlineWriter::WritesIncrementally(filename))
+        return true;
+    fprintf(stderr,
+            "%s: --maxmemory can only be used with OpenEXR, PFM, and .praw "
+            "images.\n",
+            filename.c_str());
+    return false;
+}
+
+// Creates the float-valued output file for --maxmemory processing.
+static std::unique_ptr<ImageScanlineWriter> openScanlineWriter(
+    const std::string &filename, Point2i resolution,
+    const std::vector<std::string> &channelNames) {
+    if (!checkScanlineWriter(filename))
+        return nullptr;
+    return ImageScanlineWriter::Create(filename, PixelFormat::Float, resolution,
+                                       channelNames);
+}
+
+// Average Helper Functions
+// Adds the pixel values of _im_ divided by _n_ to _avg_, treating infinite
+// values as zero. _y0_ is the image's first scanline, for reporting NaNs.
+static void addToAverage(const Image &im, int n, const std::string &filename, int y0,
+                         Image *avg) {
+    for (int y = 0; y < avg->Resolution().y; ++y)
+        for (int x = 0; x < avg->Resolution().x; ++x)
+            for (int c = 0; c < avg->NChannels(); ++c) {
+                Float v = im.GetChannel({x, y}, c) / n;
+                if (std::isnan(v))
+                    LOG_FATAL("NAN Pixel at %s in %s", Point2f(x, y0 + y), filename);
+                if (std::isinf(v))
+                    v = 0;
+                avg->SetChannel({x, y}, c, avg->GetChannel({x, y}, c) + v);
+            }
+}
+
+// Returns the sum of the per-thread partial averages. Threads that didn't
+// process any images leave an empty image, which is skipped.
+static Image sumAverages(const std::vector<Image> &avgImages) {
+    Image avg;
+    for (const Image &im : avgImages) {
+        if (im.Resolution() == Point2i(0, 0))
+            continue;
+        if (avg.Resolution() == Point2i(0, 0))
+            avg = Image(PixelFormat::Float, im.Resolution(), im.ChannelNames());
+        for (int y = 0; y < avg.Resolution().y; ++y)
+            for (int x = 0; x < avg.Resolution().x; ++x)
+                for (int c = 0; c < avg.NChannels(); ++c) {
+                    Float v = im.GetChannel({x, y}, c);
+                    if (!std::isinf(v))
+                        avg.SetChannel({x, y}, c, avg.GetChannel({x, y}, c) + v);
+                }
+    }
+    return avg;
+}
+
+// Averages the images a band of scanlines at a time. The files are opened
+// again for each band so that no more than one reader per thread is open
+// at once, however many images there are.
+static int averageStreaming(const std::vector<std::string> &filenames,
+                            const std::string &avgFile, int maxMemoryMB) {
+    Point2i res;
+    std::vector<std::string> channelNames;
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        std::unique_ptr<ImageScanlineReader> reader = openScanlineReader(filenames[i]);
+        if (!reader)
+            return 1;
+        if (i == 0) {
+            res = reader->Resolution();
+            channelNames = reader->ChannelNames();
+        } else if (!checkImageCompatibility(filenames[i], reader->Resolution(),
+                                            reader->ChannelNames(), filenames[0], res,
+                                            channelNames))
+            return 1;
+    }
+
+    // Each thread holds a band of its image and of its partial average;
+    // there is one more band for the final average.
+    int bandRows = std::min(
+        res.y, bandHeight(maxMemoryMB, sizeof(float) * channelNames.size() * res.x,
+                          2 * MaxThreadIndex() + 1));
+    std::unique_ptr<ImageScanlineWriter> writer =
+        openScanlineWriter(avgFile, res, channelNames);
+    if (!writer)
+        return 1;
+
+    for (int y0 = 0; y0 < res.y; y0 += bandRows) {
+        int y1 = std::min(y0 + bandRows, res.y);
+        std::vector<Image> avgBands(MaxThreadIndex());
+        std::atomic<bool> failed{false};
+        ParallelFor(0, filenames.size(), [&](size_t i) {
+            std::unique_ptr<ImageScanlineReader> reader =
+                ImageScanlineReader::Open(filenames[i]);
+            if (!reader) {
+                failed = true;
+                return;
+            }
+            Image im = reader->ReadScanlines(y0, y1);
+            Image &avg = avgBands[ThreadIndex];
+            if (avg.Resolution() == Point2i(0, 0))
+                avg = Image(PixelFormat::Float, im.Resolution(), channelNames);
+            addToAverage(im, filenames.size(), filenames[i], y0, &avg);
+        });
+
+        if (failed || !writer->WriteScanlines(sumAverages(avgBands)))
+            return 1;
+    }
+
+    return writer->Close() ? 0 : 1;
+}
+
 int average(int argc, char *argv[]) {
     std::string avgFile, filenameBase;
+    int maxMemoryMB = 0;
 
     while (*argv != nullptr) {
         auto onError = [](const std::string &err) {
@@ -571,7 +785,8 @@ int average(int argc, char *argv[]) {
             exit(1);
         };
 
-        if (ParseArg(&argv, "outfile", &avgFile, onError)) {
+        if (ParseArg(&argv, "maxmemory", &maxMemoryMB, onError) ||
+            ParseArg(&argv, "outfile", &avgFile, onError)) {
             // success
         } else if (filenameBase.empty() && argv[0][0] != '-') {
             filenameBase = *argv;
@@ -584,6 +799,8 @@ int average(int argc, char *argv[]) {
         usage("average", "must provide base filename.");
     if (avgFile.empty())
         usage("average", "must provide --outfile.");
+    if (maxMemoryMB < 0)
+        usage("average", "--maxmemory value must not be negative");
 
     std::vector<std::string> filenames = MatchingFilenames(filenameBase);
     if (filenames.empty()) {
@@ -591,6 +808,9 @@ int average(int argc, char *argv[]) {
         return 1;
     }
 
+    if (maxMemoryMB > 0)
+        return averageStreaming(filenames, avgFile, maxMemoryMB);
+
     // Compute average image
     std::vector<Image> avgImages(MaxThreadIndex());
     std::atomic<bool> failed{false};
@@ -606,43 +826,180 @@ int average(int argc, char *argv[]) {
             failed = true;
             return;
         }
-
-        for (int y = 0; y < avg.Resolution().y; ++y)
-            for (int x = 0; x < avg.Resolution().x; ++x)
-                for (int c = 0; c < avg.NChannels(); ++c) {
-                    Float v = im.GetChannel({x, y}, c) / filenames.size();
-                    if (std::isnan(v))
-                        LOG_FATAL("NAN Pixel at %s in %s", Point2f(x, y), filenames[i]);
-                    if (std::isinf(v))
-                        v = 0;
-                    avg.SetChannel({x, y}, c, avg.GetChannel({x, y}, c) + v);
-                }
+        addToAverage(im, filenames.size(), filenames[i], 0, &avg);
     });
 
     if (failed)
         return 1;
 
     // Average per-thread average images
-    Image avgImage;
-    for (const Image &im : avgImages) {
-        if (im.Resolution() == Point2i(0, 0))
-            continue;
-        else if (avgImage.Resolution() == Point2i(0, 0)) {
-            // First valid one
-            avgImage = im;
-        } else {
-            for (int y = 0; y < avgImage.Resolution().y; ++y)
-                for (int x = 0; x < avgImage.Resolution().x; ++x)
-                    for (int c = 0; c < avgImage.NChannels(); ++c) {
-                        Float v = im.GetChannel({x, y}, c);
-                        if (!std::isinf(v))
-                            avgImage.SetChannel({x, y}, c,
-                                                avgImage.GetChannel({x, y}, c) + v);
-                    }
+    Image avgImage = sumAverages(avgImages);
+
+    CHECK(avgImage.Write(avgFile));
+
+    return 0;
+}
+
+// Error Helper Functions
+using MultiChannelVarianceEstimator = std::vector<VarianceEstimator<double>>;
+
+// Returns the per-channel error of the image with respect to the reference.
+static ImageChannelValues imageError(const std::string &metric, const Image &im,
+                                     const Image &ref) {
+    if (metric == "L1")
+        return im.L1Error(im.AllChannelsDesc(), ref, nullptr);
+    else if (metric == "MSE")
+        return im.MSE(im.AllChannelsDesc(), ref, nullptr);
+    else
+        return im.MRSE(im.AllChannelsDesc(), ref, nullptr);
+}
+
+// Returns an estimator of each pixel's per-channel variance for each thread.
+static std::vector<Array2D<MultiChannelVarianceEstimator>> allocPixelVariances(
+    Point2i res, int nc) {
+    std::vector<Array2D<MultiChannelVarianceEstimator>> pixelVariances(
+        MaxThreadIndex());
+    for (auto &amcve : pixelVariances) {
+        amcve = Array2D<MultiChannelVarianceEstimator>(res.x, res.y);
+        for (auto &mcve : amcve)
+            mcve.resize(nc);
+    }
+    return pixelVariances;
+}
+
+// Adds the image's pixel values to the variance estimators; with MRSE, the
+// values are relative to the reference's.
+static void addPixelVariances(const std::string &metric, const Image &im,
+                              const Image &ref,
+                              Array2D<MultiChannelVarianceEstimator> *pixelVariances) {
+    for (int y = 0; y < im.Resolution().y; ++y)
+        for (int x = 0; x < im.Resolution().x; ++x) {
+            MultiChannelVarianceEstimator &pixelVariance = (*pixelVariances)(x, y);
+            for (int c = 0; c < im.NChannels(); ++c)
+                if (metric == "MRSE")
+                    pixelVariance[c].Add(im.GetChannel({x, y}, c) /
+                                         (0.01f + ref.GetChannel({x, y}, c)));
+                else
+                    pixelVariance[c].Add(im.GetChannel({x, y}, c));
+        }
+}
+
+// Returns the error image, which stores each pixel's variance averaged over
+// its channels, merging the per-thread estimates.
+static Image errorImage(
+    const std::string &metric, Point2i res, int nc,
+    const std::vector<Array2D<MultiChannelVarianceEstimator>> &pixelVariances) {
+    Image image(PixelFormat::Float, res, {metric});
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x) {
+            Float varSum = 0;
+            for (int c = 0; c < nc; ++c) {
+                VarianceEstimator<double> pixelVariance;
+                for (const auto &pixVar : pixelVariances)
+                    pixelVariance.Merge(pixVar(x, y)[c]);
+                varSum += pixelVariance.Variance();
+            }
+            image.SetChannel({x, y}, 0, varSum / nc);
+        }
+    return image;
+}
+
+// Computes the error of the images with respect to the reference a band of
+// scanlines at a time. The per-pixel variance estimates that give the
+// error image are only needed for the current band.
+static int errorStreaming(const std::vector<std::string> &filenames,
+                          const std::string &referenceFile, const std::string &errorFile,
+                          const std::string &metric, std::array<int, 4> cropWindow,
+                          int maxMemoryMB) {
+    std::unique_ptr<ImageScanlineReader> refReader = openScanlineReader(referenceFile);
+    if (!refReader)
+        return 1;
+    Bounds2i bounds = cropBounds(cropWindow, refReader->Resolution());
+    Point2i res(bounds.pMax.x - bounds.pMin.x, bounds.pMax.y - bounds.pMin.y);
+    int nc = refReader->NChannels();
+
+    // Check each image against the reference. As in averageStreaming(), the
+    // images are opened again for each band, so that no more than one reader
+    // per thread is open at once.
+    int spp0 = 0;
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        std::unique_ptr<ImageScanlineReader> reader = openScanlineReader(filenames[i]);
+        if (!reader ||
+            !checkImageCompatibility(filenames[i], reader->Resolution(),
+                                     reader->ChannelNames(), referenceFile,
+                                     refReader->Resolution(), refReader->ChannelNames()))
+            return 1;
+        CHECK(reader->Metadata().samplesPerPixel.has_value());
+        int spp = *reader->Metadata().samplesPerPixel;
+        if (i == 0)
+            spp0 = spp;
+        else if (spp != spp0) {
+            printf("%s: spp %d mismatch. %s has %d.\n", filenames[i].c_str(), spp,
+                   filenames[0].c_str(), spp0);
+            return 1;
         }
     }
 
-    CHECK(avgImage.Write(avgFile));
+    std::unique_ptr<ImageScanlineWriter> writer;
+    if (!errorFile.empty()) {
+        writer = openScanlineWriter(errorFile, res, std::vector<std::string>{metric});
+        if (!writer)
+            return 1;
+    }
+
+    // Each thread holds a band of its image and of its variance estimates;
+    // there is one more band for the reference and one for the error image.
+    size_t pixelBytes = nc * sizeof(float);
+    if (writer)
+        pixelBytes += nc * sizeof(VarianceEstimator<double>);
+    int bandRows = std::min(
+        res.y, bandHeight(maxMemoryMB, pixelBytes * res.x, MaxThreadIndex() + 2));
+
+    // Sums of each file's per-channel errors over all of the pixels
+    std::vector<std::vector<double>> errorSums(filenames.size(),
+                                               std::vector<double>(nc, 0.));
+    for (int y0 = bounds.pMin.y; y0 < bounds.pMax.y; y0 += bandRows) {
+        int y1 = std::min(y0 + bandRows, bounds.pMax.y);
+        Image refBand = readScanlines(refReader.get(), bounds, y0, y1);
+        Point2i bandRes = refBand.Resolution();
+
+        std::vector<Array2D<MultiChannelVarianceEstimator>> pixelVariances;
+        if (writer)
+            pixelVariances = allocPixelVariances(bandRes, nc);
+
+        std::atomic<bool> failed{false};
+        ParallelFor(0, filenames.size(), [&](size_t i) {
+            std::unique_ptr<ImageScanlineReader> reader =
+                ImageScanlineReader::Open(filenames[i]);
+            if (!reader) {
+                failed = true;
+                return;
+            }
+            Image im = readScanlines(reader.get(), bounds, y0, y1);
+            ImageChannelValues error = imageError(metric, im, refBand);
+            for (int c = 0; c < nc; ++c)
+                errorSums[i][c] += double(error[c]) * bandRes.x * bandRes.y;
+
+            if (!pixelVariances.empty())
+                addPixelVariances(metric, im, refBand, &pixelVariances[ThreadIndex]);
+        });
+
+        if (failed || (writer && !writer->WriteScanlines(
+                                     errorImage(metric, bandRes, nc, pixelVariances))))
+            return 1;
+    }
+
+    double sumError = 0;
+    for (const std::vector<double> &sums : errorSums)
+        sumError += std::accumulate(sums.begin(), sums.end(), 0.) /
+                    (double(nc) * res.x * res.y);
+
+    // MSE is the average over all of the pixels
+    double error = sumError / (filenames.size() - 1);
+    printf("%s estimate = %.9g\n", metric.c_str(), error);
+
+    if (writer && !writer->Close())
+        return 1;
 
     return 0;
 }
@@ -651,6 +1008,7 @@ int error(int argc, char *argv[]) {
     std::string referenceFile, errorFile, metric = "MSE";
     std::string filenameBase;
     std::array<int, 4> cropWindow = {-1, 0, -1, 0};
+    int maxMemoryMB = 0;
 
     while (*argv != nullptr) {
         auto onError = [](const std::string &err) {
@@ -660,6 +1018,7 @@ int error(int argc, char *argv[]) {
 
         if (ParseArg(&argv, "reference", &referenceFile, onError) ||
             ParseArg(&argv, "errorfile", &errorFile, onError) ||
+            ParseArg(&argv, "maxmemory", &maxMemoryMB, onError) ||
             ParseArg(&argv, "metric", &metric, onError) ||
             ParseArg(&argv, "crop", pstd::MakeSpan(cropWindow), onError)) {
             // success
@@ -684,6 +1043,12 @@ int error(int argc, char *argv[]) {
 
     if (referenceFile.empty())
         usage("error", "must provide --reference file.");
+    if (maxMemoryMB < 0)
+        usage("error", "--maxmemory value must not be negative");
+    if (maxMemoryMB > 0)
+        return errorStreaming(filenames, referenceFile, errorFile, metric, cropWindow,
+                              maxMemoryMB);
+
     ImageAndMetadata ref = Image::Read(referenceFile);
     Image &referenceImage = ref.image;
 
@@ -701,18 +1066,13 @@ int error(int argc, char *argv[]) {
     crop(referenceImage);
 
     // Compute error and error image
-    using MultiChannelVarianceEstimator = std::vector<VarianceEstimator<double>>;
-    std::vector<Array2D<MultiChannelVarianceEstimator>> pixelVariances(MaxThreadIndex());
-    for (auto &amcve : pixelVariances) {
-        amcve = Array2D<MultiChannelVarianceEstimator>(referenceImage.Resolution().x,
-                                                       referenceImage.Resolution().y);
-        for (auto &mcve : amcve)
-            mcve.resize(referenceImage.NChannels());
-    }
+    Point2i res = referenceImage.Resolution();
+    int nc = referenceImage.NChannels();
+    std::vector<Array2D<MultiChannelVarianceEstimator>> pixelVariances =
+        allocPixelVariances(res, nc);
 
     std::vector<double> sumErrors(MaxThreadIndex(), 0.);
     std::vector<int> spp(filenames.size());
-    std::atomic<bool> failed{false};
     ParallelFor(0, filenames.size(), [&](size_t i) {
         ImageAndMetadata imRead = Image::Read(filenames[i]);
         Image &im = imRead.image;
@@ -721,28 +1081,8 @@ int error(int argc, char *argv[]) {
         CHECK(imRead.metadata.samplesPerPixel.has_value());
         spp[i] = *imRead.metadata.samplesPerPixel;
 
-        Image diffImage;
-        ImageChannelValues error(referenceImage.NChannels());
-        if (metric == "L1")
-            error = im.L1Error(im.AllChannelsDesc(), referenceImage, &diffImage);
-        else if (metric == "MSE")
-            error = im.MSE(im.AllChannelsDesc(), referenceImage, &diffImage);
-        else
-            error = im.MRSE(im.AllChannelsDesc(), referenceImage, &diffImage);
-        sumErrors[ThreadIndex] += error.Average();
-
-        for (int y = 0; y < im.Resolution().y; ++y)
-            for (int x = 0; x < im.Resolution().x; ++x) {
-                MultiChannelVarianceEstimator &pixelVariance =
-                    pixelVariances[ThreadIndex](x, y);
-                for (int c = 0; c < im.NChannels(); ++c)
-                    if (metric == "MRSE")
-                        pixelVariance[c].Add(
-                            im.GetChannel({x, y}, c) /
-                            (0.01f + referenceImage.GetChannel({x, y}, c)));
-                    else
-                        pixelVariance[c].Add(im.GetChannel({x, y}, c));
-            }
+        sumErrors[ThreadIndex] += imageError(metric, im, referenceImage).Average();
+        addPixelVariances(metric, im, referenceImage, &pixelVariances[ThreadIndex]);
     });
 
     for (int i = 1; i < filenames.size(); ++i) {
@@ -753,47 +1093,187 @@ int error(int argc, char *argv[]) {
         }
     }
 
-    if (failed)
-        return 1;
-
     double sumError = std::accumulate(sumErrors.begin(), sumErrors.end(), 0.);
 
-    Array2D<MultiChannelVarianceEstimator> pixelVariance(referenceImage.Resolution().x,
-                                                         referenceImage.Resolution().y);
-    for (auto &mcve : pixelVariance)
-        mcve.resize(referenceImage.NChannels());
-
-    for (const auto &pixVar : pixelVariances)
-        for (int y = 0; y < referenceImage.Resolution().y; ++y)
-            for (int x = 0; x < referenceImage.Resolution().x; ++x)
-                for (int c = 0; c < referenceImage.NChannels(); ++c)
-                    pixelVariance(x, y)[c].Merge(pixVar(x, y)[c]);
-
-    Image errorImage(PixelFormat::Float,
-                     {referenceImage.Resolution().x, referenceImage.Resolution().y},
-                     {metric});
-    for (int y = 0; y < referenceImage.Resolution().y; ++y)
-        for (int x = 0; x < referenceImage.Resolution().x; ++x) {
-            Float varSum = 0;
-            for (int c = 0; c < referenceImage.NChannels(); ++c)
-                varSum += pixelVariance(x, y)[c].Variance();
-            errorImage.SetChannel({x, y}, 0, varSum / referenceImage.NChannels());
-        }
-
     // MSE is the average over all of the pixels
     double error = sumError / (filenames.size() - 1);
     printf("%s estimate = %.9g\n", metric.c_str(), error);
 
-    if (!errorFile.empty() && !errorImage.Write(errorFile)) {
+    if (!errorFile.empty() &&
+        !errorImage(metric, res, nc, pixelVariances).Write(errorFile))
         return 1;
-    }
 
     return 0;
 }
 
+// Checks that an image can be compared with the reference, printing an
+// error if it can't and warnings for mismatches that don't prevent it.
+static bool checkDiffCompatibility(const std::string &imageFile, Point2i res,
+                                   const std::vector<std::string> &channelNames,
+                                   const ImageMetadata &metadata, Point2i refRes,
+                                   const std::vector<std::string> &refChannelNames,
+                                   const ImageMetadata &refMetadata) {
+    if (res != refRes) {
+        fprintf(stderr,
+                "%s: image resolution (%d, %d) doesn't match reference (%d, %d)\n",
+                imageFile.c_str(), res.x, res.y, refRes.x, refRes.y);
+        return false;
+    }
+    if (channelNames.size() != refChannelNames.size()) {
+        fprintf(stderr, "%s: image channel count %d doesn't match reference %d.\n",
+                imageFile.c_str(), int(channelNames.size()),
+                int(refChannelNames.size()));
+        return false;
+    }
+
+    if (channelNames != refChannelNames) {
+        auto print = [](const std::vector<std::string> &n) {
+            std::string s = n[0];
+            for (size_t i = 1; i < n.size(); ++i) {
+                s += ", ";
+                s += n[i];
+            }
+            return s;
+        };
+        fprintf(stderr,
+                "Warning: image channel names don't match: %s has \"%s\" "
+                "but reference has \"%s\".\n",
+                imageFile.c_str(), print(channelNames).c_str(),
+                print(refChannelNames).c_str());
+    }
+
+    if (*metadata.GetColorSpace() != *refMetadata.GetColorSpace())
+        fprintf(stderr, "Warning: computing difference of images with different "
+                        "color spaces!");
+    return true;
+}
+
+// Compares the image with the reference a band of scanlines at a time,
+// computing the same errors and averages as diff() does for whole images.
+static int diffStreaming(const std::string &imageFile, const std::string &referenceFile,
+                         const std::string &outFile, const std::string &metric,
+                         std::array<int, 4> cropWindow, int maxMemoryMB) {
+    std::unique_ptr<ImageScanlineReader> refReader = openScanlineReader(referenceFile);
+    std::unique_ptr<ImageScanlineReader> reader = openScanlineReader(imageFile);
+    if (!refReader || !reader)
+        return 1;
+
+    // Crop before comparing resolutions.
+    Bounds2i refBounds = cropBounds(cropWindow, refReader->Resolution());
+    Bounds2i bounds = cropBounds(cropWindow, reader->Resolution());
+    Point2i res(bounds.pMax.x - bounds.pMin.x, bounds.pMax.y - bounds.pMin.y);
+    if (!checkDiffCompatibility(
+            imageFile, res, reader->ChannelNames(), reader->Metadata(),
+            Point2i(refBounds.pMax.x - refBounds.pMin.x,
+                    refBounds.pMax.y - refBounds.pMin.y),
+            refReader->ChannelNames(), refReader->Metadata()))
+        return 1;
+    int nc = reader->NChannels();
+
+    std::unique_ptr<ImageScanlineWriter> writer;
+    if (!outFile.empty()) {
+        writer = openScanlineWriter(outFile, res, reader->ChannelNames());
+        if (!writer)
+            return 1;
+    }
+
+    // The image, the reference, and the difference image each hold a band.
+    int bandRows =
+        std::min(res.y, bandHeight(maxMemoryMB, sizeof(float) * nc * res.x, 3));
+    std::vector<double> sumError(nc, 0.), imageSum(nc, 0.), refSum(nc, 0.);
+    int nClamped = 0, nRefClamped = 0;
+    for (int y0 = 0; y0 < res.y; y0 += bandRows) {
+        int y1 = std::min(y0 + bandRows, res.y);
+        Image band = readScanlines(reader.get(), bounds, bounds.pMin.y + y0,
+                                   bounds.pMin.y + y1);
+        Image refBand = readScanlines(refReader.get(), refBounds, refBounds.pMin.y + y0,
+                                      refBounds.pMin.y + y1);
+        ImageChannelDesc refDesc = refBand.GetChannelDesc(band.ChannelNames());
+        if (!refDesc) {
+            fprintf(stderr, "%s: channels not found in reference image.\n",
+                    imageFile.c_str());
+            return 1;
+        }
+
+        Image diffBand;
+        if (writer)
+            diffBand = Image(PixelFormat::Float, band.Resolution(), band.ChannelNames());
+        for (int y = 0; y < band.Resolution().y; ++y)
+            for (int x = 0; x < band.Resolution().x; ++x) {
+                ImageChannelValues v = band.GetChannels({x, y});
+                ImageChannelValues vref = refBand.GetChannels({x, y}, refDesc);
+                for (int c = 0; c < nc; ++c) {
+                    // Clamp Infs
+                    if (std::isinf(v[c])) {
+                        ++nClamped;
+                        v[c] = 0;
+                    }
+                    if (std::isinf(vref[c])) {
+                        ++nRefClamped;
+                        vref[c] = 0;
+                    }
+                    imageSum[c] += v[c];
+                    refSum[c] += vref[c];
+
+                    Float error;
+                    if (metric == "L1")
+                        error = v[c] - vref[c];
+                    else if (metric == "MSE")
+                        error = Sqr(v[c] - vref[c]);
+                    else
+                        error = Sqr(v[c] - vref[c]) / Sqr(vref[c] + 0.01);
+                    if (std::isinf(error))
+                        continue;
+                    sumError[c] += error;
+                    if (writer)
+                        diffBand.SetChannel({x, y}, c, error);
+                }
+            }
+
+        if (writer && !writer->WriteScanlines(diffBand))
+            return 1;
+    }
+    if (nClamped > 0)
+        fprintf(stderr, "%s: clamped %d infinite pixel values.\n", imageFile.c_str(),
+                nClamped);
+    if (nRefClamped > 0)
+        fprintf(stderr, "%s: clamped %d infinite pixel values.\n", referenceFile.c_str(),
+                nRefClamped);
+    if (writer && !writer->Close())
+        return 1;
+
+    int64_t nPixels = int64_t(res.x) * res.y;
+    ImageChannelValues error(nc);
+    Float refAverage = 0, imageAverage = 0;
+    for (int c = 0; c < nc; ++c) {
+        error[c] = sumError[c] / nPixels;
+        refAverage += refSum[c] / nPixels / nc;
+        imageAverage += imageSum[c] / nPixels / nc;
+    }
+
+    if (error.MaxValue() == 0) {
+        // Same same.
+        if (writer)
+            remove(outFile.c_str());
+        return 0;
+    }
+
+    float delta = 100.f * (imageAverage - refAverage) / refAverage;
+    std::string deltaString = StringPrintf("%f%% delta", delta);
+    if (std::abs(delta) > 0.1)
+        deltaString = Red(deltaString);
+    else if (std::abs(delta) > 0.001)
+        deltaString = Yellow(deltaString);
+    Printf("Images differ:\n\t%s %s\n\tavg = %f / %f (%s), %s = %f\n", imageFile,
+           referenceFile, imageAverage, refAverage, deltaString, metric, error.Average());
+
+    return 1;
+}
+
 int diff(int argc, char *argv[]) {
     std::string outFile, imageFile, referenceFile, metric = "MSE";
     std::array<int, 4> cropWindow = {-1, 0, -1, 0};
+    int maxMemoryMB = 0;
 
     while (*argv != nullptr) {
         auto onError = [](const std::string &err) {
@@ -803,6 +1283,7 @@ int diff(int argc, char *argv[]) {
 
         if (ParseArg(&argv, "outfile", &outFile, onError) ||
             ParseArg(&argv, "reference", &referenceFile, onError) ||
+            ParseArg(&argv, "maxmemory", &maxMemoryMB, onError) ||
             ParseArg(&argv, "metric", &metric, onError) ||
             ParseArg(&argv, "crop", pstd::MakeSpan(cropWindow), onError)) {
             // success
@@ -825,6 +1306,12 @@ int diff(int argc, char *argv[]) {
     if (metric != "L1" && metric != "MSE" && metric != "MRSE")
         usage("diff", "%s: --metric must be \"L1\", \"MSE\" or \"MRSE\".",
               metric.c_str());
+    if (maxMemoryMB < 0)
+        usage("diff", "--maxmemory value must not be negative");
+
+    if (maxMemoryMB > 0)
+        return diffStreaming(imageFile, referenceFile, outFile, metric, cropWindow,
+                             maxMemoryMB);
 
     ImageAndMetadata refRead = Image::Read(referenceFile);
     Image &refImage = refRead.image;
@@ -847,38 +1334,10 @@ int diff(int argc, char *argv[]) {
         image = image.Crop(
             Bounds2i({cropWindow[0], cropWindow[2]}, {cropWindow[1], cropWindow[3]}));
 
-    if (image.Resolution() != refImage.Resolution()) {
-        fprintf(stderr,
-                "%s: image resolution (%d, %d) doesn't match reference (%d, %d)\n",
-                imageFile.c_str(), image.Resolution().x, image.Resolution().y,
-                refImage.Resolution().x, refImage.Resolution().y);
+    if (!checkDiffCompatibility(imageFile, image.Resolution(), image.ChannelNames(),
+                                im.metadata, refImage.Resolution(),
+                                refImage.ChannelNames(), refMetadata))
         return 1;
-    }
-    if (image.NChannels() != refImage.NChannels()) {
-        fprintf(stderr, "%s: image channel count %d doesn't match reference %d.\n",
-                imageFile.c_str(), image.NChannels(), refImage.NChannels());
-        return 1;
-    }
-
-    if (image.ChannelNames() != refImage.ChannelNames()) {
-        auto print = [](const std::vector<std::string> &n) {
-            std::string s = n[0];
-            for (size_t i = 1; i < n.size(); ++i) {
-                s += ", ";
-                s += n[i];
-            }
-            return s;
-        };
-        fprintf(stderr,
-                "Warning: image channel names don't match: %s has \"%s\" "
-                "but reference has \"%s\".\n",
-                imageFile.c_str(), print(image.ChannelNames()).c_str(),
-                print(refImage.ChannelNames()).c_str());
-    }
-
-    if (*im.metadata.GetColorSpace() != *refMetadata.GetColorSpace())
-        fprintf(stderr, "Warning: computing difference of images with different "
-                        "color spaces!");
 
     // Clamp Infs
     int nClamped = 0, nRefClamped = 0;
@@ -1352,6 +1811,7 @@ int convert(int argc, char *argv[]) {
     bool acesFilmic = false;
     float scale = 1.f, gamma = 1.f;
     int repeat = 1;
+    int maxMemoryMB = 0;
     bool flipy = false;
     bool tonemap = false;
     Float maxY = 1.;
@@ -1378,6 +1838,7 @@ int convert(int argc, char *argv[]) {
             ParseArg(&argv, "flipy", &flipy, onError) ||
             ParseArg(&argv, "gamma", &gamma, onError) ||
             ParseArg(&argv, "maxluminance", &maxY, onError) ||
+            ParseArg(&argv, "maxmemory", &maxMemoryMB, onError) ||
             ParseArg(&argv, "outfile", &outFile, onError) ||
             ParseArg(&argv, "preservecolors", &preserveColors, onError) ||
             ParseArg(&argv, "repeatpix", &repeat, onError) ||
@@ -1397,26 +1858,36 @@ int convert(int argc, char *argv[]) {
         usage("convert", "--repeatpix value must be greater than zero");
     if (scale == 0)
         usage("convert", "--scale value must be non-zero");
+    if (maxMemoryMB < 0)
+        usage("convert", "--maxmemory value must not be negative");
+    if (maxMemoryMB > 0 && (despikeLimit < Infinity || flipy || repeat > 1))
+        usage("convert", "--despike, --flipy, and --repeatpix can't be used with "
+                         "--maxmemory");
     if (outFile.empty())
         usage("convert", "--outfile filename must be specified");
     if (inFile.empty())
         usage("convert", "input filename not specified");
 
-    ImageAndMetadata imRead = Image::Read(inFile);
-    Image image = std::move(imRead.image);
-    ImageMetadata metadata = std::move(imRead.metadata);
+    if (maxMemoryMB > 0 && !checkScanlineWriter(outFile))
+        return 1;
+    std::unique_ptr<ImageScanlineReader> reader =
+        maxMemoryMB > 0 ? openScanlineReader(inFile) : ImageScanlineReader::Open(inFile);
+    if (!reader)
+        return 1;
+    ImageMetadata metadata = reader->Metadata();
 
     if (channelNames.empty()) {
         // If the input image has AOVs and the target image is a regular
         // format, then just grab R,G,B...
         bool hasAOVs = false;
-        for (const std::string &name : image.ChannelNames())
+        for (const std::string &name : reader->ChannelNames())
             if (name != "R" && name != "G" && name != "B" && name != "A") {
                 hasAOVs = true;
                 break;
             }
 
-        if (hasAOVs && !HasExtension(outFile, "exr")) {
+        if (hasAOVs && !HasExtension(outFile, "exr") &&
+            !HasExtension(outFile, "praw")) {
             fprintf(stderr,
                     "%s: image has non-RGB channels but converting to an "
                     "image format that can't store them. Converting RGB only.\n",
@@ -1424,198 +1895,283 @@ int convert(int argc, char *argv[]) {
             channelNames = "R,G,B";
         }
     }
-
-    if (!channelNames.empty()) {
-        std::vector<std::string> splitChannelNames = SplitString(channelNames, ',');
-        ImageChannelDesc desc = image.GetChannelDesc(splitChannelNames);
-        if (!desc) {
-            fprintf(stderr, "%s: image doesn't have channels \"%s\".\n", inFile.c_str(),
-                    channelNames.c_str());
-            return 1;
-        }
-        image = image.SelectChannels(desc);
-    }
-
-    Point2i res = image.Resolution();
-    int nc = image.NChannels();
+    std::vector<std::string> splitChannelNames = SplitString(channelNames, ',');
 
     // Crop
-    // If last 2 are negative, they're taken as deltas
-    if (cropWindow[1] < 0)
-        cropWindow[1] = cropWindow[0] - cropWindow[1];
-    if (cropWindow[3] < 0)
-        cropWindow[3] = cropWindow[2] - cropWindow[3];
-    if (cropWindow[0] >= 0 && cropWindow[2] >= 0) {
-        image = image.Crop(
-            Bounds2i({cropWindow[0], cropWindow[2]}, {cropWindow[1], cropWindow[3]}));
-        res = image.Resolution();
+    Bounds2i bounds = cropBounds(cropWindow, reader->Resolution());
+    if (bounds.IsEmpty()) {
+        fprintf(stderr, "%s: crop window is empty.\n", inFile.c_str());
+        return 1;
     }
 
-    // Convert to a 32-bit format for maximum accuracy in the following
-    // processing.
-    if (!Is32Bit(image.Format()))
-        image = image.ConvertToFormat(PixelFormat::Float);
-
+    SquareMatrix<3> colorSpaceMatrix;
     if (!colorspace.empty()) {
         const RGBColorSpace *dest = RGBColorSpace::GetNamed(colorspace);
         if (!dest) {
             fprintf(stderr, "%s: color space unknown.\n", colorspace.c_str());
             return 1;
         }
-        ImageChannelDesc rgbDesc = image.GetChannelDesc({"R", "G", "B"});
-        if (!rgbDesc) {
-            fprintf(stderr, "%s: doesn't have R, G, B channels.\n", inFile.c_str());
-            return 1;
-        }
-
         const RGBColorSpace *srcColorSpace = (metadata.colorSpace && *metadata.colorSpace)
                                                  ? *metadata.colorSpace
                                                  : RGBColorSpace::sRGB;
-        SquareMatrix<3> m = ConvertRGBColorSpace(*srcColorSpace, *dest);
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x) {
-                ImageChannelValues channels = image.GetChannels({x, y}, rgbDesc);
-                RGB rgb = Mul<RGB>(m, channels);
-                image.SetChannels({x, y}, rgbDesc, {rgb.r, rgb.g, rgb.b});
-            }
+        colorSpaceMatrix = ConvertRGBColorSpace(*srcColorSpace, *dest);
         metadata.colorSpace = dest;
     }
+    // Only the color space carries over; the other metadata may no longer
+    // match the image after cropping or pixel repetition.
+    ImageMetadata outMetadata;
+    outMetadata.colorSpace = metadata.colorSpace;
+
+    // Convert the image all at once or, with --maxmemory, a band of
+    // scanlines at a time. The input and converted scanlines are both held
+    // in memory.
+    int bandRows = bounds.pMax.y - bounds.pMin.y;
+    if (maxMemoryMB > 0) {
+        size_t scanlineBytes =
+            sizeof(float) * reader->NChannels() * (bounds.pMax.x - bounds.pMin.x);
+        bandRows = std::min(bandRows, bandHeight(maxMemoryMB, scanlineBytes, 2));
+    }
+    std::unique_ptr<ImageScanlineWriter> writer;
+
+    for (int y0 = bounds.pMin.y; y0 < bounds.pMax.y; y0 += bandRows) {
+        int y1 = std::min(y0 + bandRows, bounds.pMax.y);
+        Image image = readScanlines(reader.get(), bounds, y0, y1);
+
+        if (!splitChannelNames.empty()) {
+            ImageChannelDesc desc = image.GetChannelDesc(splitChannelNames);
+            if (!desc) {
+                fprintf(stderr, "%s: image doesn't have channels \"%s\".\n",
+                        inFile.c_str(), channelNames.c_str());
+                return 1;
+            }
+            image = image.SelectChannels(desc);
+        }
 
-    if (bw) {
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x) {
-                Float sum = 0;
-                for (int c = 0; c < nc; ++c)
-                    sum += image.GetChannel({x, y}, c);
-                sum /= nc;
-                for (int c = 0; c < nc; ++c)
-                    image.SetChannel({x, y}, c, sum);
+        Point2i res = image.Resolution();
+        int nc = image.NChannels();
+
+        // Convert to a 32-bit format for maximum accuracy in the following
+        // processing.
+        if (!Is32Bit(image.Format()))
+            image = image.ConvertToFormat(PixelFormat::Float);
+
+        if (!colorspace.empty()) {
+            ImageChannelDesc rgbDesc = image.GetChannelDesc({"R", "G", "B"});
+            if (!rgbDesc) {
+                fprintf(stderr, "%s: doesn't have R, G, B channels.\n", inFile.c_str());
+                return 1;
             }
-    }
 
-    if (despikeLimit < Infinity) {
-        Image filteredImg = image;
-        int despikeCount = 0;
-        std::vector<ImageChannelValues> neighbors;
-        for (int i = 0; i < 9; ++i)
-            neighbors.push_back(ImageChannelValues(image.NChannels()));
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x) {
+                    ImageChannelValues channels = image.GetChannels({x, y}, rgbDesc);
+                    RGB rgb = Mul<RGB>(colorSpaceMatrix, channels);
+                    image.SetChannels({x, y}, rgbDesc, {rgb.r, rgb.g, rgb.b});
+                }
+        }
 
-        for (int y = 0; y < res.y; ++y) {
-            for (int x = 0; x < res.x; ++x) {
-                if (image.GetChannels({x, y}).Average() < despikeLimit)
-                    continue;
+        if (bw) {
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x) {
+                    Float sum = 0;
+                    for (int c = 0; c < nc; ++c)
+                        sum += image.GetChannel({x, y}, c);
+                    sum /= nc;
+                    for (int c = 0; c < nc; ++c)
+                        image.SetChannel({x, y}, c, sum);
+                }
+        }
+
+        if (despikeLimit < Infinity) {
+            Image filteredImg = image;
+            int despikeCount = 0;
+            std::vector<ImageChannelValues> neighbors;
+            for (int i = 0; i < 9; ++i)
+                neighbors.push_back(ImageChannelValues(image.NChannels()));
 
-                // Copy all of the valid neighbor pixels into neighbors[].
-                ++despikeCount;
-                int validNeighbors = 0;
-                for (int dy = -1; dy <= 1; ++dy) {
-                    if (y + dy < 0 || y + dy >= res.y)
+            for (int y = 0; y < res.y; ++y) {
+                for (int x = 0; x < res.x; ++x) {
+                    if (image.GetChannels({x, y}).Average() < despikeLimit)
                         continue;
-                    for (int dx = -1; dx <= 1; ++dx) {
-                        if (x + dx < 0 || x + dx > res.x)
+
+                    // Copy all of the valid neighbor pixels into neighbors[].
+                    ++despikeCount;
+                    int validNeighbors = 0;
+                    for (int dy = -1; dy <= 1; ++dy) {
+                        if (y + dy < 0 || y + dy >= res.y)
                             continue;
-                        neighbors[validNeighbors++] = image.GetChannels({x + dx, y + dy});
+                        for (int dx = -1; dx <= 1; ++dx) {
+                            if (x + dx < 0 || x + dx > res.x)
+                                continue;
+                            neighbors[validNeighbors++] =
+                                image.GetChannels({x + dx, y + dy});
+                        }
                     }
-                }
 
-                // Find the median of the neighbors, sorted by average value.
-                int mid = validNeighbors / 2;
-                std::nth_element(
-                    &neighbors[0], &neighbors[mid], &neighbors[validNeighbors],
-                    [](const ImageChannelValues &a, const ImageChannelValues &b) -> bool {
-                        return a.Average() < b.Average();
-                    });
-                filteredImg.SetChannels({x, y}, neighbors[mid]);
+                    // Find the median of the neighbors, sorted by average value.
+                    int mid = validNeighbors / 2;
+                    std::nth_element(&neighbors[0], &neighbors[mid],
+                                     &neighbors[validNeighbors],
+                                     [](const ImageChannelValues &a,
+                                        const ImageChannelValues &b) -> bool {
+                                         return a.Average() < b.Average();
+                                     });
+                    filteredImg.SetChannels({x, y}, neighbors[mid]);
+                }
             }
+            pstd::swap(image, filteredImg);
+            fprintf(stderr, "%s: despiked %d pixels\n", inFile.c_str(), despikeCount);
         }
-        pstd::swap(image, filteredImg);
-        fprintf(stderr, "%s: despiked %d pixels\n", inFile.c_str(), despikeCount);
-    }
 
-    if (scale != 1) {
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x)
-                for (int c = 0; c < nc; ++c)
-                    image.SetChannel({x, y}, c, scale * image.GetChannel({x, y}, c));
-    }
+        if (scale != 1) {
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x)
+                    for (int c = 0; c < nc; ++c)
+                        image.SetChannel({x, y}, c, scale * image.GetChannel({x, y}, c));
+        }
 
-    if (gamma != 1) {
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x)
-                for (int c = 0; c < nc; ++c)
-                    image.SetChannel(
-                        {x, y}, c,
-                        std::pow(std::max<Float>(0, image.GetChannel({x, y}, c)), gamma));
-    }
+        if (gamma != 1) {
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x)
+                    for (int c = 0; c < nc; ++c)
+                        image.SetChannel({x, y}, c,
+                                         std::pow(std::max<Float>(
+                                                      0, image.GetChannel({x, y}, c)),
+                                                  gamma));
+        }
 
-    if (tonemap) {
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x) {
-                Float lum = image.GetChannels({x, y}).Average();
-                // Reinhard et al. photographic tone mapping operator.
-                Float scale = (1 + lum / (maxY * maxY)) / (1 + lum);
-                for (int c = 0; c < nc; ++c)
-                    image.SetChannel({x, y}, c, scale * image.GetChannel({x, y}, c));
-            }
-    }
+        if (tonemap) {
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x) {
+                    Float lum = image.GetChannels({x, y}).Average();
+                    // Reinhard et al. photographic tone mapping operator.
+                    Float scale = (1 + lum / (maxY * maxY)) / (1 + lum);
+                    for (int c = 0; c < nc; ++c)
+                        image.SetChannel({x, y}, c, scale * image.GetChannel({x, y}, c));
+                }
+        }
+
+        if (preserveColors) {
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x) {
+                    Float m = image.GetChannel({x, y}, 0);
+                    for (int c = 1; c < nc; ++c)
+                        m = std::max(m, image.GetChannel({x, y}, c));
+                    if (m > 1) {
+                        for (int c = 0; c < nc; ++c)
+                            image.SetChannel({x, y}, c, image.GetChannel({x, y}, c) / m);
+                    }
+                }
+        }
 
-    if (preserveColors) {
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x) {
-                Float m = image.GetChannel({x, y}, 0);
-                for (int c = 1; c < nc; ++c)
-                    m = std::max(m, image.GetChannel({x, y}, c));
-                if (m > 1) {
+        if (acesFilmic) {
+            // Approximation via
+            // https://knarkowicz.wordpress.com/2016/01/06/aces-filmic-tone-mapping-curve/
+            auto ACESFilm = [](Float x) -> Float {
+                if (x <= 0)
+                    return 0;
+                Float a = 2.51f;
+                Float b = 0.03f;
+                Float c = 2.43f;
+                Float d = 0.59f;
+                Float e = 0.14f;
+                return Clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0, 1);
+            };
+
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x) {
+                    for (int c = 0; c < nc; ++c) {
+                        Float v = image.GetChannel({x, y}, c);
+                        v = ACESFilm(v);
+                        image.SetChannel({x, y}, c, v);
+                    }
+                }
+        }
+
+        if (repeat > 1) {
+            Image scaledImage(image.Format(), Point2i(res.x * repeat, res.y * repeat),
+                              image.ChannelNames(), image.Encoding());
+            for (int y = 0; y < repeat * res.y; ++y) {
+                int yy = y / repeat;
+                for (int x = 0; x < repeat * res.x; ++x) {
+                    int xx = x / repeat;
                     for (int c = 0; c < nc; ++c)
-                        image.SetChannel({x, y}, c, image.GetChannel({x, y}, c) / m);
+                        scaledImage.SetChannel({x, y}, c, image.GetChannel({xx, yy}, c));
                 }
             }
+            image = std::move(scaledImage);
+            res = image.Resolution();
+        }
+
+        if (flipy)
+            image.FlipY();
+
+        if (maxMemoryMB == 0) {
+            if (!image.Write(outFile, outMetadata))
+                return 1;
+            return 0;
+        }
+
+        if (!writer) {
+            writer = ImageScanlineWriter::Create(
+                outFile, image.Format(),
+                {image.Resolution().x, bounds.pMax.y - bounds.pMin.y},
+                image.ChannelNames(), outMetadata);
+            if (!writer)
+                return 1;
+        }
+        if (!writer->WriteScanlines(image))
+            return 1;
     }
 
-    if (acesFilmic) {
-        // Approximation via
-        // https://knarkowicz.wordpress.com/2016/01/06/aces-filmic-tone-mapping-curve/
-        auto ACESFilm = [](Float x) -> Float {
-            if (x <= 0)
-                return 0;
-            Float a = 2.51f;
-            Float b = 0.03f;
-            Float c = 2.43f;
-            Float d = 0.59f;
-            Float e = 0.14f;
-            return Clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0, 1);
+    return writer->Close() ? 0 : 1;
+}
+
+int merge(int argc, char *argv[]) {
+    std::vector<std::string> filenames;
+    std::string outFile, stateFile;
+
+    while (*argv != nullptr) {
+        auto onError = [](const std::string &err) {
+            usage("merge", "%s", err.c_str());
+            exit(1);
         };
 
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x) {
-                for (int c = 0; c < nc; ++c) {
-                    Float v = image.GetChannel({x, y}, c);
-                    v = ACESFilm(v);
-                    image.SetChannel({x, y}, c, v);
-                }
-            }
+        if (ParseArg(&argv, "outfile", &outFile, onError) ||
+            ParseArg(&argv, "statefile", &stateFile, onError)) {
+            // success
+        } else if (argv[0][0] != '-') {
+            filenames.push_back(*argv);
+            ++argv;
+        } else
+            usage("merge", "%s: unknown argument", *argv);
     }
 
-    if (repeat > 1) {
-        Image scaledImage(image.Format(), Point2i(res.x * repeat, res.y * repeat),
-                          image.ChannelNames(), image.Encoding());
-        for (int y = 0; y < repeat * res.y; ++y) {
-            int yy = y / repeat;
-            for (int x = 0; x < repeat * res.x; ++x) {
-                int xx = x / repeat;
-                for (int c = 0; c < nc; ++c)
-                    scaledImage.SetChannel({x, y}, c, image.GetChannel({xx, yy}, c));
-            }
-        }
-        image = std::move(scaledImage);
-        res = image.Resolution();
-    }
+    if (filenames.empty())
+        usage("merge", "must provide film state filenames.");
+    if (outFile.empty() && stateFile.empty())
+        usage("merge", "must provide --outfile and/or --statefile.");
 
-    if (flipy)
-        image.FlipY();
+    // Merge film states in the order given
+    pstd::optional<FilmState> merged;
+    for (const std::string &filename : filenames) {
+        pstd::optional<FilmState> state = FilmState::ReadFile(filename);
+        if (!state)
+            return 1;
+        if (!merged)
+            merged = std::move(*state);
+        else
+            merged->Merge(*state);
+    }
 
-    if (!image.Write(outFile))
+    if (!stateFile.empty() && !merged->WriteFile(stateFile))
         return 1;
+    if (!outFile.empty()) {
+        ImageMetadata metadata;
+        Image image = merged->GetImage(&metadata);
+        if (!image.Write(outFile, metadata))
+            return 1;
+    }
 
     return 0;
 }
@@ -1865,6 +2421,42 @@ int makeenv(int argc, char *argv[]) {
     return 0;
 }
 
+int makemip(int argc, char *argv[]) {
+    std::string inFilename, outFilename, encodingName, wrapName = "repeat";
+
+    auto onError = [](const std::string &err) {
+        usage("makemip", "%s", err.c_str());
+        exit(1);
+    };
+    while (*argv != nullptr) {
+        if (ParseArg(&argv, "encoding", &encodingName, onError) ||
+            ParseArg(&argv, "outfile", &outFilename, onError) ||
+            ParseArg(&argv, "wrap", &wrapName, onError)) {
+            // success
+        } else if (argv[0][0] == '-')
+            usage("makemip", "%s: unknown command flag", *argv);
+        else if (inFilename.empty()) {
+            inFilename = *argv;
+            ++argv;
+        } else
+            usage("makemip", "multiple input filenames provided.");
+    }
+    if (inFilename.empty())
+        usage("makemip", "input image filename must be provided.");
+    if (outFilename.empty())
+        outFilename = inFilename + ".mip";
+
+    pstd::optional<WrapMode> wrapMode = ParseWrapMode(wrapName.c_str());
+    if (!wrapMode)
+        usage("makemip", "%s: wrap mode unknown", wrapName.c_str());
+    if (encodingName.empty())
+        encodingName = HasExtension(inFilename, "png") ? "sRGB" : "linear";
+    ColorEncodingHandle encoding = ColorEncodingHandle::Get(encodingName);
+
+    return MIPMap::WriteTiledPyramid(inFilename, *wrapMode, encoding, outFilename) ? 0
+                                                                                    : 1;
+}
+
 Image denoiseImage(const Image &in, const ImageChannelDesc &Ldesc,
                    const Image &varianceImage, const ImageChannelDesc &albedoDesc,
                    const ImageChannelDesc &zDesc, const ImageChannelDesc &deltaZDesc,
@@ -2278,10 +2870,14 @@ int main(int argc, char *argv[]) {
         return info(argc - 2, argv + 2);
     else if (strcmp(argv[1], "makeenv") == 0)
         return makeenv(argc - 2, argv + 2);
+    else if (strcmp(argv[1], "makemip") == 0)
+        return makemip(argc - 2, argv + 2);
     else if (strcmp(argv[1], "makeemitters") == 0)
         return makeemitters(argc - 2, argv + 2);
     else if (strcmp(argv[1], "makesky") == 0)
         return makesky(argc - 2, argv + 2);
+    else if (strcmp(argv[1], "merge") == 0)
+        return merge(argc - 2, argv + 2);
     else if (strcmp(argv[1], "whitebalance") == 0)
         return whitebalance(argc - 2, argv + 2);
     else if (strcmp(argv[1], "noisybit") == 0) {
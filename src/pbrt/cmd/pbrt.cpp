@@ -4,6 +4,7 @@
 
 #include <pbrt/pbrt.h>
 
+#include <pbrt/cpu/integrators.h>
 #include <pbrt/cpu/render.h>
 #include <pbrt/options.h>
 #include <pbrt/parsedscene.h>
@@ -18,6 +19,8 @@
 #include <pbrt/util/spectrum.h>
 #include <pbrt/util/string.h>
 
+#include <csignal>
+
 #ifdef NVTX
 #include <sys/syscall.h>
 #include "nvtx3/nvToolsExt.h"
@@ -45,6 +48,21 @@ static void usage(const std::string &msg = {}) {
             R"(usage: pbrt [<options>] <filename.pbrt...>
 
 Rendering options:
+  --approx-bump-gradients      Bump map using the gradient of filtered image
+                               textures rather than evaluating them at nearby
+                               points. Faster, but the normals differ by a few
+                               degrees. (CPU only.)
+  --cameras <filename>         Render the scene once for each "Camera" statement in
+                               the given file, reusing the scene's geometry, lights,
+                               and textures. Each camera's transformation is reset
+                               after its "Camera" statement. Images are written to
+                               the output filename with the camera index appended.
+  --checkpoint <filename>      Periodically save the in-progress rendering state to
+                               the given file so that it can be resumed later. If
+                               interrupted with Ctrl-C, pbrt saves the state and
+                               exits after the current pass over the image.
+  --checkpoint-interval <s>    Minimum number of seconds between checkpoints.
+                               (Default: 300)
   --cropwindow <x0,x1,y0,y1>   Specify an image crop window w.r.t. [0,1]^2
   --debugstart <values>        Inform the Integrator where to start rendering for
                                faster debugging. (<values> are Integrator-specific
@@ -53,7 +71,12 @@ Rendering options:
   --disable-wavelength-jitter  Always sample the same %d wavelengths of light.
   --display-server <addr:port> Connect to display server at given address and port
                                to display the image as it's being rendered.
-  --force-diffuse              Convert all materials to be diffuse.)"
+  --film-state <filename>      Write the film's raw accumulated values to the given
+                               file rather than writing an image. (See "imgtool merge".)
+  --force-diffuse              Convert all materials to be diffuse.
+  --frames <n>                 Render <n> frames at evenly-spaced times over the
+                               camera's animation, reusing the rest of the scene.
+                               Images are named as with --cameras.)"
 #ifdef PBRT_BUILD_GPU_RENDERER
             R"(
   --gpu                        Use the GPU for rendering. (Default: disabled)
@@ -74,9 +97,29 @@ Rendering options:
   --quiet                      Suppress all text output other than error messages.
   --render-coord-sys <name>    Coordinate system to use for the scene when rendering,
                                where name is "camera", "cameraworld", or "world".
+  --resume                     Continue rendering from the file given with
+                               --checkpoint, if it exists.
+  --sample-range <start,end>   Only take the pixel samples with indices in
+                               [start,end) in each pixel.
   --seed <n>                   Set random number generator seed. Default: 0.
+  --server <unix:path>         Create the scene once and then render it as requested
+                               by clients connecting to the given Unix domain socket.
+                               Requests may override --camera (a "Camera" statement
+                               and preceding transformations), --cropwindow,
+                               --film-state, --outfile, --pixelbounds, --seed,
+                               and --spp.
   --spp <n>                    Override number of pixel samples specified in scene
                                description file.
+  --texture-cache-dir <dir>    Directory where MIP pyramid files for image
+                               textures are created so that later runs can
+                               memory-map them rather than reading the images.
+  --texture-cache-mb <n>       Read image texture tiles on demand, keeping at most
+                               <n> MB of them in memory. (Default: 0, disabled)
+  --work-unit-samples <n>      Number of pixel samples in each unit of work handed
+                               to a worker process with --workers.
+                               (Default: chosen automatically)
+  --workers <n>                Render using the specified number of worker
+                               processes and merge their results.
 
 Logging options:
   --log-level <level>          Log messages at or above this level, where <level>
@@ -86,6 +129,9 @@ Logging options:
 Reformatting options:
   --format                     Print a reformatted version of the input file(s) to
                                standard output. Does not render an image.
+  --tobinary <filename>        Write the input file(s) to <filename> in pbrt's binary
+                               scene format, which pbrt reads without parsing text.
+                               Does not render an image.
   --toply                      Print a reformatted version of the input file(s) to
                                standard output and convert all triangle meshes to
                                PLY files. Does not render an image.
@@ -103,10 +149,14 @@ int main(int argc, char *argv[]) {
     // Declare variables for parsed command line
     PBRTOptions options;
     std::vector<std::string> filenames;
+    std::string executable = argv[0];
 
     std::string logLevel = "error";
     std::string renderCoordSys = "cameraworld";
+    std::string serverAddress, camerasFile;
+    int nFrames = 0;
     bool format = false, toPly = false;
+    std::string toBinary;
 
     // Process command-line arguments
     ++argv;
@@ -122,8 +172,10 @@ int main(int argc, char *argv[]) {
             exit(1);
         };
 
-        std::string cropWindow, pixelBounds, pixel;
-        if (ParseArg(&argv, "cropwindow", &cropWindow, onError)) {
+        std::string cropWindow, pixelBounds, pixel, sampleRange;
+        if (ParseArg(&argv, "cameras", &camerasFile, onError)) {
+            // success
+        } else if (ParseArg(&argv, "cropwindow", &cropWindow, onError)) {
             pstd::optional<std::vector<Float>> c = SplitStringToFloats(cropWindow, ',');
             if (!c || c->size() != 4) {
                 usage("Didn't find four values after --cropwindow");
@@ -139,6 +191,18 @@ int main(int argc, char *argv[]) {
             }
             options.pixelBounds =
                 Bounds2i(Point2i((*p)[0], (*p)[1]), Point2i((*p)[0] + 1, (*p)[1] + 1));
+        } else if (ParseArg(&argv, "sample-range", &sampleRange, onError)) {
+            pstd::optional<std::vector<int>> r = SplitStringToInts(sampleRange, ',');
+            if (!r || r->size() != 2) {
+                usage("Didn't find two integer values after --sample-range");
+                return 1;
+            }
+            if ((*r)[0] < 0 || (*r)[1] <= (*r)[0]) {
+                usage("Empty or negative sample range given with --sample-range");
+                return 1;
+            }
+            options.sampleRangeStart = (*r)[0];
+            options.sampleRangeEnd = (*r)[1];
         } else if (ParseArg(&argv, "pixelbounds", &pixelBounds, onError)) {
             pstd::optional<std::vector<int>> p = SplitStringToInts(pixelBounds, ',');
             if (!p || p->size() != 4) {
@@ -152,14 +216,21 @@ int main(int argc, char *argv[]) {
             ParseArg(&argv, "gpu", &options.useGPU, onError) ||
             ParseArg(&argv, "gpu-device", &options.gpuDevice, onError) ||
 #endif
+            ParseArg(&argv, "approx-bump-gradients", &options.approximateBumpGradients,
+                     onError) ||
+            ParseArg(&argv, "checkpoint", &options.checkpointFile, onError) ||
+            ParseArg(&argv, "checkpoint-interval", &options.checkpointInterval,
+                     onError) ||
             ParseArg(&argv, "debugstart", &options.debugStart, onError) ||
             ParseArg(&argv, "disable-pixel-jitter", &options.disablePixelJitter,
                      onError) ||
             ParseArg(&argv, "disable-wavelength-jitter", &options.disableWavelengthJitter,
                      onError) ||
             ParseArg(&argv, "display-server", &options.displayServer, onError) ||
+            ParseArg(&argv, "film-state", &options.filmStateFile, onError) ||
             ParseArg(&argv, "force-diffuse", &options.forceDiffuse, onError) ||
             ParseArg(&argv, "format", &format, onError) ||
+            ParseArg(&argv, "frames", &nFrames, onError) ||
             ParseArg(&argv, "log-level", &logLevel, onError) ||
             ParseArg(&argv, "mse-reference-image", &options.mseReferenceImage, onError) ||
             ParseArg(&argv, "mse-reference-out", &options.mseReferenceOutput, onError) ||
@@ -169,11 +240,18 @@ int main(int argc, char *argv[]) {
             ParseArg(&argv, "quick", &options.quickRender, onError) ||
             ParseArg(&argv, "quiet", &options.quiet, onError) ||
             ParseArg(&argv, "render-coord-sys", &renderCoordSys, onError) ||
+            ParseArg(&argv, "resume", &options.resume, onError) ||
             ParseArg(&argv, "seed", &options.seed, onError) ||
+            ParseArg(&argv, "server", &serverAddress, onError) ||
             ParseArg(&argv, "spp", &options.pixelSamples, onError) ||
+            ParseArg(&argv, "texture-cache-dir", &options.textureCacheDir, onError) ||
+            ParseArg(&argv, "texture-cache-mb", &options.textureCacheMB, onError) ||
+            ParseArg(&argv, "tobinary", &toBinary, onError) ||
             ParseArg(&argv, "toply", &toPly, onError) ||
             ParseArg(&argv, "upgrade", &options.upgrade, onError) ||
-            ParseArg(&argv, "vlog-level", &options.logConfig.vlogLevel, onError)) {
+            ParseArg(&argv, "vlog-level", &options.logConfig.vlogLevel, onError) ||
+            ParseArg(&argv, "work-unit-samples", &options.workUnitSamples, onError) ||
+            ParseArg(&argv, "workers", &options.nWorkers, onError)) {
             // success
         } else if ((strcmp(*argv, "--help") == 0) || (strcmp(*argv, "-help") == 0) ||
                    (strcmp(*argv, "-h") == 0)) {
@@ -186,7 +264,7 @@ int main(int argc, char *argv[]) {
     }
 
     // Print welcome banner
-    if (!options.quiet && !format && !toPly && !options.upgrade) {
+    if (!options.quiet && !format && !toPly && !options.upgrade && toBinary.empty()) {
         printf("pbrt version 4 (built %s at %s)\n", __DATE__, __TIME__);
 #ifndef NDEBUG
         LOG_VERBOSE("Running debug build");
@@ -214,11 +292,46 @@ int main(int argc, char *argv[]) {
     if (!options.mseReferenceOutput.empty() && options.mseReferenceImage.empty())
         ErrorExit("Must provide MSE reference image via --mse-reference-image");
 
+    if (options.resume && options.checkpointFile.empty())
+        ErrorExit("Must provide checkpoint filename via --checkpoint with --resume");
+    if (options.checkpointInterval < 0)
+        ErrorExit("--checkpoint-interval must be non-negative");
+    if (options.nWorkers < 0)
+        ErrorExit("--workers must be non-negative");
+    if (options.nWorkers > 0 && options.useGPU)
+        ErrorExit("--workers is only supported with CPU rendering");
+    if (options.nWorkers > 0 && options.sampleRangeEnd)
+        ErrorExit("--sample-range can't be used with --workers");
+    if (!serverAddress.empty() && (options.useGPU || options.nWorkers > 0))
+        ErrorExit("--server is only supported with single-process CPU rendering");
+    if (options.approximateBumpGradients && options.useGPU)
+        ErrorExit("--approx-bump-gradients is only supported with CPU rendering");
+    if (options.textureCacheMB < 0)
+        ErrorExit("--texture-cache-mb must be non-negative");
+    if (!toBinary.empty() && (format || toPly || options.upgrade))
+        ErrorExit("--tobinary can't be used with --format, --toply, or --upgrade");
+    if (nFrames < 0)
+        ErrorExit("--frames must be positive");
+    bool renderCameras = !camerasFile.empty() || nFrames > 0;
+    if (!camerasFile.empty() && nFrames > 0)
+        ErrorExit("Only one of --cameras and --frames may be specified");
+    if (renderCameras &&
+        (options.useGPU || options.nWorkers > 0 || !serverAddress.empty()))
+        ErrorExit("--cameras and --frames are only supported with single-process "
+                  "CPU rendering");
+    if (renderCameras &&
+        (!options.checkpointFile.empty() || !options.filmStateFile.empty()))
+        ErrorExit("--checkpoint and --film-state can't be used with --cameras or "
+                  "--frames");
+
     options.logConfig.level = LogLevelFromString(logLevel);
 
     InitPBRT(options);
 
-    if (format || toPly || options.upgrade) {
+    if (!toBinary.empty()) {
+        BinarySceneWriter binaryScene(toBinary);
+        ParseFiles(&binaryScene, filenames);
+    } else if (format || toPly || options.upgrade) {
         FormattingScene formattingScene(toPly, options.upgrade);
         ParseFiles(&formattingScene, filenames);
     } else {
@@ -229,8 +342,22 @@ int main(int argc, char *argv[]) {
         // Render scene
         if (options.useGPU)
             GPURender(scene);
-        else
+        else if (!serverAddress.empty())
+            CPURenderServer(scene, serverAddress);
+        else if (renderCameras)
+            CPURenderCameras(scene, camerasFile, nFrames);
+        else if (options.nWorkers > 0)
+            CPURenderDistributed(scene, executable, filenames);
+        else {
+            // On the first interrupt, stop after the current pass and write a
+            // checkpoint; a second one exits immediately.
+            if (!options.checkpointFile.empty())
+                std::signal(SIGINT, [](int) {
+                    ImageTileIntegrator::RequestStop();
+                    std::signal(SIGINT, SIG_DFL);
+                });
             CPURender(scene);
+        }
 
         LOG_VERBOSE("Memory used after post-render cleanup: %s", GetCurrentRSS());
         // Clean up after rendering scene
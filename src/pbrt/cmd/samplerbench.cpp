@@ -0,0 +1,427 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/cpu/render.h>
+#include <pbrt/options.h>
+#include <pbrt/paramdict.h>
+#include <pbrt/parsedscene.h>
+#include <pbrt/parser.h>
+#include <pbrt/samplers.h>
+#include <pbrt/util/args.h>
+#include <pbrt/util/colorspace.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/math.h>
+#include <pbrt/util/memory.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/print.h>
+#include <pbrt/util/progressreporter.h>
+#include <pbrt/util/pstd.h>
+#include <pbrt/util/string.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace pbrt;
+
+static void usage(const std::string &msg = {}) {
+    if (!msg.empty())
+        fprintf(stderr, "samplerbench: %s\n\n", msg.c_str());
+
+    fprintf(stderr,
+            R"(usage: samplerbench [<options>] [<filename.pbrt...>]
+
+Measures the throughput and convergence of pbrt's samplers and writes the
+results as JSON.
+
+Options:
+  --help                       Print this help text.
+  --nthreads <num>             Use specified number of threads.
+  --outfile <filename>         Write results to the given file. (Default: stdout)
+  --samplers <name,...>        Only benchmark the given samplers.
+                               (Default: all of them)
+  --seed <n>                   Random number seed for the samplers.
+  --spp <n>                    Maximum number of pixel samples used to measure
+                               convergence on the analytic integrands. (Default: 256)
+
+If scene files are given, each one is also rendered with each sampler to
+measure the time taken to reach a target MSE:
+  --mse-reference-image <filename>
+                               Reference image for the scene.
+  --render-spp <n>             Maximum number of pixel samples to take when
+                               rendering. (Default: 1024)
+  --target-mse <value>         MSE that renderings must reach.
+)");
+    exit(msg.empty() ? 0 : 1);
+}
+
+// The MLT samplers don't generate pixel samples, so they aren't included.
+static const char *AllSamplerNames[] = {"halton", "paddedsobol", "pmj02bn", "random",
+                                        "sobol",  "stratified",  "zsobol"};
+
+// Prevents the compiler from discarding the values computed by the
+// throughput benchmarks.
+static volatile Float sampleSink;
+
+// The image and MSE files that scenes are rendered to; they're set in the
+// options and removed after each rendering.
+static const char *RenderImageFile = "samplerbench.exr";
+static const char *RenderMSEFile = "samplerbench-mse.txt";
+
+// Returns sampler parameters that only give the number of pixel samples,
+// using _param_ for their storage. The samplers use their defaults for
+// everything else.
+static ParameterDictionary SamplerParameters(ParsedParameter *param, int spp) {
+    param->type = "integer";
+    param->name = "pixelsamples";
+    param->AddNumber(spp);
+    return ParameterDictionary({param}, RGBColorSpace::sRGB);
+}
+
+static SamplerHandle CreateSampler(const std::string &name, int spp,
+                                   const Point2i &resolution, Allocator alloc) {
+    ParsedParameter param(alloc, FileLoc());
+    return SamplerHandle::Create(name, SamplerParameters(&param, spp), resolution,
+                                 nullptr, alloc);
+}
+
+// Generates the sample dimensions that a path of a few bounces consumes
+// for each pixel sample in _pixels_ and returns the number of 1D values.
+static int64_t GenerateSamples(SamplerHandle sampler, Bounds2i pixels, int spp) {
+    Float sum = 0;
+    int64_t count = 0;
+    for (Point2i p : pixels)
+        for (int i = 0; i < spp; ++i) {
+            sampler.StartPixelSample(p, i);
+            // Camera sample, then light and BSDF samples for each bounce
+            Point2f u = sampler.Get2D();
+            sum += u.x + u.y;
+            sum += sampler.Get1D();
+            for (int depth = 0; depth < 5; ++depth) {
+                sum += sampler.Get1D();
+                u = sampler.Get2D();
+                sum += u.x + u.y;
+                sum += sampler.Get1D();
+                u = sampler.Get2D();
+                sum += u.x + u.y;
+            }
+            count += 3 + 6 * 5;
+        }
+    sampleSink = sum;
+    return count;
+}
+
+// Generates the same number of sample values per pixel sample as
+// GenerateSamples() does, but requests each bounce's values with a single
+// GetND() call.
+static int64_t GenerateSamplesBatched(SamplerHandle sampler, Bounds2i pixels, int spp) {
+    Float sum = 0;
+    int64_t count = 0;
+    Float u[6];
+    for (Point2i p : pixels)
+        for (int i = 0; i < spp; ++i) {
+            sampler.StartPixelSample(p, i);
+            Point2f uCamera = sampler.Get2D();
+            sum += uCamera.x + uCamera.y;
+            sum += sampler.Get1D();
+            for (int depth = 0; depth < 5; ++depth) {
+                sampler.GetND(pstd::MakeSpan(u));
+                for (Float ud : u)
+                    sum += ud;
+            }
+            count += 3 + 6 * 5;
+        }
+    sampleSink = sum;
+    return count;
+}
+
+// Integrand Definition
+struct Integrand {
+    std::string name;
+    int dimensions;
+    Float (*f)(const Float *u);
+    double expected;
+};
+
+static const Integrand Integrands[] = {
+    // Discontinuous, with a curved edge
+    {"quarter disk", 2,
+     [](const Float *u) { return Float(Sqr(u[0]) + Sqr(u[1]) < 1 ? 1 : 0); },
+     Pi / 4},
+    // Discontinuous, with an edge that isn't axis-aligned
+    {"triangle", 2, [](const Float *u) { return Float(u[0] + u[1] < 1 ? 1 : 0); }, 0.5},
+    {"bilinear", 2, [](const Float *u) { return u[0] * u[1]; }, 0.25},
+    {"gaussian", 2, [](const Float *u) { return std::exp(-Sqr(u[0]) - Sqr(u[1])); },
+     Sqr(std::sqrt(Pi) / 2 * std::erf(1.))},
+    {"sine product 4D", 4,
+     [](const Float *u) {
+         Float v = 1;
+         for (int i = 0; i < 4; ++i)
+             v *= Pi / 2 * std::sin(Pi * u[i]);
+         return v;
+     },
+     1.}};
+
+static std::string JSONString(const std::string &s) {
+    std::string r = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            r += '\\';
+        r += c;
+    }
+    return r + "\"";
+}
+
+static std::string JoinStrings(const std::vector<std::string> &strs,
+                               const std::string &separator) {
+    std::string r;
+    for (size_t i = 0; i < strs.size(); ++i)
+        r += (i > 0 ? separator : "") + strs[i];
+    return r;
+}
+
+// Returns the slope of the least-squares fit of log(mse) against log(spp).
+static double ConvergenceRate(const std::vector<int> &spp,
+                              const std::vector<double> &mse) {
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (size_t i = 0; i < spp.size(); ++i) {
+        if (mse[i] <= 0)
+            continue;
+        double x = std::log(spp[i]), y = std::log(mse[i]);
+        n += 1;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    if (n < 2)
+        return 0;
+    return (n * sxy - sx * sy) / (n * sxx - sx * sx);
+}
+
+static std::string BenchmarkThroughput(const std::string &name, int spp) {
+    Point2i resolution(256, 256);
+    pstd::pmr::monotonic_buffer_resource resource;
+    Allocator alloc(&resource);
+    SamplerHandle sampler = CreateSampler(name, spp, resolution, alloc);
+
+    // Single-threaded throughput
+    Bounds2i pixels(Point2i(0, 0), Point2i(32, 32));
+    Timer timer;
+    int64_t count = GenerateSamples(sampler, pixels, spp);
+    double singleRate = count / timer.ElapsedSeconds();
+
+    // Single-threaded throughput with the bounces' values batched
+    timer = Timer();
+    count = GenerateSamplesBatched(sampler, pixels, spp);
+    double batchedRate = count / timer.ElapsedSeconds();
+
+    // Throughput when all threads are generating samples
+    int nThreads = MaxThreadIndex();
+    std::vector<SamplerHandle> samplers = sampler.Clone(nThreads, alloc);
+    std::vector<int64_t> counts(nThreads, 0);
+    timer = Timer();
+    ParallelFor(0, resolution.y, [&](int64_t y0, int64_t y1) {
+        Bounds2i rows(Point2i(0, y0), Point2i(resolution.x, y1));
+        counts[ThreadIndex] += GenerateSamples(samplers[ThreadIndex], rows, spp / 4);
+    });
+    double elapsed = timer.ElapsedSeconds();
+    int64_t total = 0;
+    for (int64_t c : counts)
+        total += c;
+    double parallelRate = total / (elapsed * RunningThreads());
+
+    // Clone() cost
+    constexpr int nClones = 64, nTrials = 16;
+    timer = Timer();
+    for (int i = 0; i < nTrials; ++i) {
+        pstd::pmr::monotonic_buffer_resource cloneResource;
+        sampler.Clone(nClones, Allocator(&cloneResource));
+    }
+    double cloneMicroseconds = 1e6 * timer.ElapsedSeconds() / (nTrials * nClones);
+
+    return StringPrintf("{ \"samplesPerSecondPerThread\": %.6g, "
+                        "\"batchedSamplesPerSecondPerThread\": %.6g, "
+                        "\"parallelSamplesPerSecondPerThread\": %.6g, "
+                        "\"threads\": %d, \"cloneMicroseconds\": %.6g }",
+                        singleRate, batchedRate, parallelRate, RunningThreads(),
+                        cloneMicroseconds);
+}
+
+static std::string BenchmarkConvergence(const std::string &name, int maxSpp) {
+    // Each pixel gives an independent estimate of each integral.
+    Point2i resolution(64, 64);
+    std::vector<int> sppValues;
+    for (int spp = 1; spp <= maxSpp; spp *= 2)
+        sppValues.push_back(spp);
+
+    std::vector<std::string> results;
+    for (const Integrand &integrand : Integrands) {
+        std::vector<double> mse;
+        for (int spp : sppValues) {
+            // Samplers for some sample counts aren't progressive, so a new
+            // one is created for each count.
+            pstd::pmr::monotonic_buffer_resource resource;
+            Allocator alloc(&resource);
+            SamplerHandle sampler = CreateSampler(name, spp, resolution, alloc);
+            std::vector<SamplerHandle> samplers = sampler.Clone(MaxThreadIndex(), alloc);
+
+            std::vector<double> sumSquaredError(MaxThreadIndex(), 0.);
+            ParallelFor(0, resolution.y, [&](int64_t y) {
+                SamplerHandle sampler = samplers[ThreadIndex];
+                for (int x = 0; x < resolution.x; ++x) {
+                    double sum = 0;
+                    for (int i = 0; i < spp; ++i) {
+                        sampler.StartPixelSample(Point2i(x, y), i);
+                        // Skip the camera sample dimensions
+                        sampler.Get2D();
+                        Float u[4];
+                        for (int d = 0; d < integrand.dimensions; d += 2) {
+                            Point2f u2 = sampler.Get2D();
+                            u[d] = u2.x;
+                            u[d + 1] = u2.y;
+                        }
+                        sum += integrand.f(u);
+                    }
+                    sumSquaredError[ThreadIndex] +=
+                        Sqr(sum / spp - integrand.expected);
+                }
+            });
+            double sse = 0;
+            for (double s : sumSquaredError)
+                sse += s;
+            mse.push_back(sse / resolution.x / resolution.y);
+        }
+
+        std::string r =
+            StringPrintf("{ \"integrand\": %s, \"rate\": %.4f, \"mse\": [ ",
+                         JSONString(integrand.name), ConvergenceRate(sppValues, mse));
+        for (size_t i = 0; i < sppValues.size(); ++i)
+            r += StringPrintf("%s[ %d, %.6g ]", i > 0 ? ", " : "", sppValues[i], mse[i]);
+        results.push_back(r + " ] }");
+    }
+    return "[\n        " + JoinStrings(results, ",\n        ") + "\n      ]";
+}
+
+static std::string BenchmarkRender(const std::string &name,
+                                   const std::vector<std::string> &filenames,
+                                   int renderSpp, double targetMSE) {
+    ParsedScene scene;
+    ParseFiles(&scene, filenames);
+    ParsedParameter param{Allocator(), FileLoc()};
+    scene.sampler =
+        SceneEntity(name, SamplerParameters(&param, renderSpp), scene.sampler.loc);
+    CPURender(scene);
+
+    // Each line of the MSE file gives the sample count and MSE after each
+    // pass; find the first one that reaches the target.
+    int targetSpp = 0, finalSpp = 0;
+    double finalMSE = 0;
+    FILE *f = fopen(RenderMSEFile, "r");
+    if (!f)
+        ErrorExit("%s: %s", RenderMSEFile, ErrorString());
+    int spp;
+    double mse;
+    while (fscanf(f, "%d, %lf", &spp, &mse) == 2) {
+        if (mse <= targetMSE && targetSpp == 0)
+            targetSpp = spp;
+        finalSpp = spp;
+        finalMSE = mse;
+    }
+    fclose(f);
+
+    // The rendering time is taken from the image's metadata. With a
+    // reference image, each pass takes one sample per pixel, so the time to
+    // reach the target is estimated as the corresponding fraction of it.
+    std::string result = "null";
+    if (targetSpp > 0) {
+        ImageAndMetadata image = Image::Read(RenderImageFile);
+        double seconds = image.metadata.renderTimeSeconds.value_or(0.f);
+        result = StringPrintf("{ \"spp\": %d, \"seconds\": %.6g }", targetSpp,
+                              seconds * targetSpp / finalSpp);
+    }
+    remove(RenderMSEFile);
+    remove(RenderImageFile);
+
+    return StringPrintf("{ \"timeToTarget\": %s, \"finalMSE\": %.6g }", result,
+                        finalMSE);
+}
+
+int main(int argc, char *argv[]) {
+    PBRTOptions options;
+    options.quiet = true;
+    std::vector<std::string> filenames;
+    std::string outFile, samplerList, referenceImage;
+    int maxSpp = 256, renderSpp = 1024;
+    double targetMSE = -1;
+
+    ++argv;
+    while (*argv != nullptr) {
+        if ((*argv)[0] != '-') {
+            filenames.push_back(*argv);
+            ++argv;
+            continue;
+        }
+
+        auto onError = [](const std::string &err) { usage(err); };
+        if (ParseArg(&argv, "mse-reference-image", &referenceImage, onError) ||
+            ParseArg(&argv, "nthreads", &options.nThreads, onError) ||
+            ParseArg(&argv, "outfile", &outFile, onError) ||
+            ParseArg(&argv, "render-spp", &renderSpp, onError) ||
+            ParseArg(&argv, "samplers", &samplerList, onError) ||
+            ParseArg(&argv, "seed", &options.seed, onError) ||
+            ParseArg(&argv, "spp", &maxSpp, onError) ||
+            ParseArg(&argv, "target-mse", &targetMSE, onError)) {
+            // success
+        } else if ((strcmp(*argv, "--help") == 0) || (strcmp(*argv, "-help") == 0) ||
+                   (strcmp(*argv, "-h") == 0))
+            usage();
+        else
+            usage(StringPrintf("argument \"%s\" unknown", *argv));
+    }
+
+    if (maxSpp < 1 || renderSpp < 1)
+        usage("sample counts must be positive");
+    if (!filenames.empty() && (referenceImage.empty() || targetMSE <= 0))
+        usage("must provide --mse-reference-image and --target-mse with scene files");
+
+    std::vector<std::string> samplerNames;
+    if (samplerList.empty())
+        samplerNames.assign(std::begin(AllSamplerNames), std::end(AllSamplerNames));
+    else
+        samplerNames = SplitString(samplerList, ',');
+
+    options.mseReferenceImage = referenceImage;
+    options.mseReferenceOutput = RenderMSEFile;
+    options.imageFile = RenderImageFile;
+    InitPBRT(options);
+
+    std::vector<std::string> results;
+    for (const std::string &name : samplerNames) {
+        std::string r = StringPrintf("    %s: {\n      \"throughput\": %s,\n"
+                                     "      \"convergence\": %s",
+                                     JSONString(name), BenchmarkThroughput(name, 64),
+                                     BenchmarkConvergence(name, maxSpp));
+        if (!filenames.empty())
+            r += StringPrintf(",\n      \"render\": %s",
+                              BenchmarkRender(name, filenames, renderSpp, targetMSE));
+        results.push_back(r + "\n    }");
+    }
+
+    std::string json =
+        StringPrintf("{\n  \"samplers\": {\n%s\n  }\n}\n", JoinStrings(results, ",\n"));
+    if (outFile.empty())
+        fputs(json.c_str(), stdout);
+    else if (!WriteFile(outFile, json))
+        ErrorExit("%s: unable to write results.", outFile);
+
+    CleanupPBRT();
+    return 0;
+}
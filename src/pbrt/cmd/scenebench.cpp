@@ -0,0 +1,246 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/options.h>
+#include <pbrt/paramdict.h>
+#include <pbrt/parsedscene.h>
+#include <pbrt/parser.h>
+#include <pbrt/shapes.h>
+#include <pbrt/util/args.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/float.h>
+#include <pbrt/util/memory.h>
+#include <pbrt/util/mesh.h>
+#include <pbrt/util/print.h>
+#include <pbrt/util/progressreporter.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/string.h>
+#include <pbrt/util/transform.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace pbrt;
+
+static void usage(const std::string &msg = {}) {
+    if (!msg.empty())
+        fprintf(stderr, "scenebench: %s\n\n", msg.c_str());
+
+    fprintf(stderr,
+            R"(usage: scenebench [<options>] [<filename.pbrt...>]
+
+Measures how long scenes take to load from pbrt's text and binary scene
+formats and writes the results as JSON. Each scene is converted to a binary
+scene file in the current directory. The time to parse the scene and the
+time to create its shapes, which includes reading PLY files, are reported
+separately.
+
+If no scene files are given, a triangle mesh with random vertices is
+generated and measured both with its vertices given in the scene file and
+stored in a PLY file.
+
+Options:
+  --help                       Print this help text.
+  --outfile <filename>         Write results to the given file. (Default: stdout)
+  --trials <n>                 Number of times to load each scene; the fastest
+                               time is reported. (Default: 3)
+  --vertices <n>               Number of vertices in the generated mesh.
+                               (Default: 1000000)
+)");
+    exit(msg.empty() ? 0 : 1);
+}
+
+static std::string JSONString(const std::string &s) {
+    std::string r = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            r += '\\';
+        r += c;
+    }
+    return r + "\"";
+}
+
+static std::string JoinStrings(const std::vector<std::string> &strs,
+                               const std::string &separator) {
+    std::string r;
+    for (size_t i = 0; i < strs.size(); ++i)
+        r += (i > 0 ? separator : "") + strs[i];
+    return r;
+}
+
+// Returns the filename without its directory or extension.
+static std::string BaseName(const std::string &filename) {
+    size_t slash = filename.find_last_of("/\\");
+    return RemoveExtension(slash == std::string::npos ? filename
+                                                      : filename.substr(slash + 1));
+}
+
+static int64_t FileSize(const std::string &filename) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f)
+        return -1;
+    fseek(f, 0, SEEK_END);
+    int64_t size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+// Writes a scene with a triangle strip through random vertices to
+// _filename_. If _plyFilename_ isn't empty, the mesh is stored in that PLY
+// file; otherwise its vertices and indices are given in the scene file.
+static void WriteMeshScene(const std::string &filename, const std::string &plyFilename,
+                           int nVertices) {
+    RNG rng;
+    std::vector<Point3f> p(nVertices);
+    for (Point3f &pp : p)
+        pp = Point3f(-10 + 20 * rng.Uniform<Float>(), -10 + 20 * rng.Uniform<Float>(),
+                     -10 + 20 * rng.Uniform<Float>());
+    std::vector<int> indices;
+    for (int i = 0; i + 2 < nVertices; ++i)
+        indices.insert(indices.end(), {i, i + 1, i + 2});
+
+    std::string scene = "WorldBegin\n";
+    if (!plyFilename.empty()) {
+        TriangleMesh mesh(pbrt::Transform(), false, indices, p, {}, {}, {}, {});
+        if (!mesh.WritePLY(plyFilename))
+            ErrorExit("%s: unable to write PLY file.", plyFilename);
+        scene += StringPrintf("Shape \"plymesh\" \"string filename\" \"%s\"\n",
+                              plyFilename);
+    } else {
+        // Use snprintf() rather than StringPrintf() since there are millions
+        // of values to format.
+        char buf[128];
+        scene += "Shape \"trianglemesh\" \"point3 P\" [\n";
+        for (Point3f pp : p) {
+            snprintf(buf, sizeof(buf), "%.9g %.9g %.9g\n", pp.x, pp.y, pp.z);
+            scene += buf;
+        }
+        scene += "] \"integer indices\" [\n";
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            snprintf(buf, sizeof(buf), "%d %d %d\n", indices[i], indices[i + 1],
+                     indices[i + 2]);
+            scene += buf;
+        }
+        scene += "]\n";
+    }
+    if (!WriteFile(filename, scene))
+        ErrorExit("%s: unable to write scene file.", filename);
+}
+
+// Returns the fastest time taken to parse the scene and to create its
+// shapes over the given number of trials.
+static std::string TimeLoad(const std::string &filename, int nTrials) {
+    double parseSeconds = Infinity, shapeSeconds = Infinity;
+    int64_t nShapes = 0;
+    for (int trial = 0; trial < nTrials; ++trial) {
+        ParsedScene scene;
+        std::vector<std::string> filenames = {filename};
+        Timer timer;
+        ParseFiles(&scene, filenames);
+        parseSeconds = std::min(parseSeconds, timer.ElapsedSeconds());
+
+        // Give each trial's shapes their own memory so that it's freed
+        // before the next one. Triangle::allMeshes still holds pointers to
+        // the meshes, but they aren't used since nothing is rendered.
+        pstd::pmr::monotonic_buffer_resource shapeResource;
+        Allocator alloc(&shapeResource);
+        timer = Timer();
+        nShapes = 0;
+        for (const ShapeSceneEntity &sh : scene.shapes)
+            nShapes += ShapeHandle::Create(sh.name, sh.renderFromObject,
+                                           sh.objectFromRender, sh.reverseOrientation,
+                                           sh.parameters, &sh.loc, alloc)
+                           .size();
+        shapeSeconds = std::min(shapeSeconds, timer.ElapsedSeconds());
+    }
+    return StringPrintf("{ \"bytes\": %d, \"parseSeconds\": %.6g, "
+                        "\"shapeSeconds\": %.6g, \"shapes\": %d }",
+                        FileSize(filename), parseSeconds, shapeSeconds, nShapes);
+}
+
+static std::string BenchmarkScene(const std::string &filename, int nTrials) {
+    // Convert the scene to a binary file in the current directory; relative
+    // filenames in it are still resolved from the scene's directory.
+    std::string binaryFilename = BaseName(filename) + "-scenebench.pbrtb";
+    {
+        BinarySceneWriter writer(binaryFilename);
+        std::vector<std::string> filenames = {filename};
+        ParseFiles(&writer, filenames);
+    }
+
+    std::string r = StringPrintf("{\n      \"text\": %s,\n      \"binary\": %s\n    }",
+                                 TimeLoad(filename, nTrials),
+                                 TimeLoad(binaryFilename, nTrials));
+    std::remove(binaryFilename.c_str());
+    return r;
+}
+
+int main(int argc, char *argv[]) {
+    PBRTOptions options;
+    options.quiet = true;
+    std::vector<std::string> filenames;
+    std::string outFile;
+    int nTrials = 3, nVertices = 1000000;
+
+    ++argv;
+    while (*argv != nullptr) {
+        if ((*argv)[0] != '-') {
+            filenames.push_back(*argv);
+            ++argv;
+            continue;
+        }
+
+        auto onError = [](const std::string &err) { usage(err); };
+        if (ParseArg(&argv, "outfile", &outFile, onError) ||
+            ParseArg(&argv, "trials", &nTrials, onError) ||
+            ParseArg(&argv, "vertices", &nVertices, onError)) {
+            // success
+        } else if ((strcmp(*argv, "--help") == 0) || (strcmp(*argv, "-help") == 0) ||
+                   (strcmp(*argv, "-h") == 0))
+            usage();
+        else
+            usage(StringPrintf("argument \"%s\" unknown", *argv));
+    }
+
+    if (nTrials < 1)
+        usage("number of trials must be positive");
+    if (nVertices < 3)
+        usage("generated mesh must have at least three vertices");
+
+    InitPBRT(options);
+
+    // Generate the mesh scenes if no scenes were given
+    std::vector<std::string> generatedFiles;
+    if (filenames.empty()) {
+        WriteMeshScene("scenebench-inline.pbrt", "", nVertices);
+        WriteMeshScene("scenebench-ply.pbrt", "scenebench.ply", nVertices);
+        filenames = {"scenebench-inline.pbrt", "scenebench-ply.pbrt"};
+        generatedFiles = {"scenebench-inline.pbrt", "scenebench-ply.pbrt",
+                          "scenebench.ply"};
+    }
+
+    std::vector<std::string> results;
+    for (const std::string &filename : filenames)
+        results.push_back(StringPrintf("    %s: %s", JSONString(filename),
+                                       BenchmarkScene(filename, nTrials)));
+
+    for (const std::string &filename : generatedFiles)
+        std::remove(filename.c_str());
+
+    std::string json =
+        StringPrintf("{\n  \"scenes\": {\n%s\n  }\n}\n", JoinStrings(results, ",\n"));
+    if (outFile.empty())
+        fputs(json.c_str(), stdout);
+    else if (!WriteFile(outFile, json))
+        ErrorExit("%s: unable to write results.", outFile);
+
+    CleanupPBRT();
+    return 0;
+}
@@ -0,0 +1,572 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/materials.h>
+#include <pbrt/options.h>
+#include <pbrt/textures.h>
+#include <pbrt/util/args.h>
+#include <pbrt/util/color.h>
+#include <pbrt/util/colorspace.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/memory.h>
+#include <pbrt/util/mipmap.h>
+#include <pbrt/util/print.h>
+#include <pbrt/util/progressreporter.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/spectrum.h>
+#include <pbrt/util/string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace pbrt;
+
+static void usage(const std::string &msg = {}) {
+    if (!msg.empty())
+        fprintf(stderr, "texturebench: %s\n\n", msg.c_str());
+
+    fprintf(stderr,
+            R"(usage: texturebench [<options>] <image...>
+
+Measures the cost of texture lookups in the given images and writes the
+results as JSON.
+
+Options:
+  --benchmarks <name,...>      Only run the given benchmarks. (Default: all)
+                               batch: a texture graph of image, scale, mix and
+                                 constant textures evaluated one point at a
+                                 time and in batches.
+                               bump: bump mapping with an image displacement
+                                 texture that is evaluated at each offset
+                                 point and with its filtered gradient.
+                               compression: image texture lookups with and
+                                 without compressed texels.
+                               filtering: MIPMap lookups with the specialized
+                                 filtering kernels and the general code.
+                               noise: Perlin noise and FBm evaluated one point
+                                 or octave at a time and with SIMD
+                                 instructions. (Doesn't use the images.)
+                               spectra: RGB image texture lookups with and
+                                 without precomputed sigmoid polynomials.
+  --filters <name,...>         Texture filters to use. (Default: bilinear,ewa)
+  --help                       Print this help text.
+  --lookups <n>                Number of texture lookups to time. (Default: 1000000)
+  --outfile <filename>         Write results to the given file. (Default: stdout)
+)");
+    exit(msg.empty() ? 0 : 1);
+}
+
+static const char *AllBenchmarkNames[] = {"batch",     "bump",  "compression",
+                                          "filtering", "noise", "spectra"};
+
+// Prevents the compiler from discarding the values computed by the
+// benchmarks.
+static volatile Float lookupSink;
+
+static std::string JSONString(const std::string &s) {
+    std::string r = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            r += '\\';
+        r += c;
+    }
+    return r + "\"";
+}
+
+static std::string JoinStrings(const std::vector<std::string> &strs,
+                               const std::string &separator) {
+    std::string r;
+    for (size_t i = 0; i < strs.size(); ++i)
+        r += (i > 0 ? separator : "") + strs[i];
+    return r;
+}
+
+// Returns texture lookup locations spread over the texture with filter
+// widths ranging from a fraction of a texel to a good part of the image.
+static std::vector<TextureEvalContext> GenerateContexts(int n) {
+    std::vector<TextureEvalContext> ctx(n);
+    RNG rng;
+    for (TextureEvalContext &c : ctx) {
+        c.uv = Point2f(rng.Uniform<Float>(), rng.Uniform<Float>());
+        Float width = std::pow(2.f, -12 + 10 * rng.Uniform<Float>());
+        Float aniso = 1 + 3 * rng.Uniform<Float>();
+        Float theta = 2 * Pi * rng.Uniform<Float>();
+        c.dudx = aniso * width * std::cos(theta);
+        c.dvdx = aniso * width * std::sin(theta);
+        c.dudy = -width * std::sin(theta);
+        c.dvdy = width * std::cos(theta);
+    }
+    return ctx;
+}
+
+// Evaluates _tex_ at each of the contexts and returns the elapsed time.
+template <typename Texture>
+static double TimeLookups(const Texture &tex, const std::vector<TextureEvalContext> &ctx,
+                          const std::vector<SampledWavelengths> &lambda,
+                          std::vector<SampledSpectrum> *values) {
+    values->resize(ctx.size());
+    Timer timer;
+    for (size_t i = 0; i < ctx.size(); ++i)
+        (*values)[i] = tex.Evaluate(ctx[i], lambda[i]);
+    double elapsed = timer.ElapsedSeconds();
+    for (const SampledSpectrum &s : *values)
+        lookupSink = lookupSink + s[0];
+    return elapsed;
+}
+
+static std::string BenchmarkSpectra(const std::string &filename,
+                                    const std::vector<std::string> &filters,
+                                    int nLookups) {
+    pstd::pmr::monotonic_buffer_resource resource;
+    Allocator alloc(&resource);
+    TextureMapping2DHandle mapping = alloc.new_object<UVMapping2D>();
+    ColorEncodingHandle encoding =
+        HasExtension(filename, "png") ? ColorEncodingHandle::sRGB
+                                      : ColorEncodingHandle::Linear;
+
+    std::vector<TextureEvalContext> ctx = GenerateContexts(nLookups);
+    std::vector<SampledWavelengths> lambda;
+    RNG rng(1);
+    for (int i = 0; i < nLookups; ++i)
+        lambda.push_back(SampledWavelengths::SampleXYZ(rng.Uniform<Float>()));
+
+    std::vector<std::string> results;
+    for (const std::string &filter : filters) {
+        // The textures are created up front so that image loading and
+        // coefficient precomputation aren't included in the timings.
+        Timer loadTimer;
+        SpectrumImageTexture rgbTex(mapping, filename, filter, 8.f, WrapMode::Repeat, 1,
+                                    encoding, alloc, false);
+        double rgbLoadSeconds = loadTimer.ElapsedSeconds();
+        loadTimer = Timer();
+        SpectrumImageTexture spectraTex(mapping, filename, filter, 8.f, WrapMode::Repeat,
+                                        1, encoding, alloc, true);
+        double spectraLoadSeconds = loadTimer.ElapsedSeconds();
+
+        std::vector<SampledSpectrum> rgbValues, spectraValues;
+        double rgbSeconds = TimeLookups(rgbTex, ctx, lambda, &rgbValues);
+        double spectraSeconds = TimeLookups(spectraTex, ctx, lambda, &spectraValues);
+
+        // Filtering in coefficient space gives slightly different results
+        // than filtering RGB, so report how different they are.
+        double sumDiff = 0, sumRef = 0;
+        for (int i = 0; i < nLookups; ++i)
+            for (int j = 0; j < NSpectrumSamples; ++j) {
+                sumDiff += std::abs(rgbValues[i][j] - spectraValues[i][j]);
+                sumRef += std::abs(rgbValues[i][j]);
+            }
+
+        results.push_back(StringPrintf(
+            "        %s: { \"rgbNanoseconds\": %.6g, \"precomputedNanoseconds\": %.6g, "
+            "\"speedup\": %.4g, \"rgbLoadSeconds\": %.4g, "
+            "\"precomputedLoadSeconds\": %.4g, \"relativeDifference\": %.4g }",
+            JSONString(filter), 1e9 * rgbSeconds / nLookups,
+            1e9 * spectraSeconds / nLookups, rgbSeconds / spectraSeconds, rgbLoadSeconds,
+            spectraLoadSeconds, sumRef > 0 ? sumDiff / sumRef : 0.));
+    }
+    ImageTextureBase::ClearCache();
+
+    return StringPrintf("{\n%s\n      }", JoinStrings(results, ",\n"));
+}
+
+static std::string BenchmarkBatch(const std::string &filename,
+                                  const std::vector<std::string> &filters,
+                                  int nLookups) {
+    pstd::pmr::monotonic_buffer_resource resource;
+    Allocator alloc(&resource);
+    TextureMapping2DHandle mapping = alloc.new_object<UVMapping2D>();
+    ColorEncodingHandle encoding =
+        HasExtension(filename, "png") ? ColorEncodingHandle::sRGB
+                                      : ColorEncodingHandle::Linear;
+
+    std::vector<TextureEvalContext> ctx = GenerateContexts(nLookups);
+    std::vector<SampledWavelengths> lambda;
+    RNG rng(1);
+    for (int i = 0; i < nLookups; ++i)
+        lambda.push_back(SampledWavelengths::SampleXYZ(rng.Uniform<Float>()));
+
+    // The number of points in each batch, which is on the order of the
+    // number of coherent shading points that a wavefront integrator might
+    // gather for a material.
+    constexpr int BatchSize = 256;
+
+    std::vector<std::string> results;
+    for (const std::string &filter : filters) {
+        // Evaluate a diffuse texture that is darkened by a scaled
+        // single-channel version of the image and blended with a constant.
+        SpectrumImageTexture image(mapping, filename, filter, 8.f, WrapMode::Repeat, 1,
+                                   encoding, alloc);
+        FloatImageTexture floatImage(mapping, filename, filter, 8.f, WrapMode::Repeat,
+                                     1, encoding, alloc);
+        if (!image.mipmap || !floatImage.mipmap)
+            ErrorExit("%s: unable to read image", filename);
+        FloatConstantTexture amount(0.75f);
+        RGBReflectanceConstantTexture constant(*RGBColorSpace::sRGB, RGB(0.2, 0.3, 0.4));
+        SpectrumScaledTexture scaled(&image, &floatImage);
+        SpectrumMixTexture mix(&constant, &scaled, &amount);
+        SpectrumTextureHandle tex(&mix);
+
+        std::vector<SampledSpectrum> pointValues(nLookups), batchValues(nLookups);
+        Timer timer;
+        for (int i = 0; i < nLookups; ++i)
+            pointValues[i] = tex.Evaluate(ctx[i], lambda[i]);
+        double pointSeconds = timer.ElapsedSeconds();
+
+        timer = Timer();
+        for (int start = 0; start < nLookups; start += BatchSize) {
+            size_t n = std::min(BatchSize, nLookups - start);
+            EvaluateBatch(tex, pstd::span<const TextureEvalContext>(&ctx[start], n),
+                          pstd::span<const SampledWavelengths>(&lambda[start], n),
+                          pstd::span<SampledSpectrum>(&batchValues[start], n));
+        }
+        double batchSeconds = timer.ElapsedSeconds();
+        for (int i = 0; i < nLookups; ++i)
+            lookupSink = lookupSink + pointValues[i][0] + batchValues[i][0];
+
+        double sumDiff = 0, sumRef = 0;
+        for (int i = 0; i < nLookups; ++i)
+            for (int j = 0; j < NSpectrumSamples; ++j) {
+                sumDiff += std::abs(pointValues[i][j] - batchValues[i][j]);
+                sumRef += std::abs(pointValues[i][j]);
+            }
+
+        results.push_back(StringPrintf(
+            "        %s: { \"pointNanoseconds\": %.6g, \"batchNanoseconds\": %.6g, "
+            "\"speedup\": %.4g, \"relativeDifference\": %.4g }",
+            JSONString(filter), 1e9 * pointSeconds / nLookups,
+            1e9 * batchSeconds / nLookups, pointSeconds / batchSeconds,
+            sumRef > 0 ? sumDiff / sumRef : 0.));
+    }
+    ImageTextureBase::ClearCache();
+
+    return StringPrintf("{\n%s\n      }", JoinStrings(results, ",\n"));
+}
+
+static std::string BenchmarkBump(const std::string &filename,
+                                 const std::vector<std::string> &filters,
+                                 int nLookups) {
+    pstd::pmr::monotonic_buffer_resource resource;
+    Allocator alloc(&resource);
+    TextureMapping2DHandle mapping = alloc.new_object<UVMapping2D>();
+    ColorEncodingHandle encoding =
+        HasExtension(filename, "png") ? ColorEncodingHandle::sRGB
+                                      : ColorEncodingHandle::Linear;
+
+    // Bump map a plane with $(u,v)$ parameterization
+    std::vector<TextureEvalContext> ctx = GenerateContexts(nLookups);
+    std::vector<BumpEvalContext> bumpCtx(nLookups);
+    for (int i = 0; i < nLookups; ++i) {
+        BumpEvalContext &b = bumpCtx[i];
+        b.p = Point3f(ctx[i].uv[0], ctx[i].uv[1], 0);
+        b.uv = ctx[i].uv;
+        b.dudx = ctx[i].dudx;
+        b.dudy = ctx[i].dudy;
+        b.dvdx = ctx[i].dvdx;
+        b.dvdy = ctx[i].dvdy;
+        b.dpdx = Vector3f(b.dudx, b.dvdx, 0);
+        b.dpdy = Vector3f(b.dudy, b.dvdy, 0);
+        b.shading.n = Normal3f(0, 0, 1);
+        b.shading.dpdu = Vector3f(1, 0, 0);
+        b.shading.dpdv = Vector3f(0, 1, 0);
+    }
+
+    std::vector<std::string> results;
+    for (const std::string &filter : filters) {
+        FloatImageTexture image(mapping, filename, filter, 8.f, WrapMode::Repeat, 1,
+                                encoding, alloc);
+        if (!image.mipmap)
+            ErrorExit("%s: unable to read image", filename);
+        FloatConstantTexture height(0.01f);
+        FloatScaledTexture displacement(&image, &height);
+
+        // Returns the time to compute the bump-mapped normals
+        auto bump = [&](auto texEval, std::vector<Normal3f> *n) {
+            n->resize(nLookups);
+            Timer timer;
+            for (int i = 0; i < nLookups; ++i) {
+                Vector3f dpdu, dpdv;
+                Bump(texEval, &displacement, bumpCtx[i], &dpdu, &dpdv);
+                (*n)[i] = Normal3f(Normalize(Cross(dpdu, dpdv)));
+            }
+            return timer.ElapsedSeconds();
+        };
+        std::vector<Normal3f> pointNormals, nearbyNormals;
+        double pointSeconds = bump(PointTextureEvaluator(), &pointNormals);
+        Options->approximateBumpGradients = true;
+        double nearbySeconds = bump(UniversalTextureEvaluator(), &nearbyNormals);
+        Options->approximateBumpGradients = false;
+
+        double sumAngle = 0;
+        for (int i = 0; i < nLookups; ++i) {
+            sumAngle += AngleBetween(pointNormals[i], nearbyNormals[i]);
+            lookupSink = lookupSink + pointNormals[i].x + nearbyNormals[i].x;
+        }
+
+        results.push_back(StringPrintf(
+            "        %s: { \"pointNanoseconds\": %.6g, \"nearbyNanoseconds\": %.6g, "
+            "\"speedup\": %.4g, \"meanAngleDegrees\": %.4g }",
+            JSONString(filter), 1e9 * pointSeconds / nLookups,
+            1e9 * nearbySeconds / nLookups, pointSeconds / nearbySeconds,
+            Degrees(sumAngle / nLookups)));
+    }
+    ImageTextureBase::ClearCache();
+
+    return StringPrintf("{\n%s\n      }", JoinStrings(results, ",\n"));
+}
+
+static std::string BenchmarkCompression(const std::string &filename,
+                                        const std::vector<std::string> &filters,
+                                        int nLookups) {
+    pstd::pmr::monotonic_buffer_resource resource;
+    Allocator alloc(&resource);
+    TextureMapping2DHandle mapping = alloc.new_object<UVMapping2D>();
+    ColorEncodingHandle encoding =
+        HasExtension(filename, "png") ? ColorEncodingHandle::sRGB
+                                      : ColorEncodingHandle::Linear;
+
+    std::vector<TextureEvalContext> ctx = GenerateContexts(nLookups);
+    std::vector<SampledWavelengths> lambda;
+    RNG rng(1);
+    for (int i = 0; i < nLookups; ++i)
+        lambda.push_back(SampledWavelengths::SampleXYZ(rng.Uniform<Float>()));
+
+    std::vector<std::string> results;
+    for (const std::string &filter : filters) {
+        SpectrumImageTexture tex(mapping, filename, filter, 8.f, WrapMode::Repeat, 1,
+                                 encoding, alloc);
+        SpectrumImageTexture compressedTex(mapping, filename, filter, 8.f,
+                                           WrapMode::Repeat, 1, encoding, alloc, false,
+                                           TextureCompression::Auto);
+        if (!tex.mipmap || !compressedTex.mipmap)
+            ErrorExit("%s: unable to read image", filename);
+
+        std::vector<SampledSpectrum> values, compressedValues;
+        double seconds = TimeLookups(tex, ctx, lambda, &values);
+        double compressedSeconds =
+            TimeLookups(compressedTex, ctx, lambda, &compressedValues);
+
+        double sumDiff = 0, sumRef = 0;
+        for (int i = 0; i < nLookups; ++i)
+            for (int j = 0; j < NSpectrumSamples; ++j) {
+                sumDiff += std::abs(values[i][j] - compressedValues[i][j]);
+                sumRef += std::abs(values[i][j]);
+            }
+
+        size_t bytes = tex.mipmap->BytesUsed();
+        size_t compressedBytes = compressedTex.mipmap->BytesUsed();
+        results.push_back(StringPrintf(
+            "        %s: { \"nanoseconds\": %.6g, \"compressedNanoseconds\": %.6g, "
+            "\"bytes\": %d, \"compressedBytes\": %d, \"memoryRatio\": %.4g, "
+            "\"relativeDifference\": %.4g }",
+            JSONString(filter), 1e9 * seconds / nLookups,
+            1e9 * compressedSeconds / nLookups, bytes, compressedBytes,
+            compressedBytes > 0 ? double(bytes) / compressedBytes : 0.,
+            sumRef > 0 ? sumDiff / sumRef : 0.));
+    }
+    ImageTextureBase::ClearCache();
+
+    return StringPrintf("{\n%s\n      }", JoinStrings(results, ",\n"));
+}
+
+static std::string BenchmarkFiltering(const std::string &filename,
+                                      const std::vector<std::string> &filters,
+                                      int nLookups) {
+    ColorEncodingHandle encoding =
+        HasExtension(filename, "png") ? ColorEncodingHandle::sRGB
+                                      : ColorEncodingHandle::Linear;
+    std::vector<TextureEvalContext> ctx = GenerateContexts(nLookups);
+
+    std::vector<std::string> results;
+    for (const std::string &filter : filters) {
+        pstd::optional<FilterFunction> filterFunction = ParseFilter(filter);
+        if (!filterFunction)
+            ErrorExit("%s: filter function unknown", filter);
+
+        // Time RGB lookups with the kernels and then with the general code
+        double seconds[2];
+        std::vector<RGB> values[2];
+        for (int scalar = 0; scalar < 2; ++scalar) {
+            MIPMapFilterOptions options;
+            options.filter = *filterFunction;
+            options.scalarFiltering = scalar;
+            std::unique_ptr<MIPMap> mipmap =
+                MIPMap::CreateFromFile(filename, options, WrapMode::Repeat, encoding, {});
+            if (!mipmap)
+                ErrorExit("%s: unable to read image", filename);
+
+            values[scalar].resize(nLookups);
+            Timer timer;
+            for (int i = 0; i < nLookups; ++i)
+                values[scalar][i] = mipmap->Lookup<RGB>(
+                    ctx[i].uv, {ctx[i].dudx, ctx[i].dvdx}, {ctx[i].dudy, ctx[i].dvdy});
+            seconds[scalar] = timer.ElapsedSeconds();
+            for (const RGB &rgb : values[scalar])
+                lookupSink = lookupSink + rgb.g;
+        }
+
+        double maxDiff = 0;
+        for (int i = 0; i < nLookups; ++i)
+            for (int c = 0; c < 3; ++c)
+                maxDiff = std::max<double>(maxDiff, std::abs(values[0][i][c] -
+                                                             values[1][i][c]));
+
+        results.push_back(StringPrintf(
+            "        %s: { \"kernelNanoseconds\": %.6g, \"scalarNanoseconds\": %.6g, "
+            "\"speedup\": %.4g, \"maxDifference\": %.4g }",
+            JSONString(filter), 1e9 * seconds[0] / nLookups,
+            1e9 * seconds[1] / nLookups, seconds[1] / seconds[0], maxDiff));
+    }
+
+    return StringPrintf("{\n%s\n      }", JoinStrings(results, ",\n"));
+}
+
+// Sums octaves of noise one at a time, as FBm() did before it evaluated
+// them with SIMD instructions.
+static Float ScalarFBm(const Point3f &p, const Vector3f &dpdx, const Vector3f &dpdy,
+                       Float omega, int maxOctaves) {
+    Float len2 = std::max(LengthSquared(dpdx), LengthSquared(dpdy));
+    Float n = Clamp(-1 - .5f * Log2(len2), 0, maxOctaves);
+    int nInt = std::floor(n);
+    Float sum = 0, lambda = 1, o = 1;
+    for (int i = 0; i < nInt; ++i) {
+        sum += o * Noise(lambda * p);
+        lambda *= 1.99f;
+        o *= omega;
+    }
+    return sum + o * SmoothStep(n - nInt, .3f, .7f) * Noise(lambda * p);
+}
+
+static std::string BenchmarkNoise(int nLookups) {
+    RNG rng;
+    std::vector<Point3f> p(nLookups);
+    for (Point3f &pt : p)
+        pt = Point3f(100 * rng.Uniform<Float>(), 100 * rng.Uniform<Float>(),
+                     100 * rng.Uniform<Float>());
+    std::vector<Float> scalar(nLookups), simd(nLookups);
+    auto report = [&](const char *name, double scalarSeconds, double simdSeconds) {
+        double maxDiff = 0;
+        for (int i = 0; i < nLookups; ++i) {
+            maxDiff = std::max<double>(maxDiff, std::abs(scalar[i] - simd[i]));
+            lookupSink = lookupSink + scalar[i] + simd[i];
+        }
+        return StringPrintf("        %s: { \"scalarNanoseconds\": %.6g, "
+                            "\"simdNanoseconds\": %.6g, \"speedup\": %.4g, "
+                            "\"maxDifference\": %.4g }",
+                            JSONString(name), 1e9 * scalarSeconds / nLookups,
+                            1e9 * simdSeconds / nLookups, scalarSeconds / simdSeconds,
+                            maxDiff);
+    };
+
+    std::vector<std::string> results;
+    Timer timer;
+    for (int i = 0; i < nLookups; ++i)
+        scalar[i] = Noise(p[i]);
+    double scalarSeconds = timer.ElapsedSeconds();
+    timer = Timer();
+    Noise(p, pstd::span<Float>(simd));
+    results.push_back(report("noise", scalarSeconds, timer.ElapsedSeconds()));
+
+    // Use differentials that give eight octaves of noise
+    Vector3f dpdx(1e-3f, 0, 0), dpdy(0, 1e-3f, 0);
+    timer = Timer();
+    for (int i = 0; i < nLookups; ++i)
+        scalar[i] = ScalarFBm(p[i], dpdx, dpdy, .5f, 8);
+    scalarSeconds = timer.ElapsedSeconds();
+    timer = Timer();
+    for (int i = 0; i < nLookups; ++i)
+        simd[i] = FBm(p[i], dpdx, dpdy, .5f, 8);
+    results.push_back(report("fbm", scalarSeconds, timer.ElapsedSeconds()));
+
+    return StringPrintf("{\n%s\n    }", JoinStrings(results, ",\n"));
+}
+
+int main(int argc, char *argv[]) {
+    PBRTOptions options;
+    options.quiet = true;
+    std::vector<std::string> filenames;
+    std::string outFile, benchmarkList, filterList = "bilinear,ewa";
+    int nLookups = 1000000;
+
+    ++argv;
+    while (*argv != nullptr) {
+        if ((*argv)[0] != '-') {
+            filenames.push_back(*argv);
+            ++argv;
+            continue;
+        }
+
+        auto onError = [](const std::string &err) { usage(err); };
+        if (ParseArg(&argv, "benchmarks", &benchmarkList, onError) ||
+            ParseArg(&argv, "filters", &filterList, onError) ||
+            ParseArg(&argv, "lookups", &nLookups, onError) ||
+            ParseArg(&argv, "outfile", &outFile, onError)) {
+            // success
+        } else if ((strcmp(*argv, "--help") == 0) || (strcmp(*argv, "-help") == 0) ||
+                   (strcmp(*argv, "-h") == 0))
+            usage();
+        else
+            usage(StringPrintf("argument \"%s\" unknown", *argv));
+    }
+
+    if (nLookups < 1)
+        usage("number of lookups must be positive");
+
+    std::vector<std::string> benchmarkNames;
+    if (benchmarkList.empty())
+        benchmarkNames.assign(std::begin(AllBenchmarkNames), std::end(AllBenchmarkNames));
+    else
+        benchmarkNames = SplitString(benchmarkList, ',');
+    std::vector<std::string> filters = SplitString(filterList, ',');
+    if (filenames.empty() &&
+        std::any_of(benchmarkNames.begin(), benchmarkNames.end(),
+                    [](const std::string &name) { return name != "noise"; }))
+        usage("must specify at least one image");
+
+    InitPBRT(options);
+
+    std::vector<std::string> results;
+    for (const std::string &name : benchmarkNames) {
+        if (name == "noise") {
+            results.push_back(
+                StringPrintf("    %s: %s", JSONString(name), BenchmarkNoise(nLookups)));
+            continue;
+        }
+        std::vector<std::string> fileResults;
+        for (const std::string &filename : filenames) {
+            std::string r;
+            if (name == "batch")
+                r = BenchmarkBatch(filename, filters, nLookups);
+            else if (name == "bump")
+                r = BenchmarkBump(filename, filters, nLookups);
+            else if (name == "compression")
+                r = BenchmarkCompression(filename, filters, nLookups);
+            else if (name == "filtering")
+                r = BenchmarkFiltering(filename, filters, nLookups);
+            else if (name == "spectra")
+                r = BenchmarkSpectra(filename, filters, nLookups);
+            else
+                usage(StringPrintf("%s: benchmark unknown", name));
+            fileResults.push_back(StringPrintf("      %s: %s", JSONString(filename), r));
+        }
+        results.push_back(StringPrintf("    %s: {\n%s\n    }", JSONString(name),
+                                       JoinStrings(fileResults, ",\n")));
+    }
+
+    std::string json =
+        StringPrintf("{\n  \"benchmarks\": {\n%s\n  }\n}\n", JoinStrings(results, ",\n"));
+    if (outFile.empty())
+        fputs(json.c_str(), stdout);
+    else if (!WriteFile(outFile, json))
+        ErrorExit("%s: unable to write results.", outFile);
+
+    CleanupPBRT();
+    return 0;
+}
@@ -7,6 +7,7 @@
 #include <pbrt/bsdf.h>
 #include <pbrt/bssrdf.h>
 #include <pbrt/cameras.h>
+#include <pbrt/cpu/wavefront.h>
 #include <pbrt/film.h>
 #include <pbrt/filters.h>
 #include <pbrt/interaction.h>
@@ -38,6 +39,11 @@
 #include <pbrt/util/stats.h>
 #include <pbrt/util/string.h>
 
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
 namespace pbrt {
 
 STAT_COUNTER("Integrator/Camera rays traced", nCameraRays);
@@ -108,7 +114,68 @@ SampledSpectrum RandomWalkIntegrator::RandomWalk(RayDifferential ray,
 // Integrator Method Definitions
 Integrator::~Integrator() {}
 
+// RenderCheckpoint Definition
+struct RenderCheckpoint {
+    // RenderCheckpoint::Header Definition
+    struct Header {
+        char magic[8];
+        int seed, samplesPerPixel, samplerType;
+        int sampleStart, sampleEnd;
+        int startWave, endWave, waveDelta;
+        double elapsedSeconds;
+    };
+
+    Header header;
+    FilmState filmState;
+};
+
+static constexpr char checkpointMagic[8] = {'p', 'b', 'r', 't', 'c', 'k', 'p', '1'};
+
+// RenderCheckpoint Function Definitions
+static bool WriteCheckpoint(const std::string &filename, const RenderCheckpoint &ckpt) {
+    // Write to a temporary file and then rename it so that a partially
+    // written checkpoint never replaces a valid one.
+    std::string tmpFilename = filename + ".tmp";
+    FILE *f = fopen(tmpFilename.c_str(), "wb");
+    if (!f) {
+        Warning("%s: unable to open checkpoint file: %s", tmpFilename, ErrorString());
+        return false;
+    }
+    bool success = fwrite(&ckpt.header, sizeof(ckpt.header), 1, f) == 1 &&
+                   ckpt.filmState.Write(f);
+    if (fclose(f) != 0)
+        success = false;
+    if (!success || std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        Warning("%s: error writing checkpoint: %s", filename, ErrorString());
+        std::remove(tmpFilename.c_str());
+        return false;
+    }
+    return true;
+}
+
+static pstd::optional<RenderCheckpoint> ReadCheckpoint(const std::string &filename) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f)
+        return {};
+    RenderCheckpoint ckpt;
+    bool success = fread(&ckpt.header, sizeof(ckpt.header), 1, f) == 1 &&
+                   memcmp(ckpt.header.magic, checkpointMagic, sizeof(checkpointMagic)) ==
+                       0 &&
+                   ckpt.filmState.Read(f);
+    fclose(f);
+    if (!success)
+        ErrorExit("%s: checkpoint file is corrupt or from another version of pbrt.",
+                  filename);
+    return ckpt;
+}
+
 // ImageTileIntegrator Method Definitions
+static std::atomic<bool> stopRequested{false};
+
+void ImageTileIntegrator::RequestStop() {
+    stopRequested = true;
+}
+
 void ImageTileIntegrator::Render() {
     // Handle debugStart, if set
     if (!Options->debugStart.empty()) {
@@ -144,7 +211,13 @@ void ImageTileIntegrator::Render() {
     // Declare common variables for rendering image in tiles
     Bounds2i pixelBounds = camera.GetFilm().PixelBounds();
     int spp = samplerPrototype.SamplesPerPixel();
-    int startWave = 0, endWave = 1, waveDelta = 1;
+    // Compute range of sample indices to render in each pixel
+    int sampleStart = Options->sampleRangeStart;
+    int sampleEnd = std::min(spp, Options->sampleRangeEnd.value_or(spp));
+    if (sampleStart < 0 || sampleStart >= sampleEnd)
+        ErrorExit("Sample range [%d, %d) is empty or invalid for %d samples per pixel.",
+                  sampleStart, sampleEnd, spp);
+    int startWave = sampleStart, endWave = sampleStart + 1, waveDelta = 1;
 
     std::vector<ScratchBuffer> scratchBuffers;
     for (int i = 0; i < MaxThreadIndex(); ++i)
@@ -153,8 +226,42 @@ void ImageTileIntegrator::Render() {
     std::vector<SamplerHandle> samplers =
         samplerPrototype.Clone(MaxThreadIndex(), Allocator());
 
-    ProgressReporter progress(int64_t(spp) * pixelBounds.Area(), "Rendering",
-                              Options->quiet);
+    ProgressReporter progress(int64_t(sampleEnd - sampleStart) * pixelBounds.Area(),
+                              "Rendering", Options->quiet);
+
+    // Restore rendering state from checkpoint, if requested
+    double resumedSeconds = 0;
+    bool resumed = false;
+    if (Options->resume) {
+        if (pstd::optional<RenderCheckpoint> ckpt =
+                ReadCheckpoint(Options->checkpointFile)) {
+            const RenderCheckpoint::Header &header = ckpt->header;
+            if (header.seed != Options->seed || header.samplesPerPixel != spp ||
+                header.samplerType != samplerPrototype.Tag() ||
+                header.sampleStart != sampleStart || header.sampleEnd != sampleEnd)
+                ErrorExit("%s: checkpoint was made with a different sampler, sample "
+                          "count, or seed than the current render.",
+                          Options->checkpointFile);
+            if (header.startWave <= sampleStart || header.startWave >= sampleEnd ||
+                header.endWave <= header.startWave || header.endWave > sampleEnd)
+                ErrorExit("%s: invalid sample range in checkpoint.",
+                          Options->checkpointFile);
+            // Sampler and RNG state are entirely determined by the pixel,
+            // sample index, and seed, so the film and the next sample index
+            // are all that need to be restored.
+            camera.GetFilm().SetState(ckpt->filmState);
+            startWave = header.startWave;
+            endWave = header.endWave;
+            waveDelta = header.waveDelta;
+            resumedSeconds = header.elapsedSeconds;
+            resumed = true;
+            progress.Update(int64_t(startWave - sampleStart) * pixelBounds.Area());
+            LOG_VERBOSE("Resumed rendering at sample index %d from %s", startWave,
+                        Options->checkpointFile);
+        } else
+            Warning("%s: checkpoint not found. Rendering from the start.",
+                    Options->checkpointFile);
+    }
 
     if (Options->recordPixelStatistics)
         StatsEnablePixelStats(pixelBounds,
@@ -185,7 +292,7 @@ void ImageTileIntegrator::Render() {
         *referenceImage = referenceImage->Crop(cropBounds);
         CHECK_EQ(referenceImage->Resolution(), Point2i(pixelBounds.Diagonal()));
 
-        mseOutFile = fopen(Options->mseReferenceOutput.c_str(), "w");
+        mseOutFile = fopen(Options->mseReferenceOutput.c_str(), resumed ? "a" : "w");
         if (!mseOutFile)
             ErrorExit("%s: %s", Options->mseReferenceOutput, ErrorString());
     }
@@ -206,7 +313,14 @@ void ImageTileIntegrator::Render() {
                        });
     }
 
-    while (startWave < spp) {
+    // Checkpoints are written in a separate thread so that rendering only
+    // pauses for the time it takes to copy the film's pixels.
+    std::thread checkpointThread;
+    std::atomic<bool> checkpointInFlight{false};
+    Timer checkpointTimer;
+
+    bool stopped = false;
+    while (startWave < sampleEnd) {
         // Render image tiles in parallel
         ParallelFor2D(pixelBounds, [&](Bounds2i tileBounds) {
             // Render image tile given by _tileBounds_
@@ -233,27 +347,88 @@ void ImageTileIntegrator::Render() {
 
         // Update start and end wave
         startWave = endWave;
-        endWave = std::min(spp, endWave + waveDelta);
+        endWave = std::min(sampleEnd, endWave + waveDelta);
         if (!referenceImage)
             waveDelta = std::min(2 * waveDelta, 64);
 
         // Write current image to disk
-        LOG_VERBOSE("Writing image with spp = %d", startWave);
+        int samplesTaken = startWave - sampleStart;
+        LOG_VERBOSE("Writing image with spp = %d", samplesTaken);
         ImageMetadata metadata;
-        metadata.renderTimeSeconds = progress.ElapsedSeconds();
-        metadata.samplesPerPixel = startWave;
+        metadata.renderTimeSeconds = resumedSeconds + progress.ElapsedSeconds();
+        metadata.samplesPerPixel = samplesTaken;
         if (referenceImage) {
             ImageMetadata filmMetadata;
-            Image filmImage = camera.GetFilm().GetImage(&filmMetadata, 1.f / startWave);
+            Image filmImage =
+                camera.GetFilm().GetImage(&filmMetadata, 1.f / samplesTaken);
             ImageChannelValues mse =
                 filmImage.MSE(filmImage.AllChannelsDesc(), *referenceImage);
-            fprintf(mseOutFile, "%d, %.9g\n", startWave, mse.Average());
+            fprintf(mseOutFile, "%d, %.9g\n", samplesTaken, mse.Average());
             metadata.MSE = mse.Average();
             fflush(mseOutFile);
         }
         camera.InitMetadata(&metadata);
-        camera.GetFilm().WriteImage(metadata, 1.0f / startWave);
+        // Only the raw film state is written when rendering a partial result
+        if (Options->filmStateFile.empty())
+            camera.GetFilm().WriteImage(metadata, 1.0f / samplesTaken);
+
+        // Write checkpoint if enough time has passed since the last one or
+        // if rendering is stopping
+        stopped = stopRequested.exchange(false) && startWave < sampleEnd;
+        bool checkpointDue =
+            stopped || (checkpointTimer.ElapsedSeconds() >= Options->checkpointInterval &&
+                        !checkpointInFlight);
+        if (!Options->checkpointFile.empty() && startWave < sampleEnd && checkpointDue) {
+            if (checkpointThread.joinable())
+                checkpointThread.join();
+            RenderCheckpoint ckpt;
+            memcpy(ckpt.header.magic, checkpointMagic, sizeof(checkpointMagic));
+            ckpt.header.seed = Options->seed;
+            ckpt.header.samplesPerPixel = spp;
+            ckpt.header.sampleStart = sampleStart;
+            ckpt.header.sampleEnd = sampleEnd;
+            ckpt.header.samplerType = samplerPrototype.Tag();
+            ckpt.header.startWave = startWave;
+            ckpt.header.endWave = endWave;
+            ckpt.header.waveDelta = waveDelta;
+            ckpt.header.elapsedSeconds = *metadata.renderTimeSeconds;
+            ckpt.filmState = camera.GetFilm().GetState();
+
+            checkpointInFlight = true;
+            checkpointTimer = Timer();
+            checkpointThread = std::thread(
+                [ckpt = std::move(ckpt), &checkpointInFlight]() {
+                    if (WriteCheckpoint(Options->checkpointFile, ckpt))
+                        LOG_VERBOSE("Wrote checkpoint at sample index %d to %s",
+                                    ckpt.header.startWave, Options->checkpointFile);
+                    checkpointInFlight = false;
+                });
+        }
+        if (stopped)
+            break;
     }
+    if (checkpointThread.joinable())
+        checkpointThread.join();
+    if (stopped) {
+        if (!Options->checkpointFile.empty())
+            Warning("Rendering stopped after %d samples per pixel. Run with \"--resume\" "
+                    "to continue from %s.",
+                    startWave - sampleStart, Options->checkpointFile);
+        else
+            Warning("Rendering stopped after %d samples per pixel.",
+                    startWave - sampleStart);
+    } else if (!Options->checkpointFile.empty())
+        // The checkpoint is stale once the image is complete
+        std::remove(Options->checkpointFile.c_str());
+
+    // Write unnormalized film state for later merging, if requested
+    if (!Options->filmStateFile.empty() && !stopped) {
+        FilmState state = camera.GetFilm().GetState();
+        state.sampleCount = sampleEnd - sampleStart;
+        if (!state.WriteFile(Options->filmStateFile))
+            ErrorExit("%s: unable to write film state.", Options->filmStateFile);
+    }
+
     if (mseOutFile)
         fclose(mseOutFile);
     progress.Done();
@@ -3260,6 +3435,9 @@ std::unique_ptr<Integrator> Integrator::Create(
     else if (name == "volpath")
         integrator = VolPathIntegrator::Create(parameters, camera, sampler, aggregate,
                                                lights, loc);
+    else if (name == "wavefront")
+        integrator = WavefrontPathIntegrator::Create(parameters, camera, sampler,
+                                                     aggregate, lights, loc);
     else if (name == "bdpt")
         integrator =
             BDPTIntegrator::Create(parameters, camera, sampler, aggregate, lights, loc);
@@ -94,6 +94,11 @@ class ImageTileIntegrator : public Integrator {
 
     void Render();
 
+    // Asks Render() to return once the current pass over the image is
+    // done, writing a checkpoint first if checkpointing is enabled. This may
+    // be called from a signal handler.
+    static void RequestStop();
+
     virtual void EvaluatePixelSample(const Point2i &pPixel, int sampleIndex,
                                      SamplerHandle sampler,
                                      ScratchBuffer &scratchBuffer) = 0;
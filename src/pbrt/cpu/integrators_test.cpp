@@ -7,6 +7,7 @@
 #include <pbrt/cameras.h>
 #include <pbrt/cpu/accelerators.h>
 #include <pbrt/cpu/integrators.h>
+#include <pbrt/cpu/wavefront.h>
 #include <pbrt/filters.h>
 #include <pbrt/lights.h>
 #include <pbrt/materials.h>
@@ -263,6 +264,8 @@ std::vector<std::pair<SamplerHandle, std::string>> GetSamplers(
     samplers.push_back(
         std::make_pair(new StratifiedSampler(16, 16, true), "Stratified 16x16"));
     samplers.push_back(std::make_pair(new PMJ02BNSampler(256), "PMJ02bn 256"));
+    samplers.push_back(std::make_pair(
+        new ZSobolSampler(256, resolution, RandomizeStrategy::Owen), "ZSobol 256"));
 
     return samplers;
 }
@@ -347,6 +350,25 @@ std::vector<TestIntegrator> GetIntegrators() {
                  scene});
         }
 
+        // Wavefront path tracing (perspective only)
+        for (auto &sampler : GetSamplers(resolution)) {
+            FilterHandle filter = new BoxFilter(Vector2f(0.5, 0.5));
+            RGBFilm *film = new RGBFilm(Sensor::CreateDefault(), resolution,
+                                        Bounds2i(Point2i(0, 0), resolution), filter, 1.,
+                                        inTestDir("test.exr"), 1., RGBColorSpace::sRGB);
+            PerspectiveCamera *camera = new PerspectiveCamera(
+                CameraTransform(identity), Bounds2f(Point2f(-1, -1), Point2f(1, 1)), 0.,
+                1., 0., 10., 45, film, nullptr);
+            const FilmHandle filmp = camera->GetFilm();
+
+            Integrator *integrator = new WavefrontPathIntegrator(
+                8, camera, sampler.first, scene.aggregate, scene.lights);
+            integrators.push_back({integrator, filmp,
+                                   "Wavefront, depth 8, Perspective, " + sampler.second +
+                                       ", " + scene.description,
+                                   scene});
+        }
+
         // Simple path (perspective only, still sample light and BSDFs). Yolo
         for (auto &sampler : GetSamplers(resolution)) {
             FilterHandle filter = new BoxFilter(Vector2f(0.5, 0.5));
@@ -428,3 +450,63 @@ TEST_P(RenderTest, RadianceMatches) {
 
 INSTANTIATE_TEST_CASE_P(AnalyticTestScenes, RenderTest,
                         testing::ValuesIn(GetIntegrators()));
+
+TEST(ImageTileIntegrator, ResumeMatchesUninterrupted) {
+    TestScene scene = GetScenes()[0];
+    Point2i resolution(10, 10);
+    static Transform id;
+    AnimatedTransform identity(id, 0, id, 1);
+
+    // Returns the image from rendering the scene, using a new film and
+    // integrator each time as a separate run of pbrt would.
+    auto render = [&]() {
+        FilterHandle filter = new BoxFilter(Vector2f(0.5, 0.5));
+        RGBFilm *film = new RGBFilm(Sensor::CreateDefault(), resolution,
+                                    Bounds2i(Point2i(0, 0), resolution), filter, 1.,
+                                    inTestDir("test.exr"), 1., RGBColorSpace::sRGB);
+        PerspectiveCamera *camera = new PerspectiveCamera(
+            CameraTransform(identity), Bounds2f(Point2f(-1, -1), Point2f(1, 1)), 0.,
+            1., 0., 10., 45, film, nullptr);
+        SamplerHandle sampler = new SobolSampler(16, resolution, RandomizeStrategy::Owen);
+        Integrator *integrator =
+            new PathIntegrator(8, camera, sampler, scene.aggregate, scene.lights);
+        integrator->Render();
+        delete integrator;
+
+        ImageMetadata metadata;
+        return camera->GetFilm().GetImage(&metadata);
+    };
+
+    Image reference = render();
+
+    // Stop after the first pass over the image and then resume.
+    PBRTOptions savedOptions = *Options;
+    Options->checkpointFile = inTestDir("test.pbrtckpt");
+    Options->checkpointInterval = 1e6;
+    ImageTileIntegrator::RequestStop();
+    render();
+    auto checkpointExists = []() {
+        FILE *f = fopen(Options->checkpointFile.c_str(), "rb");
+        if (f)
+            fclose(f);
+        return f != nullptr;
+    };
+    EXPECT_TRUE(checkpointExists());
+
+    Options->resume = true;
+    Image resumed = render();
+    // The checkpoint should be removed once rendering is done.
+    EXPECT_FALSE(checkpointExists());
+    *Options = savedOptions;
+
+    ASSERT_EQ(reference.Resolution(), resumed.Resolution());
+    ASSERT_EQ(reference.NChannels(), resumed.NChannels());
+    for (int y = 0; y < resolution.y; ++y)
+        for (int x = 0; x < resolution.x; ++x)
+            for (int c = 0; c < reference.NChannels(); ++c)
+                EXPECT_EQ(reference.GetChannel({x, y}, c),
+                          resumed.GetChannel({x, y}, c))
+                    << "pixel (" << x << ", " << y << ") channel " << c;
+
+    EXPECT_EQ(0, remove(inTestDir("test.exr").c_str()));
+}
@@ -12,54 +12,76 @@
 #include <pbrt/lights.h>
 #include <pbrt/materials.h>
 #include <pbrt/media.h>
+#include <pbrt/options.h>
 #include <pbrt/parsedscene.h>
 #include <pbrt/samplers.h>
 #include <pbrt/shapes.h>
 #include <pbrt/textures.h>
+#include <pbrt/parser.h>
+#include <pbrt/util/args.h>
 #include <pbrt/util/colorspace.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/ipc.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/progressreporter.h>
+
+#include <cstdlib>
+#include <map>
+#ifndef PBRT_IS_WINDOWS
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 namespace pbrt {
 
-void CPURender(ParsedScene &parsedScene) {
-    Allocator alloc;
+// CPUScene Definition
+// Holds the parts of a scene that don't depend on the camera, film, or
+// sampler, so that the scene can be rendered from multiple viewpoints after
+// it has been built once.
+class CPUScene {
+  public:
+    // CPUScene Public Methods
+    CPUScene(ParsedScene &parsedScene);
 
-    // Create media first (so have them for the camera...)
-    std::map<std::string, MediumHandle> media = parsedScene.CreateMedia(alloc);
+    std::string Render(const CameraSceneEntity &cameraEntity);
 
-    bool haveScatteringMedia = false;
-    auto findMedium = [&media, &haveScatteringMedia](const std::string &s,
-                                                     const FileLoc *loc) -> MediumHandle {
-        if (s.empty())
-            return nullptr;
+    std::unique_ptr<Integrator> CreateIntegrator(const CameraSceneEntity &cameraEntity,
+                                                 Allocator alloc, FilmHandle *film);
 
-        auto iter = media.find(s);
-        if (iter == media.end())
-            ErrorExit(loc, "%s: medium not defined", s);
-        haveScatteringMedia = true;
-        return iter->second;
-    };
+  private:
+    // CPUScene Private Methods
+    MediumHandle FindMedium(const std::string &name, const FileLoc *loc);
 
-    // Filter
-    FilterHandle filter =
-        FilterHandle::Create(parsedScene.filter.name, parsedScene.filter.parameters,
-                             &parsedScene.filter.loc, alloc);
-
-    // Film
-    FilmHandle film =
-        FilmHandle::Create(parsedScene.film.name, parsedScene.film.parameters,
-                           &parsedScene.film.loc, filter, alloc);
+    // CPUScene Private Members
+    ParsedScene &parsedScene;
+    std::map<std::string, MediumHandle> media;
+    std::vector<LightHandle> lights;
+    PrimitiveHandle accel = nullptr;
+    bool haveScatteringMedia = false;
+};
+
+// CPUScene Method Definitions
+MediumHandle CPUScene::FindMedium(const std::string &s, const FileLoc *loc) {
+    if (s.empty())
+        return nullptr;
+
+    auto iter = media.find(s);
+    if (iter == media.end())
+        ErrorExit(loc, "%s: medium not defined", s);
+    haveScatteringMedia = true;
+    return iter->second;
+}
 
-    // Camera
-    MediumHandle cameraMedium =
-        findMedium(parsedScene.camera.medium, &parsedScene.camera.loc);
-    CameraHandle camera = CameraHandle::Create(
-        parsedScene.camera.name, parsedScene.camera.parameters, cameraMedium,
-        parsedScene.camera.cameraTransform, film, &parsedScene.camera.loc, alloc);
+CPUScene::CPUScene(ParsedScene &parsedScene) : parsedScene(parsedScene) {
+    Allocator alloc;
 
-    // Create _Sampler_ for rendering
-    SamplerHandle sampler = SamplerHandle::Create(
-        parsedScene.sampler.name, parsedScene.sampler.parameters,
-        camera.GetFilm().FullResolution(), &parsedScene.sampler.loc, alloc);
+    // Create media first (so have them for the camera...)
+    media = parsedScene.CreateMedia(alloc);
+    auto findMedium = [this](const std::string &s, const FileLoc *loc) {
+        return FindMedium(s, loc);
+    };
+    findMedium(parsedScene.camera.medium, &parsedScene.camera.loc);
 
     // Textures
     std::map<std::string, FloatTextureHandle> floatTextures;
@@ -80,18 +102,8 @@ void CPURender(ParsedScene &parsedScene) {
             haveSubsurface = true;
 
     // Lights (area lights will be done later, with shapes...)
-    std::vector<LightHandle> lights;
+    lights = parsedScene.CreateLights(alloc, findMedium);
     lights.reserve(parsedScene.lights.size() + parsedScene.areaLights.size());
-    for (const auto &light : parsedScene.lights) {
-        MediumHandle outsideMedium = findMedium(light.medium, &light.loc);
-        if (light.renderFromObject.IsAnimated())
-            Warning(&light.loc,
-                    "Animated lights aren't supported. Using the start transform.");
-        LightHandle l = LightHandle::Create(
-            light.name, light.parameters, light.renderFromObject.startTransform,
-            parsedScene.camera.cameraTransform, outsideMedium, &light.loc, alloc);
-        lights.push_back(l);
-    }
 
     // Primitives
     auto getAlphaTexture = [&](const ParameterDictionary &parameters,
@@ -285,16 +297,22 @@ void CPURender(ParsedScene &parsedScene) {
     }
 
     // Accelerator
-    PrimitiveHandle accel = nullptr;
     if (!primitives.empty())
         accel = CreateAccelerator(parsedScene.accelerator.name, std::move(primitives),
                                   parsedScene.accelerator.parameters);
 
-    // Integrator
-    const RGBColorSpace *integratorColorSpace = parsedScene.film.parameters.ColorSpace();
-    std::unique_ptr<Integrator> integrator(Integrator::Create(
-        parsedScene.integrator.name, parsedScene.integrator.parameters, camera, sampler,
-        accel, lights, integratorColorSpace, &parsedScene.integrator.loc));
+    // The wavefront integrator would silently render such scenes incorrectly
+    if (parsedScene.integrator.name == "wavefront") {
+        if (haveScatteringMedia)
+            ErrorExit(&parsedScene.integrator.loc,
+                      "Scene has participating media, which the \"wavefront\" "
+                      "integrator doesn't support. Use the \"volpath\" integrator.");
+        if (haveSubsurface)
+            ErrorExit(&parsedScene.integrator.loc,
+                      "Some objects in the scene have subsurface scattering, which "
+                      "the \"wavefront\" integrator doesn't support. Use the "
+                      "\"volpath\" integrator.");
+    }
 
     // Helpful warnings
     if (haveScatteringMedia && parsedScene.integrator.name != "volpath" &&
@@ -326,15 +344,513 @@ void CPURender(ParsedScene &parsedScene) {
                 parsedScene.integrator.name);
 
     LOG_VERBOSE("Memory used after scene creation: %d", GetCurrentRSS());
+}
+
+// Returns the name of the file that rendering with _film_ writes.
+static std::string RenderedFilename(FilmHandle film) {
+    return Options->filmStateFile.empty() ? film.GetFilename() : Options->filmStateFile;
+}
+
+std::string CPUScene::Render(const CameraSceneEntity &cameraEntity) {
+    // Allocate the film, camera, and sampler from a memory resource that
+    // is released after rendering, since the scene may be rendered again
+    pstd::pmr::monotonic_buffer_resource viewResource;
+    FilmHandle film;
+    std::unique_ptr<Integrator> integrator =
+        CreateIntegrator(cameraEntity, Allocator(&viewResource), &film);
 
     // Render!
     integrator->Render();
 
     LOG_VERBOSE("Memory used after rendering: %s", GetCurrentRSS());
+    return RenderedFilename(film);
+}
 
+// Creates the filter, film, camera, sampler, and integrator for rendering
+// the scene from the given camera, allocating them with _alloc_.
+std::unique_ptr<Integrator> CPUScene::CreateIntegrator(
+    const CameraSceneEntity &cameraEntity, Allocator alloc, FilmHandle *film) {
+    // Filter
+    FilterHandle filter =
+        FilterHandle::Create(parsedScene.filter.name, parsedScene.filter.parameters,
+                             &parsedScene.filter.loc, alloc);
+
+    // Film
+    *film = FilmHandle::Create(parsedScene.film.name, parsedScene.film.parameters,
+                               &parsedScene.film.loc, filter, alloc);
+
+    // Camera
+    MediumHandle cameraMedium = FindMedium(cameraEntity.medium, &cameraEntity.loc);
+    if (cameraMedium && parsedScene.integrator.name == "wavefront")
+        ErrorExit(&cameraEntity.loc, "The \"wavefront\" integrator doesn't support "
+                                     "cameras inside participating media.");
+    CameraHandle camera = CameraHandle::Create(
+        cameraEntity.name, cameraEntity.parameters, cameraMedium,
+        cameraEntity.cameraTransform, *film, &cameraEntity.loc, alloc);
+
+    // Create _Sampler_ for rendering
+    SamplerHandle sampler = SamplerHandle::Create(
+        parsedScene.sampler.name, parsedScene.sampler.parameters,
+        camera.GetFilm().FullResolution(), &parsedScene.sampler.loc, alloc);
+
+    // Integrator
+    const RGBColorSpace *integratorColorSpace = parsedScene.film.parameters.ColorSpace();
+    std::unique_ptr<Integrator> integrator(Integrator::Create(
+        parsedScene.integrator.name, parsedScene.integrator.parameters, camera, sampler,
+        accel, lights, integratorColorSpace, &parsedScene.integrator.loc));
+
+    if (!Options->checkpointFile.empty() &&
+        !dynamic_cast<ImageTileIntegrator *>(integrator.get()))
+        Warning("The \"%s\" integrator doesn't support checkpointing. Ignoring "
+                "\"--checkpoint\".",
+                parsedScene.integrator.name);
+    return integrator;
+}
+
+static void CleanupScene() {
     PtexTextureBase::ReportStats();
     ImageTextureBase::ClearCache();
     FreeBufferCaches();
 }
 
+void CPURender(ParsedScene &parsedScene) {
+    CPUScene scene(parsedScene);
+    scene.Render(parsedScene.camera);
+    CleanupScene();
+}
+
+
+// Parses the camera given by _statements_, which should include a "Camera"
+// directive and the transformations that precede it, into _view_. The
+// camera is then expressed in _parsedScene_'s rendering coordinate system so
+// that it can be used with the already-created scene.
+static const CameraSceneEntity &ParseCamera(const std::string &statements,
+                                            const ParsedScene &parsedScene,
+                                            ParsedScene *view) {
+    ParseString(view, statements);
+    view->camera.cameraTransform =
+        CameraTransform(view->camera.cameraTransform.WorldFromCamera(),
+                        parsedScene.camera.cameraTransform.WorldFromRender());
+    return view->camera;
+}
+
+// Multiple Camera Rendering Definitions
+// CameraListScene records every camera in a file of scene description
+// statements. The current transformation is reset after each "Camera"
+// statement so that each camera is specified independently.
+class CameraListScene : public ParsedScene {
+  public:
+    void Camera(const std::string &name, ParsedParameterVector params, FileLoc loc) {
+        ParsedScene::Camera(name, std::move(params), loc);
+        cameras.push_back(camera);
+        Identity(loc);
+    }
+
+    std::vector<CameraSceneEntity> cameras;
+};
+
+// Returns the image filename for the given view, found by adding the view
+// index to the filename that the film would otherwise use.
+static std::string ViewFilename(const ParsedScene &parsedScene, int index) {
+    std::string filename = Options->imageFile;
+    if (filename.empty())
+        filename = parsedScene.film.parameters.GetOneString("filename", "pbrt.exr");
+    std::string base = RemoveExtension(filename);
+    return base + StringPrintf("_%04d", index) + filename.substr(base.size());
+}
+
+void CPURenderCameras(ParsedScene &parsedScene, const std::string &camerasFilename,
+                      int nFrames) {
+    // Determine the cameras to render the scene with
+    CameraListScene cameraList;
+    std::vector<CameraSceneEntity> cameras;
+    if (!camerasFilename.empty()) {
+        std::vector<std::string> filenames = {camerasFilename};
+        ParseFiles(&cameraList, filenames);
+        if (cameraList.cameras.empty())
+            ErrorExit("%s: no \"Camera\" statements found.", camerasFilename);
+        Transform worldFromRender = parsedScene.camera.cameraTransform.WorldFromRender();
+        for (CameraSceneEntity camera : cameraList.cameras) {
+            camera.cameraTransform = CameraTransform(
+                camera.cameraTransform.WorldFromCamera(), worldFromRender);
+            cameras.push_back(camera);
+        }
+    } else {
+        // Sample the scene camera's animation at _nFrames_ evenly-spaced times
+        CHECK_GT(nFrames, 0);
+        const CameraTransform &cameraTransform = parsedScene.camera.cameraTransform;
+        AnimatedTransform worldFromCamera = cameraTransform.WorldFromCamera();
+        if (!worldFromCamera.IsAnimated())
+            Warning(&parsedScene.camera.loc,
+                    "Camera isn't animated; all %d frames will be the same.", nFrames);
+        for (int i = 0; i < nFrames; ++i) {
+            Float t = Lerp(nFrames > 1 ? Float(i) / (nFrames - 1) : Float(0.5),
+                           worldFromCamera.startTime, worldFromCamera.endTime);
+            CameraSceneEntity camera = parsedScene.camera;
+            camera.cameraTransform =
+                CameraTransform(AnimatedTransform(worldFromCamera.Interpolate(t)),
+                                cameraTransform.WorldFromRender());
+            cameras.push_back(camera);
+        }
+    }
+
+    // Create the scene once and render it from each camera
+    CPUScene scene(parsedScene);
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        PBRTOptions savedOptions = *Options;
+        Options->imageFile = ViewFilename(parsedScene, i);
+        if (!Options->quiet)
+            Printf("Rendering camera %d of %d to \"%s\"\n", int(i + 1),
+                   int(cameras.size()), Options->imageFile);
+        scene.Render(cameras[i]);
+        *Options = savedOptions;
+    }
+
+    CleanupScene();
+}
+
+// Render Server Definitions
+// Requests to the render server are messages of the form
+//
+//   int length, uint8_t RenderServerDirective, int n, n NUL-terminated strings
+//
+// where the strings are pbrt command-line arguments that override the
+// ones the server was started with for a single rendering. The server
+// replies to each render request with
+//
+//   int length, uint8_t success, NUL-terminated string
+//
+// where the string is the name of the file written or an error message.
+enum RenderServerDirective : uint8_t { RenderRequest = 0, ShutdownRequest = 1 };
+
+// Updates _Options_ with the given render request arguments and returns
+// an empty string, or returns an error message if they're invalid.
+static std::string ApplyRenderRequestArguments(const std::vector<std::string> &args,
+                                               std::string *cameraStatements) {
+    std::vector<char *> argPtrs;
+    for (const std::string &arg : args)
+        argPtrs.push_back(const_cast<char *>(arg.c_str()));
+    argPtrs.push_back(nullptr);
+
+    std::string error;
+    auto onError = [&error](const std::string &err) { error = err; };
+    char **argv = argPtrs.data();
+    while (*argv != nullptr && error.empty()) {
+        std::string cropWindow, pixelBounds;
+        if ((*argv)[0] != '-') {
+            error = StringPrintf("\"%s\": unexpected argument", *argv);
+        } else if (ParseArg(&argv, "cropwindow", &cropWindow, onError)) {
+            pstd::optional<std::vector<Float>> c = SplitStringToFloats(cropWindow, ',');
+            if (!c || c->size() != 4)
+                error = "Didn't find four values after --cropwindow";
+            else
+                Options->cropWindow =
+                    Bounds2f(Point2f((*c)[0], (*c)[2]), Point2f((*c)[1], (*c)[3]));
+        } else if (ParseArg(&argv, "pixelbounds", &pixelBounds, onError)) {
+            pstd::optional<std::vector<int>> p = SplitStringToInts(pixelBounds, ',');
+            if (!p || p->size() != 4)
+                error = "Didn't find four integer values after --pixelbounds";
+            else
+                Options->pixelBounds =
+                    Bounds2i(Point2i((*p)[0], (*p)[2]), Point2i((*p)[1], (*p)[3]));
+        } else if (ParseArg(&argv, "camera", cameraStatements, onError) ||
+                   ParseArg(&argv, "film-state", &Options->filmStateFile, onError) ||
+                   ParseArg(&argv, "outfile", &Options->imageFile, onError) ||
+                   ParseArg(&argv, "seed", &Options->seed, onError) ||
+                   ParseArg(&argv, "spp", &Options->pixelSamples, onError)) {
+            // success
+        } else if (error.empty())
+            error = StringPrintf("\"%s\": unknown argument", *argv);
+    }
+    return error;
+}
+
+void CPURenderServer(ParsedScene &parsedScene, const std::string &address) {
+    CPUScene scene(parsedScene);
+    IPCListener listener(address);
+    if (!Options->quiet)
+        Printf("Scene ready. Listening for render requests on %s.\n", address);
+
+    bool shutdown = false;
+    while (!shutdown) {
+        std::unique_ptr<IPCChannel> channel = listener.Accept();
+        if (!channel)
+            continue;
+
+        std::vector<uint8_t> message;
+        while (!shutdown && channel->Receive(&message)) {
+            // Decode request
+            const uint8_t *ptr = message.data() + sizeof(int);
+            const uint8_t *end = message.data() + message.size();
+            uint8_t directive;
+            int nArgs = 0;
+            std::vector<std::string> args;
+            bool valid = Deserialize(&ptr, end, &directive);
+            if (valid && directive == ShutdownRequest) {
+                shutdown = true;
+                continue;
+            }
+            valid &= directive == RenderRequest && Deserialize(&ptr, end, &nArgs);
+            for (int i = 0; valid && i < nArgs; ++i) {
+                args.push_back({});
+                valid = Deserialize(&ptr, end, &args.back());
+            }
+
+            // Render the scene with the request's options
+            std::string result;
+            bool success = false;
+            PBRTOptions savedOptions = *Options;
+            std::string cameraStatements;
+            if (!valid)
+                result = "Malformed render server request";
+            else
+                result = ApplyRenderRequestArguments(args, &cameraStatements);
+            ParsedScene view;
+            pstd::pmr::monotonic_buffer_resource viewResource;
+            FilmHandle film;
+            std::unique_ptr<Integrator> integrator;
+            if (result.empty()) {
+                // Errors in the request's camera and in the objects created
+                // with the request's options are reported back to the client.
+                try {
+                    ScopedRecoverableErrors recoverableErrors;
+                    const CameraSceneEntity &camera =
+                        cameraStatements.empty()
+                            ? parsedScene.camera
+                            : ParseCamera(cameraStatements, parsedScene, &view);
+                    integrator =
+                        scene.CreateIntegrator(camera, Allocator(&viewResource), &film);
+                } catch (const RecoverableError &error) {
+                    result = error.what();
+                    LOG_VERBOSE("Render request failed: %s", result);
+                }
+            }
+            if (integrator) {
+                Timer timer;
+                integrator->Render();
+                result = RenderedFilename(film);
+                success = true;
+                LOG_VERBOSE("Rendered %s in %.2fs", result, timer.ElapsedSeconds());
+            }
+            *Options = savedOptions;
+
+            // Send reply
+            std::vector<uint8_t> reply(sizeof(int) + 1 + result.size() + 1);
+            uint8_t *replyPtr = reply.data();
+            Serialize(&replyPtr, int(0));  // reserve space for message length
+            Serialize(&replyPtr, uint8_t(success));
+            Serialize(&replyPtr, result);
+            channel->Send(pstd::MakeSpan(reply));
+        }
+    }
+
+    CleanupScene();
+}
+
+// Distributed Rendering Definitions
+#ifndef PBRT_IS_WINDOWS
+// Returns the command line for a worker process that renders the samples
+// [sampleStart, sampleEnd) in every pixel and saves the film state.
+static std::vector<std::string> WorkerArguments(
+    const std::string &executable, const std::vector<std::string> &sceneFilenames,
+    int nThreads, int sampleStart, int sampleEnd, const std::string &filmStateFile) {
+    std::vector<std::string> args = {executable,
+                                     "--quiet",
+                                     "--nthreads",
+                                     std::to_string(nThreads),
+                                     "--seed",
+                                     std::to_string(Options->seed),
+                                     "--sample-range",
+                                     StringPrintf("%d,%d", sampleStart, sampleEnd),
+                                     "--film-state",
+                                     filmStateFile};
+    if (Options->pixelSamples) {
+        args.push_back("--spp");
+        args.push_back(std::to_string(*Options->pixelSamples));
+    }
+    if (Options->cropWindow) {
+        Bounds2f c = *Options->cropWindow;
+        args.push_back("--cropwindow");
+        args.push_back(
+            StringPrintf("%.9g,%.9g,%.9g,%.9g", c.pMin.x, c.pMax.x, c.pMin.y, c.pMax.y));
+    }
+    if (Options->pixelBounds) {
+        Bounds2i b = *Options->pixelBounds;
+        args.push_back("--pixelbounds");
+        args.push_back(
+            StringPrintf("%d,%d,%d,%d", b.pMin.x, b.pMax.x, b.pMin.y, b.pMax.y));
+    }
+    if (Options->quickRender)
+        args.push_back("--quick");
+    if (Options->disablePixelJitter)
+        args.push_back("--disable-pixel-jitter");
+    if (Options->disableWavelengthJitter)
+        args.push_back("--disable-wavelength-jitter");
+    if (Options->forceDiffuse)
+        args.push_back("--force-diffuse");
+    args.push_back("--render-coord-sys");
+    switch (Options->renderingSpace) {
+    case RenderingCoordinateSystem::Camera:
+        args.push_back("camera");
+        break;
+    case RenderingCoordinateSystem::CameraWorld:
+        args.push_back("cameraworld");
+        break;
+    case RenderingCoordinateSystem::World:
+        args.push_back("world");
+        break;
+    }
+    args.insert(args.end(), sceneFilenames.begin(), sceneFilenames.end());
+    return args;
+}
+
+// Returns -1 if the worker process couldn't be created.
+static pid_t LaunchWorker(const std::vector<std::string> &args) {
+    std::vector<char *> argv;
+    for (const std::string &arg : args)
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        execvp(argv[0], argv.data());
+        fprintf(stderr, "%s: %s\n", argv[0], ErrorString().c_str());
+        _exit(1);
+    }
+    return pid;
+}
+#endif  // !PBRT_IS_WINDOWS
+
+void CPURenderDistributed(ParsedScene &parsedScene, const std::string &executable,
+                          const std::vector<std::string> &sceneFilenames) {
+#ifdef PBRT_IS_WINDOWS
+    ErrorExit("Multi-process rendering is not supported on Windows.");
+#else
+    Allocator alloc;
+    // Create film and sampler to find the image extent and sample count
+    FilterHandle filter =
+        FilterHandle::Create(parsedScene.filter.name, parsedScene.filter.parameters,
+                             &parsedScene.filter.loc, alloc);
+    FilmHandle film =
+        FilmHandle::Create(parsedScene.film.name, parsedScene.film.parameters,
+                           &parsedScene.film.loc, filter, alloc);
+    SamplerHandle sampler = SamplerHandle::Create(
+        parsedScene.sampler.name, parsedScene.sampler.parameters, film.FullResolution(),
+        &parsedScene.sampler.loc, alloc);
+    int spp = sampler.SamplesPerPixel();
+
+    if (!Options->checkpointFile.empty() || !Options->mseReferenceImage.empty() ||
+        !Options->displayServer.empty())
+        Warning("Checkpointing, MSE computation, and the display server aren't "
+                "supported with \"--workers\" and will be ignored.");
+
+    // Split the pixel samples into work units
+    int nWorkers = Options->nWorkers;
+    int unitSamples = Options->workUnitSamples;
+    if (unitSamples <= 0)
+        // Default to a few units per worker so that faster workers take more
+        unitSamples = std::max(1, spp / (4 * nWorkers));
+    struct WorkUnit {
+        int sampleStart, sampleEnd;
+        std::string filmStateFile;
+    };
+    std::vector<WorkUnit> units;
+
+    const char *tmpdir = getenv("TMPDIR");
+    std::string dirTemplate =
+        std::string(tmpdir ? tmpdir : "/tmp") + "/pbrt-workers-XXXXXX";
+    if (!mkdtemp(&dirTemplate[0]))
+        ErrorExit("%s: %s", dirTemplate, ErrorString());
+    for (int start = 0; start < spp; start += unitSamples)
+        units.push_back({start, std::min(spp, start + unitSamples),
+                         StringPrintf("%s/unit%05d.pbrtfilm", dirTemplate,
+                                      int(units.size()))});
+
+    int nThreads = Options->nThreads > 0 ? Options->nThreads : AvailableCores();
+    nThreads = std::max(1, nThreads / nWorkers);
+    LOG_VERBOSE("Rendering %d samples per pixel in %d work units with %d workers",
+                spp, int(units.size()), nWorkers);
+
+    // Hand out work units to worker processes as they become idle and merge
+    // their results in unit order, so that the final image doesn't depend on
+    // the order in which the workers finish.
+    ProgressReporter progress(units.size(), "Rendering", Options->quiet);
+    std::map<pid_t, int> runningUnits;
+    std::map<int, FilmState> finishedStates;
+    pstd::optional<FilmState> mergedState;
+
+    // If anything goes wrong, stop the other workers and remove the
+    // temporary directory before exiting so that neither is left behind.
+    auto abortRender = [&](const std::string &message) {
+        for (const auto &running : runningUnits)
+            kill(running.first, SIGTERM);
+        for (const auto &running : runningUnits)
+            waitpid(running.first, nullptr, 0);
+        for (const WorkUnit &unit : units)
+            std::remove(unit.filmStateFile.c_str());
+        rmdir(dirTemplate.c_str());
+        ErrorExit("%s", message);
+    };
+
+    int nextUnit = 0, nextUnitToMerge = 0;
+    while (nextUnit < units.size() || !runningUnits.empty()) {
+        while (runningUnits.size() < nWorkers && nextUnit < units.size()) {
+            const WorkUnit &unit = units[nextUnit];
+            pid_t pid = LaunchWorker(WorkerArguments(executable, sceneFilenames,
+                                                     nThreads, unit.sampleStart,
+                                                     unit.sampleEnd, unit.filmStateFile));
+            if (pid == -1)
+                abortRender(StringPrintf("fork: %s", ErrorString()));
+            runningUnits[pid] = nextUnit++;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1)
+            abortRender(StringPrintf("waitpid: %s", ErrorString()));
+        auto iter = runningUnits.find(pid);
+        if (iter == runningUnits.end())
+            continue;
+        int unitIndex = iter->second;
+        const WorkUnit &unit = units[unitIndex];
+        runningUnits.erase(iter);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            abortRender(StringPrintf("Worker rendering samples [%d, %d) failed.",
+                                     unit.sampleStart, unit.sampleEnd));
+
+        pstd::optional<FilmState> state = FilmState::ReadFile(unit.filmStateFile);
+        if (!state)
+            abortRender(StringPrintf("%s: unable to read worker's film state.",
+                                     unit.filmStateFile));
+        std::remove(unit.filmStateFile.c_str());
+        finishedStates[unitIndex] = std::move(*state);
+
+        for (auto fs = finishedStates.find(nextUnitToMerge); fs != finishedStates.end();
+             fs = finishedStates.find(++nextUnitToMerge)) {
+            if (!mergedState)
+                mergedState = std::move(fs->second);
+            else
+                mergedState->Merge(fs->second);
+            finishedStates.erase(fs);
+        }
+        progress.Update();
+    }
+    progress.Done();
+    rmdir(dirTemplate.c_str());
+
+    // Write final image or merged film state
+    CHECK(mergedState && mergedState->sampleCount == spp);
+    if (!Options->filmStateFile.empty()) {
+        if (!mergedState->WriteFile(Options->filmStateFile))
+            ErrorExit("%s: unable to write film state.", Options->filmStateFile);
+    } else {
+        film.SetState(*mergedState);
+        ImageMetadata metadata;
+        metadata.renderTimeSeconds = progress.ElapsedSeconds();
+        metadata.samplesPerPixel = spp;
+        film.WriteImage(metadata, 1.f / spp);
+    }
+#endif  // PBRT_IS_WINDOWS
+}
+
 }  // namespace pbrt
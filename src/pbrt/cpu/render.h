@@ -7,12 +7,23 @@
 
 #include <pbrt/pbrt.h>
 
+#include <string>
+#include <vector>
+
 namespace pbrt {
 
 class ParsedScene;
 
 void CPURender(ParsedScene &scene);
 
+void CPURenderServer(ParsedScene &scene, const std::string &address);
+
+void CPURenderCameras(ParsedScene &scene, const std::string &camerasFilename,
+                      int nFrames);
+
+void CPURenderDistributed(ParsedScene &scene, const std::string &executable,
+                          const std::vector<std::string> &sceneFilenames);
+
 }  // namespace pbrt
 
 #endif  // PBRT_CPU_RENDER_H
@@ -0,0 +1,119 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/cpu/render.h>
+#include <pbrt/parsedscene.h>
+#include <pbrt/parser.h>
+#include <pbrt/pbrt.h>
+#include <pbrt/util/ipc.h>
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace pbrt;
+
+static std::string inTestDir(const std::string &path) {
+    return path;
+}
+
+#ifndef PBRT_IS_WINDOWS
+TEST(RenderServer, SurvivesMalformedCamera) {
+    std::string address = "unix:" + inTestDir("pbrt-render-server-test.sock");
+    std::string outfile = inTestDir("pbrt-render-server-test.pfm");
+
+    ParsedScene scene;
+    ParseString(&scene, R"(
+Film "rgb" "integer xresolution" 4 "integer yresolution" 4
+Sampler "independent" "integer pixelsamples" 1
+Camera "perspective"
+WorldBegin
+LightSource "point" "rgb I" [1 1 1]
+Shape "sphere" "float radius" 2
+)");
+    std::thread server([&]() { CPURenderServer(scene, address); });
+    auto outfileExists = [&]() {
+        FILE *f = fopen(outfile.c_str(), "rb");
+        if (f)
+            fclose(f);
+        return f != nullptr;
+    };
+
+    // The server creates the scene before it starts listening
+    std::unique_ptr<IPCChannel> channel;
+    for (int i = 0; i < 500; ++i) {
+        channel = std::make_unique<IPCChannel>(address);
+        if (channel->Connected())
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (!channel->Connected()) {
+        server.detach();
+        FAIL() << "Unable to connect to the render server";
+    }
+
+    // Sends a render request with the given arguments and returns whether it
+    // succeeded along with the server's reply.
+    auto request = [&](std::vector<std::string> args) {
+        size_t size = sizeof(int) + 1 + sizeof(int);
+        for (const std::string &arg : args)
+            size += arg.size() + 1;
+        std::vector<uint8_t> message(size);
+        uint8_t *ptr = message.data();
+        Serialize(&ptr, int(0));  // reserve space for message length
+        Serialize(&ptr, uint8_t(0));  // RenderRequest
+        Serialize(&ptr, int(args.size()));
+        for (const std::string &arg : args)
+            Serialize(&ptr, arg);
+        EXPECT_TRUE(channel->Send(pstd::MakeSpan(message)));
+
+        std::vector<uint8_t> reply;
+        uint8_t success = 0;
+        std::string result;
+        if (channel->Receive(&reply)) {
+            const uint8_t *replyPtr = reply.data() + sizeof(int);
+            const uint8_t *end = reply.data() + reply.size();
+            EXPECT_TRUE(Deserialize(&replyPtr, end, &success));
+            EXPECT_TRUE(Deserialize(&replyPtr, end, &result));
+        } else
+            ADD_FAILURE() << "No reply from the server";
+        return std::make_pair(bool(success), result);
+    };
+
+    // Syntax error
+    std::pair<bool, std::string> reply = request(
+        {"--camera", "Camera \"perspective\" \"float fov\" [", "--outfile", outfile});
+    EXPECT_FALSE(reply.first);
+    EXPECT_FALSE(reply.second.empty());
+
+    // Error when the camera is created
+    reply = request({"--camera", "Camera \"nonexistent\"", "--outfile", outfile});
+    EXPECT_FALSE(reply.first);
+    EXPECT_NE(std::string::npos, reply.second.find("nonexistent")) << reply.second;
+    EXPECT_FALSE(outfileExists());
+
+    // The server is still running and renders valid requests
+    reply = request({"--camera", "LookAt 0 0 0  0 0 1  0 1 0 Camera \"perspective\"",
+                     "--outfile", outfile});
+    EXPECT_TRUE(reply.first) << reply.second;
+    EXPECT_EQ(outfile, reply.second);
+    EXPECT_TRUE(outfileExists());
+
+    // Shut down the server
+    std::vector<uint8_t> shutdown(sizeof(int) + 1);
+    uint8_t *ptr = shutdown.data();
+    Serialize(&ptr, int(0));
+    Serialize(&ptr, uint8_t(1));  // ShutdownRequest
+    EXPECT_TRUE(channel->Send(pstd::MakeSpan(shutdown)));
+    server.join();
+
+    EXPECT_EQ(0, remove(outfile.c_str()));
+}
+#endif  // !PBRT_IS_WINDOWS
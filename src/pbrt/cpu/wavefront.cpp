@@ -0,0 +1,576 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/cpu/wavefront.h>
+
+#include <pbrt/bsdf.h>
+#include <pbrt/cameras.h>
+#include <pbrt/film.h>
+#include <pbrt/interaction.h>
+#include <pbrt/lights.h>
+#include <pbrt/lightsamplers.h>
+#include <pbrt/materials.h>
+#include <pbrt/options.h>
+#include <pbrt/paramdict.h>
+#include <pbrt/samplers.h>
+#include <pbrt/textures.h>
+#include <pbrt/util/bluenoise.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/log.h>
+#include <pbrt/util/lowdiscrepancy.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/progressreporter.h>
+#include <pbrt/util/stats.h>
+
+#include <cmath>
+#include <type_traits>
+
+namespace pbrt {
+
+STAT_COUNTER("Integrator/Wavefront camera rays", nWavefrontCameraRays);
+STAT_COUNTER("Integrator/Wavefront indirect rays", nWavefrontIndirectRays);
+STAT_COUNTER("Integrator/Wavefront shadow rays", nWavefrontShadowRays);
+
+// WavefrontPathIntegrator Method Definitions
+WavefrontPathIntegrator::WavefrontPathIntegrator(
+    int maxDepth, CameraHandle camera, SamplerHandle sampler, PrimitiveHandle aggregate,
+    std::vector<LightHandle> lights, Float rrThreshold,
+    const std::string &lightSampleStrategy, bool regularize)
+    : Integrator(aggregate, lights),
+      camera(camera),
+      samplerPrototype(sampler),
+      lightSampler(LightSamplerHandle::Create(lightSampleStrategy, lights, Allocator())),
+      maxDepth(maxDepth),
+      rrThreshold(rrThreshold),
+      regularize(regularize) {
+    // Compute number of scanlines to render per pass
+    Vector2i resolution = camera.GetFilm().PixelBounds().Diagonal();
+    // Batches of this size amortize the cost of launching each stage
+    // without letting the queues grow too large.
+    int maxSamples = 64 * 1024;
+    scanlinesPerPass = std::max(1, maxSamples / std::max(1, resolution.x));
+    int nPasses = std::max(1, (resolution.y + scanlinesPerPass - 1) / scanlinesPerPass);
+    scanlinesPerPass = (resolution.y + nPasses - 1) / nPasses;
+    maxQueueSize = std::max(1, resolution.x * scanlinesPerPass);
+    LOG_VERBOSE("Will render in %d passes %d scanlines per pass", nPasses,
+                scanlinesPerPass);
+
+    // Allocate pixel sample state and work queues
+    Allocator alloc(&queueMemory);
+    pixelSampleState = SOA<PixelSampleState>(maxQueueSize, alloc);
+
+    rayQueues[0] = alloc.new_object<RayQueue>(maxQueueSize, alloc);
+    rayQueues[1] = alloc.new_object<RayQueue>(maxQueueSize, alloc);
+    shadowRayQueue = alloc.new_object<ShadowRayQueue>(maxQueueSize, alloc);
+    if (!infiniteLights.empty())
+        escapedRayQueue = alloc.new_object<EscapedRayQueue>(maxQueueSize, alloc);
+    hitAreaLightQueue = alloc.new_object<HitAreaLightQueue>(maxQueueSize, alloc);
+
+    // The integrator doesn't know which materials the scene uses, so there
+    // is a queue for each type.
+    pstd::array<bool, MaterialHandle::NumTags()> haveMaterial;
+    haveMaterial.fill(true);
+    materialEvalQueue = alloc.new_object<MaterialEvalQueue>(
+        maxQueueSize, alloc,
+        pstd::MakeConstSpan(&haveMaterial[1], haveMaterial.size() - 1));
+}
+
+void WavefrontPathIntegrator::Render() {
+    FilmHandle film = camera.GetFilm();
+    Vector2i resolution = film.PixelBounds().Diagonal();
+    int spp = samplerPrototype.SamplesPerPixel();
+    // Compute range of sample indices to render in each pixel
+    int sampleStart = Options->sampleRangeStart;
+    int sampleEnd = std::min(spp, Options->sampleRangeEnd.value_or(spp));
+    if (sampleStart < 0 || sampleStart >= sampleEnd)
+        ErrorExit("Sample range [%d, %d) is empty or invalid for %d samples per pixel.",
+                  sampleStart, sampleEnd, spp);
+
+    ProgressReporter progress(sampleEnd - sampleStart, "Rendering", Options->quiet);
+    for (int sampleIndex = sampleStart; sampleIndex < sampleEnd; ++sampleIndex) {
+        for (int y0 = 0; y0 < resolution.y; y0 += scanlinesPerPass) {
+            // Generate camera rays for the pixels in the current pass
+            rayQueues[0]->Reset();
+            GenerateCameraRays(y0, sampleIndex);
+            nWavefrontCameraRays += rayQueues[0]->Size();
+
+            // Advance all of the pass's paths by one vertex at a time
+            for (int depth = 0; rayQueues[depth & 1]->Size() > 0; ++depth) {
+                GenerateRaySamples(depth, sampleIndex);
+
+                hitAreaLightQueue->Reset();
+                if (escapedRayQueue)
+                    escapedRayQueue->Reset();
+                materialEvalQueue->Reset();
+                rayQueues[(depth + 1) & 1]->Reset();
+
+                IntersectClosest(depth);
+                if (depth > 0)
+                    nWavefrontIndirectRays += rayQueues[depth & 1]->Size();
+
+                if (escapedRayQueue)
+                    HandleEscapedRays(depth);
+                HandleRayFoundEmission(depth);
+
+                if (depth == maxDepth)
+                    break;
+
+                EvaluateMaterialsAndBSDFs(depth);
+                TraceShadowRays(depth);
+            }
+
+            UpdateFilm();
+        }
+        progress.Update();
+    }
+
+    // Write the image or the raw film state for later merging
+    int samplesTaken = sampleEnd - sampleStart;
+    ImageMetadata metadata;
+    metadata.renderTimeSeconds = progress.ElapsedSeconds();
+    metadata.samplesPerPixel = samplesTaken;
+    camera.InitMetadata(&metadata);
+    progress.Done();
+    if (Options->filmStateFile.empty())
+        film.WriteImage(metadata, 1.0f / samplesTaken);
+    else {
+        FilmState state = film.GetState();
+        state.sampleCount = samplesTaken;
+        if (!state.WriteFile(Options->filmStateFile))
+            ErrorExit("%s: unable to write film state.", Options->filmStateFile);
+    }
+    LOG_VERBOSE("Rendering finished");
+}
+
+template <typename Sampler>
+void WavefrontPathIntegrator::GenerateCameraRays(int y0, int sampleIndex) {
+    FilmHandle film = camera.GetFilm();
+    FilterHandle filter = film.GetFilter();
+    Bounds2i pixelBounds = film.PixelBounds();
+    Vector2i resolution = pixelBounds.Diagonal();
+
+    ParallelFor(0, maxQueueSize, [&](int64_t start, int64_t end) {
+        for (int pixelIndex = start; pixelIndex < end; ++pixelIndex) {
+            Point2i pPixel(pixelBounds.pMin.x + pixelIndex % resolution.x,
+                           pixelBounds.pMin.y + y0 + pixelIndex / resolution.x);
+            pixelSampleState.pPixel[pixelIndex] = pPixel;
+            // The final pass may extend past the end of the image
+            if (!InsideExclusive(pPixel, pixelBounds))
+                continue;
+
+            // Initialize the _Sampler_ for the current pixel and sample
+            Sampler sampler = *samplerPrototype.Cast<Sampler>();
+            sampler.StartPixelSample(pPixel, sampleIndex, 0);
+
+            // Sample wavelengths for the ray path for the pixel sample
+            Float lu = RadicalInverse(1, sampleIndex) + BlueNoise(47, pPixel.x, pPixel.y);
+            if (lu >= 1)
+                lu -= 1;
+            if (Options->disableWavelengthJitter)
+                lu = 0.5;
+            SampledWavelengths lambda = film.SampleWavelengths(lu);
+
+            // Generate the camera ray and initialize the pixel sample's state
+            CameraSample cameraSample = GetCameraSample(sampler, pPixel, filter);
+            CameraRay cameraRay = camera.GenerateRay(cameraSample, lambda);
+            pixelSampleState.L[pixelIndex] = SampledSpectrum(0.f);
+            pixelSampleState.lambda[pixelIndex] = lambda;
+            pixelSampleState.cameraRayWeight[pixelIndex] = cameraRay.weight;
+            pixelSampleState.filterWeight[pixelIndex] = cameraSample.weight;
+
+            if (cameraRay.weight)
+                rayQueues[0]->PushCameraRay(cameraRay.ray, lambda, pixelIndex);
+        }
+    });
+}
+
+void WavefrontPathIntegrator::GenerateCameraRays(int y0, int sampleIndex) {
+    auto generateRays = [=](auto sampler) {
+        using Sampler = std::remove_reference_t<decltype(*sampler)>;
+        if constexpr (!std::is_same_v<Sampler, MLTSampler> &&
+                      !std::is_same_v<Sampler, DebugMLTSampler>)
+            GenerateCameraRays<Sampler>(y0, sampleIndex);
+    };
+    samplerPrototype.DispatchCPU(generateRays);
+}
+
+template <typename Sampler>
+void WavefrontPathIntegrator::GenerateRaySamples(int depth, int sampleIndex) {
+    RayQueue *rayQueue = rayQueues[depth & 1];
+    ForAllQueued(CPUExecution(), "Generate ray samples", rayQueue, maxQueueSize,
+                 [&](const RayWorkItem w, int index) {
+                     // Five dimensions are used for the camera sample and then
+                     // seven for each ray.
+                     int dimension = 5 + 7 * depth;
+                     Sampler pixelSampler = *samplerPrototype.Cast<Sampler>();
+                     Point2i pPixel = pixelSampleState.pPixel[w.pixelIndex];
+                     pixelSampler.StartPixelSample(pPixel, sampleIndex, dimension);
+
+                     RaySamples rs;
+                     if (std::is_same_v<Sampler, SobolSampler> &&
+                         dimension + 7 <= NSobolDimensions) {
+                         // The SobolSampler's 2D samples are two consecutive
+                         // 1D dimensions, so all seven can be computed in a
+                         // batch.
+                         Float u[7];
+                         pixelSampler.GetND(pstd::MakeSpan(u));
+                         rs.direct.u = Point2f(u[0], u[1]);
+                         rs.direct.uc = u[2];
+                         rs.indirect.u = Point2f(u[3], u[4]);
+                         rs.indirect.uc = u[5];
+                         rs.indirect.rr = u[6];
+                     } else {
+                         rs.direct.u = pixelSampler.Get2D();
+                         rs.direct.uc = pixelSampler.Get1D();
+                         rs.indirect.u = pixelSampler.Get2D();
+                         rs.indirect.uc = pixelSampler.Get1D();
+                         rs.indirect.rr = pixelSampler.Get1D();
+                     }
+                     // Scenes with subsurface scattering are rejected in
+                     // CPUScene, so no BSSRDF samples are needed.
+                     rs.haveSubsurface = false;
+                     rayQueue->raySamples[index] = rs;
+                 });
+}
+
+void WavefrontPathIntegrator::GenerateRaySamples(int depth, int sampleIndex) {
+    auto generateSamples = [=](auto sampler) {
+        using Sampler = std::remove_reference_t<decltype(*sampler)>;
+        if constexpr (!std::is_same_v<Sampler, MLTSampler> &&
+                      !std::is_same_v<Sampler, DebugMLTSampler>)
+            GenerateRaySamples<Sampler>(depth, sampleIndex);
+    };
+    samplerPrototype.DispatchCPU(generateSamples);
+}
+
+void WavefrontPathIntegrator::IntersectClosest(int depth) {
+    RayQueue *rayQueue = rayQueues[depth & 1];
+    ForAllQueued(
+        CPUExecution(), "Intersect closest", rayQueue, maxQueueSize,
+        [&](const RayWorkItem r, int index) {
+            // Find the closest intersection with a surface that scatters light
+            RayDifferential ray(r.ray);
+            pstd::optional<ShapeIntersection> si = Intersect(ray);
+            MaterialHandle material;
+            while (si) {
+                SurfaceInteraction &intr = si->intr;
+                material = intr.material;
+                if (material.Is<MixMaterial>()) {
+                    intr.ComputeDifferentials(ray, camera);
+                    while (material.Is<MixMaterial>())
+                        material = material.Cast<MixMaterial>()->ChooseMaterial(
+                            UniversalTextureEvaluator(), intr);
+                }
+                if (material)
+                    break;
+                // Skip over surfaces that only mark medium boundaries
+                intr.SkipIntersection(&ray, si->tHit);
+                si = Intersect(ray);
+            }
+
+            if (!si) {
+                if (escapedRayQueue)
+                    escapedRayQueue->Push(EscapedRayWorkItem{
+                        r.beta, r.pdfUni, r.pdfNEE, r.lambda, ray.o, ray.d, r.piPrev,
+                        r.nPrev, r.nsPrev, (int)r.isSpecularBounce, r.pixelIndex});
+                return;
+            }
+
+            const SurfaceInteraction &intr = si->intr;
+            if (intr.areaLight)
+                hitAreaLightQueue->Push(HitAreaLightWorkItem{
+                    intr.areaLight, r.lambda, r.beta, r.pdfUni, r.pdfNEE, intr.p(),
+                    intr.n, intr.uv, intr.wo, r.piPrev, ray.d, ray.time, r.nPrev,
+                    r.nsPrev, (int)r.isSpecularBounce, r.pixelIndex});
+
+            // Enqueue the intersection in the queue for its material's type;
+            // there's no medium interface since scenes with media are rejected.
+            auto enqueue = [&](auto ptr) {
+                using Material = typename std::remove_reference_t<decltype(*ptr)>;
+                materialEvalQueue->Push<Material>(MaterialEvalWorkItem<Material>{
+                    ptr, r.lambda, r.beta, r.pdfUni, intr.pi, intr.n, intr.shading.n,
+                    intr.shading.dpdu, intr.shading.dpdv, intr.shading.dndu,
+                    intr.shading.dndv, intr.wo, intr.uv, intr.time,
+                    r.anyNonSpecularBounces, r.etaScale, MediumInterface(), index,
+                    r.pixelIndex});
+            };
+            material.Dispatch(enqueue);
+        });
+}
+
+void WavefrontPathIntegrator::HandleEscapedRays(int depth) {
+    ForAllQueued(
+        CPUExecution(), "Handle escaped rays", escapedRayQueue, maxQueueSize,
+        [&](const EscapedRayWorkItem er, int index) {
+            Ray ray(er.rayo, er.rayd);
+            SampledSpectrum L = pixelSampleState.L[er.pixelIndex];
+            for (const auto &light : infiniteLights) {
+                SampledSpectrum Le = light.Le(ray, er.lambda);
+                if (!Le)
+                    continue;
+                if (depth == 0 || er.specularBounce)
+                    L += er.beta * Le / er.pdfUni.Average();
+                else {
+                    // Add infinite light contribution using both PDFs with MIS
+                    LightSampleContext ctx(er.piPrev, er.nPrev, er.nsPrev);
+                    Float lightPDF =
+                        lightSampler.PDF(ctx, light) *
+                        light.PDF_Li(ctx, ray.d, LightSamplingMode::WithMIS);
+                    SampledSpectrum pdfNEE = er.pdfNEE * lightPDF;
+                    L += er.beta * Le / (er.pdfUni + pdfNEE).Average();
+                }
+            }
+            pixelSampleState.L[er.pixelIndex] = L;
+        });
+}
+
+void WavefrontPathIntegrator::HandleRayFoundEmission(int depth) {
+    ForAllQueued(
+        CPUExecution(), "Handle emitters hit by rays", hitAreaLightQueue, maxQueueSize,
+        [&](const HitAreaLightWorkItem he, int index) {
+            LightHandle areaLight = he.areaLight;
+            SampledSpectrum Le = areaLight.L(he.p, he.n, he.uv, he.wo, he.lambda);
+            if (!Le)
+                return;
+
+            SampledSpectrum L = pixelSampleState.L[he.pixelIndex];
+            if (depth == 0 || he.isSpecularBounce)
+                L += he.beta * Le / he.pdfUni.Average();
+            else {
+                // Add surface light contribution using both PDFs with MIS
+                LightSampleContext ctx(he.piPrev, he.nPrev, he.nsPrev);
+                Float lightPDF =
+                    lightSampler.PDF(ctx, areaLight) *
+                    areaLight.PDF_Li(ctx, he.rayd, LightSamplingMode::WithMIS);
+                SampledSpectrum pdfNEE = he.pdfNEE * lightPDF;
+                L += he.beta * Le / (he.pdfUni + pdfNEE).Average();
+            }
+            pixelSampleState.L[he.pixelIndex] = L;
+        });
+}
+
+template <typename Material>
+void WavefrontPathIntegrator::EvaluateMaterialAndBSDF(int depth) {
+    WorkQueue<MaterialEvalWorkItem<Material>> *evalQueue =
+        materialEvalQueue->Get<Material>();
+    if (evalQueue->Size() == 0)
+        return;
+
+    RayQueue *rayQueue = rayQueues[depth & 1];
+    RayQueue *nextRayQueue = rayQueues[(depth + 1) & 1];
+    ForAllQueued(
+        CPUExecution(), Material::Name(), evalQueue, maxQueueSize,
+        [&](const MaterialEvalWorkItem<Material> me, int index) {
+            // Reconstruct the _SurfaceInteraction_ and estimate texture footprints
+            SurfaceInteraction intr;
+            intr.pi = me.pi;
+            intr.n = me.n;
+            intr.uv = me.uv;
+            intr.wo = me.wo;
+            intr.time = me.time;
+            intr.dpdu = me.dpdus;
+            intr.dpdv = me.dpdvs;
+            intr.shading.n = me.ns;
+            intr.shading.dpdu = me.dpdus;
+            intr.shading.dpdv = me.dpdvs;
+            intr.shading.dndu = me.dndus;
+            intr.shading.dndv = me.dndvs;
+            intr.ComputeDifferentials(RayDifferential(), camera);
+
+            // Evaluate bump map and compute shading normal
+            const Material *material = me.material;
+            FloatTextureHandle displacement = material->GetDisplacement();
+            if (displacement) {
+                Vector3f dpdu, dpdv;
+                Bump(UniversalTextureEvaluator(), displacement, BumpEvalContext(intr),
+                     &dpdu, &dpdv);
+                intr.SetShadingGeometry(Normal3f(Normalize(Cross(dpdu, dpdv))), dpdu,
+                                        dpdv, intr.shading.dndu, intr.shading.dndv,
+                                        false);
+            }
+
+            // Evaluate the material's textures to get the BSDF
+            using BxDF = typename Material::BxDF;
+            BxDF bxdf;
+            SampledWavelengths lambda = me.lambda;
+            BSDF bsdf = material->GetBSDF(UniversalTextureEvaluator(),
+                                          MaterialEvalContext(intr), lambda, &bxdf);
+            if (lambda.SecondaryTerminated())
+                pixelSampleState.lambda[me.pixelIndex] = lambda;
+            if (regularize && me.anyNonSpecularBounces)
+                bsdf.Regularize();
+
+            Vector3f wo = me.wo;
+            Normal3f ns = intr.shading.n;
+            RaySamples raySamples = rayQueue->raySamples[me.rayIndex];
+
+            // Sample BSDF to get the path's next direction
+            BSDFSample bs =
+                bsdf.Sample_f<BxDF>(wo, raySamples.indirect.uc, raySamples.indirect.u);
+            if (bs) {
+                // Update _beta_ and PDFs for BSDF scattering
+                SampledSpectrum beta = me.beta * bs.f * AbsDot(bs.wi, ns);
+                SampledSpectrum pdfUni = me.pdfUni, pdfNEE = pdfUni;
+                if (bsdf.SampledPDFIsProportional()) {
+                    Float pdf = bsdf.PDF<BxDF>(wo, bs.wi);
+                    beta *= pdf / bs.pdf;
+                    pdfUni *= pdf;
+                } else
+                    pdfUni *= bs.pdf;
+
+                Float etaScale = me.etaScale;
+                if (bs.IsTransmission())
+                    etaScale *= Sqr(bsdf.eta);
+
+                // Possibly terminate the path with Russian roulette; as with the
+                // _VolPathIntegrator_, the first bounce is never terminated.
+                SampledSpectrum rrBeta = beta * etaScale / pdfUni.Average();
+                if (beta && rrBeta.MaxComponentValue() < rrThreshold && depth > 0) {
+                    Float q = std::max<Float>(0, 1 - rrBeta.MaxComponentValue());
+                    if (raySamples.indirect.rr < q)
+                        beta = SampledSpectrum(0.f);
+                    pdfUni *= 1 - q;
+                    pdfNEE *= 1 - q;
+                }
+
+                if (beta) {
+                    Ray ray = intr.SpawnRay(bs.wi);
+                    bool anyNonSpecularBounces =
+                        !bs.IsSpecular() || me.anyNonSpecularBounces;
+                    nextRayQueue->PushIndirect(ray, me.pi, me.n, ns, beta, pdfUni, pdfNEE,
+                                               lambda, etaScale, bs.IsSpecular(),
+                                               anyNonSpecularBounces, me.pixelIndex);
+                }
+            }
+
+            // Sample illumination from lights and enqueue a shadow ray
+            if (!bsdf.IsNonSpecular())
+                return;
+            LightSampleContext ctx(intr);
+            pstd::optional<SampledLight> sampledLight =
+                lightSampler.Sample(ctx, raySamples.direct.uc);
+            if (!sampledLight)
+                return;
+            LightHandle light = sampledLight->light;
+            LightLiSample ls = light.SampleLi(ctx, raySamples.direct.u, lambda,
+                                              LightSamplingMode::WithMIS);
+            if (!ls || !ls.L)
+                return;
+
+            Vector3f wi = ls.wi;
+            SampledSpectrum f = bsdf.f<BxDF>(wo, wi) * AbsDot(wi, ns);
+            if (!f)
+                return;
+
+            // Compute the PDFs for MIS; delta lights can't be sampled by the BSDF
+            Float lightPDF = ls.pdf * sampledLight->pdf;
+            Float bsdfPDF = IsDeltaLight(light.Type()) ? 0.f : bsdf.PDF<BxDF>(wo, wi);
+            SampledSpectrum pdfUni = me.pdfUni * bsdfPDF;
+            SampledSpectrum pdfNEE = me.pdfUni * lightPDF;
+
+            Ray ray = intr.SpawnRayTo(ls.pLight);
+            shadowRayQueue->Push(ray, 1 - ShadowEpsilon, lambda, me.beta * f * ls.L,
+                                 pdfUni, pdfNEE, me.pixelIndex);
+        });
+}
+
+struct WavefrontEvaluateMaterialCallback {
+    int depth;
+    WavefrontPathIntegrator *integrator;
+    template <typename Material>
+    void operator()() {
+        // MixMaterials have already been resolved in IntersectClosest()
+        if constexpr (!std::is_same_v<Material, MixMaterial>)
+            integrator->EvaluateMaterialAndBSDF<Material>(depth);
+    }
+};
+
+void WavefrontPathIntegrator::EvaluateMaterialsAndBSDFs(int depth) {
+    MaterialHandle::ForEachType(WavefrontEvaluateMaterialCallback{depth, this});
+}
+
+void WavefrontPathIntegrator::TraceShadowRays(int depth) {
+    nWavefrontShadowRays += shadowRayQueue->Size();
+    ForAllQueued(
+        CPUExecution(), "Trace shadow rays", shadowRayQueue, maxQueueSize,
+        [&](const ShadowRayWorkItem sr, int index) {
+            if (IntersectP(sr.ray, sr.tMax)) {
+                // The ray may only have hit surfaces that mark medium
+                // boundaries; follow it through them to the light.
+                Ray ray = sr.ray;
+                Point3f pLight = ray(1);
+                while (true) {
+                    pstd::optional<ShapeIntersection> si = Intersect(ray, sr.tMax);
+                    if (!si)
+                        break;
+                    if (si->intr.material)
+                        return;
+                    ray = si->intr.SpawnRayTo(pLight);
+                }
+            }
+
+            // Add the light's contribution using both PDFs with MIS
+            SampledSpectrum L = pixelSampleState.L[sr.pixelIndex];
+            L += sr.Ld / (sr.pdfUni + sr.pdfNEE).Average();
+            pixelSampleState.L[sr.pixelIndex] = L;
+        });
+    shadowRayQueue->Reset();
+}
+
+void WavefrontPathIntegrator::UpdateFilm() {
+    FilmHandle film = camera.GetFilm();
+    Bounds2i pixelBounds = film.PixelBounds();
+    ParallelFor(0, maxQueueSize, [&](int64_t start, int64_t end) {
+        for (int pixelIndex = start; pixelIndex < end; ++pixelIndex) {
+            Point2i pPixel = pixelSampleState.pPixel[pixelIndex];
+            if (!InsideExclusive(pPixel, pixelBounds))
+                continue;
+
+            // Compute the final weighted radiance value
+            SampledSpectrum L = SampledSpectrum(pixelSampleState.L[pixelIndex]) *
+                                pixelSampleState.cameraRayWeight[pixelIndex];
+            SampledWavelengths lambda = pixelSampleState.lambda[pixelIndex];
+
+            // Issue warning if unexpected radiance value is returned
+            if (L.HasNaNs()) {
+                LOG_ERROR("Not-a-number radiance value returned for pixel (%d, %d). "
+                          "Setting to black.",
+                          pPixel.x, pPixel.y);
+                L = SampledSpectrum(0.f);
+            } else if (std::isinf(L.y(lambda))) {
+                LOG_ERROR("Infinite radiance value returned for pixel (%d, %d). "
+                          "Setting to black.",
+                          pPixel.x, pPixel.y);
+                L = SampledSpectrum(0.f);
+            }
+
+            VisibleSurface visibleSurface;
+            film.AddSample(pPixel, L, lambda, &visibleSurface,
+                           pixelSampleState.filterWeight[pixelIndex]);
+        }
+    });
+}
+
+std::string WavefrontPathIntegrator::ToString() const {
+    return StringPrintf("[ WavefrontPathIntegrator maxDepth: %d rrThreshold: %f "
+                        "lightSampler: %s regularize: %s maxQueueSize: %d ]",
+                        maxDepth, rrThreshold, lightSampler, regularize, maxQueueSize);
+}
+
+std::unique_ptr<WavefrontPathIntegrator> WavefrontPathIntegrator::Create(
+    const ParameterDictionary &parameters, CameraHandle camera, SamplerHandle sampler,
+    PrimitiveHandle aggregate, std::vector<LightHandle> lights, const FileLoc *loc) {
+    int maxDepth = parameters.GetOneInt("maxdepth", 5);
+    Float rrThreshold = parameters.GetOneFloat("rrthreshold", 1.);
+    std::string lightStrategy = parameters.GetOneString("lightsampler", "bvh");
+    bool regularize = parameters.GetOneBool("regularize", false);
+    if (sampler.Is<MLTSampler>() || sampler.Is<DebugMLTSampler>())
+        ErrorExit(loc, "The \"wavefront\" integrator can't be used with the MLT "
+                       "samplers.");
+    return std::make_unique<WavefrontPathIntegrator>(maxDepth, camera, sampler,
+                                                     aggregate, lights, rrThreshold,
+                                                     lightStrategy, regularize);
+}
+
+}  // namespace pbrt
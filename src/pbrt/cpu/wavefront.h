@@ -0,0 +1,96 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_CPU_WAVEFRONT_H
+#define PBRT_CPU_WAVEFRONT_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/base/bxdf.h>
+#include <pbrt/base/camera.h>
+#include <pbrt/base/film.h>
+#include <pbrt/base/filter.h>
+#include <pbrt/base/light.h>
+#include <pbrt/base/lightsampler.h>
+#include <pbrt/base/sampler.h>
+#include <pbrt/cpu/integrators.h>
+#include <pbrt/gpu/workitems.h>
+#include <pbrt/gpu/workqueue.h>
+#include <pbrt/util/pstd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pbrt {
+
+// WavefrontPathIntegrator Definition
+// The WavefrontPathIntegrator computes the same estimate as the
+// VolPathIntegrator for scenes without participating media or subsurface
+// scattering; scenes that have them are rejected when they are created.
+// Rather than following one path at a time, it advances a large batch of
+// paths through each stage of path tracing in turn, using the same work
+// queues and SOA work items as the GPUPathIntegrator. The work items don't
+// carry ray differentials, so texture filtering uses the camera's
+// approximate footprint at each intersection.
+class WavefrontPathIntegrator : public Integrator {
+  public:
+    // WavefrontPathIntegrator Public Methods
+    WavefrontPathIntegrator(int maxDepth, CameraHandle camera, SamplerHandle sampler,
+                            PrimitiveHandle aggregate, std::vector<LightHandle> lights,
+                            Float rrThreshold = 1,
+                            const std::string &lightSampleStrategy = "bvh",
+                            bool regularize = false);
+
+    void Render();
+
+    static std::unique_ptr<WavefrontPathIntegrator> Create(
+        const ParameterDictionary &parameters, CameraHandle camera, SamplerHandle sampler,
+        PrimitiveHandle aggregate, std::vector<LightHandle> lights, const FileLoc *loc);
+
+    std::string ToString() const;
+
+    void GenerateCameraRays(int y0, int sampleIndex);
+    template <typename Sampler>
+    void GenerateCameraRays(int y0, int sampleIndex);
+
+    void GenerateRaySamples(int depth, int sampleIndex);
+    template <typename Sampler>
+    void GenerateRaySamples(int depth, int sampleIndex);
+
+    void IntersectClosest(int depth);
+    void HandleEscapedRays(int depth);
+    void HandleRayFoundEmission(int depth);
+
+    void EvaluateMaterialsAndBSDFs(int depth);
+    template <typename Material>
+    void EvaluateMaterialAndBSDF(int depth);
+
+    void TraceShadowRays(int depth);
+    void UpdateFilm();
+
+  private:
+    // WavefrontPathIntegrator Private Members
+    CameraHandle camera;
+    SamplerHandle samplerPrototype;
+    LightSamplerHandle lightSampler;
+    int maxDepth;
+    Float rrThreshold;
+    bool regularize;
+
+    int maxQueueSize, scanlinesPerPass;
+    // The queues are sized for a full pass of pixel samples. Memory for the
+    // material types that aren't present in the scene is never touched.
+    pstd::pmr::monotonic_buffer_resource queueMemory;
+    SOA<PixelSampleState> pixelSampleState;
+    RayQueue *rayQueues[2] = {nullptr, nullptr};
+    ShadowRayQueue *shadowRayQueue = nullptr;
+    EscapedRayQueue *escapedRayQueue = nullptr;
+    HitAreaLightQueue *hitAreaLightQueue = nullptr;
+    MaterialEvalQueue *materialEvalQueue = nullptr;
+};
+
+}  // namespace pbrt
+
+#endif  // PBRT_CPU_WAVEFRONT_H
@@ -27,6 +27,8 @@
 #include <pbrt/util/stats.h>
 #include <pbrt/util/transform.h>
 
+#include <algorithm>
+
 namespace pbrt {
 
 void FilmHandle::AddSplat(const Point2f &p, SampledSpectrum v,
@@ -45,6 +47,16 @@ Image FilmHandle::GetImage(ImageMetadata *metadata, Float splatScale) {
     return DispatchCPU(get);
 }
 
+FilmState FilmHandle::GetState() const {
+    auto get = [&](auto ptr) { return ptr->GetState(); };
+    return DispatchCPU(get);
+}
+
+void FilmHandle::SetState(const FilmState &state) {
+    auto set = [&](auto ptr) { return ptr->SetState(state); };
+    return DispatchCPU(set);
+}
+
 std::string FilmHandle::ToString() const {
     if (ptr() == nullptr)
         return "(nullptr)";
@@ -58,6 +70,254 @@ std::string FilmHandle::GetFilename() const {
     return DispatchCPU(get);
 }
 
+// FilmState Method Definitions
+template <typename T>
+static bool WriteValues(FILE *f, const T *v, size_t n = 1) {
+    return fwrite(v, sizeof(T), n, f) == n;
+}
+
+template <typename T>
+static bool ReadValues(FILE *f, T *v, size_t n = 1) {
+    return fread(v, sizeof(T), n, f) == n;
+}
+
+bool FilmState::Write(FILE *f) const {
+    CHECK_EQ(values.size(), size_t(valuesPerPixel) * pixelBounds.Area());
+    CHECK_EQ(variance.size(), size_t(pixelBounds.Area()));
+    CHECK(pixelSampleCounts.empty() ||
+          pixelSampleCounts.size() == size_t(pixelBounds.Area()));
+    int nameLength = filmName.size();
+    int hasPixelSampleCounts = !pixelSampleCounts.empty();
+    return WriteValues(f, &nameLength) && WriteValues(f, filmName.data(), nameLength) &&
+           WriteValues(f, &fullResolution) && WriteValues(f, &pixelBounds) &&
+           WriteValues(f, &sampleCount) && WriteValues(f, &scale) &&
+           WriteValues(f, &filterIntegral) && WriteValues(f, &outputRGBFromCameraRGB) &&
+           WriteValues(f, &colorSpaceR) && WriteValues(f, &colorSpaceG) &&
+           WriteValues(f, &colorSpaceB) && WriteValues(f, &colorSpaceW) &&
+           WriteValues(f, &writeFP16) && WriteValues(f, &valuesPerPixel) &&
+           WriteValues(f, values.data(), values.size()) &&
+           WriteValues(f, variance.data(), variance.size()) &&
+           WriteValues(f, &hasPixelSampleCounts) &&
+           WriteValues(f, pixelSampleCounts.data(), pixelSampleCounts.size());
+}
+
+bool FilmState::Read(FILE *f) {
+    int nameLength;
+    if (!ReadValues(f, &nameLength) || nameLength < 0 || nameLength > 256)
+        return false;
+    filmName.resize(nameLength);
+    if (!ReadValues(f, &filmName[0], nameLength) || !ReadValues(f, &fullResolution) ||
+        !ReadValues(f, &pixelBounds) || !ReadValues(f, &sampleCount) ||
+        !ReadValues(f, &scale) || !ReadValues(f, &filterIntegral) ||
+        !ReadValues(f, &outputRGBFromCameraRGB) || !ReadValues(f, &colorSpaceR) ||
+        !ReadValues(f, &colorSpaceG) || !ReadValues(f, &colorSpaceB) ||
+        !ReadValues(f, &colorSpaceW) || !ReadValues(f, &writeFP16) ||
+        !ReadValues(f, &valuesPerPixel))
+        return false;
+    if (pixelBounds.IsEmpty() || valuesPerPixel < 7)
+        return false;
+
+    values.resize(size_t(valuesPerPixel) * pixelBounds.Area());
+    variance.resize(pixelBounds.Area());
+    int hasPixelSampleCounts;
+    if (!ReadValues(f, values.data(), values.size()) ||
+        !ReadValues(f, variance.data(), variance.size()) ||
+        !ReadValues(f, &hasPixelSampleCounts))
+        return false;
+    pixelSampleCounts.resize(hasPixelSampleCounts ? pixelBounds.Area() : 0);
+    return ReadValues(f, pixelSampleCounts.data(), pixelSampleCounts.size());
+}
+
+static constexpr char filmStateMagic[8] = {'p', 'b', 'r', 't', 'f', 'l', 'm', '2'};
+
+bool FilmState::WriteFile(const std::string &filename) const {
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) {
+        Error("%s: %s", filename, ErrorString());
+        return false;
+    }
+    bool success = WriteValues(f, filmStateMagic, sizeof(filmStateMagic)) && Write(f);
+    if (fclose(f) != 0 || !success) {
+        Error("%s: error writing film state: %s", filename, ErrorString());
+        return false;
+    }
+    return true;
+}
+
+pstd::optional<FilmState> FilmState::ReadFile(const std::string &filename) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) {
+        Error("%s: %s", filename, ErrorString());
+        return {};
+    }
+    char magic[sizeof(filmStateMagic)];
+    FilmState state;
+    bool success = ReadValues(f, magic, sizeof(magic)) &&
+                   memcmp(magic, filmStateMagic, sizeof(magic)) == 0 && state.Read(f);
+    fclose(f);
+    if (!success) {
+        Error("%s: not a valid pbrt film state file.", filename);
+        return {};
+    }
+    return state;
+}
+
+void FilmState::Merge(const FilmState &state) {
+    if (state.filmName != filmName || state.valuesPerPixel != valuesPerPixel ||
+        state.fullResolution != fullResolution || state.scale != scale ||
+        state.filterIntegral != filterIntegral ||
+        state.outputRGBFromCameraRGB != outputRGBFromCameraRGB ||
+        state.colorSpaceR != colorSpaceR || state.colorSpaceG != colorSpaceG ||
+        state.colorSpaceB != colorSpaceB || state.colorSpaceW != colorSpaceW ||
+        state.writeFP16 != writeFP16)
+        ErrorExit("Can't merge %s film state with %s film state.", state, *this);
+
+    if (state.pixelBounds == pixelBounds && state.pixelSampleCounts.empty() &&
+        pixelSampleCounts.empty()) {
+        // Merge states that cover the same pixels with different samples
+        for (size_t i = 0; i < values.size(); ++i)
+            values[i] += state.values[i];
+        for (size_t i = 0; i < variance.size(); ++i)
+            variance[i].Merge(state.variance[i]);
+        sampleCount += state.sampleCount;
+        return;
+    }
+
+    // Accumulate both states' pixels into the union of their pixel bounds.
+    // Pixel sums and sample counts add, so states may cover any mix of
+    // pixels and samples; pixels that neither covers have no samples.
+    Bounds2i mergedBounds = Union(pixelBounds, state.pixelBounds);
+    std::vector<double> mergedValues(size_t(valuesPerPixel) * mergedBounds.Area(), 0.);
+    std::vector<VarianceEstimator<Float>> mergedVariance(mergedBounds.Area());
+    std::vector<int> mergedSampleCounts(mergedBounds.Area(), 0);
+    auto accumulatePixels = [&](const FilmState &from) {
+        int fromWidth = from.pixelBounds.pMax.x - from.pixelBounds.pMin.x;
+        int mergedWidth = mergedBounds.pMax.x - mergedBounds.pMin.x;
+        for (Point2i p : from.pixelBounds) {
+            size_t fromOffset = (p.x - from.pixelBounds.pMin.x) +
+                                fromWidth * (p.y - from.pixelBounds.pMin.y);
+            size_t mergedOffset = (p.x - mergedBounds.pMin.x) +
+                                  mergedWidth * (p.y - mergedBounds.pMin.y);
+            for (int i = 0; i < valuesPerPixel; ++i)
+                mergedValues[valuesPerPixel * mergedOffset + i] +=
+                    from.values[valuesPerPixel * fromOffset + i];
+            mergedVariance[mergedOffset].Merge(from.variance[fromOffset]);
+            mergedSampleCounts[mergedOffset] += from.PixelSampleCount(fromOffset);
+        }
+    };
+    accumulatePixels(*this);
+    accumulatePixels(state);
+
+    pixelBounds = mergedBounds;
+    values = std::move(mergedValues);
+    variance = std::move(mergedVariance);
+    auto [minCount, maxCount] =
+        std::minmax_element(mergedSampleCounts.begin(), mergedSampleCounts.end());
+    sampleCount = *maxCount;
+    if (*minCount == *maxCount)
+        pixelSampleCounts.clear();
+    else
+        pixelSampleCounts = std::move(mergedSampleCounts);
+}
+
+Image FilmState::GetImage(ImageMetadata *metadata) const {
+    PixelFormat format = writeFP16 ? PixelFormat::Half : PixelFormat::Float;
+    Image image(format, Point2i(pixelBounds.Diagonal()), {"R", "G", "B"});
+
+    int width = pixelBounds.pMax.x - pixelBounds.pMin.x;
+    int nMissingSamplesPixels = 0;
+    for (size_t i = 0; i < pixelSampleCounts.size(); ++i)
+        if (pixelSampleCounts[i] < sampleCount)
+            ++nMissingSamplesPixels;
+    if (nMissingSamplesPixels > 0)
+        Warning("%d pixels of the film state have fewer than %d samples.",
+                nMissingSamplesPixels, sampleCount);
+
+    ParallelFor2D(pixelBounds, [&](Point2i p) {
+        Point2i pOffset(p.x - pixelBounds.pMin.x, p.y - pixelBounds.pMin.y);
+        size_t offset = pOffset.x + width * pOffset.y;
+        const double *v = &values[valuesPerPixel * offset];
+        int pixelSamples = PixelSampleCount(offset);
+        Float splatScale = pixelSamples > 0 ? Float(1) / pixelSamples : Float(1);
+        // Compute final RGB value as in _RGBFilm::GetPixelRGB()_
+        RGB rgb(v[0], v[1], v[2]);
+        Float weightSum = v[3];
+        if (weightSum != 0)
+            rgb /= weightSum;
+        for (int c = 0; c < 3; ++c)
+            rgb[c] += splatScale * v[4 + c] / filterIntegral;
+        rgb *= scale;
+        rgb = Mul<RGB>(outputRGBFromCameraRGB, rgb);
+
+        image.SetChannels(pOffset, {rgb[0], rgb[1], rgb[2]});
+    });
+
+    metadata->pixelBounds = pixelBounds;
+    metadata->fullResolution = fullResolution;
+    metadata->colorSpace =
+        RGBColorSpace::Lookup(colorSpaceR, colorSpaceG, colorSpaceB, colorSpaceW);
+    metadata->samplesPerPixel = sampleCount;
+
+    Float varianceSum = 0;
+    for (const VarianceEstimator<Float> &ve : variance)
+        varianceSum += ve.Variance();
+    metadata->estimatedVariance = varianceSum / pixelBounds.Area();
+
+    return image;
+}
+
+std::string FilmState::ToString() const {
+    return StringPrintf("[ FilmState filmName: %s fullResolution: %s pixelBounds: %s "
+                        "sampleCount: %d scale: %f filterIntegral: %f "
+                        "outputRGBFromCameraRGB: %s writeFP16: %s valuesPerPixel: %d ]",
+                        filmName, fullResolution, pixelBounds, sampleCount, scale,
+                        filterIntegral, outputRGBFromCameraRGB, writeFP16,
+                        valuesPerPixel);
+}
+
+static FilmState InitFilmState(const char *filmName, int valuesPerPixel,
+                               Point2i fullResolution, const Bounds2i &pixelBounds,
+                               Float scale, Float filterIntegral,
+                               const SquareMatrix<3> &outputRGBFromCameraRGB,
+                               const RGBColorSpace *colorSpace, bool writeFP16) {
+    FilmState state;
+    state.filmName = filmName;
+    state.fullResolution = fullResolution;
+    state.pixelBounds = pixelBounds;
+    state.scale = scale;
+    state.filterIntegral = filterIntegral;
+    state.outputRGBFromCameraRGB = outputRGBFromCameraRGB;
+    state.colorSpaceR = colorSpace->r;
+    state.colorSpaceG = colorSpace->g;
+    state.colorSpaceB = colorSpace->b;
+    state.colorSpaceW = colorSpace->w;
+    state.writeFP16 = writeFP16;
+    state.valuesPerPixel = valuesPerPixel;
+    state.values.resize(size_t(valuesPerPixel) * pixelBounds.Area());
+    state.variance.resize(pixelBounds.Area());
+    return state;
+}
+
+// Make sure that a _FilmState_ read from disk matches the film it is being
+// restored into.
+static void CheckFilmStateCompatible(const FilmState &state, const char *filmName,
+                                     int valuesPerPixel, Point2i fullResolution,
+                                     const Bounds2i &pixelBounds) {
+    if (state.filmName != filmName)
+        ErrorExit("Film state is for a \"%s\" film but the scene uses \"%s\".",
+                  state.filmName, filmName);
+    if (state.valuesPerPixel != valuesPerPixel ||
+        state.values.size() != size_t(valuesPerPixel) * pixelBounds.Area())
+        ErrorExit("Film state has %d values per pixel; expected %d.",
+                  state.valuesPerPixel, valuesPerPixel);
+    if (state.fullResolution != fullResolution || state.pixelBounds != pixelBounds)
+        ErrorExit("Film state resolution %s and pixel bounds %s don't match the film's "
+                  "resolution %s and pixel bounds %s.",
+                  state.fullResolution, state.pixelBounds, fullResolution, pixelBounds);
+    if (!state.pixelSampleCounts.empty())
+        ErrorExit("Film state doesn't have the same number of samples in all pixels.");
+}
+
 // FilmBase Method Definitions
 std::string FilmBase::BaseToString() const {
     return StringPrintf("fullResolution: %s diagonal: %f filter: %s filename: %s "
@@ -607,6 +867,42 @@ Image RGBFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
     return image;
 }
 
+FilmState RGBFilm::GetState() const {
+    FilmState state =
+        InitFilmState("rgb", 7, fullResolution, pixelBounds, scale, filterIntegral,
+                      outputRGBFromCameraRGB, colorSpace, writeFP16);
+
+    int width = pixelBounds.pMax.x - pixelBounds.pMin.x;
+    ParallelFor2D(pixelBounds, [&](Point2i p) {
+        const Pixel &pixel = pixels[p];
+        size_t offset = (p.x - pixelBounds.pMin.x) + width * (p.y - pixelBounds.pMin.y);
+        double *v = &state.values[state.valuesPerPixel * offset];
+        for (int c = 0; c < 3; ++c) {
+            v[c] = pixel.rgbSum[c];
+            v[4 + c] = pixel.splatRGB[c];
+        }
+        v[3] = pixel.weightSum;
+        state.variance[offset] = pixel.varianceEstimator;
+    });
+    return state;
+}
+
+void RGBFilm::SetState(const FilmState &state) {
+    CheckFilmStateCompatible(state, "rgb", 7, fullResolution, pixelBounds);
+    int width = pixelBounds.pMax.x - pixelBounds.pMin.x;
+    ParallelFor2D(pixelBounds, [&](Point2i p) {
+        Pixel &pixel = pixels[p];
+        size_t offset = (p.x - pixelBounds.pMin.x) + width * (p.y - pixelBounds.pMin.y);
+        const double *v = &state.values[state.valuesPerPixel * offset];
+        for (int c = 0; c < 3; ++c) {
+            pixel.rgbSum[c] = v[c];
+            pixel.splatRGB[c] = v[4 + c];
+        }
+        pixel.weightSum = v[3];
+        pixel.varianceEstimator = state.variance[offset];
+    });
+}
+
 std::string RGBFilm::ToString() const {
     return StringPrintf("[ RGBFilm %s scale: %f colorSpace: %s maxComponentValue: %f "
                         "writeFP16: %s ]",
@@ -915,6 +1211,59 @@ Image GBufferFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
     return image;
 }
 
+FilmState GBufferFilm::GetState() const {
+    FilmState state =
+        InitFilmState("gbuffer", 21, fullResolution, pixelBounds, scale, filterIntegral,
+                      outputRGBFromCameraRGB, colorSpace, writeFP16);
+
+    int width = pixelBounds.pMax.x - pixelBounds.pMin.x;
+    ParallelFor2D(pixelBounds, [&](Point2i p) {
+        const Pixel &pixel = pixels[p];
+        size_t offset = (p.x - pixelBounds.pMin.x) + width * (p.y - pixelBounds.pMin.y);
+        double *v = &state.values[state.valuesPerPixel * offset];
+        // Store the RGB sums, weight, and splats first, matching _RGBFilm_
+        for (int c = 0; c < 3; ++c) {
+            v[c] = pixel.rgbSum[c];
+            v[4 + c] = pixel.splatRGB[c];
+        }
+        v[3] = pixel.weightSum;
+        for (int c = 0; c < 3; ++c) {
+            v[7 + c] = pixel.pSum[c];
+            v[12 + c] = pixel.nSum[c];
+            v[15 + c] = pixel.nsSum[c];
+            v[18 + c] = pixel.albedoSum[c];
+        }
+        v[10] = pixel.dzdxSum;
+        v[11] = pixel.dzdySum;
+        state.variance[offset] = pixel.rgbVarianceEstimator;
+    });
+    return state;
+}
+
+void GBufferFilm::SetState(const FilmState &state) {
+    CheckFilmStateCompatible(state, "gbuffer", 21, fullResolution, pixelBounds);
+    int width = pixelBounds.pMax.x - pixelBounds.pMin.x;
+    ParallelFor2D(pixelBounds, [&](Point2i p) {
+        Pixel &pixel = pixels[p];
+        size_t offset = (p.x - pixelBounds.pMin.x) + width * (p.y - pixelBounds.pMin.y);
+        const double *v = &state.values[state.valuesPerPixel * offset];
+        for (int c = 0; c < 3; ++c) {
+            pixel.rgbSum[c] = v[c];
+            pixel.splatRGB[c] = v[4 + c];
+        }
+        pixel.weightSum = v[3];
+        for (int c = 0; c < 3; ++c) {
+            pixel.pSum[c] = v[7 + c];
+            pixel.nSum[c] = v[12 + c];
+            pixel.nsSum[c] = v[15 + c];
+            pixel.albedoSum[c] = v[18 + c];
+        }
+        pixel.dzdxSum = v[10];
+        pixel.dzdySum = v[11];
+        pixel.rgbVarianceEstimator = state.variance[offset];
+    });
+}
+
 std::string GBufferFilm::ToString() const {
     return StringPrintf("[ GBufferFilm %s colorSpace: %s maxComponentValue: %f "
                         "writeFP16: %s ]",
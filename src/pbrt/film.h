@@ -25,6 +25,7 @@
 #include <pbrt/util/vecmath.h>
 
 #include <atomic>
+#include <cstdio>
 #include <map>
 #include <string>
 #include <thread>
@@ -103,6 +104,45 @@ class VisibleSurface {
     SampledSpectrum albedo;
 };
 
+// FilmState Definition
+struct FilmState {
+    // FilmState Public Methods
+    bool Write(FILE *f) const;
+    bool Read(FILE *f);
+
+    bool WriteFile(const std::string &filename) const;
+    static pstd::optional<FilmState> ReadFile(const std::string &filename);
+
+    void Merge(const FilmState &state);
+    Image GetImage(ImageMetadata *metadata) const;
+
+    int PixelSampleCount(size_t offset) const {
+        return pixelSampleCounts.empty() ? sampleCount : pixelSampleCounts[offset];
+    }
+
+    std::string ToString() const;
+
+    // FilmState Public Members
+    std::string filmName;
+    Point2i fullResolution;
+    Bounds2i pixelBounds;
+    // Largest number of samples taken in any pixel
+    int sampleCount = 0;
+    // Values needed to compute final RGB pixel values from the state
+    Float scale = 1, filterIntegral = 1;
+    SquareMatrix<3> outputRGBFromCameraRGB;
+    Point2f colorSpaceR, colorSpaceG, colorSpaceB, colorSpaceW;
+    bool writeFP16 = true;
+    // Per-pixel unnormalized sums; the first seven values of each pixel
+    // are always the RGB sums, the filter weight sum, and the RGB splats.
+    int valuesPerPixel = 0;
+    std::vector<double> values;
+    std::vector<VarianceEstimator<Float>> variance;
+    // Number of samples taken in each pixel, when they differ; otherwise
+    // empty, and all pixels have _sampleCount_ samples.
+    std::vector<int> pixelSampleCounts;
+};
+
 // FilmBase Definition
 class FilmBase {
   public:
@@ -225,6 +265,9 @@ class RGBFilm : public FilmBase {
     void WriteImage(ImageMetadata metadata, Float splatScale = 1);
     Image GetImage(ImageMetadata *metadata, Float splatScale = 1);
 
+    FilmState GetState() const;
+    void SetState(const FilmState &state);
+
     std::string ToString() const;
 
   private:
@@ -300,6 +343,9 @@ class GBufferFilm : public FilmBase {
     void WriteImage(ImageMetadata metadata, Float splatScale = 1);
     Image GetImage(ImageMetadata *metadata, Float splatScale = 1);
 
+    FilmState GetState() const;
+    void SetState(const FilmState &state);
+
     std::string ToString() const;
 
   private:
@@ -0,0 +1,120 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/film.h>
+
+using namespace pbrt;
+
+static FilmState MakeState(Bounds2i pixelBounds, int sampleCount, double v) {
+    FilmState state;
+    state.filmName = "rgb";
+    state.fullResolution = Point2i(8, 8);
+    state.pixelBounds = pixelBounds;
+    state.sampleCount = sampleCount;
+    state.valuesPerPixel = 7;
+    state.values.assign(size_t(state.valuesPerPixel) * pixelBounds.Area(), v);
+    state.variance.resize(pixelBounds.Area());
+    for (VarianceEstimator<Float> &ve : state.variance)
+        ve.Add(v);
+    return state;
+}
+
+TEST(FilmState, MergeSamples) {
+    Bounds2i b(Point2i(0, 0), Point2i(8, 8));
+    FilmState a = MakeState(b, 3, 1.), c = MakeState(b, 5, 2.);
+    a.Merge(c);
+
+    EXPECT_EQ(8, a.sampleCount);
+    EXPECT_EQ(b, a.pixelBounds);
+    for (double v : a.values)
+        EXPECT_EQ(3., v);
+    for (const VarianceEstimator<Float> &ve : a.variance)
+        EXPECT_EQ(2, ve.Count());
+}
+
+TEST(FilmState, MergePixels) {
+    FilmState top = MakeState(Bounds2i(Point2i(0, 0), Point2i(8, 3)), 4, 1.);
+    FilmState bottom = MakeState(Bounds2i(Point2i(0, 3), Point2i(8, 8)), 4, 2.);
+    top.Merge(bottom);
+
+    EXPECT_EQ(4, top.sampleCount);
+    EXPECT_EQ(Bounds2i(Point2i(0, 0), Point2i(8, 8)), top.pixelBounds);
+    ASSERT_EQ(7 * 64, top.values.size());
+    for (int y = 0; y < 8; ++y)
+        for (int x = 0; x < 8; ++x)
+            for (int i = 0; i < 7; ++i)
+                EXPECT_EQ(y < 3 ? 1. : 2., top.values[7 * (y * 8 + x) + i]);
+}
+
+TEST(FilmState, MergeTiles) {
+    // Merge a 2x2 split of the film one tile at a time; the second and
+    // third tiles leave part of the union of the pixel bounds uncovered.
+    Bounds2i tiles[4] = {Bounds2i(Point2i(0, 0), Point2i(4, 4)),
+                         Bounds2i(Point2i(4, 4), Point2i(8, 8)),
+                         Bounds2i(Point2i(4, 0), Point2i(8, 4)),
+                         Bounds2i(Point2i(0, 4), Point2i(4, 8))};
+    FilmState merged = MakeState(tiles[0], 4, 1.);
+    for (int i = 1; i < 4; ++i) {
+        merged.Merge(MakeState(tiles[i], 4, 1. + i));
+        EXPECT_EQ(4, merged.sampleCount);
+        EXPECT_EQ(i == 1 || i == 2, !merged.pixelSampleCounts.empty());
+    }
+
+    EXPECT_EQ(Bounds2i(Point2i(0, 0), Point2i(8, 8)), merged.pixelBounds);
+    ASSERT_EQ(7 * 64, merged.values.size());
+    for (int y = 0; y < 8; ++y)
+        for (int x = 0; x < 8; ++x) {
+            int tile = 0;
+            while (!InsideExclusive(Point2i(x, y), tiles[tile]))
+                ++tile;
+            for (int i = 0; i < 7; ++i)
+                EXPECT_EQ(1. + tile, merged.values[7 * (y * 8 + x) + i]);
+            EXPECT_EQ(1, merged.variance[y * 8 + x].Count());
+        }
+}
+
+TEST(FilmState, MergeOverlapping) {
+    // Two states that overlap in some pixels but not others
+    FilmState a = MakeState(Bounds2i(Point2i(0, 0), Point2i(6, 8)), 2, 1.);
+    FilmState b = MakeState(Bounds2i(Point2i(2, 0), Point2i(8, 8)), 3, 2.);
+    a.Merge(b);
+
+    EXPECT_EQ(5, a.sampleCount);
+    ASSERT_EQ(64, a.pixelSampleCounts.size());
+    for (int y = 0; y < 8; ++y)
+        for (int x = 0; x < 8; ++x) {
+            int offset = y * 8 + x;
+            EXPECT_EQ((x < 6 ? 2 : 0) + (x >= 2 ? 3 : 0), a.PixelSampleCount(offset));
+            EXPECT_EQ((x < 6 ? 1. : 0.) + (x >= 2 ? 2. : 0.), a.values[7 * offset]);
+        }
+}
+
+TEST(FilmState, ReadWrite) {
+    FilmState state = MakeState(Bounds2i(Point2i(1, 2), Point2i(5, 7)), 16, 0.5);
+    state.scale = 2;
+    std::string fn = "filmstate.pbrtfilm";
+    EXPECT_TRUE(state.WriteFile(fn));
+
+    pstd::optional<FilmState> read = FilmState::ReadFile(fn);
+    ASSERT_TRUE(read.has_value());
+    EXPECT_EQ(state.filmName, read->filmName);
+    EXPECT_EQ(state.pixelBounds, read->pixelBounds);
+    EXPECT_EQ(state.sampleCount, read->sampleCount);
+    EXPECT_EQ(state.scale, read->scale);
+    EXPECT_EQ(state.values, read->values);
+    EXPECT_EQ(state.variance.size(), read->variance.size());
+    EXPECT_TRUE(read->pixelSampleCounts.empty());
+    EXPECT_EQ(0, remove(fn.c_str()));
+
+    state.pixelSampleCounts.assign(state.pixelBounds.Area(), 8);
+    state.pixelSampleCounts[3] = 16;
+    EXPECT_TRUE(state.WriteFile(fn));
+    read = FilmState::ReadFile(fn);
+    ASSERT_TRUE(read.has_value());
+    EXPECT_EQ(state.pixelSampleCounts, read->pixelSampleCounts);
+    EXPECT_EQ(0, remove(fn.c_str()));
+}
@@ -94,20 +94,13 @@ GPUPathIntegrator::GPUPathIntegrator(Allocator alloc, const ParsedScene &scene)
 
     pstd::vector<LightHandle> allLights;
 
-    for (const auto &light : scene.lights) {
-        MediumHandle outsideMedium = findMedium(light.medium, &light.loc);
-        if (light.renderFromObject.IsAnimated())
-            Warning(&light.loc,
-                    "Animated lights aren't supported. Using the start transform.");
-
-        LightHandle l = LightHandle::Create(
-            light.name, light.parameters, light.renderFromObject.startTransform,
-            scene.camera.cameraTransform, outsideMedium, &light.loc, alloc);
-
+    std::vector<LightHandle> lights = scene.CreateLights(alloc, findMedium);
+    for (size_t i = 0; i < lights.size(); ++i) {
+        LightHandle l = lights[i];
         if (l.Is<UniformInfiniteLight>() || l.Is<ImageInfiniteLight>() ||
             l.Is<PortalImageInfiniteLight>()) {
             if (envLight)
-                Warning(&light.loc,
+                Warning(&scene.lights[i].loc,
                         "Multiple infinite lights specified. Using this one.");
             envLight = l;
         }
@@ -7,36 +7,63 @@
 
 #include <pbrt/pbrt.h>
 
-#include <pbrt/gpu/launch.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/pstd.h>
+#ifdef PBRT_BUILD_GPU_RENDERER
+#include <pbrt/gpu/launch.h>
+#endif
 
+#ifdef PBRT_BUILD_GPU_RENDERER
 #include <cuda/atomic>
+#else
+#include <atomic>
+#endif
 #include <utility>
 
 namespace pbrt {
 
+// Work queues are also used by the CPU wavefront integrator, in which case
+// a regular std::atomic tracks the number of queued items.
+#ifdef PBRT_BUILD_GPU_RENDERER
+using WorkQueueCounter = cuda::atomic<int, cuda::thread_scope_device>;
+static constexpr cuda::std::memory_order WorkQueueMemoryOrder =
+    cuda::std::memory_order_relaxed;
+#else
+using WorkQueueCounter = std::atomic<int>;
+static constexpr std::memory_order WorkQueueMemoryOrder = std::memory_order_relaxed;
+#endif
+
 template <typename WorkItem>
 class WorkQueue : public SOA<WorkItem> {
   public:
     WorkQueue(int n, Allocator alloc) : SOA<WorkItem>(n, alloc) {}
 
     PBRT_CPU_GPU
-    int Size() const { return size.load(cuda::std::memory_order_relaxed); }
+    int Size() const { return size.load(WorkQueueMemoryOrder); }
 
     PBRT_CPU_GPU
-    void Reset() { size.store(0, cuda::std::memory_order_relaxed); }
+    void Reset() { size.store(0, WorkQueueMemoryOrder); }
 
     PBRT_CPU_GPU
     int Push(WorkItem w) {
-        int index = size.fetch_add(1, cuda::std::memory_order_relaxed);
+        int index = AllocateEntry();
         (*this)[index] = w;
         return index;
     }
 
   protected:
-    cuda::atomic<int, cuda::thread_scope_device> size{0};
+    PBRT_CPU_GPU
+    int AllocateEntry() { return size.fetch_add(1, WorkQueueMemoryOrder); }
+
+    WorkQueueCounter size{0};
 };
 
+// CPUExecution Definition
+// Passing _CPUExecution_ to ForAllQueued() runs the loop on the CPU with
+// host code, even in builds that also include the GPU renderer.
+struct CPUExecution {};
+
+#ifdef PBRT_BUILD_GPU_RENDERER
 template <typename F, typename WorkItem>
 void ForAllQueued(const char *desc, WorkQueue<WorkItem> *q, int maxQueued, F func) {
     GPUParallelFor(desc, maxQueued, [=] PBRT_GPU(int index) {
@@ -45,6 +72,18 @@ void ForAllQueued(const char *desc, WorkQueue<WorkItem> *q, int maxQueued, F fun
         func((*q)[index], index);
     });
 }
+#endif  // PBRT_BUILD_GPU_RENDERER
+
+// On the CPU, the number of queued items is known when the loop starts, so
+// there's no need to launch _maxQueued_ threads.
+template <typename F, typename WorkItem>
+void ForAllQueued(CPUExecution, const char *desc, WorkQueue<WorkItem> *q,
+                  int maxQueued, F func) {
+    ParallelFor(0, q->Size(), [&](int64_t start, int64_t end) {
+        for (int64_t index = start; index < end; ++index)
+            func((*q)[index], index);
+    });
+}
 
 template <template <typename> class Work, typename... Ts>
 class MultiWorkQueueHelper;
@@ -97,7 +136,6 @@ class MultiWorkQueueHelper<WorkItem, T, Ts...>
     }
 
   private:
-    cuda::atomic<int, cuda::thread_scope_device> size{0};
     WorkQueue<WorkItem<T>> q;
 };
 
@@ -79,12 +79,12 @@ LightBounds Union(const LightBounds &a, const LightBounds &b) {
 
 // PointLight Method Definitions
 SampledSpectrum PointLight::Phi(const SampledWavelengths &lambda) const {
-    return 4 * Pi * scale * I.Sample(lambda);
+    return 4 * Pi * scale * I->Sample(lambda);
 }
 
 LightBounds PointLight::Bounds() const {
     Point3f p = renderFromLight(Point3f(0, 0, 0));
-    return LightBounds(p, Vector3f(0, 0, 1), 4 * Pi * scale * I.MaxValue(), Pi, Pi / 2,
+    return LightBounds(p, Vector3f(0, 0, 1), 4 * Pi * scale * I->MaxValue(), Pi, Pi / 2,
                        false);
 }
 
@@ -92,7 +92,7 @@ LightLeSample PointLight::SampleLe(const Point2f &u1, const Point2f &u2,
                                    SampledWavelengths &lambda, Float time) const {
     Point3f p = renderFromLight(Point3f(0, 0, 0));
     Ray ray(p, SampleUniformSphere(u1), time, mediumInterface.outside);
-    return LightLeSample(scale * I.Sample(lambda), ray, 1, UniformSpherePDF());
+    return LightLeSample(scale * I->Sample(lambda), ray, 1, UniformSpherePDF());
 }
 
 void PointLight::PDF_Le(const Ray &, Float *pdfPos, Float *pdfDir) const {
@@ -101,7 +101,7 @@ void PointLight::PDF_Le(const Ray &, Float *pdfPos, Float *pdfDir) const {
 }
 
 std::string PointLight::ToString() const {
-    return StringPrintf("[ PointLight %s I: %s scale: %f ]", BaseToString(), I, scale);
+    return StringPrintf("[ PointLight %s I: %s scale: %f ]", BaseToString(), *I, scale);
 }
 
 PointLight *PointLight::Create(const Transform &renderFromLight, MediumHandle medium,
@@ -131,11 +131,11 @@ PointLight *PointLight::Create(const Transform &renderFromLight, MediumHandle me
 DistantLight::DistantLight(const Transform &renderFromLight, SpectrumHandle Lemit,
                            Float scale, Allocator alloc)
     : LightBase(LightType::DeltaDirection, renderFromLight, MediumInterface()),
-      Lemit(Lemit, alloc),
+      Lemit(LookupSpectrum(Lemit)),
       scale(scale) {}
 
 SampledSpectrum DistantLight::Phi(const SampledWavelengths &lambda) const {
-    return scale * Lemit.Sample(lambda) * Pi * sceneRadius * sceneRadius;
+    return scale * Lemit->Sample(lambda) * Pi * sceneRadius * sceneRadius;
 }
 
 LightLeSample DistantLight::SampleLe(const Point2f &u1, const Point2f &u2,
@@ -149,7 +149,7 @@ LightLeSample DistantLight::SampleLe(const Point2f &u1, const Point2f &u2,
     // Compute _DistantLight_ light ray
     Ray ray(pDisk + sceneRadius * w, -w, time);
 
-    return LightLeSample(scale * Lemit.Sample(lambda), ray,
+    return LightLeSample(scale * Lemit->Sample(lambda), ray,
                          1 / (Pi * sceneRadius * sceneRadius), 1);
 }
 
@@ -159,7 +159,7 @@ void DistantLight::PDF_Le(const Ray &, Float *pdfPos, Float *pdfDir) const {
 }
 
 std::string DistantLight::ToString() const {
-    return StringPrintf("[ DistantLight %s Lemit: %s scale: %f ]", BaseToString(), Lemit,
+    return StringPrintf("[ DistantLight %s Lemit: %s scale: %f ]", BaseToString(), *Lemit,
                         scale);
 }
 
@@ -432,7 +432,7 @@ GoniometricLight::GoniometricLight(const Transform &renderFromLight,
                                    SpectrumHandle I, Float scale, Image im,
                                    const RGBColorSpace *imageColorSpace, Allocator alloc)
     : LightBase(LightType::DeltaPosition, renderFromLight, mediumInterface),
-      I(I, alloc),
+      I(LookupSpectrum(I)),
       scale(scale),
       image(std::move(im)),
       imageColorSpace(imageColorSpace),
@@ -475,7 +475,7 @@ LightBounds GoniometricLight::Bounds() const {
                 sinTheta * image.GetChannels({u, v}, wrapMode).MaxValue();
     }
     Float phi =
-        scale * I.MaxValue() * 2 * Pi * Pi * weightedMaxImageSum / (width * height);
+        scale * I->MaxValue() * 2 * Pi * Pi * weightedMaxImageSum / (width * height);
 
     Point3f p = renderFromLight(Point3f(0, 0, 0));
     // Bound it as an isotropic point light.
@@ -491,7 +491,7 @@ SampledSpectrum GoniometricLight::Phi(const SampledWavelengths &lambda) const {
         for (int u = 0; u < width; ++u)
             sumY += sinTheta * image.GetChannels({u, v}, wrapMode).Average();
     }
-    return scale * I.Sample(lambda) * 2 * Pi * Pi * sumY / (width * height);
+    return scale * I->Sample(lambda) * 2 * Pi * Pi * sumY / (width * height);
 }
 
 LightLeSample GoniometricLight::SampleLe(const Point2f &u1, const Point2f &u2,
@@ -516,7 +516,7 @@ void GoniometricLight::PDF_Le(const Ray &ray, Float *pdfPos, Float *pdfDir) cons
 }
 
 std::string GoniometricLight::ToString() const {
-    return StringPrintf("[ GoniometricLight %s I: %s scale: %f ]", BaseToString(), I,
+    return StringPrintf("[ GoniometricLight %s I: %s scale: %f ]", BaseToString(), *I,
                         scale);
 }
 
@@ -595,7 +595,7 @@ DiffuseAreaLight::DiffuseAreaLight(const Transform &renderFromLight,
                                    const RGBColorSpace *imageColorSpace, bool twoSided,
                                    Allocator alloc)
     : LightBase(LightType::Area, renderFromLight, mediumInterface),
-      Lemit(Le, alloc),
+      Lemit(LookupSpectrum(Le)),
       scale(scale),
       shape(shape),
       twoSided(twoSided),
@@ -640,7 +640,7 @@ SampledSpectrum DiffuseAreaLight::Phi(const SampledWavelengths &lambda) const {
         phi /= image.Resolution().x * image.Resolution().y;
 
     } else
-        phi = Lemit.Sample(lambda);
+        phi = Lemit->Sample(lambda);
     return phi * (twoSided ? 2 : 1) * scale * area * Pi;
 }
 
@@ -654,7 +654,7 @@ LightBounds DiffuseAreaLight::Bounds() const {
                     phi += image.GetChannel({x, y}, c);
         phi /= 3 * image.Resolution().x * image.Resolution().y;
     } else
-        phi = Lemit.MaxValue();
+        phi = Lemit->MaxValue();
 
     phi *= scale * (twoSided ? 2 : 1) * area * Pi;
 
@@ -716,7 +716,7 @@ void DiffuseAreaLight::PDF_Le(const Interaction &intr, Vector3f &w, Float *pdfPo
 std::string DiffuseAreaLight::ToString() const {
     return StringPrintf("[ DiffuseAreaLight %s Lemit: %s scale: %f shape: %s "
                         "twoSided: %s area: %f image: %s ]",
-                        BaseToString(), Lemit, scale, shape, twoSided ? "true" : "false",
+                        BaseToString(), *Lemit, scale, shape, twoSided ? "true" : "false",
                         area, image);
 }
 
@@ -794,19 +794,19 @@ UniformInfiniteLight::UniformInfiniteLight(const Transform &renderFromLight,
                                            SpectrumHandle Lemit, Float scale,
                                            Allocator alloc)
     : LightBase(LightType::Infinite, renderFromLight, MediumInterface()),
-      Lemit(Lemit, alloc),
+      Lemit(LookupSpectrum(Lemit)),
       scale(scale) {}
 
 SampledSpectrum UniformInfiniteLight::Le(const Ray &ray,
                                          const SampledWavelengths &lambda) const {
-    return scale * Lemit.Sample(lambda);
+    return scale * Lemit->Sample(lambda);
 }
 
 SampledSpectrum UniformInfiniteLight::Phi(const SampledWavelengths &lambda) const {
     // TODO: is there another Pi or so for the hemisphere?
     // pi r^2 for disk
     // 2pi for cosine-weighted sphere
-    return 2 * Pi * Pi * Sqr(sceneRadius) * scale * Lemit.Sample(lambda);
+    return 2 * Pi * Pi * Sqr(sceneRadius) * scale * Lemit->Sample(lambda);
 }
 
 LightLiSample UniformInfiniteLight::SampleLi(LightSampleContext ctx, Point2f u,
@@ -815,7 +815,7 @@ LightLiSample UniformInfiniteLight::SampleLi(LightSampleContext ctx, Point2f u,
     Vector3f wi = SampleUniformSphere(u);
     Float pdf = UniformSpherePDF();
     return LightLiSample(
-        this, scale * Lemit.Sample(lambda), wi, pdf,
+        this, scale * Lemit->Sample(lambda), wi, pdf,
         Interaction(ctx.p() + wi * (2 * sceneRadius), 0 /* time */, &mediumInterface));
 }
 
@@ -838,7 +838,7 @@ LightLeSample UniformInfiniteLight::SampleLe(const Point2f &u1, const Point2f &u
     Float pdfPos = 1 / (Pi * Sqr(sceneRadius));
     Float pdfDir = UniformSpherePDF();
 
-    return LightLeSample(scale * Lemit.Sample(lambda), ray, pdfPos, pdfDir);
+    return LightLeSample(scale * Lemit->Sample(lambda), ray, pdfPos, pdfDir);
 }
 
 void UniformInfiniteLight::PDF_Le(const Ray &ray, Float *pdfPos, Float *pdfDir) const {
@@ -847,7 +847,7 @@ void UniformInfiniteLight::PDF_Le(const Ray &ray, Float *pdfPos, Float *pdfDir)
 }
 
 std::string UniformInfiniteLight::ToString() const {
-    return StringPrintf("[ UniformInfiniteLight %s Lemit: %s ]", BaseToString(), Lemit);
+    return StringPrintf("[ UniformInfiniteLight %s Lemit: %s ]", BaseToString(), *Lemit);
 }
 
 // ImageInfiniteLight Method Definitions
@@ -1193,7 +1193,7 @@ SpotLight::SpotLight(const Transform &renderFromLight,
                      const MediumInterface &mediumInterface, SpectrumHandle I,
                      Float scale, Float totalWidth, Float falloffStart, Allocator alloc)
     : LightBase(LightType::DeltaPosition, renderFromLight, mediumInterface),
-      I(I, alloc),
+      I(LookupSpectrum(I)),
       scale(scale),
       cosFalloffEnd(std::cos(Radians(totalWidth))),
       cosFalloffStart(std::cos(Radians(falloffStart))) {
@@ -1207,7 +1207,7 @@ LightLiSample SpotLight::SampleLi(LightSampleContext ctx, Point2f u,
     Vector3f wi = Normalize(p - ctx.p());
     Vector3f wl = Normalize(renderFromLight.ApplyInverse(-wi));
     SampledSpectrum L =
-        scale * I.Sample(lambda) * Falloff(wl) / DistanceSquared(p, ctx.p());
+        scale * I->Sample(lambda) * Falloff(wl) / DistanceSquared(p, ctx.p());
     if (!L)
         return {};
     return LightLiSample(this, L, wi, 1, Interaction(p, 0 /* time */, &mediumInterface));
@@ -1229,7 +1229,7 @@ LightBounds SpotLight::Bounds() const {
     Vector3f w = Normalize(renderFromLight(Vector3f(0, 0, 1)));
     // As in Phi()
 #if 0
-    Float phi = scale * I.MaxValue() * 2 * Pi * ((1 - cosFalloffStart) +
+    Float phi = scale * I->MaxValue() * 2 * Pi * ((1 - cosFalloffStart) +
                                           (cosFalloffStart - cosFalloffEnd) / 2);
 #else
     // cf. room-subsurf-from-kd.pbrt test: we sorta kinda actually want to
@@ -1238,7 +1238,7 @@ LightBounds SpotLight::Bounds() const {
     // light's cone, so inside the cone, it doesn't matter if the overall
     // power is low; it's more accurate to effectively treat it as a point
     // light source.
-    Float phi = scale * I.MaxValue() * 4 * Pi;
+    Float phi = scale * I->MaxValue() * 4 * Pi;
 #endif
 
     return LightBounds(p, w, phi, 0.f, std::acos(cosFalloffEnd), false);
@@ -1249,7 +1249,7 @@ SampledSpectrum SpotLight::Phi(const SampledWavelengths &lambda) const {
     // See notes/sample-spotlight.nb for the falloff part:
     // int_start^end smoothstep(cost, end, start) sin theta dtheta =
     //  (cosStart - cosEnd) / 2
-    return scale * I.Sample(lambda) * 2 * Pi *
+    return scale * I->Sample(lambda) * 2 * Pi *
            ((1 - cosFalloffStart) + (cosFalloffStart - cosFalloffEnd) / 2);
 }
 
@@ -1278,7 +1278,7 @@ LightLeSample SpotLight::SampleLe(const Point2f &u1, const Point2f &u2,
     }
 
     Ray ray = renderFromLight(Ray(Point3f(0, 0, 0), wl, time, mediumInterface.outside));
-    return LightLeSample(scale * I.Sample(lambda) * Falloff(wl), ray, 1, pdfDir);
+    return LightLeSample(scale * I->Sample(lambda) * Falloff(wl), ray, 1, pdfDir);
 }
 
 void SpotLight::PDF_Le(const Ray &ray, Float *pdfPos, Float *pdfDir) const {
@@ -1297,7 +1297,7 @@ void SpotLight::PDF_Le(const Ray &ray, Float *pdfPos, Float *pdfDir) const {
 
 std::string SpotLight::ToString() const {
     return StringPrintf("[ SpotLight %s I: %s cosFalloffStart: %f cosFalloffEnd: %f ]",
-                        BaseToString(), I, cosFalloffStart, cosFalloffEnd);
+                        BaseToString(), *I, cosFalloffStart, cosFalloffEnd);
 }
 
 SpotLight *SpotLight::Create(const Transform &renderFromLight, MediumHandle medium,
@@ -1488,7 +1488,12 @@ LightHandle LightHandle::Create(const std::string &name,
                 scale *= E_v / k_e;
             }
 
-            Image image = imageAndMetadata.image.SelectChannels(channelDesc, alloc);
+            // Use the image as is when possible so that pixels that are
+            // mapped from a raw image file aren't copied.
+            Image image = (channelDesc.IsIdentity() &&
+                           imageAndMetadata.image.NChannels() == 3)
+                              ? std::move(imageAndMetadata.image)
+                              : imageAndMetadata.image.SelectChannels(channelDesc, alloc);
 
             if (!portal.empty()) {
                 for (Point3f &p : portal)
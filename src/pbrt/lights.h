@@ -259,7 +259,7 @@ class PointLight : public LightBase {
     PointLight(const Transform &renderFromLight, const MediumInterface &mediumInterface,
                SpectrumHandle I, Float scale, Allocator alloc)
         : LightBase(LightType::DeltaPosition, renderFromLight, mediumInterface),
-          I(I, alloc),
+          I(LookupSpectrum(I)),
           scale(scale) {}
 
     static PointLight *Create(const Transform &renderFromLight, MediumHandle medium,
@@ -289,7 +289,7 @@ class PointLight : public LightBase {
                            LightSamplingMode mode) const {
         Point3f p = renderFromLight(Point3f(0, 0, 0));
         Vector3f wi = Normalize(p - ctx.p());
-        return LightLiSample(this, scale * I.Sample(lambda) / DistanceSquared(p, ctx.p()),
+        return LightLiSample(this, scale * I->Sample(lambda) / DistanceSquared(p, ctx.p()),
                              wi, 1, Interaction(p, 0 /* time */, &mediumInterface));
     }
 
@@ -298,7 +298,7 @@ class PointLight : public LightBase {
 
   private:
     // PointLight Private Members
-    DenselySampledSpectrum I;
+    const DenselySampledSpectrum *I;
     Float scale;
 };
 
@@ -343,13 +343,13 @@ class DistantLight : public LightBase {
                            LightSamplingMode mode) const {
         Vector3f wi = Normalize(renderFromLight(Vector3f(0, 0, 1)));
         Point3f pOutside = ctx.p() + wi * (2 * sceneRadius);
-        return LightLiSample(this, scale * Lemit.Sample(lambda), wi, 1,
+        return LightLiSample(this, scale * Lemit->Sample(lambda), wi, 1,
                              Interaction(pOutside, 0 /* time */, &mediumInterface));
     }
 
   private:
     // DistantLight Private Members
-    DenselySampledSpectrum Lemit;
+    const DenselySampledSpectrum *Lemit;
     Float scale;
     Point3f sceneCenter;
     Float sceneRadius;
@@ -451,12 +451,12 @@ class GoniometricLight : public LightBase {
     SampledSpectrum Scale(Vector3f wl, const SampledWavelengths &lambda) const {
         Float theta = SphericalTheta(wl), phi = SphericalPhi(wl);
         Point2f st(phi * Inv2Pi, theta * InvPi);
-        return scale * I.Sample(lambda) * image.LookupNearestChannel(st, 0);
+        return scale * I->Sample(lambda) * image.LookupNearestChannel(st, 0);
     }
 
   private:
     // GoniometricLight Private Members
-    DenselySampledSpectrum I;
+    const DenselySampledSpectrum *I;
     Float scale;
     Image image;
     const RGBColorSpace *imageColorSpace;
@@ -510,7 +510,7 @@ class DiffuseAreaLight : public LightBase {
                 rgb[c] = image.BilerpChannel(uv, c);
             return scale * RGBSpectrum(*imageColorSpace, rgb).Sample(lambda);
         } else
-            return scale * Lemit.Sample(lambda);
+            return scale * Lemit->Sample(lambda);
     }
 
     PBRT_CPU_GPU
@@ -542,7 +542,7 @@ class DiffuseAreaLight : public LightBase {
 
   private:
     // DiffuseAreaLight Private Members
-    DenselySampledSpectrum Lemit;
+    const DenselySampledSpectrum *Lemit;
     Float scale;
     ShapeHandle shape;
     bool twoSided;
@@ -589,7 +589,7 @@ class UniformInfiniteLight : public LightBase {
 
   private:
     // UniformInfiniteLight Private Members
-    DenselySampledSpectrum Lemit;
+    const DenselySampledSpectrum *Lemit;
     Float scale;
     Point3f sceneCenter;
     Float sceneRadius;
@@ -823,7 +823,7 @@ class SpotLight : public LightBase {
 
   private:
     // SpotLight Private Members
-    DenselySampledSpectrum I;
+    const DenselySampledSpectrum *I;
     Float scale;
     Float cosFalloffStart, cosFalloffEnd;
 };
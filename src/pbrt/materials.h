@@ -84,24 +84,25 @@ PBRT_CPU_GPU void Bump(TextureEvaluator texEval, FloatTextureHandle displacement
     DCHECK(displacement != nullptr);
     DCHECK(texEval.CanEvaluate({displacement}, {}));
     // Compute offset positions and evaluate displacement texture
-    TextureEvalContext shiftedCtx = si;
-    // Shift _shiftedCtx_ _du_ in the $u$ direction
+    pstd::array<TextureEvalContext, 3> ctx = {si, si, si};
+    // Shift _ctx[1]_ _du_ in the $u$ direction
     Float du = .5f * (std::abs(si.dudx) + std::abs(si.dudy));
     if (du == 0)
         du = .0005f;
-    shiftedCtx.p = si.p + du * si.shading.dpdu;
-    shiftedCtx.uv = si.uv + Vector2f(du, 0.f);
+    ctx[1].p = si.p + du * si.shading.dpdu;
+    ctx[1].uv = si.uv + Vector2f(du, 0.f);
 
-    Float uDisplace = texEval(displacement, shiftedCtx);
-    // Shift _shiftedCtx_ _dv_ in the $v$ direction
+    // Shift _ctx[2]_ _dv_ in the $v$ direction
     Float dv = .5f * (std::abs(si.dvdx) + std::abs(si.dvdy));
     if (dv == 0)
         dv = .0005f;
-    shiftedCtx.p = si.p + dv * si.shading.dpdv;
-    shiftedCtx.uv = si.uv + Vector2f(0.f, dv);
+    ctx[2].p = si.p + dv * si.shading.dpdv;
+    ctx[2].uv = si.uv + Vector2f(0.f, dv);
 
-    Float vDisplace = texEval(displacement, shiftedCtx);
-    Float displace = texEval(displacement, si);
+    // Evaluate the displacement at all three points together so that the
+    // evaluator can share work between them
+    pstd::array<Float, 3> values = texEval(displacement, ctx);
+    Float displace = values[0], uDisplace = values[1], vDisplace = values[2];
 
     // Compute bump-mapped differential geometry
     *dpdu = si.shading.dpdu + (uDisplace - displace) / du * Vector3f(si.shading.n) +
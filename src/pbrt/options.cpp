@@ -20,11 +20,16 @@ std::string PBRTOptions::ToString() const {
         "recordPixelStatistics: %s upgrade: %s disablePixelJitter: %s "
         "disableWavelengthJitter: %s forceDiffuse: %s useGPU: %s "
         "imageFile: %s mseReferenceImage: %s mseReferenceOutput: %s "
-        "debugStart: %s displayServer: %s cropWindow: %s pixelBounds: %s ]",
+        "debugStart: %s displayServer: %s checkpointFile: %s checkpointInterval: %f "
+        "resume: %s sampleRangeStart: %d sampleRangeEnd: %s filmStateFile: %s "
+        "nWorkers: %d workUnitSamples: %d cropWindow: %s pixelBounds: %s "
+        "textureCacheMB: %d textureCacheDir: %s approximateBumpGradients: %s ]",
         nThreads, seed, quickRender, quiet, recordPixelStatistics, upgrade,
         disablePixelJitter, disableWavelengthJitter, forceDiffuse, useGPU, imageFile,
-        mseReferenceImage, mseReferenceOutput, debugStart, displayServer, cropWindow,
-        pixelBounds);
+        mseReferenceImage, mseReferenceOutput, debugStart, displayServer, checkpointFile,
+        checkpointInterval, resume, sampleRangeStart, sampleRangeEnd, filmStateFile,
+        nWorkers, workUnitSamples, cropWindow, pixelBounds, textureCacheMB,
+        textureCacheDir, approximateBumpGradients);
 }
 
 }  // namespace pbrt
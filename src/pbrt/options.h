@@ -40,8 +40,23 @@ struct PBRTOptions : BasicOptions {
     std::string mseReferenceImage, mseReferenceOutput;
     std::string debugStart;
     std::string displayServer;
+    std::string checkpointFile;
+    Float checkpointInterval = 300;
+    bool resume = false;
+    int sampleRangeStart = 0;
+    pstd::optional<int> sampleRangeEnd;
+    std::string filmStateFile;
+    int nWorkers = 0;
+    int workUnitSamples = 0;
     pstd::optional<Bounds2f> cropWindow;
     pstd::optional<Bounds2i> pixelBounds;
+    // If non-zero, image textures are stored in tiles that are read on
+    // demand into a cache of at most this many megabytes.
+    int textureCacheMB = 0;
+    std::string textureCacheDir;
+    // Estimate the displacement at Bump()'s offset points from the gradient
+    // of the filtered image texture rather than evaluating it there.
+    bool approximateBumpGradients = false;
 
     std::string ToString() const;
 };
@@ -16,6 +16,7 @@
 #include <pbrt/util/spectrum.h>
 
 #include <algorithm>
+#include <mutex>
 #include <utility>
 
 namespace pbrt {
@@ -353,10 +354,13 @@ std::vector<Normal3f> ParameterDictionary::GetNormal3fArray(
 }
 
 static std::map<std::string, SpectrumHandle> cachedSpectra;
+static std::mutex cachedSpectraMutex;
 
 // TODO: move this functionality (but not the caching?) to a Spectrum method.
 static SpectrumHandle readSpectrumFromFile(const std::string &filename, Allocator alloc) {
     std::string fn = ResolveFilename(filename);
+    // Lights and textures may be created by multiple threads.
+    std::lock_guard<std::mutex> lock(cachedSpectraMutex);
     if (cachedSpectra.find(fn) != cachedSpectra.end())
         return cachedSpectra[fn];
 
@@ -4,6 +4,7 @@
 
 #include <pbrt/parsedscene.h>
 
+#include <pbrt/lights.h>
 #include <pbrt/materials.h>
 #include <pbrt/options.h>
 #include <pbrt/paramdict.h>
@@ -155,6 +156,7 @@ TransformCache::~TransformCache() {
 
 STAT_COUNTER("Scene/Object instances created", nObjectInstancesCreated);
 STAT_COUNTER("Scene/Object instances used", nObjectInstancesUsed);
+STAT_COUNTER("Scene/Texture nodes removed by optimization", nTextureNodesRemoved);
 
 // ParsedScene Method Definitions
 ParsedScene::ParsedScene() {
@@ -802,7 +804,11 @@ void ParsedScene::CreateTextures(
 
     // Figure out which textures to load in parallel
     // Need to be careful since two textures can use the same image file;
-    // we only want to load it once in that case...
+    // only the first is loaded in parallel. The texture cache creates
+    // each image under a std::once_flag, and a thread that is waiting on
+    // the image's own ParallelFor may run another iteration of the loop
+    // below; if that iteration requested the same image, the thread would
+    // wait on itself.
     for (size_t i = 0; i < floatTextures.size(); ++i) {
         const auto &tex = floatTextures[i];
 
@@ -912,6 +918,16 @@ void ParsedScene::CreateTextures(
         (*spectrumTextureMap)[tex.first] = t;
     }
 
+    // Simplify the texture graph now that all of the textures exist
+    TextureGraphOptimizer optimizer(alloc);
+    for (auto &tex : *floatTextureMap)
+        tex.second = optimizer.Optimize(tex.second);
+    for (auto &tex : *spectrumTextureMap)
+        tex.second = optimizer.Optimize(tex.second);
+    nTextureNodesRemoved += optimizer.NodesRemoved();
+    LOG_VERBOSE("Texture graph optimization removed %d textures",
+                optimizer.NodesRemoved());
+
     LOG_VERBOSE("Done creating textures");
 }
 
@@ -936,6 +952,52 @@ std::map<std::string, MediumHandle> ParsedScene::CreateMedia(Allocator alloc) co
     return mediaMap;
 }
 
+std::vector<LightHandle> ParsedScene::CreateLights(
+    Allocator alloc,
+    std::function<MediumHandle(const std::string &, const FileLoc *)> findMedium) const {
+    // Look up the media first, since _findMedium_ may not be thread-safe
+    std::vector<MediumHandle> outsideMedia;
+    for (const auto &light : lights) {
+        outsideMedia.push_back(findMedium(light.medium, &light.loc));
+        if (light.renderFromObject.IsAnimated())
+            Warning(&light.loc,
+                    "Animated lights aren't supported. Using the start transform.");
+    }
+
+    // Lights that use images are created in parallel, since most of their
+    // creation time goes to reading and decoding the image. Only the first
+    // light that uses each file is created then, so that no image is
+    // decoded twice at once; the rest are created serially afterward, as
+    // CreateTextures() does for image textures.
+    std::vector<size_t> parallelLights, serialLights;
+    std::set<std::string> imageFilenames;
+    for (size_t i = 0; i < lights.size(); ++i) {
+        std::string filename =
+            ResolveFilename(lights[i].parameters.GetOneString("filename", ""));
+        if (!filename.empty() && imageFilenames.insert(filename).second)
+            parallelLights.push_back(i);
+        else
+            serialLights.push_back(i);
+    }
+    LOG_VERBOSE("Creating %d lights in parallel, %d serially", parallelLights.size(),
+                serialLights.size());
+
+    std::vector<LightHandle> lightHandles(lights.size());
+    auto createLight = [&](size_t i) {
+        const auto &light = lights[i];
+        lightHandles[i] = LightHandle::Create(
+            light.name, light.parameters, light.renderFromObject.startTransform,
+            camera.cameraTransform, outsideMedia[i], &light.loc, alloc);
+    };
+    ParallelFor(0, parallelLights.size(),
+                [&](int64_t i) { createLight(parallelLights[i]); });
+    for (size_t i : serialLights)
+        createLight(i);
+
+    LOG_VERBOSE("Done creating %d lights", lightHandles.size());
+    return lightHandles;
+}
+
 // FormattingScene Method Definitions
 FormattingScene::~FormattingScene() {
     if (errorExit)
@@ -7,6 +7,7 @@
 
 #include <pbrt/pbrt.h>
 
+#include <pbrt/base/light.h>
 #include <pbrt/cameras.h>
 #include <pbrt/paramdict.h>
 #include <pbrt/util/error.h>
@@ -14,6 +15,7 @@
 #include <pbrt/util/print.h>
 #include <pbrt/util/transform.h>
 
+#include <functional>
 #include <map>
 #include <set>
 #include <string>
@@ -342,6 +344,13 @@ class ParsedScene : public SceneRepresentation {
 
     std::map<std::string, MediumHandle> CreateMedia(Allocator alloc) const;
 
+    // Creates the lights other than area lights in parallel, so that the
+    // image files that they use are read concurrently.
+    std::vector<LightHandle> CreateLights(
+        Allocator alloc,
+        std::function<MediumHandle(const std::string &, const FileLoc *)> findMedium)
+        const;
+
     // ParsedScene Public Members
     SceneEntity film, sampler, integrator, filter, accelerator;
     CameraSceneEntity camera;
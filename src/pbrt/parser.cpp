@@ -529,6 +529,681 @@ static ParsedParameterVector parseParameters(
     return parameterVector;
 }
 
+///////////////////////////////////////////////////////////////////////////
+// Binary Scene Files
+
+// Binary scene files start with a magic number and the value 1 as a 32-bit
+// integer, which identifies files written on machines with a different
+// byte order. A sequence of records follows, each starting with a
+// BinarySceneOp. SetFile records give the filename of the locations of the
+// records that follow them and SearchDirectory records give the absolute
+// path of the directory that their relative filenames are resolved from;
+// all others are followed by the line and column of the directive and then
+// its arguments. Floats are stored as doubles,
+// strings as a 64-bit length followed by their characters, and parameter
+// lists as a count followed by each parameter's type, name, location and
+// values. Numeric parameter values are an array of doubles that is copied
+// directly into the ParsedParameter when the file is read.
+static constexpr char binarySceneMagic[8] = {'p', 'b', 'r', 't', 'b', 'i', 'n', '1'};
+
+enum class BinarySceneOp : uint32_t {
+    SetFile,
+    Option,
+    Identity,
+    Translate,
+    Rotate,
+    Scale,
+    LookAt,
+    ConcatTransform,
+    Transform,
+    CoordinateSystem,
+    CoordSysTransform,
+    ActiveTransformAll,
+    ActiveTransformEndTime,
+    ActiveTransformStartTime,
+    TransformTimes,
+    ColorSpace,
+    PixelFilter,
+    Film,
+    Sampler,
+    Accelerator,
+    Integrator,
+    Camera,
+    MakeNamedMedium,
+    MediumInterface,
+    WorldBegin,
+    AttributeBegin,
+    AttributeEnd,
+    Attribute,
+    TransformBegin,
+    TransformEnd,
+    Texture,
+    Material,
+    MakeNamedMaterial,
+    NamedMaterial,
+    LightSource,
+    AreaLightSource,
+    Shape,
+    ReverseOrientation,
+    ObjectBegin,
+    ObjectEnd,
+    ObjectInstance,
+    SearchDirectory
+};
+
+static bool isBinarySceneFile(const std::string &filename) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f)
+        return false;
+    char magic[sizeof(binarySceneMagic)];
+    bool isBinary = fread(magic, sizeof(magic), 1, f) == 1 &&
+                    memcmp(magic, binarySceneMagic, sizeof(magic)) == 0;
+    fclose(f);
+    return isBinary;
+}
+
+// BinarySceneReader Definition
+class BinarySceneReader {
+  public:
+    BinarySceneReader(const MappedFile &file, const std::string &filename)
+        : data(file.data()), size(file.size()), filename(filename) {
+        if (size < sizeof(binarySceneMagic) ||
+            memcmp(data, binarySceneMagic, sizeof(binarySceneMagic)) != 0 ||
+            Read<int32_t>() != 1)
+            Corrupt();
+    }
+
+    bool AtEnd() const { return pos == size; }
+
+    template <typename T>
+    T Read() {
+        Require(sizeof(T));
+        T v;
+        std::memcpy(&v, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return v;
+    }
+
+    void ReadFloats(Float *v, int n) {
+        for (int i = 0; i < n; ++i)
+            v[i] = Read<double>();
+    }
+
+    std::string ReadString() {
+        uint64_t length = Read<uint64_t>();
+        Require(length);
+        std::string str((const char *)data + pos, length);
+        pos += length;
+        return str;
+    }
+
+    FileLoc ReadLoc() {
+        FileLoc loc(currentFile);
+        loc.line = Read<int32_t>();
+        loc.column = Read<int32_t>();
+        return loc;
+    }
+
+    void ReadFile() {
+        // As with the Tokenizer, the filename is leaked so that the FileLocs
+        // that refer to it remain valid after the file has been read.
+        currentFile = *new std::string(ReadString());
+    }
+
+    ParsedParameterVector ReadParameters(Allocator alloc) {
+        ParsedParameterVector params;
+        uint64_t count = Read<uint64_t>();
+        for (uint64_t i = 0; i < count; ++i) {
+            ParsedParameter *param = alloc.new_object<ParsedParameter>(alloc, FileLoc());
+            param->type = ReadString();
+            param->name = ReadString();
+            param->loc = ReadLoc();
+
+            // Copy the numeric values directly from the file
+            uint64_t nNumbers = Read<uint64_t>();
+            if (nNumbers > (size - pos) / sizeof(double))
+                Corrupt();
+            if (nNumbers > 0) {
+                param->numbers.resize(nNumbers);
+                std::memcpy(param->numbers.data(), data + pos, nNumbers * sizeof(double));
+                pos += nNumbers * sizeof(double);
+            }
+
+            uint64_t nStrings = Read<uint64_t>();
+            for (uint64_t j = 0; j < nStrings; ++j)
+                param->strings.push_back(ReadString());
+
+            uint64_t nBools = Read<uint64_t>();
+            Require(nBools);
+            for (uint64_t j = 0; j < nBools; ++j)
+                param->bools.push_back(data[pos + j]);
+            pos += nBools;
+
+            params.push_back(param);
+        }
+        return params;
+    }
+
+    [[noreturn]] void Corrupt() const {
+        ErrorExit("%s: binary scene file is corrupt or was written on a machine "
+                  "with a different byte order.",
+                  filename);
+    }
+
+  private:
+    void Require(uint64_t n) const {
+        if (n > size - pos)
+            Corrupt();
+    }
+
+    const uint8_t *data;
+    size_t size, pos = sizeof(binarySceneMagic);
+    std::string filename;
+    std::string_view currentFile;
+};
+
+// Files given on the command line use the search directory recorded in the
+// file, if it still exists, so that they can be written to a different
+// directory than the scene they were made from. Included files use the
+// including file's, as text files do.
+static void parseBinary(SceneRepresentation *scene, const std::string &filename,
+                        bool useSearchDirectory) {
+    LOG_VERBOSE("Reading binary scene file %s", filename);
+    std::unique_ptr<MappedFile> file = MappedFile::Open(filename);
+    if (!file)
+        ErrorExit("%s: %s", filename, ErrorString());
+    BinarySceneReader reader(*file, filename);
+
+    TrackedMemoryResource memoryResource;
+    Allocator alloc(&memoryResource);
+
+    FileLoc loc;
+    CheckCallbackScope _([&loc]() -> std::string {
+        return StringPrintf("Current parser location %s", loc);
+    });
+
+    while (!reader.AtEnd()) {
+        BinarySceneOp op = BinarySceneOp(reader.Read<uint32_t>());
+        if (op == BinarySceneOp::SetFile) {
+            reader.ReadFile();
+            continue;
+        } else if (op == BinarySceneOp::SearchDirectory) {
+            std::string dir = reader.ReadString();
+            if (useSearchDirectory && IsDirectory(dir))
+                SetSearchDirectory(dir);
+            else if (useSearchDirectory)
+                LOG_VERBOSE("%s: recorded search directory %s not found. Using the "
+                            "file's directory.",
+                            filename, dir);
+            continue;
+        }
+        loc = reader.ReadLoc();
+
+        // Read the arguments into variables before calling the scene's
+        // method, since the order that function arguments are evaluated in
+        // is unspecified.
+        Float v[16];
+        std::string name, type, texName;
+        switch (op) {
+        case BinarySceneOp::Option:
+            name = reader.ReadString();
+            scene->Option(name, reader.ReadString(), loc);
+            break;
+        case BinarySceneOp::Identity:
+            scene->Identity(loc);
+            break;
+        case BinarySceneOp::Translate:
+            reader.ReadFloats(v, 3);
+            scene->Translate(v[0], v[1], v[2], loc);
+            break;
+        case BinarySceneOp::Rotate:
+            reader.ReadFloats(v, 4);
+            scene->Rotate(v[0], v[1], v[2], v[3], loc);
+            break;
+        case BinarySceneOp::Scale:
+            reader.ReadFloats(v, 3);
+            scene->Scale(v[0], v[1], v[2], loc);
+            break;
+        case BinarySceneOp::LookAt:
+            reader.ReadFloats(v, 9);
+            scene->LookAt(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], loc);
+            break;
+        case BinarySceneOp::ConcatTransform:
+            reader.ReadFloats(v, 16);
+            scene->ConcatTransform(v, loc);
+            break;
+        case BinarySceneOp::Transform:
+            reader.ReadFloats(v, 16);
+            scene->Transform(v, loc);
+            break;
+        case BinarySceneOp::CoordinateSystem:
+            scene->CoordinateSystem(reader.ReadString(), loc);
+            break;
+        case BinarySceneOp::CoordSysTransform:
+            scene->CoordSysTransform(reader.ReadString(), loc);
+            break;
+        case BinarySceneOp::ActiveTransformAll:
+            scene->ActiveTransformAll(loc);
+            break;
+        case BinarySceneOp::ActiveTransformEndTime:
+            scene->ActiveTransformEndTime(loc);
+            break;
+        case BinarySceneOp::ActiveTransformStartTime:
+            scene->ActiveTransformStartTime(loc);
+            break;
+        case BinarySceneOp::TransformTimes:
+            reader.ReadFloats(v, 2);
+            scene->TransformTimes(v[0], v[1], loc);
+            break;
+        case BinarySceneOp::ColorSpace:
+            scene->ColorSpace(reader.ReadString(), loc);
+            break;
+        case BinarySceneOp::PixelFilter:
+            name = reader.ReadString();
+            scene->PixelFilter(name, reader.ReadParameters(alloc), loc);
+            break;
+        case BinarySceneOp::Film:
+            name = reader.ReadString();
+            scene->Film(name, reader.ReadParameters(alloc), loc);
+            break;
+        case BinarySceneOp::Sampler:
+            name = reader.ReadString();
+            scene->Sampler(name, reader.ReadParameters(alloc), loc);
+            break;
+        case BinarySceneOp::Accelerator:
+            name = reader.ReadString();
+            scene->Accelerator(name, reader.ReadParameters(alloc), loc);
+            break;
+        case BinarySceneOp::Integrator:
+            name = reader.ReadString();
+            scene->Integrator(name, reader.ReadParameters(alloc), loc);
+            break;
+        case BinarySceneOp::Camera:
+            name = reader.ReadString();
+            scene->Camera(name, reader.ReadParameters(alloc), loc);
+            break;
+        case BinarySceneOp::MakeNamedMedium:
+            name = reader.ReadString();
+            scene->MakeNamedMedium(name, reader.ReadParameters(alloc), loc);
+            break;
+        case BinarySceneOp::MediumInterface:
+            name = reader.ReadString();
+            scene->MediumInterface(name, reader.ReadString(), loc);
+            break;
+        case BinarySceneOp::WorldBegin:
+            scene->WorldBegin(loc);
+            break;
+        case BinarySceneOp::AttributeBegin:
+            scene->AttributeBegin(loc);
+            break;
+        case BinarySceneOp::AttributeEnd:
+            scene->AttributeEnd(loc);
+            break;
+        case BinarySceneOp::Attribute:
+            name = reader.ReadString();
+            scene->Attribute(name, reader.ReadParameters(alloc), loc);
+            break;
+        case BinarySceneOp::TransformBegin:
+            scene->TransformBegin(loc);
+            break;
+        case BinarySceneOp::TransformEnd:
+            scene->TransformEnd(loc);
+            break;
+        case BinarySceneOp::Texture:
+            name = reader.ReadString();
+            type = reader.ReadString();
+            texName = reader.ReadString();
+            scene->Texture(name, type, texName, reader.ReadParameters(alloc), loc);
+            break;
+        case BinarySceneOp::Material:
+            name = reader.ReadString();
+            scene->Material(name, reader.ReadParameters(alloc), loc);
+            break;
+        case BinarySceneOp::MakeNamedMaterial:
+            name = reader.ReadString();
+            scene->MakeNamedMaterial(name, reader.ReadParameters(alloc), loc);
+            break;
+        case BinarySceneOp::NamedMaterial:
+            scene->NamedMaterial(reader.ReadString(), loc);
+            break;
+        case BinarySceneOp::LightSource:
+            name = reader.ReadString();
+            scene->LightSource(name, reader.ReadParameters(alloc), loc);
+            break;
+        case BinarySceneOp::AreaLightSource:
+            name = reader.ReadString();
+            scene->AreaLightSource(name, reader.ReadParameters(alloc), loc);
+            break;
+        case BinarySceneOp::Shape:
+            name = reader.ReadString();
+            scene->Shape(name, reader.ReadParameters(alloc), loc);
+            break;
+        case BinarySceneOp::ReverseOrientation:
+            scene->ReverseOrientation(loc);
+            break;
+        case BinarySceneOp::ObjectBegin:
+            scene->ObjectBegin(reader.ReadString(), loc);
+            break;
+        case BinarySceneOp::ObjectEnd:
+            scene->ObjectEnd(loc);
+            break;
+        case BinarySceneOp::ObjectInstance:
+            scene->ObjectInstance(reader.ReadString(), loc);
+            break;
+        default:
+            reader.Corrupt();
+        }
+    }
+}
+
+// BinarySceneWriter Method Definitions
+BinarySceneWriter::BinarySceneWriter(const std::string &filename) : filename(filename) {
+    fp = fopen(filename.c_str(), "wb");
+    if (!fp)
+        ErrorExit("%s: unable to open output binary scene file: %s", filename,
+                  ErrorString());
+    int32_t byteOrder = 1;
+    WriteBytes(binarySceneMagic, sizeof(binarySceneMagic));
+    WriteBytes(&byteOrder, sizeof(byteOrder));
+}
+
+BinarySceneWriter::~BinarySceneWriter() {
+    if (fclose(fp) != 0 || !success)
+        ErrorExit("%s: error writing binary scene file: %s", filename, ErrorString());
+}
+
+void BinarySceneWriter::WriteBytes(const void *ptr, size_t size) {
+    success = success && (size == 0 || fwrite(ptr, 1, size, fp) == size);
+}
+
+void BinarySceneWriter::WriteOp(BinarySceneOp op, FileLoc loc) {
+    if (loc.filename != currentFile) {
+        // The search directory only changes when a new file is started.
+        std::string dir = SearchDirectory();
+        if (dir != searchDirectory) {
+            searchDirectory = dir;
+            BinarySceneOp setDir = BinarySceneOp::SearchDirectory;
+            WriteBytes(&setDir, sizeof(setDir));
+            WriteString(searchDirectory);
+        }
+
+        currentFile = std::string(loc.filename);
+        BinarySceneOp setFile = BinarySceneOp::SetFile;
+        WriteBytes(&setFile, sizeof(setFile));
+        WriteString(currentFile);
+    }
+    int32_t lineColumn[2] = {loc.line, loc.column};
+    WriteBytes(&op, sizeof(op));
+    WriteBytes(lineColumn, sizeof(lineColumn));
+}
+
+void BinarySceneWriter::WriteFloats(std::initializer_list<Float> v) {
+    for (Float f : v) {
+        double d = f;
+        WriteBytes(&d, sizeof(d));
+    }
+}
+
+void BinarySceneWriter::WriteString(const std::string &str) {
+    uint64_t length = str.size();
+    WriteBytes(&length, sizeof(length));
+    WriteBytes(str.data(), str.size());
+}
+
+void BinarySceneWriter::WriteParameters(const ParsedParameterVector &params) {
+    uint64_t count = params.size();
+    WriteBytes(&count, sizeof(count));
+    for (const ParsedParameter *p : params) {
+        WriteString(p->type);
+        WriteString(p->name);
+        // Parameters are always in the same file as their directive.
+        int32_t lineColumn[2] = {p->loc.line, p->loc.column};
+        WriteBytes(lineColumn, sizeof(lineColumn));
+
+        uint64_t nNumbers = p->numbers.size();
+        WriteBytes(&nNumbers, sizeof(nNumbers));
+        WriteBytes(p->numbers.data(), nNumbers * sizeof(double));
+
+        uint64_t nStrings = p->strings.size();
+        WriteBytes(&nStrings, sizeof(nStrings));
+        for (const std::string &str : p->strings)
+            WriteString(str);
+
+        uint64_t nBools = p->bools.size();
+        WriteBytes(&nBools, sizeof(nBools));
+        WriteBytes(p->bools.data(), nBools);
+    }
+}
+
+void BinarySceneWriter::Option(const std::string &name, const std::string &value,
+                               FileLoc loc) {
+    WriteOp(BinarySceneOp::Option, loc);
+    WriteString(name);
+    WriteString(value);
+}
+
+void BinarySceneWriter::Identity(FileLoc loc) {
+    WriteOp(BinarySceneOp::Identity, loc);
+}
+
+void BinarySceneWriter::Translate(Float dx, Float dy, Float dz, FileLoc loc) {
+    WriteOp(BinarySceneOp::Translate, loc);
+    WriteFloats({dx, dy, dz});
+}
+
+void BinarySceneWriter::Rotate(Float angle, Float ax, Float ay, Float az, FileLoc loc) {
+    WriteOp(BinarySceneOp::Rotate, loc);
+    WriteFloats({angle, ax, ay, az});
+}
+
+void BinarySceneWriter::Scale(Float sx, Float sy, Float sz, FileLoc loc) {
+    WriteOp(BinarySceneOp::Scale, loc);
+    WriteFloats({sx, sy, sz});
+}
+
+void BinarySceneWriter::LookAt(Float ex, Float ey, Float ez, Float lx, Float ly,
+                               Float lz, Float ux, Float uy, Float uz, FileLoc loc) {
+    WriteOp(BinarySceneOp::LookAt, loc);
+    WriteFloats({ex, ey, ez, lx, ly, lz, ux, uy, uz});
+}
+
+void BinarySceneWriter::ConcatTransform(Float transform[16], FileLoc loc) {
+    WriteOp(BinarySceneOp::ConcatTransform, loc);
+    for (int i = 0; i < 16; ++i)
+        WriteFloats({transform[i]});
+}
+
+void BinarySceneWriter::Transform(Float transform[16], FileLoc loc) {
+    WriteOp(BinarySceneOp::Transform, loc);
+    for (int i = 0; i < 16; ++i)
+        WriteFloats({transform[i]});
+}
+
+void BinarySceneWriter::CoordinateSystem(const std::string &name, FileLoc loc) {
+    WriteOp(BinarySceneOp::CoordinateSystem, loc);
+    WriteString(name);
+}
+
+void BinarySceneWriter::CoordSysTransform(const std::string &name, FileLoc loc) {
+    WriteOp(BinarySceneOp::CoordSysTransform, loc);
+    WriteString(name);
+}
+
+void BinarySceneWriter::ActiveTransformAll(FileLoc loc) {
+    WriteOp(BinarySceneOp::ActiveTransformAll, loc);
+}
+
+void BinarySceneWriter::ActiveTransformEndTime(FileLoc loc) {
+    WriteOp(BinarySceneOp::ActiveTransformEndTime, loc);
+}
+
+void BinarySceneWriter::ActiveTransformStartTime(FileLoc loc) {
+    WriteOp(BinarySceneOp::ActiveTransformStartTime, loc);
+}
+
+void BinarySceneWriter::TransformTimes(Float start, Float end, FileLoc loc) {
+    WriteOp(BinarySceneOp::TransformTimes, loc);
+    WriteFloats({start, end});
+}
+
+void BinarySceneWriter::ColorSpace(const std::string &n, FileLoc loc) {
+    WriteOp(BinarySceneOp::ColorSpace, loc);
+    WriteString(n);
+}
+
+void BinarySceneWriter::PixelFilter(const std::string &name,
+                                    ParsedParameterVector params, FileLoc loc) {
+    WriteOp(BinarySceneOp::PixelFilter, loc);
+    WriteString(name);
+    WriteParameters(params);
+}
+
+void BinarySceneWriter::Film(const std::string &type, ParsedParameterVector params,
+                             FileLoc loc) {
+    WriteOp(BinarySceneOp::Film, loc);
+    WriteString(type);
+    WriteParameters(params);
+}
+
+void BinarySceneWriter::Sampler(const std::string &name, ParsedParameterVector params,
+                                FileLoc loc) {
+    WriteOp(BinarySceneOp::Sampler, loc);
+    WriteString(name);
+    WriteParameters(params);
+}
+
+void BinarySceneWriter::Accelerator(const std::string &name,
+                                    ParsedParameterVector params, FileLoc loc) {
+    WriteOp(BinarySceneOp::Accelerator, loc);
+    WriteString(name);
+    WriteParameters(params);
+}
+
+void BinarySceneWriter::Integrator(const std::string &name, ParsedParameterVector params,
+                                   FileLoc loc) {
+    WriteOp(BinarySceneOp::Integrator, loc);
+    WriteString(name);
+    WriteParameters(params);
+}
+
+void BinarySceneWriter::Camera(const std::string &name, ParsedParameterVector params,
+                               FileLoc loc) {
+    WriteOp(BinarySceneOp::Camera, loc);
+    WriteString(name);
+    WriteParameters(params);
+}
+
+void BinarySceneWriter::MakeNamedMedium(const std::string &name,
+                                        ParsedParameterVector params, FileLoc loc) {
+    WriteOp(BinarySceneOp::MakeNamedMedium, loc);
+    WriteString(name);
+    WriteParameters(params);
+}
+
+void BinarySceneWriter::MediumInterface(const std::string &insideName,
+                                        const std::string &outsideName, FileLoc loc) {
+    WriteOp(BinarySceneOp::MediumInterface, loc);
+    WriteString(insideName);
+    WriteString(outsideName);
+}
+
+void BinarySceneWriter::WorldBegin(FileLoc loc) {
+    WriteOp(BinarySceneOp::WorldBegin, loc);
+}
+
+void BinarySceneWriter::AttributeBegin(FileLoc loc) {
+    WriteOp(BinarySceneOp::AttributeBegin, loc);
+}
+
+void BinarySceneWriter::AttributeEnd(FileLoc loc) {
+    WriteOp(BinarySceneOp::AttributeEnd, loc);
+}
+
+void BinarySceneWriter::Attribute(const std::string &target, ParsedParameterVector params,
+                                  FileLoc loc) {
+    WriteOp(BinarySceneOp::Attribute, loc);
+    WriteString(target);
+    WriteParameters(params);
+}
+
+void BinarySceneWriter::TransformBegin(FileLoc loc) {
+    WriteOp(BinarySceneOp::TransformBegin, loc);
+}
+
+void BinarySceneWriter::TransformEnd(FileLoc loc) {
+    WriteOp(BinarySceneOp::TransformEnd, loc);
+}
+
+void BinarySceneWriter::Texture(const std::string &name, const std::string &type,
+                                const std::string &texname, ParsedParameterVector params,
+                                FileLoc loc) {
+    WriteOp(BinarySceneOp::Texture, loc);
+    WriteString(name);
+    WriteString(type);
+    WriteString(texname);
+    WriteParameters(params);
+}
+
+void BinarySceneWriter::Material(const std::string &name, ParsedParameterVector params,
+                                 FileLoc loc) {
+    WriteOp(BinarySceneOp::Material, loc);
+    WriteString(name);
+    WriteParameters(params);
+}
+
+void BinarySceneWriter::MakeNamedMaterial(const std::string &name,
+                                          ParsedParameterVector params, FileLoc loc) {
+    WriteOp(BinarySceneOp::MakeNamedMaterial, loc);
+    WriteString(name);
+    WriteParameters(params);
+}
+
+void BinarySceneWriter::NamedMaterial(const std::string &name, FileLoc loc) {
+    WriteOp(BinarySceneOp::NamedMaterial, loc);
+    WriteString(name);
+}
+
+void BinarySceneWriter::LightSource(const std::string &name,
+                                    ParsedParameterVector params, FileLoc loc) {
+    WriteOp(BinarySceneOp::LightSource, loc);
+    WriteString(name);
+    WriteParameters(params);
+}
+
+void BinarySceneWriter::AreaLightSource(const std::string &name,
+                                        ParsedParameterVector params, FileLoc loc) {
+    WriteOp(BinarySceneOp::AreaLightSource, loc);
+    WriteString(name);
+    WriteParameters(params);
+}
+
+void BinarySceneWriter::Shape(const std::string &name, ParsedParameterVector params,
+                              FileLoc loc) {
+    WriteOp(BinarySceneOp::Shape, loc);
+    WriteString(name);
+    WriteParameters(params);
+}
+
+void BinarySceneWriter::ReverseOrientation(FileLoc loc) {
+    WriteOp(BinarySceneOp::ReverseOrientation, loc);
+}
+
+void BinarySceneWriter::ObjectBegin(const std::string &name, FileLoc loc) {
+    WriteOp(BinarySceneOp::ObjectBegin, loc);
+    WriteString(name);
+}
+
+void BinarySceneWriter::ObjectEnd(FileLoc loc) {
+    WriteOp(BinarySceneOp::ObjectEnd, loc);
+}
+
+void BinarySceneWriter::ObjectInstance(const std::string &name, FileLoc loc) {
+    WriteOp(BinarySceneOp::ObjectInstance, loc);
+    WriteString(name);
+}
+
+void BinarySceneWriter::EndOfFiles() {}
+
 static void parse(SceneRepresentation *scene, std::unique_ptr<Tokenizer> t) {
     bool formatting = dynamic_cast<FormattingScene *>(scene) != nullptr;
     TrackedMemoryResource memoryResource;
@@ -688,10 +1363,16 @@ static void parse(SceneRepresentation *scene, std::unique_ptr<Tokenizer> t) {
                            dynamic_cast<FormattingScene *>(scene)->indent(), filename);
                 else {
                     filename = ResolveFilename(filename);
-                    std::unique_ptr<Tokenizer> tinc =
-                        Tokenizer::CreateFromFile(filename, parseError);
-                    if (tinc)
-                        fileStack.push_back(std::move(tinc));
+                    // Binary files are read immediately, which is equivalent
+                    // to parsing their directives next.
+                    if (isBinarySceneFile(filename))
+                        parseBinary(scene, filename, false);
+                    else {
+                        std::unique_ptr<Tokenizer> tinc =
+                            Tokenizer::CreateFromFile(filename, parseError);
+                        if (tinc)
+                            fileStack.push_back(std::move(tinc));
+                    }
                 }
             } else if (tok->token == "Identity")
                 scene->Identity(tok->loc);
@@ -878,6 +1559,10 @@ void ParseFiles(SceneRepresentation *scene, pstd::span<const std::string> filena
             if (fn != "-")
                 SetSearchDirectory(fn);
 
+            if (fn != "-" && isBinarySceneFile(fn)) {
+                parseBinary(scene, fn, true);
+                continue;
+            }
             std::unique_ptr<Tokenizer> t = Tokenizer::CreateFromFile(fn, tokError);
             if (t)
                 parse(scene, std::move(t));
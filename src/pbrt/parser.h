@@ -12,7 +12,9 @@
 #include <pbrt/util/error.h>
 #include <pbrt/util/pstd.h>
 
+#include <cstdio>
 #include <functional>
+#include <initializer_list>
 #include <memory>
 #include <string>
 #include <string_view>
@@ -138,6 +140,84 @@ class SceneRepresentation {
 void ParseFiles(SceneRepresentation *scene, pstd::span<const std::string> filenames);
 void ParseString(SceneRepresentation *scene, std::string str);
 
+enum class BinarySceneOp : uint32_t;
+
+// BinarySceneWriter Definition
+// Writes the scene description in pbrt's binary scene format, which
+// ParseFiles() reads from a mapped file without tokenizing it. Parameter
+// values are stored as they were parsed, so the vertices and indices of
+// meshes are copied in bulk rather than converted from text when the file
+// is read.
+class BinarySceneWriter : public SceneRepresentation {
+  public:
+    BinarySceneWriter(const std::string &filename);
+    ~BinarySceneWriter();
+
+    void Option(const std::string &name, const std::string &value, FileLoc loc);
+    void Identity(FileLoc loc);
+    void Translate(Float dx, Float dy, Float dz, FileLoc loc);
+    void Rotate(Float angle, Float ax, Float ay, Float az, FileLoc loc);
+    void Scale(Float sx, Float sy, Float sz, FileLoc loc);
+    void LookAt(Float ex, Float ey, Float ez, Float lx, Float ly, Float lz, Float ux,
+                Float uy, Float uz, FileLoc loc);
+    void ConcatTransform(Float transform[16], FileLoc loc);
+    void Transform(Float transform[16], FileLoc loc);
+    void CoordinateSystem(const std::string &, FileLoc loc);
+    void CoordSysTransform(const std::string &, FileLoc loc);
+    void ActiveTransformAll(FileLoc loc);
+    void ActiveTransformEndTime(FileLoc loc);
+    void ActiveTransformStartTime(FileLoc loc);
+    void TransformTimes(Float start, Float end, FileLoc loc);
+    void ColorSpace(const std::string &n, FileLoc loc);
+    void PixelFilter(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void Film(const std::string &type, ParsedParameterVector params, FileLoc loc);
+    void Sampler(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void Accelerator(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void Integrator(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void Camera(const std::string &, ParsedParameterVector params, FileLoc loc);
+    void MakeNamedMedium(const std::string &name, ParsedParameterVector params,
+                         FileLoc loc);
+    void MediumInterface(const std::string &insideName, const std::string &outsideName,
+                         FileLoc loc);
+    void WorldBegin(FileLoc loc);
+    void AttributeBegin(FileLoc loc);
+    void AttributeEnd(FileLoc loc);
+    void Attribute(const std::string &target, ParsedParameterVector params, FileLoc loc);
+    void TransformBegin(FileLoc loc);
+    void TransformEnd(FileLoc loc);
+    void Texture(const std::string &name, const std::string &type,
+                 const std::string &texname, ParsedParameterVector params, FileLoc loc);
+    void Material(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void MakeNamedMaterial(const std::string &name, ParsedParameterVector params,
+                           FileLoc loc);
+    void NamedMaterial(const std::string &name, FileLoc loc);
+    void LightSource(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void AreaLightSource(const std::string &name, ParsedParameterVector params,
+                         FileLoc loc);
+    void Shape(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void ReverseOrientation(FileLoc loc);
+    void ObjectBegin(const std::string &name, FileLoc loc);
+    void ObjectEnd(FileLoc loc);
+    void ObjectInstance(const std::string &name, FileLoc loc);
+
+    void EndOfFiles();
+
+  private:
+    void WriteOp(BinarySceneOp op, FileLoc loc);
+    void WriteFloats(std::initializer_list<Float> v);
+    void WriteString(const std::string &str);
+    void WriteParameters(const ParsedParameterVector &params);
+    void WriteBytes(const void *ptr, size_t size);
+
+    std::string filename;
+    FILE *fp;
+    // Filename of the locations of the directives most recently written
+    std::string currentFile;
+    // Directory that the filenames in those directives are relative to
+    std::string searchDirectory;
+    bool success = true;
+};
+
 // Token Definition
 struct Token {
     Token() = default;
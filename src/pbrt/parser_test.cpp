@@ -6,6 +6,8 @@
 
 #include <pbrt/parser.h>
 #include <pbrt/pbrt.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
 #include <pbrt/util/pstd.h>
 
 #include <fstream>
@@ -119,6 +121,25 @@ TEST(Parser, TokenizerErrors) {
     }
 }
 
+TEST(Parser, RecoverableErrors) {
+    // Malformed input is reported with a RecoverableError rather than
+    // exiting while errors are recoverable.
+    std::string binaryFile = inTestDir("recoverable.pbrb");
+    {
+        ScopedRecoverableErrors recoverableErrors;
+        BinarySceneWriter writer(binaryFile);
+        try {
+            ParseString(&writer, "Shape \"sphere\" \"float radius\" [ 1");
+            ADD_FAILURE() << "ParseString() didn't report the error";
+        } catch (const RecoverableError &error) {
+            EXPECT_NE(std::string::npos,
+                      std::string(error.what()).find("premature end of file"))
+                << error.what();
+        }
+    }
+    EXPECT_EQ(0, remove(binaryFile.c_str()));
+}
+
 TEST(Parser, TokenizeFile) {
     std::string filename = inTestDir("test.tok");
     std::ofstream out(filename);
@@ -144,3 +165,105 @@ Integrator "deep" "float density" [ 2 2.66612 -5e-51]
 
     EXPECT_EQ(0, remove(filename.c_str()));
 }
+
+// Passes the directives it's given on to a BinarySceneWriter after
+// recording the shapes' parameters.
+class ShapeRecordingWriter : public BinarySceneWriter {
+  public:
+    using BinarySceneWriter::BinarySceneWriter;
+
+    void Shape(const std::string &name, ParsedParameterVector params, FileLoc loc) {
+        shapes.push_back(name);
+        shapeLines.push_back(loc.line);
+        for (const ParsedParameter *p : params)
+            shapeParams.push_back(*p);
+        BinarySceneWriter::Shape(name, std::move(params), loc);
+    }
+
+    std::vector<std::string> shapes;
+    std::vector<int> shapeLines;
+    std::vector<ParsedParameter> shapeParams;
+};
+
+TEST(Parser, BinarySceneRoundTrip) {
+    std::string textScene = R"(
+LookAt 0 0 5  0 0 0  0 1 0
+Camera "perspective" "float fov" [ 45 ]
+WorldBegin
+AttributeBegin
+  Translate 0.1 -2 1e-3
+  Texture "checks" "spectrum" "checkerboard" "float uscale" [ 8 ]
+  Material "diffuse" "texture reflectance" "checks"
+  Shape "trianglemesh" "point3 P" [ 0 0 0  1 0 0  1 1 0.25 ]
+      "integer indices" [ 0 1 2 ] "bool cullable" false
+AttributeEnd
+)";
+    std::string binaryFile = inTestDir("test.pbrtb"), copyFile = inTestDir("copy.pbrtb");
+    {
+        BinarySceneWriter writer(binaryFile);
+        ParseString(&writer, textScene);
+    }
+
+    // Reading the binary file should give the same directives and
+    // parameters, which are written again to compare with the original.
+    std::vector<std::string> filenames = {binaryFile};
+    {
+        ShapeRecordingWriter writer(copyFile);
+        ParseFiles(&writer, filenames);
+
+        ASSERT_EQ(1, writer.shapes.size());
+        EXPECT_EQ("trianglemesh", writer.shapes[0]);
+        EXPECT_EQ(9, writer.shapeLines[0]);
+        ASSERT_EQ(3, writer.shapeParams.size());
+
+        const ParsedParameter &P = writer.shapeParams[0];
+        EXPECT_EQ("point3", P.type);
+        EXPECT_EQ("P", P.name);
+        std::vector<double> expected = {0, 0, 0, 1, 0, 0, 1, 1, 0.25};
+        ASSERT_EQ(expected.size(), P.numbers.size());
+        for (size_t i = 0; i < expected.size(); ++i)
+            EXPECT_EQ(expected[i], P.numbers[i]);
+
+        const ParsedParameter &indices = writer.shapeParams[1];
+        EXPECT_EQ("integer", indices.type);
+        ASSERT_EQ(3, indices.numbers.size());
+        EXPECT_EQ(2, indices.numbers[2]);
+
+        const ParsedParameter &cullable = writer.shapeParams[2];
+        EXPECT_EQ("bool", cullable.type);
+        EXPECT_EQ(1, cullable.strings.size() + cullable.bools.size());
+    }
+
+    EXPECT_EQ(ReadFileContents(binaryFile), ReadFileContents(copyFile));
+
+    EXPECT_EQ(0, remove(binaryFile.c_str()));
+    EXPECT_EQ(0, remove(copyFile.c_str()));
+}
+
+TEST(Parser, BinarySceneSearchDirectory) {
+    // Relative filenames in a binary scene file should be resolved from the
+    // directory of the scene it was made from, here the parent directory,
+    // rather than the binary file's directory.
+    std::string previousDirectory = SearchDirectory();
+    SetSearchDirectory("..");
+    std::string sceneDirectory = SearchDirectory();
+    std::string binaryFile = inTestDir("test.pbrtb"), copyFile = inTestDir("copy.pbrtb");
+    {
+        BinarySceneWriter writer(binaryFile);
+        ParseString(&writer, R"(WorldBegin
+Shape "plymesh" "string filename" "mesh.ply")");
+    }
+
+    std::vector<std::string> filenames = {binaryFile};
+    {
+        BinarySceneWriter writer(copyFile);
+        ParseFiles(&writer, filenames);
+    }
+    EXPECT_EQ(sceneDirectory, SearchDirectory());
+
+    // Don't affect the filenames that later tests resolve
+    SetSearchDirectory(previousDirectory);
+    EXPECT_EQ(previousDirectory, SearchDirectory());
+    EXPECT_EQ(0, remove(binaryFile.c_str()));
+    EXPECT_EQ(0, remove(copyFile.c_str()));
+}
@@ -16,6 +16,7 @@
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/spectrum.h>
 #include <pbrt/util/stats.h>
+#include <pbrt/util/texcache.h>
 
 namespace pbrt {
 
@@ -45,6 +46,7 @@ void InitPBRT(const PBRTOptions &opt) {
 
         RGBColorSpace::Init(gpuMemoryAllocator);
         InitBufferCaches(gpuMemoryAllocator);
+        InitSpectrumPool(gpuMemoryAllocator);
         Triangle::Init(gpuMemoryAllocator);
         BilinearPatch::Init(gpuMemoryAllocator);
 #else
@@ -57,10 +59,17 @@ void InitPBRT(const PBRTOptions &opt) {
 
         RGBColorSpace::Init(Allocator{});
         InitBufferCaches({});
+        InitSpectrumPool({});
         Triangle::Init({});
         BilinearPatch::Init({});
     }
 
+    // Image textures are only tiled with --texture-cache-mb, though
+    // TiledImagePyramids can also be opened directly. The cache itself is
+    // only created once tiles are read.
+    int64_t textureCacheMB = Options->textureCacheMB > 0 ? Options->textureCacheMB : 1024;
+    InitTextureTileCache(textureCacheMB << 20);
+
     if (!Options->displayServer.empty())
         ConnectToDisplayServer(Options->displayServer);
 }
@@ -270,6 +270,51 @@ StratifiedSampler *StratifiedSampler::Create(const ParameterDictionary &paramete
     return alloc.new_object<StratifiedSampler>(xSamples, ySamples, jitter, seed);
 }
 
+// ZSobolSampler Method Definitions
+std::string ZSobolSampler::ToString() const {
+    return StringPrintf("[ ZSobolSampler samplesPerPixel: %d randomizeStrategy: %s "
+                        "seed: %d log2SamplesPerPixel: %d nBase4Digits: %d "
+                        "mortonIndex: %d dimension: %d ]",
+                        samplesPerPixel, randomizeStrategy, seed, log2SamplesPerPixel,
+                        nBase4Digits, mortonIndex, dimension);
+}
+
+std::vector<SamplerHandle> ZSobolSampler::Clone(int n, Allocator alloc) {
+    std::vector<SamplerHandle> samplers(n);
+    ZSobolSampler *samplerMem = (ZSobolSampler *)alloc.allocate_object<ZSobolSampler>(n);
+    for (int i = 0; i < n; ++i) {
+        alloc.construct(&samplerMem[i], *this);
+        samplers[i] = &samplerMem[i];
+    }
+    return samplers;
+}
+
+ZSobolSampler *ZSobolSampler::Create(const ParameterDictionary &parameters,
+                                     const Point2i &fullResolution, const FileLoc *loc,
+                                     Allocator alloc) {
+    int nsamp = parameters.GetOneInt("pixelsamples", 16);
+    if (Options->pixelSamples)
+        nsamp = *Options->pixelSamples;
+    if (Options->quickRender)
+        nsamp = 1;
+    int seed = parameters.GetOneInt("seed", Options->seed);
+
+    RandomizeStrategy randomizer;
+    std::string s = parameters.GetOneString("randomization", "owen");
+    if (s == "none")
+        randomizer = RandomizeStrategy::None;
+    else if (s == "cranleypatterson")
+        randomizer = RandomizeStrategy::CranleyPatterson;
+    else if (s == "xor")
+        randomizer = RandomizeStrategy::Xor;
+    else if (s == "owen")
+        randomizer = RandomizeStrategy::Owen;
+    else
+        ErrorExit(loc, "%s: unknown randomization strategy given to ZSobolSampler", s);
+
+    return alloc.new_object<ZSobolSampler>(nsamp, fullResolution, randomizer, seed);
+}
+
 // MLTSampler Method Definitions
 Float MLTSampler::Get1D() {
     int index = GetNextIndex();
@@ -387,6 +432,8 @@ SamplerHandle SamplerHandle::Create(const std::string &name,
         sampler = RandomSampler::Create(parameters, loc, alloc);
     else if (name == "stratified")
         sampler = StratifiedSampler::Create(parameters, loc, alloc);
+    else if (name == "zsobol")
+        sampler = ZSobolSampler::Create(parameters, fullResolution, loc, alloc);
     else
         ErrorExit(loc, "%s: sampler type unknown.", name);
 
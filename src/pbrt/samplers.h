@@ -10,9 +10,11 @@
 #include <pbrt/base/sampler.h>
 #include <pbrt/filters.h>
 #include <pbrt/options.h>
+#include <pbrt/util/bits.h>
 #include <pbrt/util/bluenoise.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/error.h>
+#include <pbrt/util/hash.h>
 #include <pbrt/util/lowdiscrepancy.h>
 #include <pbrt/util/math.h>
 #include <pbrt/util/pmj02tables.h>
@@ -82,6 +84,12 @@ class HaltonSampler {
         }
     }
 
+    PBRT_CPU_GPU
+    void GetND(pstd::span<Float> u) {
+        for (Float &ud : u)
+            ud = Get1D();
+    }
+
     std::vector<SamplerHandle> Clone(int n, Allocator alloc);
     std::string ToString() const;
 
@@ -158,6 +166,12 @@ class PaddedSobolSampler {
                     generateSample(CSobol[1], index, hash >> 32)};
     }
 
+    PBRT_CPU_GPU
+    void GetND(pstd::span<Float> u) {
+        for (Float &ud : u)
+            ud = Get1D();
+    }
+
     std::vector<SamplerHandle> Clone(int n, Allocator alloc);
     std::string ToString() const;
 
@@ -254,6 +268,12 @@ class PMJ02BNSampler {
         }
     }
 
+    PBRT_CPU_GPU
+    void GetND(pstd::span<Float> u) {
+        for (Float &ud : u)
+            ud = Get1D();
+    }
+
     std::vector<SamplerHandle> Clone(int n, Allocator alloc);
     std::string ToString() const;
 
@@ -302,6 +322,12 @@ class RandomSampler {
     PBRT_CPU_GPU
     Point2f Get2D() { return {rng.Uniform<Float>(), rng.Uniform<Float>()}; }
 
+    PBRT_CPU_GPU
+    void GetND(pstd::span<Float> u) {
+        for (Float &ud : u)
+            ud = Get1D();
+    }
+
     std::vector<SamplerHandle> Clone(int n, Allocator alloc);
     std::string ToString() const;
 
@@ -367,6 +393,34 @@ class SobolSampler {
         return u;
     }
 
+    // Returns the next _u.size()_ sample dimensions; the values are the same
+    // as those returned by that many calls to Get1D().
+    PBRT_CPU_GPU
+    void GetND(pstd::span<Float> u) {
+#ifdef PBRT_FLOAT_AS_DOUBLE
+        for (Float &ud : u)
+            ud = Get1D();
+#else
+        size_t i = 0;
+        while (i < u.size()) {
+            if (dimension >= NSobolDimensions)
+                dimension = 2;
+            if (dimension < 2) {
+                u[i++] = sampleDimension(dimension++);
+                continue;
+            }
+            // Compute a batch of consecutive dimensions together
+            constexpr int BatchSize = 16;
+            uint32_t bits[BatchSize];
+            int n = std::min<int>(std::min<int>(BatchSize, u.size() - i),
+                                  NSobolDimensions - dimension);
+            SobolSampleBits32(sequenceIndex, dimension, pstd::span<uint32_t>(bits, n));
+            for (int j = 0; j < n; ++j)
+                u[i++] = randomizeBits(bits[j], dimension++);
+        }
+#endif
+    }
+
     std::vector<SamplerHandle> Clone(int n, Allocator alloc);
     std::string ToString() const;
 
@@ -392,6 +446,19 @@ class SobolSampler {
         }
     }
 
+    PBRT_CPU_GPU
+    Float randomizeBits(uint32_t v, int dimension) const {
+        // Apply the same randomization as sampleDimension() to precomputed bits
+        uint32_t hash = MixBits(dimension);
+        if (randomizeStrategy == RandomizeStrategy::CranleyPatterson)
+            v = CranleyPattersonRotator(hash)(v);
+        else if (randomizeStrategy == RandomizeStrategy::Xor)
+            v = XORScrambler(hash)(v);
+        else if (randomizeStrategy == RandomizeStrategy::Owen)
+            v = OwenScrambler(hash)(v);
+        return std::min(v * 0x1p-32f /* 1/2^32 */, FloatOneMinusEpsilon);
+    }
+
     // SobolSampler Private Members
     int samplesPerPixel;
     int resolution;
@@ -401,6 +468,138 @@ class SobolSampler {
     int64_t sequenceIndex;
 };
 
+// ZSobolSampler Definition
+// The ZSobolSampler uses a single Sobol sequence for all of the pixels,
+// visiting them in Morton order and randomly permuting the base-4 digits of
+// the sample index (Ahmed and Wonka 2020). Neighboring pixels then receive
+// well-distributed sample values, which gives a blue noise distribution of
+// error at low sampling rates without any tabulated data.
+class ZSobolSampler {
+  public:
+    // ZSobolSampler Public Methods
+    ZSobolSampler(int spp, const Point2i &fullResolution,
+                  RandomizeStrategy randomizeStrategy, int seed = 0)
+        : samplesPerPixel(RoundUpPow2(spp)),
+          randomizeStrategy(randomizeStrategy),
+          seed(seed) {
+        if (!IsPowerOf2(spp))
+            Warning("Non power-of-two sample count rounded up to %d "
+                    "for ZSobolSampler.",
+                    samplesPerPixel);
+        log2SamplesPerPixel = Log2Int(samplesPerPixel);
+        int res = RoundUpPow2(std::max(fullResolution.x, fullResolution.y));
+        int log4SamplesPerPixel = (log2SamplesPerPixel + 1) / 2;
+        nBase4Digits = Log2Int(res) + log4SamplesPerPixel;
+        // The permuted sample index must fit in the Sobol matrices' columns.
+        if (2 * nBase4Digits > SobolMatrixSize)
+            ErrorExit("ZSobolSampler: image resolution %d and %d samples per pixel "
+                      "give sample indices larger than 2^%d.",
+                      res, samplesPerPixel, SobolMatrixSize);
+    }
+
+    PBRT_CPU_GPU
+    static constexpr const char *Name() { return "ZSobolSampler"; }
+    static ZSobolSampler *Create(const ParameterDictionary &parameters,
+                                 const Point2i &fullResolution, const FileLoc *loc,
+                                 Allocator alloc);
+
+    PBRT_CPU_GPU
+    int SamplesPerPixel() const { return samplesPerPixel; }
+
+    PBRT_CPU_GPU
+    void StartPixelSample(const Point2i &p, int index, int dim) {
+        dimension = dim;
+        mortonIndex = (EncodeMorton2(p.x, p.y) << log2SamplesPerPixel) | index;
+    }
+
+    PBRT_CPU_GPU
+    Float Get1D() {
+        uint64_t sampleIndex = GetSampleIndex();
+        ++dimension;
+        // Use a different scramble for each dimension
+        uint32_t sampleHash = Hash(dimension, seed);
+        return sample(sampleIndex, 0, sampleHash);
+    }
+
+    PBRT_CPU_GPU
+    Point2f Get2D() {
+        uint64_t sampleIndex = GetSampleIndex();
+        dimension += 2;
+        uint64_t bits = Hash(dimension, seed);
+        return {sample(sampleIndex, 0, uint32_t(bits)),
+                sample(sampleIndex, 1, uint32_t(bits >> 32))};
+    }
+
+    PBRT_CPU_GPU
+    void GetND(pstd::span<Float> u) {
+        for (Float &ud : u)
+            ud = Get1D();
+    }
+
+    std::vector<SamplerHandle> Clone(int n, Allocator alloc);
+    std::string ToString() const;
+
+    PBRT_CPU_GPU
+    uint64_t GetSampleIndex() const {
+        // Define the full set of 4-way permutations in _permutations_
+        static const uint8_t permutations[24][4] = {
+            {0, 1, 2, 3}, {0, 1, 3, 2}, {0, 2, 1, 3}, {0, 2, 3, 1}, {0, 3, 2, 1},
+            {0, 3, 1, 2}, {1, 0, 2, 3}, {1, 0, 3, 2}, {1, 2, 0, 3}, {1, 2, 3, 0},
+            {1, 3, 2, 0}, {1, 3, 0, 2}, {2, 1, 0, 3}, {2, 1, 3, 0}, {2, 0, 1, 3},
+            {2, 0, 3, 1}, {2, 3, 0, 1}, {2, 3, 1, 0}, {3, 1, 2, 0}, {3, 1, 0, 2},
+            {3, 2, 1, 0}, {3, 2, 0, 1}, {3, 0, 2, 1}, {3, 0, 1, 2}};
+
+        uint64_t sampleIndex = 0;
+        // Apply random permutations to full base-4 digits
+        bool pow2Samples = log2SamplesPerPixel & 1;
+        int lastDigit = pow2Samples ? 1 : 0;
+        for (int i = nBase4Digits - 1; i >= lastDigit; --i) {
+            // Randomly permute $i$th base-4 digit in _mortonIndex_
+            int digitShift = 2 * i - (pow2Samples ? 1 : 0);
+            int digit = (mortonIndex >> digitShift) & 3;
+            // Choose permutation _p_ to use for _digit_
+            uint64_t higherDigits = mortonIndex >> (digitShift + 2);
+            int p = (MixBits(higherDigits ^ (0x55555555u * dimension)) >> 24) % 24;
+
+            digit = permutations[p][digit];
+            sampleIndex |= uint64_t(digit) << digitShift;
+        }
+
+        // Handle power-of-2 (but not 4) sample count
+        if (pow2Samples) {
+            int digit = mortonIndex & 1;
+            sampleIndex |=
+                digit ^ (MixBits((mortonIndex >> 1) ^ (0x55555555u * dimension)) & 1);
+        }
+
+        return sampleIndex;
+    }
+
+  private:
+    // ZSobolSampler Private Methods
+    PBRT_CPU_GPU
+    Float sample(uint64_t sampleIndex, int dim, uint32_t hash) const {
+        switch (randomizeStrategy) {
+        case RandomizeStrategy::None:
+            return SobolSample(sampleIndex, dim, NoRandomizer());
+        case RandomizeStrategy::CranleyPatterson:
+            return SobolSample(sampleIndex, dim, CranleyPattersonRotator(hash));
+        case RandomizeStrategy::Xor:
+            return SobolSample(sampleIndex, dim, XORScrambler(hash));
+        default:
+            DCHECK(randomizeStrategy == RandomizeStrategy::Owen);
+            return SobolSample(sampleIndex, dim, OwenScrambler(hash));
+        }
+    }
+
+    // ZSobolSampler Private Members
+    int samplesPerPixel;
+    RandomizeStrategy randomizeStrategy;
+    int seed, log2SamplesPerPixel, nBase4Digits;
+    uint64_t mortonIndex = 0;
+    int dimension = 0;
+};
+
 // StratifiedSampler Definition
 class StratifiedSampler {
   public:
@@ -453,6 +652,12 @@ class StratifiedSampler {
         return {(x + dx) / xPixelSamples, (y + dy) / yPixelSamples};
     }
 
+    PBRT_CPU_GPU
+    void GetND(pstd::span<Float> u) {
+        for (Float &ud : u)
+            ud = Get1D();
+    }
+
     std::vector<SamplerHandle> Clone(int n, Allocator alloc);
     std::string ToString() const;
 
@@ -506,6 +711,12 @@ class MLTSampler {
     PBRT_CPU_GPU
     Point2f Get2D();
 
+    PBRT_CPU_GPU
+    void GetND(pstd::span<Float> u) {
+        for (Float &ud : u)
+            ud = Get1D();
+    }
+
     std::vector<SamplerHandle> Clone(int n, Allocator alloc);
 
     PBRT_CPU_GPU
@@ -585,6 +796,12 @@ class DebugMLTSampler : public MLTSampler {
     PBRT_CPU_GPU
     Point2f Get2D() { return {Get1D(), Get1D()}; }
 
+    PBRT_CPU_GPU
+    void GetND(pstd::span<Float> u) {
+        for (Float &ud : u)
+            ud = Get1D();
+    }
+
     std::string ToString() const {
         return StringPrintf("[ DebugMLTSampler %s u: %s ]",
                             ((const MLTSampler *)this)->ToString(), u);
@@ -619,6 +836,11 @@ inline Point2f SamplerHandle::Get2D() {
     return Dispatch(get);
 }
 
+inline void SamplerHandle::GetND(pstd::span<Float> u) {
+    auto get = [&](auto ptr) { return ptr->GetND(u); };
+    return Dispatch(get);
+}
+
 // Sampler Inline Functions
 template <typename Sampler>
 inline PBRT_CPU_GPU CameraSample GetCameraSample(Sampler sampler, const Point2i &pPixel,
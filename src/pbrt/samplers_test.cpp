@@ -31,6 +31,9 @@ TEST(Sampler, ConsistentValues) {
         new SobolSampler(spp, resolution, RandomizeStrategy::CranleyPatterson));
     samplers.push_back(new SobolSampler(spp, resolution, RandomizeStrategy::Xor));
     samplers.push_back(new SobolSampler(spp, resolution, RandomizeStrategy::Owen));
+    samplers.push_back(new ZSobolSampler(spp, resolution, RandomizeStrategy::None));
+    samplers.push_back(new ZSobolSampler(spp, resolution, RandomizeStrategy::Xor));
+    samplers.push_back(new ZSobolSampler(spp, resolution, RandomizeStrategy::Owen));
 
     for (auto &sampler : samplers) {
         std::vector<Float> s1d[spp];
@@ -64,6 +67,44 @@ TEST(Sampler, ConsistentValues) {
     }
 }
 
+// GetND() should return the same values as a sequence of Get1D() calls.
+TEST(Sampler, GetNDMatchesGet1D) {
+    constexpr int spp = 16;
+    Point2i resolution(100, 101);
+
+    std::vector<SamplerHandle> samplers;
+    samplers.push_back(new HaltonSampler(spp, resolution));
+    samplers.push_back(new RandomSampler(spp));
+    samplers.push_back(new PaddedSobolSampler(spp, RandomizeStrategy::Owen));
+    samplers.push_back(new PMJ02BNSampler(spp));
+    samplers.push_back(new StratifiedSampler(4, 4, true));
+    samplers.push_back(new SobolSampler(spp, resolution, RandomizeStrategy::None));
+    samplers.push_back(
+        new SobolSampler(spp, resolution, RandomizeStrategy::CranleyPatterson));
+    samplers.push_back(new SobolSampler(spp, resolution, RandomizeStrategy::Xor));
+    samplers.push_back(new SobolSampler(spp, resolution, RandomizeStrategy::Owen));
+    samplers.push_back(new ZSobolSampler(spp, resolution, RandomizeStrategy::Owen));
+
+    for (auto &sampler : samplers) {
+        for (int s = 0; s < spp; ++s) {
+            // Start at dimension 1 so that the batch doesn't begin aligned
+            // to anything in particular.
+            sampler.StartPixelSample({7, 3}, s, 1);
+            std::vector<Float> u1d;
+            for (int i = 0; i < 45; ++i)
+                u1d.push_back(sampler.Get1D());
+
+            sampler.StartPixelSample({7, 3}, s, 1);
+            std::vector<Float> und(45);
+            sampler.GetND(pstd::MakeSpan(und.data(), 20));
+            sampler.GetND(pstd::MakeSpan(und.data() + 20, 25));
+
+            for (int i = 0; i < 45; ++i)
+                EXPECT_EQ(u1d[i], und[i]) << sampler.ToString() << ", " << i;
+        }
+    }
+}
+
 static void checkElementary(const char *name, std::vector<Point2f> samples,
                             int logSamples) {
     for (int i = 0; i <= logSamples; ++i) {
@@ -140,6 +181,27 @@ TEST(SobolOwenScrambledSampler, ElementaryIntervals) {
             logSamples);
 }
 
+TEST(ZSobolSampler, ElementaryIntervals) {
+    for (int seed : {0, 1, 5, 6, 10, 15})
+        for (auto rand : {RandomizeStrategy::None, RandomizeStrategy::Xor,
+                          RandomizeStrategy::Owen})
+            for (int logSamples = 2; logSamples <= 8; ++logSamples)
+                checkElementarySampler(
+                    "ZSobolSampler",
+                    new ZSobolSampler(1 << logSamples, Point2i(10, 10), rand, seed),
+                    logSamples);
+}
+
+// Pixels whose coordinates only differ in bits above the 16th should
+// still get different samples.
+TEST(ZSobolSampler, LargeResolution) {
+    ZSobolSampler sampler(16, Point2i(100000, 10), RandomizeStrategy::None);
+    sampler.StartPixelSample({3, 2}, 5, 0);
+    uint64_t index = sampler.GetSampleIndex();
+    sampler.StartPixelSample({3 + 65536, 2}, 5, 0);
+    EXPECT_NE(index, sampler.GetSampleIndex());
+}
+
 TEST(PMJ02BNSampler, ElementaryIntervals) {
     for (int logSamples = 2; logSamples <= 10; logSamples += 2)
         checkElementarySampler("PMJ02BNSampler", new PMJ02BNSampler(1 << logSamples),
@@ -5,15 +5,20 @@
 #include <pbrt/textures.h>
 
 #include <pbrt/interaction.h>
+#include <pbrt/options.h>
 #include <pbrt/paramdict.h>
 #include <pbrt/util/color.h>
 #include <pbrt/util/colorspace.h>
 #include <pbrt/util/error.h>
 #include <pbrt/util/file.h>
 #include <pbrt/util/float.h>
+#include <pbrt/util/simd.h>
 #include <pbrt/util/stats.h>
 
+#include <algorithm>
 #include <mutex>
+#include <set>
+#include <type_traits>
 
 #include <Ptexture.h>
 
@@ -66,6 +71,17 @@ std::string SpectrumTextureHandle::ToString() const {
     return DispatchCPU(toStr);
 }
 
+#ifdef PBRT_HAVE_SIMD
+// BatchVector Definition
+// The widest available SIMD vector, which is used to process several
+// texture evaluation points at once.
+#ifdef PBRT_HAVE_AVX2
+using BatchVector = simd::Vec8f;
+#else
+using BatchVector = simd::Vec4f;
+#endif
+#endif  // PBRT_HAVE_SIMD
+
 // Texture Forward Declarations
 PBRT_CPU_GPU
 inline Float Grad(int x, int y, int z, Float dx, Float dy, Float dz);
@@ -179,6 +195,136 @@ inline Float NoiseWeight(Float t) {
     return 6 * t4 * t - 15 * t4 + 10 * t3;
 }
 
+#ifdef PBRT_HAVE_SIMD
+// Gradient directions for the low four bits of the hash in Grad(); their
+// dot products with the offsets give exactly the values that Grad() returns.
+static constexpr int8_t NoiseGradients[16][3] = {
+    {1, 1, 0}, {-1, 1, 0}, {1, -1, 0}, {-1, -1, 0},
+    {1, 0, 1}, {-1, 0, 1}, {1, 0, -1}, {-1, 0, -1},
+    {0, 1, 1}, {0, -1, 1}, {0, 1, -1}, {0, -1, -1},
+    {1, 1, 0}, {-1, 1, 0}, {0, 1, -1}, {0, -1, -1}};
+
+// Evaluates Noise() at the points given by the first BatchVector::Width
+// elements of the arrays. The permutation table lookups are done for each
+// point in turn and the rest of the computation is done with SIMD vectors,
+// following the same sequence of operations as Noise(). The results are
+// identical unless the compiler has fused some of Noise()'s operations into
+// FMA instructions.
+static BatchVector NoiseVector(const Float *x, const Float *y, const Float *z) {
+    constexpr int Width = BatchVector::Width;
+    // Compute noise cell offsets and corner gradients for each point
+    alignas(32) Float d[3][Width], g[8][3][Width];
+    for (int lane = 0; lane < Width; ++lane) {
+        int ix = std::floor(x[lane]), iy = std::floor(y[lane]), iz = std::floor(z[lane]);
+        d[0][lane] = x[lane] - ix;
+        d[1][lane] = y[lane] - iy;
+        d[2][lane] = z[lane] - iz;
+        ix &= NoisePermSize - 1;
+        iy &= NoisePermSize - 1;
+        iz &= NoisePermSize - 1;
+        // Share the outer permutation lookups among the cell's corners
+        for (int cx = 0; cx < 2; ++cx) {
+            int px = NoisePerm[ix + cx];
+            for (int cy = 0; cy < 2; ++cy) {
+                int pxy = NoisePerm[px + iy + cy];
+                for (int cz = 0; cz < 2; ++cz) {
+                    int h = NoisePerm[pxy + iz + cz] & 15;
+                    for (int c = 0; c < 3; ++c)
+                        g[cx + 2 * cy + 4 * cz][c][lane] = NoiseGradients[h][c];
+                }
+            }
+        }
+    }
+
+    // Compute gradient weights
+    using V = BatchVector;
+    V dx = V::Load(d[0]), dy = V::Load(d[1]), dz = V::Load(d[2]), one(1.f);
+    auto grad = [&](int corner, V dx, V dy, V dz) {
+        return V::Load(g[corner][0]) * dx + V::Load(g[corner][1]) * dy +
+               V::Load(g[corner][2]) * dz;
+    };
+    V w000 = grad(0, dx, dy, dz);
+    V w100 = grad(1, dx - one, dy, dz);
+    V w010 = grad(2, dx, dy - one, dz);
+    V w110 = grad(3, dx - one, dy - one, dz);
+    V w001 = grad(4, dx, dy, dz - one);
+    V w101 = grad(5, dx - one, dy, dz - one);
+    V w011 = grad(6, dx, dy - one, dz - one);
+    V w111 = grad(7, dx - one, dy - one, dz - one);
+
+    // Compute trilinear interpolation of weights
+    auto weight = [](V t) {
+        V t3 = t * t * t;
+        V t4 = t3 * t;
+        return V(6.f) * t4 * t - V(15.f) * t4 + V(10.f) * t3;
+    };
+    auto lerp = [&](V t, V a, V b) { return (one - t) * a + t * b; };
+    V wx = weight(dx), wy = weight(dy), wz = weight(dz);
+    V x00 = lerp(wx, w000, w100);
+    V x10 = lerp(wx, w010, w110);
+    V x01 = lerp(wx, w001, w101);
+    V x11 = lerp(wx, w011, w111);
+    V y0 = lerp(wy, x00, x10);
+    V y1 = lerp(wy, x01, x11);
+    return lerp(wz, y0, y1);
+}
+#endif  // PBRT_HAVE_SIMD
+
+void Noise(pstd::span<const Point3f> p, pstd::span<Float> result) {
+    CHECK_EQ(p.size(), result.size());
+    size_t i = 0;
+#ifdef PBRT_HAVE_SIMD
+    // Process the points a SIMD vector's worth at a time, padding the last
+    // vector with the origin
+    constexpr int Width = BatchVector::Width;
+    alignas(32) Float x[Width], y[Width], z[Width], noise[Width];
+    for (; i < p.size(); i += Width) {
+        int n = std::min<size_t>(Width, p.size() - i);
+        for (int lane = 0; lane < Width; ++lane) {
+            Point3f pl = lane < n ? p[i + lane] : Point3f(0, 0, 0);
+            x[lane] = pl.x;
+            y[lane] = pl.y;
+            z[lane] = pl.z;
+        }
+        NoiseVector(x, y, z).Store(noise);
+        std::copy(noise, noise + n, &result[i]);
+    }
+#endif
+    for (; i < p.size(); ++i)
+        result[i] = Noise(p[i]);
+}
+
+// Calls _f_ with the index and value of Noise(lambda p) for each of the
+// first _n_ octaves in order, where _lambda_ is one for the first octave
+// and increases by a factor of 1.99 with each subsequent one, as FBm()
+// and Turbulence() require.
+template <typename F>
+PBRT_CPU_GPU static void ForEachOctaveNoise(const Point3f &p, int n, F f) {
+#ifdef PBRT_IS_GPU_CODE
+    Float lambda = 1;
+    for (int i = 0; i < n; ++i) {
+        f(i, Noise(lambda * p));
+        lambda *= 1.99f;
+    }
+#else
+    // Evaluate a chunk of octaves' noise values at once
+    constexpr int ChunkSize = 16;
+    Point3f octaveP[ChunkSize];
+    Float noise[ChunkSize];
+    Float lambda = 1;
+    for (int start = 0; start < n; start += ChunkSize) {
+        int count = std::min(ChunkSize, n - start);
+        for (int i = 0; i < count; ++i) {
+            octaveP[i] = lambda * p;
+            lambda *= 1.99f;
+        }
+        Noise(pstd::span<const Point3f>(octaveP, count), pstd::span<Float>(noise, count));
+        for (int i = 0; i < count; ++i)
+            f(start + i, noise[i]);
+    }
+#endif
+}
+
 Float FBm(const Point3f &p, const Vector3f &dpdx, const Vector3f &dpdy, Float omega,
           int maxOctaves) {
     // Compute number of octaves for antialiased FBm
@@ -187,14 +333,15 @@ Float FBm(const Point3f &p, const Vector3f &dpdx, const Vector3f &dpdy, Float om
     int nInt = std::floor(n);
 
     // Compute sum of octaves of noise for FBm
-    Float sum = 0, lambda = 1, o = 1;
-    for (int i = 0; i < nInt; ++i) {
-        sum += o * Noise(lambda * p);
-        lambda *= 1.99f;
-        o *= omega;
-    }
+    Float sum = 0, o = 1;
     Float nPartial = n - nInt;
-    sum += o * SmoothStep(nPartial, .3f, .7f) * Noise(lambda * p);
+    ForEachOctaveNoise(p, nInt + 1, [&](int i, Float noise) {
+        if (i < nInt) {
+            sum += o * noise;
+            o *= omega;
+        } else
+            sum += o * SmoothStep(nPartial, .3f, .7f) * noise;
+    });
 
     return sum;
 }
@@ -207,16 +354,17 @@ Float Turbulence(const Point3f &p, const Vector3f &dpdx, const Vector3f &dpdy,
     int nInt = std::floor(n);
 
     // Compute sum of octaves of noise for turbulence
-    Float sum = 0, lambda = 1, o = 1;
-    for (int i = 0; i < nInt; ++i) {
-        sum += o * std::abs(Noise(lambda * p));
-        lambda *= 1.99f;
-        o *= omega;
-    }
-
-    // Account for contributions of clamped octaves in turbulence
+    Float sum = 0, o = 1;
     Float nPartial = n - nInt;
-    sum += o * Lerp(SmoothStep(nPartial, .3f, .7f), 0.2, std::abs(Noise(lambda * p)));
+    ForEachOctaveNoise(p, nInt + 1, [&](int i, Float noise) {
+        if (i < nInt) {
+            sum += o * std::abs(noise);
+            o *= omega;
+        } else {
+            // Account for contributions of clamped octaves in turbulence
+            sum += o * Lerp(SmoothStep(nPartial, .3f, .7f), 0.2, std::abs(noise));
+        }
+    });
     for (int i = nInt; i < maxOctaves; ++i) {
         sum += o * 0.2f;
         o *= omega;
@@ -511,46 +659,38 @@ std::string FBmTexture::ToString() const {
 ImageTextureBase::ImageTextureBase(TextureMapping2DHandle mapping,
                                    const std::string &filename, const std::string &filter,
                                    Float maxAniso, WrapMode wrapMode, Float scale,
-                                   ColorEncodingHandle encoding, Allocator alloc)
+                                   ColorEncodingHandle encoding, Allocator alloc,
+                                   bool precomputeSpectra,
+                                   TextureCompression compression)
     : mapping(std::move(mapping)), scale(scale) {
-    mipmap = GetTexture(filename, filter, maxAniso, wrapMode, encoding, alloc);
+    mipmap = GetTexture(filename, filter, maxAniso, wrapMode, encoding,
+                        precomputeSpectra, compression, alloc);
 }
 
 MIPMap *ImageTextureBase::GetTexture(const std::string &filename,
                                      const std::string &filter, Float maxAniso,
                                      WrapMode wrap, ColorEncodingHandle encoding,
-                                     Allocator alloc) {
-    // Return _MIPMap_ from texture cache if present
-    TexInfo texInfo(filename, filter, maxAniso, wrap, encoding);
-    std::unique_lock<std::mutex> lock(textureCacheMutex);
-    if (textureCache.find(texInfo) != textureCache.end())
-        return textureCache[texInfo].get();
-    else
-        lock.unlock();
-
-    // Create _MIPMap_ for _filename_
-    MIPMapFilterOptions options;
-    options.maxAnisotropy = maxAniso;
+                                     bool precomputeSpectra,
+                                     TextureCompression compression, Allocator alloc) {
+    // Return _MIPMap_ from texture cache, creating it if necessary
+    TexInfo texInfo(filename, filter, maxAniso, wrap, encoding, precomputeSpectra,
+                    compression);
+    auto create = [&]() {
+        // Create _MIPMap_ for _filename_
+        MIPMapFilterOptions options;
+        options.maxAnisotropy = maxAniso;
+        options.precomputeSpectra = precomputeSpectra;
+        options.compression = compression;
+
+        pstd::optional<FilterFunction> ff = ParseFilter(filter);
+        if (ff)
+            options.filter = *ff;
+        else
+            Warning("%s: filter function unknown", filter);
 
-    pstd::optional<FilterFunction> ff = ParseFilter(filter);
-    if (ff)
-        options.filter = *ff;
-    else
-        Warning("%s: filter function unknown", filter);
-
-    std::unique_ptr<MIPMap> mipmap =
-        MIPMap::CreateFromFile(filename, options, wrap, encoding, alloc);
-    if (mipmap) {
-        lock.lock();
-        // This is actually ok, but if it hits, it means we've wastefully
-        // loaded this texture. (Note that in that case, should just return
-        // the one that's already in there and not replace it.)
-        CHECK(textureCache.find(texInfo) == textureCache.end());
-        textureCache[texInfo] = std::move(mipmap);
-
-        return textureCache[texInfo].get();
-    } else
-        return nullptr;
+        return MIPMap::CreateFromFile(filename, options, wrap, encoding, alloc);
+    };
+    return textureCache.LookupOrCreate(texInfo, create).get();
 }
 
 // SpectrumImageTexture Method Definitions
@@ -567,6 +707,20 @@ SampledSpectrum SpectrumImageTexture::Evaluate(TextureEvalContext ctx,
     // Texture coordinates are (0,0) in the lower left corner, but
     // image coordinates are (0,0) in the upper left.
     st[1] = 1 - st[1];
+    if (mipmap->HasPrecomputedSpectra()) {
+        // Evaluate the filtered sigmoid polynomial directly
+        SigmoidPolynomialTexel texel =
+            mipmap->Lookup<SigmoidPolynomialTexel>(st, dstdx, dstdy);
+        if (texel.scale == 0)
+            return SampledSpectrum(0);
+        RGBSigmoidPolynomial rsp = texel.Polynomial();
+        SampledSpectrum illum = mipmap->GetRGBColorSpace()->illuminant.Sample(lambda);
+        SampledSpectrum s;
+        for (int i = 0; i < NSpectrumSamples; ++i)
+            s[i] = scale * texel.scale * rsp(lambda[i]) *
+                   texel.IlluminantFactor(illum[i]);
+        return s;
+    }
     RGB rgb = scale * mipmap->Lookup<RGB>(st, dstdx, dstdy);
     const RGBColorSpace *cs = mipmap->GetRGBColorSpace();
     if (cs != nullptr) {
@@ -592,12 +746,24 @@ std::string FloatImageTexture::ToString() const {
 
 std::string TexInfo::ToString() const {
     return StringPrintf("[ TexInfo filename: %s filter: %s maxAniso: %f "
-                        "wrapMode: %s encoding: %s ]",
-                        filename, filter, maxAniso, wrapMode, encoding);
+                        "wrapMode: %s encoding: %s precomputeSpectra: %s "
+                        "compression: %s ]",
+                        filename, filter, maxAniso, wrapMode, encoding,
+                        precomputeSpectra, compression);
+}
+
+static TextureCompression GetTextureCompression(
+    const TextureParameterDictionary &parameters) {
+    std::string compressionString = parameters.GetOneString("compression", "none");
+    pstd::optional<TextureCompression> compression =
+        ParseTextureCompression(compressionString);
+    if (!compression)
+        ErrorExit("%s: texture compression unknown", compressionString);
+    return *compression;
 }
 
-std::mutex ImageTextureBase::textureCacheMutex;
-std::map<TexInfo, std::unique_ptr<MIPMap>> ImageTextureBase::textureCache;
+ConcurrentCache<TexInfo, std::unique_ptr<MIPMap>, TexInfoHash>
+    ImageTextureBase::textureCache;
 
 FloatImageTexture *FloatImageTexture::Create(const Transform &renderFromTexture,
                                              const TextureParameterDictionary &parameters,
@@ -620,8 +786,10 @@ FloatImageTexture *FloatImageTexture::Create(const Transform &renderFromTexture,
     std::string encodingString = parameters.GetOneString("encoding", defaultEncoding);
     ColorEncodingHandle encoding = ColorEncodingHandle::Get(encodingString);
 
+    TextureCompression compression = GetTextureCompression(parameters);
+
     return alloc.new_object<FloatImageTexture>(map, filename, filter, maxAniso, *wrapMode,
-                                               scale, encoding, alloc);
+                                               scale, encoding, alloc, compression);
 }
 
 SpectrumImageTexture *SpectrumImageTexture::Create(
@@ -645,8 +813,12 @@ SpectrumImageTexture *SpectrumImageTexture::Create(
     std::string encodingString = parameters.GetOneString("encoding", defaultEncoding);
     ColorEncodingHandle encoding = ColorEncodingHandle::Get(encodingString);
 
+    bool precomputeSpectra = parameters.GetOneBool("precomputespectra", false);
+    TextureCompression compression = GetTextureCompression(parameters);
+
     return alloc.new_object<SpectrumImageTexture>(map, filename, filter, maxAniso,
-                                                  *wrapMode, scale, encoding, alloc);
+                                                  *wrapMode, scale, encoding, alloc,
+                                                  precomputeSpectra, compression);
 }
 
 // MarbleTexture Method Definitions
@@ -1005,15 +1177,18 @@ struct LuminanceTextureCacheItem {
     cudaTextureReadMode readMode;
     bool originallySingleChannel;
 };
+// Single-channel images that are used as spectrum textures share the
+// array in the luminance cache; _array_ is null if the image couldn't be
+// used.
 struct RGBTextureCacheItem {
     cudaArray_t array;
     cudaTextureReadMode readMode;
     const RGBColorSpace *colorSpace;
+    bool isSingleChannel;
 };
 
-static std::mutex textureCacheMutex;
-static std::map<std::string, LuminanceTextureCacheItem> lumTextureCache;
-static std::map<std::string, RGBTextureCacheItem> rgbTextureCache;
+static ConcurrentCache<std::string, LuminanceTextureCacheItem> lumTextureCache;
+static ConcurrentCache<std::string, RGBTextureCacheItem> rgbTextureCache;
 
 STAT_MEMORY_COUNTER("Memory/ImageTextures", gpuImageTextureBytes);
 
@@ -1074,155 +1249,121 @@ GPUSpectrumImageTexture *GPUSpectrumImageTexture::Create(
 
     std::string filename = ResolveFilename(parameters.GetOneString("filename", ""));
 
-    // These have to be initialized one way or another in the below
-    cudaArray_t texArray;
-    cudaTextureReadMode readMode;
-    const RGBColorSpace *colorSpace = nullptr;
-    bool isSingleChannel = false;
-
-    textureCacheMutex.lock();
-    auto rgbIter = rgbTextureCache.find(filename);
-    if (rgbIter != rgbTextureCache.end()) {
-        LOG_VERBOSE("Found %s in RGB tex array cache!", filename);
-        texArray = rgbIter->second.array;
-        readMode = rgbIter->second.readMode;
-        colorSpace = rgbIter->second.colorSpace;
-        textureCacheMutex.unlock();
-    } else {
-        auto lumIter = lumTextureCache.find(filename);
-        // We don't want to take it if it was originally an RGB texture and
-        // GPUFloatImageTexture converted it to single channel
-        if (lumIter != lumTextureCache.end() && lumIter->second.originallySingleChannel) {
-            LOG_VERBOSE("Found %s in luminance tex array cache!", filename);
-            texArray = lumIter->second.array;
-            readMode = lumIter->second.readMode;
-            colorSpace = RGBColorSpace::sRGB;
-            textureCacheMutex.unlock();
-            isSingleChannel = true;
-        } else {
-            textureCacheMutex.unlock();
-
-            {
-                ImageAndMetadata immeta = Image::Read(filename);
-                Image &image = immeta.image;
-
-                readMode = image.Format() == PixelFormat::U256
-                               ? cudaReadModeNormalizedFloat
-                               : cudaReadModeElementType;
-                colorSpace = immeta.metadata.GetColorSpace();
-
-                ImageChannelDesc rgbDesc = image.GetChannelDesc({"R", "G", "B"});
-                if (rgbDesc) {
-                    image = image.SelectChannels(rgbDesc);
-
-                    switch (image.Format()) {
-                    case PixelFormat::U256: {
-                        std::vector<uint8_t> rgba(4 * image.Resolution().x *
-                                                  image.Resolution().y);
-                        size_t offset = 0;
-                        for (int y = 0; y < image.Resolution().y; ++y)
-                            for (int x = 0; x < image.Resolution().x; ++x) {
-                                for (int c = 0; c < 3; ++c)
-                                    rgba[offset++] =
-                                        ((uint8_t *)image.RawPointer({x, y}))[c];
-                                rgba[offset++] = 255;
-                            }
-
-                        cudaChannelFormatDesc channelDesc = cudaCreateChannelDesc(
-                            8, 8, 8, 8, cudaChannelFormatKindUnsigned);
-
-                        CUDA_CHECK(cudaMallocArray(&texArray, &channelDesc,
-                                                   image.Resolution().x,
-                                                   image.Resolution().y));
-
-                        int pitch = image.Resolution().x * 4 * sizeof(uint8_t);
-                        gpuImageTextureBytes += pitch * image.Resolution().y;
-
-                        CUDA_CHECK(cudaMemcpy2DToArray(texArray,
-                                                       /* offset */ 0, 0, rgba.data(),
-                                                       pitch, pitch, image.Resolution().y,
-                                                       cudaMemcpyHostToDevice));
-                        break;
-                    }
-                    case PixelFormat::Half: {
-                        std::vector<Half> rgba(4 * image.Resolution().x *
-                                               image.Resolution().y);
-
-                        size_t offset = 0;
-                        for (int y = 0; y < image.Resolution().y; ++y)
-                            for (int x = 0; x < image.Resolution().x; ++x) {
-                                for (int c = 0; c < 3; ++c)
-                                    rgba[offset++] = Half(image.GetChannel({x, y}, c));
-                                rgba[offset++] = Half(1.f);
-                            }
-
-                        cudaChannelFormatDesc channelDesc = cudaCreateChannelDesc(
-                            16, 16, 16, 16, cudaChannelFormatKindFloat);
-
-                        CUDA_CHECK(cudaMallocArray(&texArray, &channelDesc,
-                                                   image.Resolution().x,
-                                                   image.Resolution().y));
-
-                        int pitch = image.Resolution().x * 4 * sizeof(Half);
-                        gpuImageTextureBytes += pitch * image.Resolution().y;
-
-                        CUDA_CHECK(cudaMemcpy2DToArray(texArray,
-                                                       /* offset */ 0, 0, rgba.data(),
-                                                       pitch, pitch, image.Resolution().y,
-                                                       cudaMemcpyHostToDevice));
-                        break;
+    auto create = [&]() -> RGBTextureCacheItem {
+        ImageAndMetadata immeta = Image::Read(filename);
+        Image &image = immeta.image;
+
+        cudaTextureReadMode readMode = image.Format() == PixelFormat::U256
+                                           ? cudaReadModeNormalizedFloat
+                                           : cudaReadModeElementType;
+        const RGBColorSpace *colorSpace = immeta.metadata.GetColorSpace();
+
+        ImageChannelDesc rgbDesc = image.GetChannelDesc({"R", "G", "B"});
+        if (rgbDesc) {
+            image = image.SelectChannels(rgbDesc);
+
+            cudaArray_t texArray;
+            switch (image.Format()) {
+            case PixelFormat::U256: {
+                std::vector<uint8_t> rgba(4 * image.Resolution().x *
+                                          image.Resolution().y);
+                size_t offset = 0;
+                for (int y = 0; y < image.Resolution().y; ++y)
+                    for (int x = 0; x < image.Resolution().x; ++x) {
+                        for (int c = 0; c < 3; ++c)
+                            rgba[offset++] = ((uint8_t *)image.RawPointer({x, y}))[c];
+                        rgba[offset++] = 255;
                     }
-                    case PixelFormat::Float: {
-                        std::vector<float> rgba(4 * image.Resolution().x *
-                                                image.Resolution().y);
-
-                        size_t offset = 0;
-                        for (int y = 0; y < image.Resolution().y; ++y)
-                            for (int x = 0; x < image.Resolution().x; ++x) {
-                                for (int c = 0; c < 3; ++c)
-                                    rgba[offset++] = image.GetChannel({x, y}, c);
-                                rgba[offset++] = 1.f;
-                            }
-
-                        cudaChannelFormatDesc channelDesc = cudaCreateChannelDesc(
-                            32, 32, 32, 32, cudaChannelFormatKindFloat);
-
-                        CUDA_CHECK(cudaMallocArray(&texArray, &channelDesc,
-                                                   image.Resolution().x,
-                                                   image.Resolution().y));
-
-                        int pitch = image.Resolution().x * 4 * sizeof(float);
-                        gpuImageTextureBytes += pitch * image.Resolution().y;
-
-                        CUDA_CHECK(cudaMemcpy2DToArray(texArray,
-                                                       /* offset */ 0, 0, rgba.data(),
-                                                       pitch, pitch, image.Resolution().y,
-                                                       cudaMemcpyHostToDevice));
-                        break;
+
+                cudaChannelFormatDesc channelDesc =
+                    cudaCreateChannelDesc(8, 8, 8, 8, cudaChannelFormatKindUnsigned);
+
+                CUDA_CHECK(cudaMallocArray(&texArray, &channelDesc, image.Resolution().x,
+                                           image.Resolution().y));
+
+                int pitch = image.Resolution().x * 4 * sizeof(uint8_t);
+                gpuImageTextureBytes += pitch * image.Resolution().y;
+
+                CUDA_CHECK(cudaMemcpy2DToArray(texArray, /* offset */ 0, 0, rgba.data(),
+                                               pitch, pitch, image.Resolution().y,
+                                               cudaMemcpyHostToDevice));
+                break;
+            }
+            case PixelFormat::Half: {
+                std::vector<Half> rgba(4 * image.Resolution().x * image.Resolution().y);
+
+                size_t offset = 0;
+                for (int y = 0; y < image.Resolution().y; ++y)
+                    for (int x = 0; x < image.Resolution().x; ++x) {
+                        for (int c = 0; c < 3; ++c)
+                            rgba[offset++] = Half(image.GetChannel({x, y}, c));
+                        rgba[offset++] = Half(1.f);
                     }
-                    default:
-                        LOG_FATAL("Unexpected PixelFormat");
+
+                cudaChannelFormatDesc channelDesc =
+                    cudaCreateChannelDesc(16, 16, 16, 16, cudaChannelFormatKindFloat);
+
+                CUDA_CHECK(cudaMallocArray(&texArray, &channelDesc, image.Resolution().x,
+                                           image.Resolution().y));
+
+                int pitch = image.Resolution().x * 4 * sizeof(Half);
+                gpuImageTextureBytes += pitch * image.Resolution().y;
+
+                CUDA_CHECK(cudaMemcpy2DToArray(texArray, /* offset */ 0, 0, rgba.data(),
+                                               pitch, pitch, image.Resolution().y,
+                                               cudaMemcpyHostToDevice));
+                break;
+            }
+            case PixelFormat::Float: {
+                std::vector<float> rgba(4 * image.Resolution().x * image.Resolution().y);
+
+                size_t offset = 0;
+                for (int y = 0; y < image.Resolution().y; ++y)
+                    for (int x = 0; x < image.Resolution().x; ++x) {
+                        for (int c = 0; c < 3; ++c)
+                            rgba[offset++] = image.GetChannel({x, y}, c);
+                        rgba[offset++] = 1.f;
                     }
 
-                    textureCacheMutex.lock();
-                    rgbTextureCache[filename] =
-                        RGBTextureCacheItem{texArray, readMode, colorSpace};
-                    textureCacheMutex.unlock();
-                } else if (image.NChannels() == 1) {
-                    texArray = createSingleChannelTextureArray(image);
-
-                    textureCacheMutex.lock();
-                    lumTextureCache[filename] =
-                        LuminanceTextureCacheItem{texArray, readMode, true};
-                    textureCacheMutex.unlock();
-                    isSingleChannel = true;
-                } else {
-                    Warning(loc, "%s: unable to decypher image format", filename);
-                    return nullptr;
-                }
-            }  // profile scope
+                cudaChannelFormatDesc channelDesc =
+                    cudaCreateChannelDesc(32, 32, 32, 32, cudaChannelFormatKindFloat);
+
+                CUDA_CHECK(cudaMallocArray(&texArray, &channelDesc, image.Resolution().x,
+                                           image.Resolution().y));
+
+                int pitch = image.Resolution().x * 4 * sizeof(float);
+                gpuImageTextureBytes += pitch * image.Resolution().y;
+
+                CUDA_CHECK(cudaMemcpy2DToArray(texArray, /* offset */ 0, 0, rgba.data(),
+                                               pitch, pitch, image.Resolution().y,
+                                               cudaMemcpyHostToDevice));
+                break;
+            }
+            default:
+                LOG_FATAL("Unexpected PixelFormat");
+            }
+
+            return RGBTextureCacheItem{texArray, readMode, colorSpace, false};
+        } else if (image.NChannels() == 1) {
+            const LuminanceTextureCacheItem &lum =
+                lumTextureCache.LookupOrCreate(filename, [&]() {
+                    return LuminanceTextureCacheItem{
+                        createSingleChannelTextureArray(image), readMode, true};
+                });
+            return RGBTextureCacheItem{lum.array, lum.readMode, RGBColorSpace::sRGB,
+                                       true};
+        } else {
+            Warning(loc, "%s: unable to decypher image format", filename);
+            return RGBTextureCacheItem{nullptr, readMode, colorSpace, false};
         }
-    }
+    };
+    const RGBTextureCacheItem &item = rgbTextureCache.LookupOrCreate(filename, create);
+    if (!item.array)
+        return nullptr;
+    cudaArray_t texArray = item.array;
+    cudaTextureReadMode readMode = item.readMode;
+    const RGBColorSpace *colorSpace = item.colorSpace;
+    bool isSingleChannel = item.isSingleChannel;
 
     cudaResourceDesc resDesc = {};
     resDesc.resType = cudaResourceTypeArray;
@@ -1268,19 +1409,7 @@ GPUFloatImageTexture *GPUFloatImageTexture::Create(
     */
     std::string filename = ResolveFilename(parameters.GetOneString("filename", ""));
 
-    cudaArray_t texArray;
-    cudaTextureReadMode readMode;
-
-    textureCacheMutex.lock();
-    auto iter = lumTextureCache.find(filename);
-    if (iter != lumTextureCache.end()) {
-        LOG_VERBOSE("Found %s in luminance tex array cache!", filename);
-        texArray = iter->second.array;
-        readMode = iter->second.readMode;
-        textureCacheMutex.unlock();
-    } else {
-        textureCacheMutex.unlock();
-
+    auto create = [&]() {
         ImageAndMetadata immeta = Image::Read(filename);
         Image &image = immeta.image;
         bool convertedImage = false;
@@ -1315,15 +1444,16 @@ GPUFloatImageTexture *GPUFloatImageTexture::Create(
                           image.NChannels());
         }
 
-        texArray = createSingleChannelTextureArray(image);
-        readMode = (image.Format() == PixelFormat::U256) ? cudaReadModeNormalizedFloat
-                                                         : cudaReadModeElementType;
-
-        textureCacheMutex.lock();
-        lumTextureCache[filename] =
-            LuminanceTextureCacheItem{texArray, readMode, !convertedImage};
-        textureCacheMutex.unlock();
-    }
+        cudaTextureReadMode readMode = image.Format() == PixelFormat::U256
+                                           ? cudaReadModeNormalizedFloat
+                                           : cudaReadModeElementType;
+        return LuminanceTextureCacheItem{createSingleChannelTextureArray(image), readMode,
+                                         !convertedImage};
+    };
+    const LuminanceTextureCacheItem &item =
+        lumTextureCache.LookupOrCreate(filename, create);
+    cudaArray_t texArray = item.array;
+    cudaTextureReadMode readMode = item.readMode;
 
     cudaResourceDesc resDesc = {};
     resDesc.resType = cudaResourceTypeArray;
@@ -1460,4 +1590,630 @@ SampledSpectrum UniversalTextureEvaluator::operator()(SpectrumTextureHandle tex,
     return tex.Evaluate(ctx, lambda);
 }
 
+pstd::array<Float, 3> UniversalTextureEvaluator::operator()(
+    FloatTextureHandle tex, const pstd::array<TextureEvalContext, 3> &ctx) {
+#ifdef PBRT_IS_GPU_CODE
+    return {tex.Evaluate(ctx[0]), tex.Evaluate(ctx[1]), tex.Evaluate(ctx[2])};
+#else
+    if (Options->approximateBumpGradients)
+        return EvaluateNearby(tex, ctx);
+    return {tex.Evaluate(ctx[0]), tex.Evaluate(ctx[1]), tex.Evaluate(ctx[2])};
+#endif
+}
+
+// Batched Texture Evaluation Definitions
+// Sets each element of _result_ to _f_ applied to the corresponding elements
+// of the _in_ arrays. As with SampledSpectrum::Map(), _f_ is called with
+// SIMD vectors of values where possible, so it should be generic.
+template <typename F, typename... Spans>
+static void MapBatch(pstd::span<Float> result, F f, Spans... in) {
+    size_t i = 0;
+#ifdef PBRT_HAVE_SIMD
+    for (; i + BatchVector::Width <= result.size(); i += BatchVector::Width)
+        f(BatchVector::Load(&in[i])...).Store(&result[i]);
+#endif
+    for (; i < result.size(); ++i)
+        result[i] = f(in[i]...);
+}
+
+// Returns _scale_ times the sigmoid polynomial with coefficients _c_
+// evaluated at each of the wavelengths, which are stored in a
+// SampledSpectrum so that they can be processed with SIMD instructions.
+static SampledSpectrum SampleSigmoidPolynomial(pstd::array<Float, 3> c, Float scale,
+                                               const SampledSpectrum &lambda) {
+    return SampledSpectrum::Map(lambda, [&](auto l) {
+        using V = decltype(l);
+        V v = (V(c[0]) * l + V(c[1])) * l + V(c[2]);
+        // Clamp infinite values, as black's polynomial has, to where the
+        // sigmoid is exactly zero or one.
+        v = simd::Min(simd::Max(v, V(-1e10f)), V(1e10f));
+        return V(scale) * (V(.5f) + v / (V(2) * simd::Sqrt(V(1) + v * v)));
+    });
+}
+
+// Evaluates the 2D mapping at each of the points, dispatching on its type
+// once for the batch, and calls _lookup_ with the image texture coordinates
+// and their differentials.
+template <typename F>
+static void MapImageBatch(TextureMapping2DHandle mapping,
+                          pstd::span<const TextureEvalContext> ctx, F lookup) {
+    mapping.DispatchCPU([&](auto m) {
+        for (size_t i = 0; i < ctx.size(); ++i) {
+            Vector2f dstdx, dstdy;
+            Point2f st = m->Map(ctx[i], &dstdx, &dstdy);
+            // Flip $t$ as in the image textures' Evaluate() methods
+            st[1] = 1 - st[1];
+            lookup(i, st, dstdx, dstdy);
+        }
+    });
+}
+
+void FloatConstantTexture::EvaluateBatch(pstd::span<const TextureEvalContext> ctx,
+                                         pstd::span<Float> result) const {
+    std::fill(result.begin(), result.end(), value);
+}
+
+void FloatImageTexture::EvaluateBatch(pstd::span<const TextureEvalContext> ctx,
+                                      pstd::span<Float> result) const {
+    if (!mipmap) {
+        std::fill(result.begin(), result.end(), scale);
+        return;
+    }
+    MapImageBatch(mapping, ctx, [&](size_t i, Point2f st, Vector2f dstdx,
+                                    Vector2f dstdy) {
+        result[i] = mipmap->Lookup<Float>(st, dstdx, dstdy);
+    });
+    MapBatch(
+        result, [&](auto v) { return decltype(v)(scale) * v; },
+        pstd::span<const Float>(result));
+}
+
+void SpectrumImageTexture::EvaluateBatch(pstd::span<const TextureEvalContext> ctx,
+                                         pstd::span<const SampledWavelengths> lambda,
+                                         pstd::span<SampledSpectrum> result) const {
+    if (!mipmap) {
+        std::fill(result.begin(), result.end(), SampledSpectrum(scale));
+        return;
+    }
+    auto wavelengths = [&](size_t i) {
+        SampledSpectrum l;
+        for (int j = 0; j < NSpectrumSamples; ++j)
+            l[j] = lambda[i][j];
+        return l;
+    };
+
+    const RGBColorSpace *cs = mipmap->GetRGBColorSpace();
+    if (mipmap->HasPrecomputedSpectra()) {
+        MapImageBatch(mapping, ctx, [&](size_t i, Point2f st, Vector2f dstdx,
+                                        Vector2f dstdy) {
+            SigmoidPolynomialTexel texel =
+                mipmap->Lookup<SigmoidPolynomialTexel>(st, dstdx, dstdy);
+            if (texel.scale == 0) {
+                result[i] = SampledSpectrum(0);
+                return;
+            }
+            result[i] = SampleSigmoidPolynomial(texel.Polynomial().Coefficients(),
+                                                scale * texel.scale, wavelengths(i));
+            if (texel.illuminant > 0) {
+                // Follow SpectrumImageTexture::Evaluate() for unbounded texels
+                SampledSpectrum illum = cs->illuminant.Sample(lambda[i]);
+                for (int j = 0; j < NSpectrumSamples; ++j)
+                    result[i][j] *= texel.IlluminantFactor(illum[j]);
+            }
+        });
+        return;
+    }
+
+    MapImageBatch(mapping, ctx, [&](size_t i, Point2f st, Vector2f dstdx,
+                                    Vector2f dstdy) {
+        RGB rgb = scale * mipmap->Lookup<RGB>(st, dstdx, dstdy);
+        if (!cs) {
+            // Single-channel textures give constant spectra
+            CHECK(rgb[0] == rgb[1] && rgb[1] == rgb[2]);
+            result[i] = SampledSpectrum(rgb[0]);
+            return;
+        }
+        // Follow the RGBSpectrum and RGBReflectanceSpectrum constructors
+        Float m = std::max({rgb.r, rgb.g, rgb.b});
+        if (m > 1) {
+            RGBSigmoidPolynomial rsp = cs->ToRGBCoeffs(rgb / (2 * m));
+            result[i] = SampleSigmoidPolynomial(rsp.Coefficients(), 2 * m,
+                                                wavelengths(i)) *
+                        cs->illuminant.Sample(lambda[i]);
+        } else
+            result[i] = SampleSigmoidPolynomial(cs->ToRGBCoeffs(rgb).Coefficients(), 1,
+                                                wavelengths(i));
+    });
+}
+
+void FloatMixTexture::EvaluateBatch(pstd::span<const TextureEvalContext> ctx,
+                                    pstd::span<Float> result) const {
+    std::vector<Float> t2(ctx.size()), amt(ctx.size());
+    pbrt::EvaluateBatch(tex1, ctx, result);
+    pbrt::EvaluateBatch(tex2, ctx, pstd::span<Float>(t2));
+    pbrt::EvaluateBatch(amount, ctx, pstd::span<Float>(amt));
+    MapBatch(
+        result,
+        [](auto t1, auto t2, auto amt) {
+            using V = decltype(amt);
+            return (V(1) - amt) * t1 + amt * t2;
+        },
+        pstd::span<const Float>(result), pstd::span<const Float>(t2),
+        pstd::span<const Float>(amt));
+}
+
+void SpectrumMixTexture::EvaluateBatch(pstd::span<const TextureEvalContext> ctx,
+                                       pstd::span<const SampledWavelengths> lambda,
+                                       pstd::span<SampledSpectrum> result) const {
+    std::vector<SampledSpectrum> t2(ctx.size());
+    std::vector<Float> amt(ctx.size());
+    pbrt::EvaluateBatch(tex1, ctx, lambda, result);
+    pbrt::EvaluateBatch(tex2, ctx, lambda, pstd::span<SampledSpectrum>(t2));
+    pbrt::EvaluateBatch(amount, ctx, pstd::span<Float>(amt));
+    for (size_t i = 0; i < ctx.size(); ++i)
+        result[i] = (1 - amt[i]) * result[i] + amt[i] * t2[i];
+}
+
+void FloatScaledTexture::EvaluateBatch(pstd::span<const TextureEvalContext> ctx,
+                                       pstd::span<Float> result) const {
+    std::vector<Float> s(ctx.size());
+    pbrt::EvaluateBatch(tex, ctx, result);
+    pbrt::EvaluateBatch(scale, ctx, pstd::span<Float>(s));
+    MapBatch(
+        result, [](auto t, auto s) { return t * s; }, pstd::span<const Float>(result),
+        pstd::span<const Float>(s));
+}
+
+void SpectrumScaledTexture::EvaluateBatch(pstd::span<const TextureEvalContext> ctx,
+                                          pstd::span<const SampledWavelengths> lambda,
+                                          pstd::span<SampledSpectrum> result) const {
+    std::vector<Float> s(ctx.size());
+    pbrt::EvaluateBatch(tex, ctx, lambda, result);
+    pbrt::EvaluateBatch(scale, ctx, pstd::span<Float>(s));
+    for (size_t i = 0; i < ctx.size(); ++i)
+        result[i] *= s[i];
+}
+
+// HasEvaluateBatch Definition
+// Detects texture classes that provide their own EvaluateBatch() method.
+template <typename T, typename = void>
+struct HasEvaluateBatch : std::false_type {};
+template <typename T>
+struct HasEvaluateBatch<T, std::void_t<decltype(&T::EvaluateBatch)>> : std::true_type {};
+
+void EvaluateBatch(FloatTextureHandle tex, pstd::span<const TextureEvalContext> ctx,
+                   pstd::span<Float> result) {
+    CHECK_EQ(ctx.size(), result.size());
+    if (ctx.empty())
+        return;
+    tex.DispatchCPU([&](auto t) {
+        using Texture = std::remove_cv_t<std::remove_pointer_t<decltype(t)>>;
+        if constexpr (HasEvaluateBatch<Texture>::value)
+            t->EvaluateBatch(ctx, result);
+        else
+            for (size_t i = 0; i < ctx.size(); ++i)
+                result[i] = t->Evaluate(ctx[i]);
+    });
+}
+
+void EvaluateBatch(SpectrumTextureHandle tex, pstd::span<const TextureEvalContext> ctx,
+                   pstd::span<const SampledWavelengths> lambda,
+                   pstd::span<SampledSpectrum> result) {
+    CHECK_EQ(ctx.size(), lambda.size());
+    CHECK_EQ(ctx.size(), result.size());
+    if (ctx.empty())
+        return;
+    tex.DispatchCPU([&](auto t) {
+        using Texture = std::remove_cv_t<std::remove_pointer_t<decltype(t)>>;
+        if constexpr (HasEvaluateBatch<Texture>::value)
+            t->EvaluateBatch(ctx, lambda, result);
+        else
+            for (size_t i = 0; i < ctx.size(); ++i)
+                result[i] = t->Evaluate(ctx[i], lambda[i]);
+    });
+}
+
+// Nearby Texture Evaluation Definitions
+pstd::array<Float, 3> FloatImageTexture::EvaluateNearby(
+    const pstd::array<TextureEvalContext, 3> &ctx) const {
+    if (!mipmap)
+        return {scale, scale, scale};
+    Point2f st[3];
+    Vector2f dstdx[3], dstdy[3];
+    MapImageBatch(mapping, ctx, [&](size_t i, Point2f p, Vector2f dx, Vector2f dy) {
+        st[i] = p;
+        dstdx[i] = dx;
+        dstdy[i] = dy;
+    });
+
+    Vector2f dfdst;
+    Float f = mipmap->LookupWithGradient(st[0], dstdx[0], dstdy[0], &dfdst);
+    pstd::array<Float, 3> result;
+    result[0] = scale * f;
+    for (int i = 1; i < 3; ++i) {
+        Vector2f d = st[i] - st[0];
+        if (std::max(std::abs(d.x), std::abs(d.y)) > .5f)
+            // The points are on opposite sides of a discontinuity in the
+            // mapping, such as the seam of a spherical mapping, so the
+            // gradient doesn't apply.
+            result[i] = scale * mipmap->Lookup<Float>(st[i], dstdx[i], dstdy[i]);
+        else
+            result[i] = scale * (f + Dot(dfdst, d));
+    }
+    return result;
+}
+
+pstd::array<Float, 3> FloatMixTexture::EvaluateNearby(
+    const pstd::array<TextureEvalContext, 3> &ctx) const {
+    pstd::array<Float, 3> t1 = pbrt::EvaluateNearby(tex1, ctx);
+    pstd::array<Float, 3> t2 = pbrt::EvaluateNearby(tex2, ctx);
+    pstd::array<Float, 3> amt = pbrt::EvaluateNearby(amount, ctx);
+    pstd::array<Float, 3> result;
+    for (int i = 0; i < 3; ++i)
+        result[i] = (1 - amt[i]) * t1[i] + amt[i] * t2[i];
+    return result;
+}
+
+pstd::array<Float, 3> FloatScaledTexture::EvaluateNearby(
+    const pstd::array<TextureEvalContext, 3> &ctx) const {
+    pstd::array<Float, 3> t = pbrt::EvaluateNearby(tex, ctx);
+    pstd::array<Float, 3> s = pbrt::EvaluateNearby(scale, ctx);
+    return {t[0] * s[0], t[1] * s[1], t[2] * s[2]};
+}
+
+// HasEvaluateNearby Definition
+template <typename T, typename = void>
+struct HasEvaluateNearby : std::false_type {};
+template <typename T>
+struct HasEvaluateNearby<T, std::void_t<decltype(&T::EvaluateNearby)>>
+    : std::true_type {};
+
+pstd::array<Float, 3> EvaluateNearby(FloatTextureHandle tex,
+                                     const pstd::array<TextureEvalContext, 3> &ctx) {
+    pstd::array<Float, 3> result;
+    tex.DispatchCPU([&](auto t) {
+        using Texture = std::remove_cv_t<std::remove_pointer_t<decltype(t)>>;
+        if constexpr (HasEvaluateNearby<Texture>::value)
+            result = t->EvaluateNearby(ctx);
+        else if constexpr (HasEvaluateBatch<Texture>::value)
+            t->EvaluateBatch(ctx, pstd::span<Float>(result));
+        else
+            for (int i = 0; i < 3; ++i)
+                result[i] = t->Evaluate(ctx[i]);
+    });
+    return result;
+}
+
+// BatchTextureEvaluator Method Definitions
+void BatchTextureEvaluator::Evaluate() {
+    // Sort the requests by texture; since the type tag is stored in the
+    // high bits of a TaggedPointer, this also groups them by type.
+    auto byTexture = [](const auto &a, const auto &b) { return a.tex < b.tex; };
+    std::stable_sort(floatRequests.begin(), floatRequests.end(), byTexture);
+    std::stable_sort(spectrumRequests.begin(), spectrumRequests.end(), byTexture);
+
+    // Evaluate each run of requests that use the same texture together
+    for (size_t start = 0; start < floatRequests.size();) {
+        size_t end = start + 1;
+        while (end < floatRequests.size() &&
+               floatRequests[end].tex == floatRequests[start].tex)
+            ++end;
+        ctxScratch.clear();
+        for (size_t i = start; i < end; ++i)
+            ctxScratch.push_back(floatRequests[i].ctx);
+        floatScratch.resize(end - start);
+        pbrt::EvaluateBatch(floatRequests[start].tex, ctxScratch,
+                            pstd::span<Float>(floatScratch));
+        for (size_t i = start; i < end; ++i)
+            *floatRequests[i].result = floatScratch[i - start];
+        start = end;
+    }
+
+    for (size_t start = 0; start < spectrumRequests.size();) {
+        size_t end = start + 1;
+        while (end < spectrumRequests.size() &&
+               spectrumRequests[end].tex == spectrumRequests[start].tex)
+            ++end;
+        ctxScratch.clear();
+        lambdaScratch.clear();
+        for (size_t i = start; i < end; ++i) {
+            ctxScratch.push_back(spectrumRequests[i].ctx);
+            lambdaScratch.push_back(spectrumRequests[i].lambda);
+        }
+        spectrumScratch.resize(end - start);
+        pbrt::EvaluateBatch(spectrumRequests[start].tex, ctxScratch, lambdaScratch,
+                            pstd::span<SampledSpectrum>(spectrumScratch));
+        for (size_t i = start; i < end; ++i)
+            *spectrumRequests[i].result = spectrumScratch[i - start];
+        start = end;
+    }
+
+    floatRequests.clear();
+    spectrumRequests.clear();
+}
+
+// TextureGraphOptimizer Method Definitions
+FloatTextureHandle TextureGraphOptimizer::Optimize(FloatTextureHandle tex) {
+    if (!tex)
+        return tex;
+    FloatTextureHandle opt = OptimizeNode(tex);
+    floatRoots.push_back(opt);
+    return opt;
+}
+
+SpectrumTextureHandle TextureGraphOptimizer::Optimize(SpectrumTextureHandle tex) {
+    if (!tex)
+        return tex;
+    SpectrumTextureHandle opt = OptimizeNode(tex);
+    spectrumRoots.push_back(opt);
+    return opt;
+}
+
+FloatTextureHandle TextureGraphOptimizer::OptimizeNode(FloatTextureHandle tex) {
+    if (auto iter = floatOptimized.find(tex); iter != floatOptimized.end())
+        return iter->second;
+
+    // Optimize the texture's inputs before the texture itself
+    FloatTextureHandle opt = tex;
+    if (FloatConstantTexture *c = tex.CastOrNullptr<FloatConstantTexture>())
+        opt = FloatConstant(c->value, tex);
+    else if (FloatScaledTexture *s = tex.CastOrNullptr<FloatScaledTexture>())
+        opt = Scale(OptimizeNode(s->tex), OptimizeNode(s->scale), s);
+    else if (FloatMixTexture *m = tex.CastOrNullptr<FloatMixTexture>())
+        opt = Mix(OptimizeNode(m->tex1), OptimizeNode(m->tex2), OptimizeNode(m->amount),
+                  m);
+
+    floatOptimized[tex] = opt;
+    return opt;
+}
+
+SpectrumTextureHandle TextureGraphOptimizer::OptimizeNode(SpectrumTextureHandle tex) {
+    if (auto iter = spectrumOptimized.find(tex); iter != spectrumOptimized.end())
+        return iter->second;
+
+    SpectrumTextureHandle opt = tex;
+    Float c;
+    if (IsConstant(tex, &c))
+        opt = SpectrumConstant(c, tex);
+    else if (SpectrumScaledTexture *s = tex.CastOrNullptr<SpectrumScaledTexture>())
+        opt = Scale(OptimizeNode(s->tex), OptimizeNode(s->scale), s);
+    else if (SpectrumMixTexture *m = tex.CastOrNullptr<SpectrumMixTexture>())
+        opt = Mix(OptimizeNode(m->tex1), OptimizeNode(m->tex2), OptimizeNode(m->amount),
+                  m);
+
+    spectrumOptimized[tex] = opt;
+    return opt;
+}
+
+bool TextureGraphOptimizer::IsConstant(FloatTextureHandle tex, Float *value) {
+    FloatConstantTexture *c = tex.CastOrNullptr<FloatConstantTexture>();
+    if (c)
+        *value = c->value;
+    return c != nullptr;
+}
+
+bool TextureGraphOptimizer::IsConstant(SpectrumTextureHandle tex, Float *value) {
+    // Only spectrally-constant constant textures are folded
+    SpectrumConstantTexture *c = tex.CastOrNullptr<SpectrumConstantTexture>();
+    if (!c || !c->value.Is<ConstantSpectrum>())
+        return false;
+    *value = c->value.MaxValue();
+    return true;
+}
+
+FloatTextureHandle TextureGraphOptimizer::FloatConstant(Float value,
+                                                        FloatTextureHandle original) {
+    // NaNs can't be used as keys, so constant NaN textures aren't shared
+    if (std::isnan(value))
+        return original ? original : alloc.new_object<FloatConstantTexture>(value);
+    FloatTextureHandle &c = floatConstants[value];
+    if (!c)
+        c = original ? original : alloc.new_object<FloatConstantTexture>(value);
+    return c;
+}
+
+SpectrumTextureHandle TextureGraphOptimizer::SpectrumConstant(
+    Float value, SpectrumTextureHandle original) {
+    auto create = [&]() -> SpectrumTextureHandle {
+        if (original)
+            return original;
+        SpectrumHandle s = alloc.new_object<ConstantSpectrum>(value);
+        return alloc.new_object<SpectrumConstantTexture>(s);
+    };
+    if (std::isnan(value))
+        return create();
+    SpectrumTextureHandle &c = spectrumConstants[value];
+    if (!c)
+        c = create();
+    return c;
+}
+
+FloatTextureHandle TextureGraphOptimizer::Scale(FloatTextureHandle tex,
+                                                FloatTextureHandle scale,
+                                                FloatScaledTexture *original) {
+    // Make a constant input the scale, which is where it's expected below
+    Float s, c;
+    if (IsConstant(tex, &c) && !IsConstant(scale, &s))
+        pstd::swap(tex, scale);
+
+    if (IsConstant(scale, &s)) {
+        if (s == 1)
+            return tex;
+        if (IsConstant(tex, &c))
+            return FloatConstant(c * s);
+        if (s == 0)
+            return FloatConstant(0);
+        // Apply the scale to image textures, as FloatScaledTexture::Create()
+        // does.
+        if (FloatImageTexture *image = tex.CastOrNullptr<FloatImageTexture>()) {
+            FloatImageTexture *imageCopy = alloc.new_object<FloatImageTexture>(*image);
+            imageCopy->scale *= s;
+            return imageCopy;
+        }
+#if defined(PBRT_BUILD_GPU_RENDERER)
+        if (GPUFloatImageTexture *gimage = tex.CastOrNullptr<GPUFloatImageTexture>()) {
+            GPUFloatImageTexture *gimageCopy =
+                alloc.new_object<GPUFloatImageTexture>(*gimage);
+            gimageCopy->scale *= s;
+            return gimageCopy;
+        }
+#endif
+        // Collapse nested scales by constants
+        if (FloatScaledTexture *inner = tex.CastOrNullptr<FloatScaledTexture>();
+            inner && IsConstant(inner->scale, &c))
+            return Scale(inner->tex, FloatConstant(c * s));
+    } else if (scale < tex)
+        // Order non-constant inputs consistently so that the product is
+        // shared no matter how it was written
+        pstd::swap(tex, scale);
+
+    FloatTextureHandle &t = floatScales[std::make_pair(tex, scale)];
+    if (!t) {
+        if (original && ((original->tex == tex && original->scale == scale) ||
+                         (original->tex == scale && original->scale == tex)))
+            t = original;
+        else
+            t = alloc.new_object<FloatScaledTexture>(tex, scale);
+    }
+    return t;
+}
+
+SpectrumTextureHandle TextureGraphOptimizer::Scale(SpectrumTextureHandle tex,
+                                                   FloatTextureHandle scale,
+                                                   SpectrumScaledTexture *original) {
+    Float s, c;
+    if (IsConstant(tex, &c) && c == 0)
+        return tex;
+    if (IsConstant(scale, &s)) {
+        if (s == 1)
+            return tex;
+        if (IsConstant(tex, &c))
+            return SpectrumConstant(c * s);
+        if (s == 0)
+            return SpectrumConstant(0);
+        if (SpectrumImageTexture *image = tex.CastOrNullptr<SpectrumImageTexture>()) {
+            SpectrumImageTexture *imageCopy =
+                alloc.new_object<SpectrumImageTexture>(*image);
+            imageCopy->scale *= s;
+            return imageCopy;
+        }
+#if defined(PBRT_BUILD_GPU_RENDERER)
+        if (GPUSpectrumImageTexture *gimage =
+                tex.CastOrNullptr<GPUSpectrumImageTexture>()) {
+            GPUSpectrumImageTexture *gimageCopy =
+                alloc.new_object<GPUSpectrumImageTexture>(*gimage);
+            gimageCopy->scale *= s;
+            return gimageCopy;
+        }
+#endif
+        if (SpectrumScaledTexture *inner = tex.CastOrNullptr<SpectrumScaledTexture>();
+            inner && IsConstant(inner->scale, &c))
+            return Scale(inner->tex, FloatConstant(c * s));
+    }
+
+    SpectrumTextureHandle &t = spectrumScales[std::make_pair(tex, scale)];
+    if (!t) {
+        if (original && original->tex == tex && original->scale == scale)
+            t = original;
+        else
+            t = alloc.new_object<SpectrumScaledTexture>(tex, scale);
+    }
+    return t;
+}
+
+FloatTextureHandle TextureGraphOptimizer::Mix(FloatTextureHandle tex1,
+                                              FloatTextureHandle tex2,
+                                              FloatTextureHandle amount,
+                                              FloatMixTexture *original) {
+    if (tex1 == tex2)
+        return tex1;
+    Float a, c1, c2;
+    if (IsConstant(amount, &a)) {
+        if (a == 0)
+            return tex1;
+        if (a == 1)
+            return tex2;
+        if (IsConstant(tex1, &c1) && IsConstant(tex2, &c2))
+            return FloatConstant((1 - a) * c1 + a * c2);
+    }
+
+    FloatTextureHandle &t = floatMixes[std::make_tuple(tex1, tex2, amount)];
+    if (!t) {
+        if (original && original->tex1 == tex1 && original->tex2 == tex2 &&
+            original->amount == amount)
+            t = original;
+        else
+            t = alloc.new_object<FloatMixTexture>(tex1, tex2, amount);
+    }
+    return t;
+}
+
+SpectrumTextureHandle TextureGraphOptimizer::Mix(SpectrumTextureHandle tex1,
+                                                 SpectrumTextureHandle tex2,
+                                                 FloatTextureHandle amount,
+                                                 SpectrumMixTexture *original) {
+    if (tex1 == tex2)
+        return tex1;
+    Float a, c1, c2;
+    if (IsConstant(amount, &a)) {
+        if (a == 0)
+            return tex1;
+        if (a == 1)
+            return tex2;
+        if (IsConstant(tex1, &c1) && IsConstant(tex2, &c2))
+            return SpectrumConstant((1 - a) * c1 + a * c2);
+    }
+
+    SpectrumTextureHandle &t = spectrumMixes[std::make_tuple(tex1, tex2, amount)];
+    if (!t) {
+        if (original && original->tex1 == tex1 && original->tex2 == tex2 &&
+            original->amount == amount)
+            t = original;
+        else
+            t = alloc.new_object<SpectrumMixTexture>(tex1, tex2, amount);
+    }
+    return t;
+}
+
+int64_t TextureGraphOptimizer::NodesRemoved() const {
+    // Find the distinct textures that the optimized textures use
+    std::set<const void *> used;
+    std::vector<FloatTextureHandle> floatStack = floatRoots;
+    std::vector<SpectrumTextureHandle> spectrumStack = spectrumRoots;
+    while (!floatStack.empty() || !spectrumStack.empty()) {
+        if (!spectrumStack.empty()) {
+            SpectrumTextureHandle tex = spectrumStack.back();
+            spectrumStack.pop_back();
+            if (!used.insert(tex.ptr()).second)
+                continue;
+            if (SpectrumScaledTexture *s = tex.CastOrNullptr<SpectrumScaledTexture>()) {
+                spectrumStack.push_back(s->tex);
+                floatStack.push_back(s->scale);
+            } else if (SpectrumMixTexture *m = tex.CastOrNullptr<SpectrumMixTexture>()) {
+                spectrumStack.push_back(m->tex1);
+                spectrumStack.push_back(m->tex2);
+                floatStack.push_back(m->amount);
+            }
+        } else {
+            FloatTextureHandle tex = floatStack.back();
+            floatStack.pop_back();
+            if (!used.insert(tex.ptr()).second)
+                continue;
+            if (FloatScaledTexture *s = tex.CastOrNullptr<FloatScaledTexture>()) {
+                floatStack.push_back(s->tex);
+                floatStack.push_back(s->scale);
+            } else if (FloatMixTexture *m = tex.CastOrNullptr<FloatMixTexture>()) {
+                floatStack.push_back(m->tex1);
+                floatStack.push_back(m->tex2);
+                floatStack.push_back(m->amount);
+            }
+        }
+    }
+
+    // Every texture used by the original textures was visited by
+    // OptimizeNode().
+    return int64_t(floatOptimized.size() + spectrumOptimized.size()) -
+           int64_t(used.size());
+}
+
 }  // namespace pbrt
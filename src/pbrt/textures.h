@@ -10,6 +10,8 @@
 #include <pbrt/base/texture.h>
 #include <pbrt/interaction.h>
 #include <pbrt/paramdict.h>
+#include <pbrt/util/containers.h>
+#include <pbrt/util/hash.h>
 #include <pbrt/util/math.h>
 #include <pbrt/util/mipmap.h>
 #include <pbrt/util/spectrum.h>
@@ -21,6 +23,9 @@
 #include <map>
 #include <mutex>
 #include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 namespace pbrt {
 
@@ -28,6 +33,9 @@ PBRT_CPU_GPU
 Float Noise(Float x, Float y = .5f, Float z = .5f);
 PBRT_CPU_GPU
 Float Noise(const Point3f &p);
+// Evaluates Noise() at each of the points, processing several of them at
+// once with SIMD instructions.
+void Noise(pstd::span<const Point3f> p, pstd::span<Float> result);
 PBRT_CPU_GPU
 Float FBm(const Point3f &p, const Vector3f &dpdx, const Vector3f &dpdy, Float omega,
           int octaves);
@@ -278,6 +286,9 @@ class FloatConstantTexture {
     PBRT_CPU_GPU
     Float Evaluate(TextureEvalContext ctx) const { return value; }
 
+    void EvaluateBatch(pstd::span<const TextureEvalContext> ctx,
+                       pstd::span<Float> result) const;
+
     static FloatConstantTexture *Create(const Transform &renderFromTexture,
                                         const TextureParameterDictionary &parameters,
                                         const FileLoc *loc, Allocator alloc);
@@ -285,6 +296,8 @@ class FloatConstantTexture {
     std::string ToString() const;
 
   private:
+    friend class TextureGraphOptimizer;
+
     Float value;
 };
 
@@ -337,6 +350,8 @@ class SpectrumConstantTexture {
     std::string ToString() const;
 
   private:
+    friend class TextureGraphOptimizer;
+
     SpectrumHandle value;
 };
 
@@ -567,29 +582,57 @@ class FBmTexture {
 // TexInfo Declarations
 struct TexInfo {
     TexInfo(const std::string &f, const std::string &filt, Float ma, WrapMode wm,
-            ColorEncodingHandle encoding)
-        : filename(f), filter(filt), maxAniso(ma), wrapMode(wm), encoding(encoding) {}
+            ColorEncodingHandle encoding, bool precomputeSpectra,
+            TextureCompression compression)
+        : filename(f),
+          filter(filt),
+          maxAniso(ma),
+          wrapMode(wm),
+          encoding(encoding),
+          precomputeSpectra(precomputeSpectra),
+          compression(compression) {}
     std::string filename;
     std::string filter;
     Float maxAniso;
     WrapMode wrapMode;
     ColorEncodingHandle encoding;
+    bool precomputeSpectra;
+    TextureCompression compression;
     bool operator<(const TexInfo &t2) const {
-        return std::tie(filename, filter, maxAniso, encoding, wrapMode) <
-               std::tie(t2.filename, t2.filter, t2.maxAniso, t2.encoding, t2.wrapMode);
+        return std::tie(filename, filter, maxAniso, encoding, wrapMode, precomputeSpectra,
+                        compression) < std::tie(t2.filename, t2.filter, t2.maxAniso,
+                                                t2.encoding, t2.wrapMode,
+                                                t2.precomputeSpectra, t2.compression);
+    }
+    bool operator==(const TexInfo &t2) const {
+        return std::tie(filename, filter, maxAniso, encoding, wrapMode, precomputeSpectra,
+                        compression) == std::tie(t2.filename, t2.filter, t2.maxAniso,
+                                                 t2.encoding, t2.wrapMode,
+                                                 t2.precomputeSpectra, t2.compression);
     }
 
     std::string ToString() const;
 };
 
+// TexInfoHash Definition
+struct TexInfoHash {
+    size_t operator()(const TexInfo &t) const {
+        return Hash(HashBuffer(t.filename.data(), t.filename.size()),
+                    HashBuffer(t.filter.data(), t.filter.size()), t.maxAniso, t.wrapMode,
+                    t.encoding, t.precomputeSpectra, t.compression);
+    }
+};
+
 // ImageTextureBase Definition
 class ImageTextureBase {
   public:
     ImageTextureBase(TextureMapping2DHandle m, const std::string &filename,
                      const std::string &filter, Float maxAniso, WrapMode wm, Float scale,
-                     ColorEncodingHandle encoding, Allocator alloc);
+                     ColorEncodingHandle encoding, Allocator alloc,
+                     bool precomputeSpectra = false,
+                     TextureCompression compression = TextureCompression::None);
 
-    static void ClearCache() { textureCache.clear(); }
+    static void ClearCache() { textureCache.Clear(); }
 
     TextureMapping2DHandle mapping;
     Float scale;
@@ -598,11 +641,11 @@ class ImageTextureBase {
   private:
     static MIPMap *GetTexture(const std::string &filename, const std::string &filter,
                               Float maxAniso, WrapMode wm, ColorEncodingHandle encoding,
+                              bool precomputeSpectra, TextureCompression compression,
                               Allocator alloc);
 
     // ImageTextureBase Private Data
-    static std::mutex textureCacheMutex;
-    static std::map<TexInfo, std::unique_ptr<MIPMap>> textureCache;
+    static ConcurrentCache<TexInfo, std::unique_ptr<MIPMap>, TexInfoHash> textureCache;
 };
 
 // FloatImageTexture Definition
@@ -610,8 +653,10 @@ class FloatImageTexture : public ImageTextureBase {
   public:
     FloatImageTexture(TextureMapping2DHandle m, const std::string &filename,
                       const std::string &filter, Float maxAniso, WrapMode wm, Float scale,
-                      ColorEncodingHandle encoding, Allocator alloc)
-        : ImageTextureBase(m, filename, filter, maxAniso, wm, scale, encoding, alloc) {}
+                      ColorEncodingHandle encoding, Allocator alloc,
+                      TextureCompression compression = TextureCompression::None)
+        : ImageTextureBase(m, filename, filter, maxAniso, wm, scale, encoding, alloc,
+                           false, compression) {}
     PBRT_CPU_GPU
     Float Evaluate(TextureEvalContext ctx) const {
 #ifdef PBRT_IS_GPU_CODE
@@ -629,6 +674,11 @@ class FloatImageTexture : public ImageTextureBase {
 #endif
     }
 
+    void EvaluateBatch(pstd::span<const TextureEvalContext> ctx,
+                       pstd::span<Float> result) const;
+    pstd::array<Float, 3> EvaluateNearby(
+        const pstd::array<TextureEvalContext, 3> &ctx) const;
+
     static FloatImageTexture *Create(const Transform &renderFromTexture,
                                      const TextureParameterDictionary &parameters,
                                      const FileLoc *loc, Allocator alloc);
@@ -639,14 +689,25 @@ class FloatImageTexture : public ImageTextureBase {
 // SpectrumImageTexture Definition
 class SpectrumImageTexture : public ImageTextureBase {
   public:
+    // If _precomputeSpectra_ is true, the texels are converted to sigmoid
+    // polynomial coefficients at load time and filtered in that space.
+    // Lookups are then faster, though the texture's scale is applied to
+    // the spectrum rather than to the RGB value before it is converted.
     SpectrumImageTexture(TextureMapping2DHandle m, const std::string &filename,
                          const std::string &filter, Float maxAniso, WrapMode wm,
-                         Float scale, ColorEncodingHandle encoding, Allocator alloc)
-        : ImageTextureBase(m, filename, filter, maxAniso, wm, scale, encoding, alloc) {}
+                         Float scale, ColorEncodingHandle encoding, Allocator alloc,
+                         bool precomputeSpectra = false,
+                         TextureCompression compression = TextureCompression::None)
+        : ImageTextureBase(m, filename, filter, maxAniso, wm, scale, encoding, alloc,
+                           precomputeSpectra, compression) {}
 
     PBRT_CPU_GPU
     SampledSpectrum Evaluate(TextureEvalContext ctx, SampledWavelengths lambda) const;
 
+    void EvaluateBatch(pstd::span<const TextureEvalContext> ctx,
+                       pstd::span<const SampledWavelengths> lambda,
+                       pstd::span<SampledSpectrum> result) const;
+
     static SpectrumImageTexture *Create(const Transform &renderFromTexture,
                                         const TextureParameterDictionary &parameters,
                                         const FileLoc *loc, Allocator alloc);
@@ -815,6 +876,11 @@ class FloatMixTexture {
         return (1 - amt) * t1 + amt * t2;
     }
 
+    void EvaluateBatch(pstd::span<const TextureEvalContext> ctx,
+                       pstd::span<Float> result) const;
+    pstd::array<Float, 3> EvaluateNearby(
+        const pstd::array<TextureEvalContext, 3> &ctx) const;
+
     static FloatMixTexture *Create(const Transform &renderFromTexture,
                                    const TextureParameterDictionary &parameters,
                                    const FileLoc *loc, Allocator alloc);
@@ -822,6 +888,8 @@ class FloatMixTexture {
     std::string ToString() const;
 
   private:
+    friend class TextureGraphOptimizer;
+
     FloatTextureHandle tex1, tex2;
     FloatTextureHandle amount;
 };
@@ -842,6 +910,10 @@ class SpectrumMixTexture {
         return (1 - amt) * t1 + amt * t2;
     }
 
+    void EvaluateBatch(pstd::span<const TextureEvalContext> ctx,
+                       pstd::span<const SampledWavelengths> lambda,
+                       pstd::span<SampledSpectrum> result) const;
+
     static SpectrumMixTexture *Create(const Transform &renderFromTexture,
                                       const TextureParameterDictionary &parameters,
                                       const FileLoc *loc, Allocator alloc);
@@ -849,6 +921,8 @@ class SpectrumMixTexture {
     std::string ToString() const;
 
   private:
+    friend class TextureGraphOptimizer;
+
     SpectrumTextureHandle tex1, tex2;
     FloatTextureHandle amount;
 };
@@ -913,9 +987,16 @@ class FloatScaledTexture {
         return tex.Evaluate(ctx) * scale.Evaluate(ctx);
     }
 
+    void EvaluateBatch(pstd::span<const TextureEvalContext> ctx,
+                       pstd::span<Float> result) const;
+    pstd::array<Float, 3> EvaluateNearby(
+        const pstd::array<TextureEvalContext, 3> &ctx) const;
+
     std::string ToString() const;
 
   private:
+    friend class TextureGraphOptimizer;
+
     FloatTextureHandle tex, scale;
 };
 
@@ -930,6 +1011,10 @@ class SpectrumScaledTexture {
         return tex.Evaluate(ctx, lambda) * scale.Evaluate(ctx);
     }
 
+    void EvaluateBatch(pstd::span<const TextureEvalContext> ctx,
+                       pstd::span<const SampledWavelengths> lambda,
+                       pstd::span<SampledSpectrum> result) const;
+
     static SpectrumTextureHandle Create(const Transform &renderFromTexture,
                                         const TextureParameterDictionary &parameters,
                                         const FileLoc *loc, Allocator alloc);
@@ -937,6 +1022,8 @@ class SpectrumScaledTexture {
     std::string ToString() const;
 
   private:
+    friend class TextureGraphOptimizer;
+
     SpectrumTextureHandle tex;
     FloatTextureHandle scale;
 };
@@ -1017,6 +1104,35 @@ class UniversalTextureEvaluator {
     PBRT_CPU_GPU
     SampledSpectrum operator()(SpectrumTextureHandle tex, TextureEvalContext ctx,
                                SampledWavelengths lambda);
+
+    // Evaluates _tex_ at three nearby points. On the CPU, this uses
+    // EvaluateNearby() if --approx-bump-gradients was given.
+    PBRT_CPU_GPU
+    pstd::array<Float, 3> operator()(FloatTextureHandle tex,
+                                     const pstd::array<TextureEvalContext, 3> &ctx);
+};
+
+// PointTextureEvaluator Definition
+// Evaluates textures one point at a time, including the nearby points that
+// Bump() passes together, which gives the values that EvaluateNearby()
+// approximates for image textures.
+class PointTextureEvaluator {
+  public:
+    bool CanEvaluate(std::initializer_list<FloatTextureHandle>,
+                     std::initializer_list<SpectrumTextureHandle>) const {
+        return true;
+    }
+    Float operator()(FloatTextureHandle tex, TextureEvalContext ctx) {
+        return tex.Evaluate(ctx);
+    }
+    SampledSpectrum operator()(SpectrumTextureHandle tex, TextureEvalContext ctx,
+                               SampledWavelengths lambda) {
+        return tex.Evaluate(ctx, lambda);
+    }
+    pstd::array<Float, 3> operator()(FloatTextureHandle tex,
+                                     const pstd::array<TextureEvalContext, 3> &ctx) {
+        return {tex.Evaluate(ctx[0]), tex.Evaluate(ctx[1]), tex.Evaluate(ctx[2])};
+    }
 };
 
 class BasicTextureEvaluator {
@@ -1063,6 +1179,141 @@ class BasicTextureEvaluator {
         else
             return SampledSpectrum(0.f);
     }
+
+    PBRT_CPU_GPU
+    pstd::array<Float, 3> operator()(FloatTextureHandle tex,
+                                     const pstd::array<TextureEvalContext, 3> &ctx) {
+        return {(*this)(tex, ctx[0]), (*this)(tex, ctx[1]), (*this)(tex, ctx[2])};
+    }
+};
+
+// Batched Texture Evaluation Declarations
+// These evaluate a texture at each of a batch of points, dispatching on the
+// texture's type once for the whole batch. Constant, image, scale, and mix
+// textures process the batch together, with the arithmetic that combines
+// values done with SIMD instructions; other textures are evaluated one
+// point at a time.
+void EvaluateBatch(FloatTextureHandle tex, pstd::span<const TextureEvalContext> ctx,
+                   pstd::span<Float> result);
+void EvaluateBatch(SpectrumTextureHandle tex, pstd::span<const TextureEvalContext> ctx,
+                   pstd::span<const SampledWavelengths> lambda,
+                   pstd::span<SampledSpectrum> result);
+
+// Evaluates _tex_ at three nearby points, as Bump() does to estimate the
+// derivatives of displacement textures. Image textures are filtered once,
+// at the first point, and the gradient of the filtered image gives their
+// values at the other two. Scale and mix textures pass the points on to
+// their inputs and other textures are evaluated with EvaluateBatch().
+pstd::array<Float, 3> EvaluateNearby(FloatTextureHandle tex,
+                                     const pstd::array<TextureEvalContext, 3> &ctx);
+
+// BatchTextureEvaluator Definition
+// Collects texture evaluations for points that may use different textures
+// and then performs them together, grouped by texture, so that each group
+// can be handled by EvaluateBatch().
+class BatchTextureEvaluator {
+  public:
+    // BatchTextureEvaluator Public Methods
+    // The result is stored at the given address when Evaluate() is called.
+    void Add(FloatTextureHandle tex, const TextureEvalContext &ctx, Float *result) {
+        floatRequests.push_back({tex, ctx, result});
+    }
+    void Add(SpectrumTextureHandle tex, const TextureEvalContext &ctx,
+             const SampledWavelengths &lambda, SampledSpectrum *result) {
+        spectrumRequests.push_back({tex, ctx, lambda, result});
+    }
+
+    size_t size() const { return floatRequests.size() + spectrumRequests.size(); }
+
+    // Evaluates all of the textures that have been added and then clears
+    // them so that the evaluator can be reused.
+    void Evaluate();
+
+  private:
+    // BatchTextureEvaluator Private Members
+    struct FloatRequest {
+        FloatTextureHandle tex;
+        TextureEvalContext ctx;
+        Float *result;
+    };
+    struct SpectrumRequest {
+        SpectrumTextureHandle tex;
+        TextureEvalContext ctx;
+        SampledWavelengths lambda;
+        SampledSpectrum *result;
+    };
+    std::vector<FloatRequest> floatRequests;
+    std::vector<SpectrumRequest> spectrumRequests;
+    // Reused from one call to Evaluate() to the next
+    std::vector<TextureEvalContext> ctxScratch;
+    std::vector<SampledWavelengths> lambdaScratch;
+    std::vector<Float> floatScratch;
+    std::vector<SampledSpectrum> spectrumScratch;
+};
+
+// TextureGraphOptimizer Definition
+// Simplifies graphs of textures once they have been created: scale and mix
+// textures with constant inputs are folded, nested scales by constants are
+// collapsed into one, and identical constant, scale, and mix textures are
+// shared. Textures are never modified; new ones are allocated as needed.
+class TextureGraphOptimizer {
+  public:
+    // TextureGraphOptimizer Public Methods
+    TextureGraphOptimizer(Allocator alloc) : alloc(alloc) {}
+
+    FloatTextureHandle Optimize(FloatTextureHandle tex);
+    SpectrumTextureHandle Optimize(SpectrumTextureHandle tex);
+
+    // Returns the number of distinct textures that are used by the textures
+    // passed to Optimize() less the number used by the ones it returned.
+    int64_t NodesRemoved() const;
+
+  private:
+    // TextureGraphOptimizer Private Methods
+    FloatTextureHandle OptimizeNode(FloatTextureHandle tex);
+    SpectrumTextureHandle OptimizeNode(SpectrumTextureHandle tex);
+
+    static bool IsConstant(FloatTextureHandle tex, Float *value);
+    static bool IsConstant(SpectrumTextureHandle tex, Float *value);
+
+    // These return simplified textures that are equivalent to constant,
+    // scale, and mix textures with the given (optimized) inputs. If a new
+    // texture is needed, _original_ is used if it has the same inputs.
+    FloatTextureHandle FloatConstant(Float value, FloatTextureHandle original = nullptr);
+    SpectrumTextureHandle SpectrumConstant(Float value,
+                                           SpectrumTextureHandle original = nullptr);
+    FloatTextureHandle Scale(FloatTextureHandle tex, FloatTextureHandle scale,
+                             FloatScaledTexture *original = nullptr);
+    SpectrumTextureHandle Scale(SpectrumTextureHandle tex, FloatTextureHandle scale,
+                                SpectrumScaledTexture *original = nullptr);
+    FloatTextureHandle Mix(FloatTextureHandle tex1, FloatTextureHandle tex2,
+                           FloatTextureHandle amount,
+                           FloatMixTexture *original = nullptr);
+    SpectrumTextureHandle Mix(SpectrumTextureHandle tex1, SpectrumTextureHandle tex2,
+                              FloatTextureHandle amount,
+                              SpectrumMixTexture *original = nullptr);
+
+    // TextureGraphOptimizer Private Members
+    Allocator alloc;
+    // Optimized versions of the textures that have been visited
+    std::map<FloatTextureHandle, FloatTextureHandle> floatOptimized;
+    std::map<SpectrumTextureHandle, SpectrumTextureHandle> spectrumOptimized;
+    // Textures returned by Optimize()
+    std::vector<FloatTextureHandle> floatRoots;
+    std::vector<SpectrumTextureHandle> spectrumRoots;
+    // Simplified textures, which are shared when they match
+    std::map<Float, FloatTextureHandle> floatConstants;
+    std::map<Float, SpectrumTextureHandle> spectrumConstants;
+    std::map<std::pair<FloatTextureHandle, FloatTextureHandle>, FloatTextureHandle>
+        floatScales;
+    std::map<std::pair<SpectrumTextureHandle, FloatTextureHandle>, SpectrumTextureHandle>
+        spectrumScales;
+    std::map<std::tuple<FloatTextureHandle, FloatTextureHandle, FloatTextureHandle>,
+             FloatTextureHandle>
+        floatMixes;
+    std::map<std::tuple<SpectrumTextureHandle, SpectrumTextureHandle, FloatTextureHandle>,
+             SpectrumTextureHandle>
+        spectrumMixes;
 };
 
 }  // namespace pbrt
@@ -0,0 +1,398 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/materials.h>
+#include <pbrt/options.h>
+#include <pbrt/textures.h>
+#include <pbrt/util/colorspace.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/memory.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/spectrum.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace pbrt;
+
+static std::vector<TextureEvalContext> RandomContexts(int n) {
+    RNG rng;
+    std::vector<TextureEvalContext> ctx(n);
+    for (TextureEvalContext &c : ctx) {
+        c.uv = Point2f(rng.Uniform<Float>(), rng.Uniform<Float>());
+        Float width = std::pow(2.f, -10 + 8 * rng.Uniform<Float>());
+        c.dudx = width * (1 + rng.Uniform<Float>());
+        c.dvdx = width * rng.Uniform<Float>();
+        c.dudy = -width * rng.Uniform<Float>();
+        c.dvdy = width * (1 + rng.Uniform<Float>());
+    }
+    return ctx;
+}
+
+static std::vector<SampledWavelengths> RandomWavelengths(int n) {
+    RNG rng(7);
+    std::vector<SampledWavelengths> lambda;
+    for (int i = 0; i < n; ++i)
+        lambda.push_back(SampledWavelengths::SampleXYZ(rng.Uniform<Float>()));
+    return lambda;
+}
+
+static void ExpectSpectraNear(const SampledSpectrum &ref, const SampledSpectrum &s) {
+    // The batched versions evaluate sigmoid polynomials without FMA
+    // instructions, so their results may differ slightly.
+    for (int i = 0; i < NSpectrumSamples; ++i)
+        EXPECT_NEAR(ref[i], s[i], 1e-5f + 1e-4f * std::abs(ref[i])) << ref << " " << s;
+}
+
+TEST(Textures, EvaluateBatch) {
+    // Write an RGB image whose values go above one so that both the
+    // reflectance and unbounded RGB spectrum paths are exercised.
+    Point2i res(32, 16);
+    Image image(PixelFormat::Float, res, {"R", "G", "B"});
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < 3; ++c)
+                image.SetChannel({x, y}, c,
+                                 0.6f + 0.55f * std::sin(0.3f * x + 0.4f * y + c));
+    ASSERT_TRUE(image.Write("batchtest.pfm"));
+
+    pstd::pmr::monotonic_buffer_resource resource;
+    Allocator alloc(&resource);
+    TextureMapping2DHandle mapping = alloc.new_object<UVMapping2D>(2, 3, 0.1f, 0);
+    FloatImageTexture floatImage(mapping, "batchtest.pfm", "bilinear", 8,
+                                 WrapMode::Repeat, 0.5f, ColorEncodingHandle::Linear,
+                                 alloc);
+    SpectrumImageTexture rgbImage(mapping, "batchtest.pfm", "ewa", 8, WrapMode::Repeat,
+                                  1, ColorEncodingHandle::Linear, alloc);
+    SpectrumImageTexture sigmoidImage(mapping, "batchtest.pfm", "trilinear", 8,
+                                      WrapMode::Repeat, 0.8f,
+                                      ColorEncodingHandle::Linear, alloc, true);
+    ASSERT_TRUE(floatImage.mipmap && rgbImage.mipmap && sigmoidImage.mipmap);
+
+    FloatConstantTexture constant(0.25f);
+    FloatScaledTexture floatScaled(&floatImage, &constant);
+    FloatMixTexture floatMix(&floatScaled, &constant, &floatImage);
+    RGBReflectanceConstantTexture rgbConstant(*RGBColorSpace::sRGB, RGB(0.2, 0.5, 0.7));
+    SpectrumScaledTexture spectrumScaled(&sigmoidImage, &floatImage);
+    SpectrumMixTexture spectrumMix(&rgbConstant, &rgbImage, &floatMix);
+    SpectrumMixTexture nestedMix(&spectrumScaled, &spectrumMix, &constant);
+
+    // Use a batch size that isn't a multiple of the SIMD width
+    int n = 1001;
+    std::vector<TextureEvalContext> ctx = RandomContexts(n);
+    std::vector<SampledWavelengths> lambda = RandomWavelengths(n);
+
+    for (FloatTextureHandle tex : {FloatTextureHandle(&constant),
+                                   FloatTextureHandle(&floatImage),
+                                   FloatTextureHandle(&floatScaled),
+                                   FloatTextureHandle(&floatMix)}) {
+        std::vector<Float> result(n);
+        EvaluateBatch(tex, ctx, pstd::span<Float>(result));
+        for (int i = 0; i < n; ++i)
+            EXPECT_FLOAT_EQ(tex.Evaluate(ctx[i]), result[i]) << tex.ToString();
+    }
+
+    for (SpectrumTextureHandle tex : {SpectrumTextureHandle(&rgbConstant),
+                                      SpectrumTextureHandle(&rgbImage),
+                                      SpectrumTextureHandle(&sigmoidImage),
+                                      SpectrumTextureHandle(&spectrumScaled),
+                                      SpectrumTextureHandle(&spectrumMix),
+                                      SpectrumTextureHandle(&nestedMix)}) {
+        std::vector<SampledSpectrum> result(n);
+        EvaluateBatch(tex, ctx, lambda, pstd::span<SampledSpectrum>(result));
+        for (int i = 0; i < n; ++i)
+            ExpectSpectraNear(tex.Evaluate(ctx[i], lambda[i]), result[i]);
+    }
+
+    ImageTextureBase::ClearCache();
+    EXPECT_EQ(0, remove("batchtest.pfm"));
+}
+
+TEST(Textures, PrecomputedSpectraBatch) {
+    // At texel centers, point-sampled textures with precomputed spectra
+    // should give the same spectra as converting the RGB values at
+    // lookup time, both for reflectances and for RGB values above one,
+    // which are multiplied by the color space's illuminant.
+    Point2i res(16, 8);
+    Image image(PixelFormat::Float, res, {"R", "G", "B"});
+    RNG rng;
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < 3; ++c)
+                image.SetChannel({x, y}, c, ((x + y) % 2 ? 3 : 1) * rng.Uniform<Float>());
+    ASSERT_TRUE(image.Write("precomputed.pfm"));
+
+    pstd::pmr::monotonic_buffer_resource resource;
+    Allocator alloc(&resource);
+    TextureMapping2DHandle mapping = alloc.new_object<UVMapping2D>(1, 1, 0, 0);
+    SpectrumImageTexture rgbImage(mapping, "precomputed.pfm", "point", 8,
+                                  WrapMode::Clamp, 1, ColorEncodingHandle::Linear, alloc);
+    SpectrumImageTexture sigmoidImage(mapping, "precomputed.pfm", "point", 8,
+                                      WrapMode::Clamp, 1, ColorEncodingHandle::Linear,
+                                      alloc, true);
+    ASSERT_TRUE(rgbImage.mipmap && sigmoidImage.mipmap);
+    ASSERT_TRUE(sigmoidImage.mipmap->HasPrecomputedSpectra());
+
+    std::vector<TextureEvalContext> ctx;
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x) {
+            TextureEvalContext c;
+            c.uv = Point2f((x + 0.5f) / res.x, (y + 0.5f) / res.y);
+            ctx.push_back(c);
+        }
+    std::vector<SampledWavelengths> lambda = RandomWavelengths(ctx.size());
+
+    std::vector<SampledSpectrum> rgbResult(ctx.size()), sigmoidResult(ctx.size());
+    EvaluateBatch(&rgbImage, ctx, lambda, pstd::span<SampledSpectrum>(rgbResult));
+    EvaluateBatch(&sigmoidImage, ctx, lambda,
+                  pstd::span<SampledSpectrum>(sigmoidResult));
+    for (size_t i = 0; i < ctx.size(); ++i) {
+        SampledSpectrum ref = rgbImage.Evaluate(ctx[i], lambda[i]);
+        ExpectSpectraNear(ref, rgbResult[i]);
+        ExpectSpectraNear(ref, sigmoidImage.Evaluate(ctx[i], lambda[i]));
+        ExpectSpectraNear(ref, sigmoidResult[i]);
+    }
+
+    ImageTextureBase::ClearCache();
+    EXPECT_EQ(0, remove("precomputed.pfm"));
+}
+
+TEST(Textures, BatchTextureEvaluator) {
+    pstd::pmr::monotonic_buffer_resource resource;
+    Allocator alloc(&resource);
+    FloatConstantTexture half(0.5f), quarter(0.25f);
+    FloatScaledTexture scaled(&half, &quarter);
+    RGBReflectanceConstantTexture rgb(*RGBColorSpace::sRGB, RGB(0.3, 0.6, 0.1));
+    SpectrumScaledTexture spectrumScaled(&rgb, &half);
+    FloatTextureHandle floatTextures[] = {&half, &scaled, &quarter};
+    SpectrumTextureHandle spectrumTextures[] = {&rgb, &spectrumScaled};
+
+    // Interleave requests for the different textures
+    int n = 100;
+    std::vector<TextureEvalContext> ctx = RandomContexts(n);
+    std::vector<SampledWavelengths> lambda = RandomWavelengths(n);
+    std::vector<Float> floatResults(n);
+    std::vector<SampledSpectrum> spectrumResults(n);
+    BatchTextureEvaluator evaluator;
+    for (int i = 0; i < n; ++i) {
+        evaluator.Add(floatTextures[i % 3], ctx[i], &floatResults[i]);
+        evaluator.Add(spectrumTextures[i % 2], ctx[i], lambda[i], &spectrumResults[i]);
+    }
+    EXPECT_EQ(2 * n, evaluator.size());
+    evaluator.Evaluate();
+    EXPECT_EQ(0, evaluator.size());
+
+    for (int i = 0; i < n; ++i) {
+        EXPECT_EQ(floatTextures[i % 3].Evaluate(ctx[i]), floatResults[i]);
+        ExpectSpectraNear(spectrumTextures[i % 2].Evaluate(ctx[i], lambda[i]),
+                          spectrumResults[i]);
+    }
+}
+
+TEST(Textures, GraphOptimization) {
+    pstd::pmr::monotonic_buffer_resource resource;
+    Allocator alloc(&resource);
+    TextureMapping2DHandle mapping = alloc.new_object<UVMapping2D>(1, 1, 0, 0);
+    FloatBilerpTexture bilerp(mapping, 0.1f, 0.7f, 0.3f, 0.9f);
+    FloatConstantTexture zero(0), half(0.5f), one(1), two(2), three(3);
+
+    // (bilerp * 2) * 3 becomes a single scale by 6, however it's written
+    FloatScaledTexture inner(&bilerp, &two), outer(&three, &inner);
+    FloatScaledTexture inner2(&two, &bilerp), outer2(&inner2, &three);
+    // Constant inputs are folded
+    FloatScaledTexture constantProduct(&two, &three);
+    FloatMixTexture constantMix(&two, &three, &half);
+    FloatMixTexture mix0(&bilerp, &outer, &zero), mix1(&bilerp, &outer, &one);
+    FloatMixTexture sameMix(&outer, &outer2, &bilerp);
+    FloatScaledTexture unitScale(&sameMix, &one);
+    // Only this mix's inputs can be simplified
+    FloatMixTexture mix(&unitScale, &bilerp, &constantMix);
+
+    TextureGraphOptimizer counter(alloc);
+    counter.Optimize(FloatTextureHandle(&outer));
+    EXPECT_EQ(2, counter.NodesRemoved());
+
+    TextureGraphOptimizer optimizer(alloc);
+    auto optimizeFloat = [&](FloatTextureHandle tex) { return optimizer.Optimize(tex); };
+    auto optimizeSpectrum = [&](SpectrumTextureHandle tex) {
+        return optimizer.Optimize(tex);
+    };
+    FloatTextureHandle scaled = optimizeFloat(&outer);
+    EXPECT_TRUE(scaled.Is<FloatScaledTexture>());
+    EXPECT_EQ(scaled, optimizeFloat(&outer2));
+    FloatTextureHandle product = optimizeFloat(&constantProduct);
+    ASSERT_TRUE(product.Is<FloatConstantTexture>());
+    EXPECT_EQ(6, product.Evaluate({}));
+    FloatTextureHandle constant = optimizeFloat(&constantMix);
+    ASSERT_TRUE(constant.Is<FloatConstantTexture>());
+    EXPECT_EQ(2.5f, constant.Evaluate({}));
+    EXPECT_EQ(FloatTextureHandle(&bilerp), optimizeFloat(&mix0));
+    EXPECT_EQ(scaled, optimizeFloat(&mix1));
+    EXPECT_EQ(scaled, optimizeFloat(&unitScale));
+    EXPECT_TRUE(optimizeFloat(&mix).Is<FloatMixTexture>());
+
+    SpectrumConstantTexture quarter(alloc.new_object<ConstantSpectrum>(0.25f));
+    RGBReflectanceConstantTexture rgb(*RGBColorSpace::sRGB, RGB(0.2, 0.5, 0.7));
+    SpectrumScaledTexture constantScaled(&quarter, &two);
+    SpectrumScaledTexture rgbInner(&rgb, &two), rgbOuter(&rgbInner, &three);
+    SpectrumMixTexture spectrumMix(&rgbOuter, &quarter, &one);
+    SpectrumMixTexture spectrumMix2(&constantScaled, &rgbOuter, &bilerp);
+    SpectrumTextureHandle spectrumConstant = optimizeSpectrum(&constantScaled);
+    EXPECT_TRUE(spectrumConstant.Is<SpectrumConstantTexture>());
+    SpectrumTextureHandle rgbScaled = optimizeSpectrum(&rgbOuter);
+    EXPECT_TRUE(rgbScaled.Is<SpectrumScaledTexture>());
+    EXPECT_EQ(SpectrumTextureHandle(&quarter), optimizeSpectrum(&spectrumMix));
+    EXPECT_TRUE(optimizeSpectrum(&spectrumMix2).Is<SpectrumMixTexture>());
+
+    // The simplified textures should give the same values as the originals
+    int n = 100;
+    std::vector<TextureEvalContext> ctx = RandomContexts(n);
+    std::vector<SampledWavelengths> lambda = RandomWavelengths(n);
+    for (FloatTextureHandle tex :
+         {FloatTextureHandle(&outer), FloatTextureHandle(&outer2),
+          FloatTextureHandle(&mix1), FloatTextureHandle(&mix)})
+        for (int i = 0; i < n; ++i)
+            EXPECT_FLOAT_EQ(tex.Evaluate(ctx[i]),
+                            optimizer.Optimize(tex).Evaluate(ctx[i]));
+    for (SpectrumTextureHandle tex :
+         {SpectrumTextureHandle(&constantScaled), SpectrumTextureHandle(&rgbOuter),
+          SpectrumTextureHandle(&spectrumMix2)})
+        for (int i = 0; i < n; ++i)
+            ExpectSpectraNear(tex.Evaluate(ctx[i], lambda[i]),
+                              optimizer.Optimize(tex).Evaluate(ctx[i], lambda[i]));
+}
+
+TEST(Textures, BumpNearby) {
+    // With --approx-bump-gradients, image textures use the gradient of the
+    // filtered image for the displacement at the offset points, which
+    // matches evaluating them there for a linear ramp.
+    Point2i res(64, 64);
+    Image image(PixelFormat::Float, res, {"R", "G", "B"});
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < 3; ++c)
+                image.SetChannel({x, y}, c, 0.5f + 0.004f * x - 0.006f * y);
+    ASSERT_TRUE(image.Write("bumptest.pfm"));
+
+    pstd::pmr::monotonic_buffer_resource resource;
+    Allocator alloc(&resource);
+    TextureMapping2DHandle mapping = alloc.new_object<UVMapping2D>(1, 1, 0, 0);
+    FloatImageTexture bilinear(mapping, "bumptest.pfm", "bilinear", 8, WrapMode::Clamp,
+                               0.5f, ColorEncodingHandle::Linear, alloc);
+    FloatImageTexture trilinear(mapping, "bumptest.pfm", "trilinear", 8,
+                                WrapMode::Clamp, 2, ColorEncodingHandle::Linear, alloc);
+    ASSERT_TRUE(bilinear.mipmap && trilinear.mipmap);
+    FloatConstantTexture constant(0.25f);
+    FloatScaledTexture scaled(&trilinear, &constant);
+    FloatMixTexture mix(&bilinear, &scaled, &constant);
+
+    PBRTOptions savedOptions = *Options;
+    Options->approximateBumpGradients = true;
+    RNG rng;
+    for (FloatTextureHandle tex :
+         {FloatTextureHandle(&constant), FloatTextureHandle(&bilinear),
+          FloatTextureHandle(&trilinear), FloatTextureHandle(&scaled),
+          FloatTextureHandle(&mix)}) {
+        for (int i = 0; i < 100; ++i) {
+            BumpEvalContext ctx;
+            ctx.uv = Point2f(0.3f + 0.4f * rng.Uniform<Float>(),
+                             0.3f + 0.4f * rng.Uniform<Float>());
+            ctx.p = Point3f(ctx.uv[0], ctx.uv[1], 0);
+            Float width = std::pow(2.f, -10 + 5 * rng.Uniform<Float>());
+            ctx.dudx = width;
+            ctx.dvdy = width * (0.5f + rng.Uniform<Float>());
+            ctx.dpdx = Vector3f(ctx.dudx, 0, 0);
+            ctx.dpdy = Vector3f(0, ctx.dvdy, 0);
+            ctx.shading.n = Normal3f(0, 0, 1);
+            ctx.shading.dpdu = Vector3f(1, 0, 0);
+            ctx.shading.dpdv = Vector3f(0, 1, 0);
+
+            Vector3f dpdu, dpdv, refdpdu, refdpdv;
+            Bump(UniversalTextureEvaluator(), tex, ctx, &dpdu, &dpdv);
+            Bump(PointTextureEvaluator(), tex, ctx, &refdpdu, &refdpdv);
+            // The finite differences of the reference lose some precision
+            // for small offsets.
+            for (int c = 0; c < 3; ++c) {
+                EXPECT_NEAR(refdpdu[c], dpdu[c], 1e-3f) << tex.ToString();
+                EXPECT_NEAR(refdpdv[c], dpdv[c], 1e-3f) << tex.ToString();
+            }
+
+            // Without the option, the points are evaluated individually.
+            Options->approximateBumpGradients = false;
+            Bump(UniversalTextureEvaluator(), tex, ctx, &dpdu, &dpdv);
+            EXPECT_EQ(refdpdu, dpdu) << tex.ToString();
+            EXPECT_EQ(refdpdv, dpdv) << tex.ToString();
+            Options->approximateBumpGradients = true;
+        }
+    }
+    *Options = savedOptions;
+
+    ImageTextureBase::ClearCache();
+    EXPECT_EQ(0, remove("bumptest.pfm"));
+}
+
+TEST(Noise, Batch) {
+    RNG rng;
+    std::vector<Point3f> p;
+    for (int i = 0; i < 1000; ++i)
+        p.push_back(Point3f(-300 + 600 * rng.Uniform<Float>(),
+                            -300 + 600 * rng.Uniform<Float>(),
+                            -300 + 600 * rng.Uniform<Float>()));
+    // Include points on the lattice and a number of points that isn't a
+    // multiple of the SIMD width. The results may differ slightly if the
+    // compiler uses FMA instructions for the scalar version.
+    p.push_back(Point3f(1, 2, 3));
+    p.push_back(Point3f(-4, 0, 255));
+    p.push_back(Point3f(0.5f, -0.5f, 256.5f));
+
+    std::vector<Float> noise(p.size());
+    Noise(p, pstd::span<Float>(noise));
+    for (size_t i = 0; i < p.size(); ++i)
+        EXPECT_NEAR(Noise(p[i]), noise[i], 1e-5f) << p[i];
+}
+
+TEST(Noise, FBmOctaves) {
+    // FBm() and Turbulence() evaluate the noise for all of their octaves
+    // together; compare them to sums of octaves that are evaluated one at a
+    // time.
+    auto octaves = [](Vector3f dpdx, Vector3f dpdy, int maxOctaves) {
+        Float len2 = std::max(LengthSquared(dpdx), LengthSquared(dpdy));
+        return Clamp(-1 - .5f * Log2(len2), 0, maxOctaves);
+    };
+    RNG rng;
+    for (int i = 0; i < 1000; ++i) {
+        Point3f p(-10 + 20 * rng.Uniform<Float>(), -10 + 20 * rng.Uniform<Float>(),
+                  -10 + 20 * rng.Uniform<Float>());
+        Vector3f dpdx(std::pow(10.f, -6 + 6 * rng.Uniform<Float>()), 0, 0);
+        Vector3f dpdy(0, std::pow(10.f, -6 + 6 * rng.Uniform<Float>()), 0);
+        Float omega = 0.3f + 0.4f * rng.Uniform<Float>();
+        int maxOctaves = 1 + i % 24;
+
+        Float n = octaves(dpdx, dpdy, maxOctaves);
+        int nInt = std::floor(n);
+        Float fbm = 0, turbulence = 0, lambda = 1, o = 1;
+        for (int j = 0; j < nInt; ++j) {
+            fbm += o * Noise(lambda * p);
+            turbulence += o * std::abs(Noise(lambda * p));
+            lambda *= 1.99f;
+            o *= omega;
+        }
+        Float partial = SmoothStep(n - nInt, .3f, .7f);
+        fbm += o * partial * Noise(lambda * p);
+        turbulence += o * Lerp(partial, 0.2, std::abs(Noise(lambda * p)));
+        for (int j = nInt; j < maxOctaves; ++j) {
+            turbulence += o * 0.2f;
+            o *= omega;
+        }
+
+        EXPECT_NEAR(fbm, FBm(p, dpdx, dpdy, omega, maxOctaves), 5e-5f);
+        EXPECT_NEAR(turbulence, Turbulence(p, dpdx, dpdy, omega, maxOctaves), 5e-5f);
+    }
+}
@@ -55,19 +55,27 @@ inline uint64_t MixBits(uint64_t v) {
 }
 
 // https://fgiesen.wordpress.com/2009/12/13/decoding-morton-codes/
-// "Insert" a 0 bit after each of the 16 low bits of x
+// "Insert" a 0 bit after each of the 32 low bits of x
 PBRT_CPU_GPU
-inline uint32_t LeftShift2(uint32_t x) {
-    x &= 0x0000ffff;                  // x = ---- ---- ---- ---- fedc ba98 7654 3210
-    x = (x ^ (x << 8)) & 0x00ff00ff;  // x = ---- ---- fedc ba98 ---- ---- 7654 3210
-    x = (x ^ (x << 4)) & 0x0f0f0f0f;  // x = ---- fedc ---- ba98 ---- 7654 ---- 3210
-    x = (x ^ (x << 2)) & 0x33333333;  // x = --fe --dc --ba --98 --76 --54 --32 --10
-    x = (x ^ (x << 1)) & 0x55555555;  // x = -f-e -d-c -b-a -9-8 -7-6 -5-4 -3-2 -1-0
+inline uint64_t LeftShift2(uint64_t x) {
+    // Bits 31 through 0 of _x_ are labeled v through 0 below.
+    x &= 0xffffffff;
+    // x = -------- -------- -------- -------- vutsrqpo nmlkjihg fedcba98 76543210
+    x = (x ^ (x << 16)) & 0x0000ffff0000ffff;
+    // x = -------- -------- vutsrqpo nmlkjihg -------- -------- fedcba98 76543210
+    x = (x ^ (x << 8)) & 0x00ff00ff00ff00ff;
+    // x = -------- vutsrqpo -------- nmlkjihg -------- fedcba98 -------- 76543210
+    x = (x ^ (x << 4)) & 0x0f0f0f0f0f0f0f0f;
+    // x = ----vuts ----rqpo ----nmlk ----jihg ----fedc ----ba98 ----7654 ----3210
+    x = (x ^ (x << 2)) & 0x3333333333333333;
+    // x = --vu--ts --rq--po --nm--lk --ji--hg --fe--dc --ba--98 --76--54 --32--10
+    x = (x ^ (x << 1)) & 0x5555555555555555;
+    // x = -v-u-t-s -r-q-p-o -n-m-l-k -j-i-h-g -f-e-d-c -b-a-9-8 -7-6-5-4 -3-2-1-0
     return x;
 }
 
 PBRT_CPU_GPU
-inline uint32_t EncodeMorton2(uint16_t x, uint16_t y) {
+inline uint64_t EncodeMorton2(uint32_t x, uint32_t y) {
     return (LeftShift2(y) << 1) | LeftShift2(x);
 }
 
@@ -86,3 +86,19 @@ TEST(Morton2, Basics) {
         EXPECT_EQ(y, yp);
     }
 }
+
+TEST(Morton2, FullRange) {
+    EXPECT_EQ(0x5555555555555555, EncodeMorton2(0xffffffff, 0));
+    EXPECT_EQ(0xaaaaaaaaaaaaaaaa, EncodeMorton2(0, 0xffffffff));
+    EXPECT_EQ(1ull << 32, EncodeMorton2(65536, 0));
+
+    RNG rng(6502);
+    for (int i = 0; i < 100000; ++i) {
+        uint32_t x = rng.Uniform<uint32_t>(), y = rng.Uniform<uint32_t>();
+        uint64_t m = EncodeMorton2(x, y);
+        for (int b = 0; b < 32; ++b) {
+            EXPECT_EQ((x >> b) & 1, (m >> (2 * b)) & 1);
+            EXPECT_EQ((y >> b) & 1, (m >> (2 * b + 1)) & 1);
+        }
+    }
+}
@@ -210,6 +210,16 @@ std::string ColorEncodingHandle::ToString() const {
     return DispatchCPU(ts);
 }
 
+std::string ColorEncodingHandle::Name() const {
+    CHECK(ptr() != nullptr);
+    if (Is<LinearColorEncoding>())
+        return "linear";
+    else if (Is<sRGBColorEncoding>())
+        return "sRGB";
+    else
+        return StringPrintf("gamma %f", Cast<GammaColorEncoding>()->Gamma());
+}
+
 const ColorEncodingHandle ColorEncodingHandle::Linear = new LinearColorEncoding;
 const ColorEncodingHandle ColorEncodingHandle::sRGB = new sRGBColorEncoding;
 
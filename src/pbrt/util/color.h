@@ -341,6 +341,9 @@ class RGBSigmoidPolynomial {
         return s(v);
     }
 
+    PBRT_CPU_GPU
+    pstd::array<Float, 3> Coefficients() const { return {c0, c1, c2}; }
+
     PBRT_CPU_GPU
     Float MaxValue() const {
         if (c0 < 0) {
@@ -404,6 +407,8 @@ class ColorEncodingHandle
                                         pstd::span<uint8_t> vout) const;
 
     std::string ToString() const;
+    // Returns the name that Get() takes for this encoding
+    std::string Name() const;
 
     static const ColorEncodingHandle Linear;
     static const ColorEncodingHandle sRGB;
@@ -457,6 +462,8 @@ class GammaColorEncoding {
     PBRT_CPU_GPU
     void FromLinear(pstd::span<const Float> vin, pstd::span<uint8_t> vout) const;
 
+    Float Gamma() const { return gamma; }
+
     std::string ToString() const;
 
   private:
@@ -16,9 +16,11 @@
 #include <cstring>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
 
 namespace pbrt {
 
@@ -721,6 +723,72 @@ class HashMap {
     Allocator alloc;
 };
 
+// ConcurrentCache Definition
+// ConcurrentCache maps keys to values that are created the first time that
+// they are requested. Keys are distributed over independently locked shards
+// whose locks are only held to find or add a key's entry. Each value is
+// created outside of the shard's lock by the first thread that requests it;
+// other threads that request the same key wait on that entry alone, so
+// values for distinct keys can be created in parallel.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ConcurrentCache {
+  public:
+    // ConcurrentCache Public Methods
+    ConcurrentCache() = default;
+    ConcurrentCache(const ConcurrentCache &) = delete;
+    ConcurrentCache &operator=(const ConcurrentCache &) = delete;
+
+    // Returns the key's value, calling _create_ to create it if it isn't
+    // already present. References remain valid until Clear() is called.
+    // _create_ must not request the same key, including from work that it
+    // waits on: a thread waiting for a ParallelFor that _create_ started
+    // may run other iterations of an enclosing ParallelFor.
+    template <typename F>
+    const Value &LookupOrCreate(const Key &key, F create) {
+        Shard &shard = shards[Hash()(key) % NShards];
+        Entry *entry;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            std::unique_ptr<Entry> &e = shard.entries[key];
+            if (!e)
+                e = std::make_unique<Entry>();
+            entry = e.get();
+        }
+        std::call_once(entry->once, [&]() { entry->value = create(); });
+        return entry->value;
+    }
+
+    size_t size() const {
+        size_t n = 0;
+        for (const Shard &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            n += shard.entries.size();
+        }
+        return n;
+    }
+
+    // Removes all entries; it must not be called concurrently with lookups.
+    void Clear() {
+        for (Shard &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.entries.clear();
+        }
+    }
+
+  private:
+    // ConcurrentCache Private Members
+    struct Entry {
+        std::once_flag once;
+        Value value;
+    };
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<Key, std::unique_ptr<Entry>, Hash> entries;
+    };
+    static constexpr int NShards = 32;
+    Shard shards[NShards];
+};
+
 // SampledGrid Definition
 template <typename T>
 class SampledGrid {
@@ -8,8 +8,12 @@
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/rng.h>
 
+#include <atomic>
+#include <chrono>
 #include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace pbrt;
 
@@ -107,3 +111,63 @@ TEST(HashMap, Randoms) {
     EXPECT_EQ(nVisited, 10000);
     EXPECT_EQ(0, values.size());
 }
+
+TEST(ConcurrentCache, CreateOnce) {
+    // Each value should be created once, however many threads request it.
+    ConcurrentCache<int, int> cache;
+    std::atomic<int> nCreated[100] = {};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t)
+        threads.push_back(std::thread([&, t]() {
+            RNG rng(t);
+            for (int i = 0; i < 10000; ++i) {
+                int key = rng.Uniform<uint32_t>() % 100;
+                int value = cache.LookupOrCreate(key, [&]() {
+                    ++nCreated[key];
+                    return -key;
+                });
+                EXPECT_EQ(-key, value);
+            }
+        }));
+    for (std::thread &thread : threads)
+        thread.join();
+
+    EXPECT_EQ(100, cache.size());
+    for (int key = 0; key < 100; ++key)
+        EXPECT_EQ(1, nCreated[key]);
+
+    cache.Clear();
+    EXPECT_EQ(0, cache.size());
+    EXPECT_EQ(2, cache.LookupOrCreate(1, []() { return 2; }));
+}
+
+TEST(ConcurrentCache, ParallelCreation) {
+    // Creating one key's value shouldn't prevent another key's value from
+    // being created at the same time. If it did, the slow creation would
+    // wait until it timed out before the other value could be created.
+    ConcurrentCache<std::string, int> cache;
+    std::atomic<bool> slowStarted{false}, otherCreated{false};
+    bool timedOut = false;
+    std::thread slow([&]() {
+        cache.LookupOrCreate("slow", [&]() {
+            slowStarted = true;
+            auto start = std::chrono::steady_clock::now();
+            while (!otherCreated) {
+                if (std::chrono::steady_clock::now() - start >
+                    std::chrono::milliseconds(500)) {
+                    timedOut = true;
+                    break;
+                }
+                std::this_thread::yield();
+            }
+            return 1;
+        });
+    });
+    while (!slowStarted)
+        std::this_thread::yield();
+    EXPECT_EQ(2, cache.LookupOrCreate("fast", []() { return 2; }));
+    otherCreated = true;
+    slow.join();
+    EXPECT_FALSE(timedOut);
+    EXPECT_EQ(1, cache.LookupOrCreate("slow", []() { return 3; }));
+}
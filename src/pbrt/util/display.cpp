@@ -7,6 +7,7 @@
 #include <pbrt/util/error.h>
 #include <pbrt/util/hash.h>
 #include <pbrt/util/image.h>
+#include <pbrt/util/ipc.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/string.h>
 
@@ -19,175 +20,14 @@
 #ifndef NOMINMAX
 #define NOMINMAX
 #endif
-#include <Ws2tcpip.h>
-#include <winsock2.h>
+#include <windows.h>
 #undef NOMINMAX
-using socket_t = SOCKET;
 #else
-using socket_t = int;
-#include <arpa/inet.h>
-#include <errno.h>
-#include <netdb.h>
-#include <netinet/in.h>
-#include <signal.h>
-#include <sys/socket.h>
 #include <unistd.h>
-#define SOCKET_ERROR (-1)
-#define INVALID_SOCKET (-1)
 #endif
 
 namespace pbrt {
 
-enum SocketError : int {
-#ifdef PBRT_IS_WINDOWS
-    Again = EAGAIN,
-    ConnRefused = WSAECONNREFUSED,
-    WouldBlock = WSAEWOULDBLOCK,
-#else
-    Again = EAGAIN,
-    ConnRefused = ECONNREFUSED,
-    WouldBlock = EWOULDBLOCK,
-#endif
-};
-
-static int closeSocket(socket_t socket) {
-#ifdef PBRT_IS_WINDOWS
-    return closesocket(socket);
-#else
-    return close(socket);
-#endif
-}
-
-static std::atomic<int> numActiveChannels{0};
-
-class IPCChannel {
-  public:
-    IPCChannel(const std::string &host);
-    ~IPCChannel();
-
-    IPCChannel(const IPCChannel &) = delete;
-    IPCChannel &operator=(const IPCChannel &) = delete;
-
-    bool Send(pstd::span<const uint8_t> message);
-
-    bool Connected() const { return socketFd != INVALID_SOCKET; }
-
-  private:
-    void Connect();
-    void Disconnect();
-
-    int numFailures = 0;
-    std::string address, port;
-    socket_t socketFd = INVALID_SOCKET;
-};
-
-IPCChannel::IPCChannel(const std::string &hostname) {
-    if (numActiveChannels++ == 0) {
-#ifdef PBRT_IS_WINDOWS
-        WSADATA wsaData;
-        int err = WSAStartup(MAKEWORD(2, 2), &wsaData);
-        if (err != NO_ERROR)
-            LOG_FATAL("Unable to initialize WinSock: %s", ErrorString(err));
-#else
-        // We don't care about getting a SIGPIPE if the display server goes
-        // away...
-        signal(SIGPIPE, SIG_IGN);
-#endif
-    }
-
-    size_t split = hostname.find_last_of(':');
-    if (split == std::string::npos)
-        ErrorExit("Expected \"host:port\" for display server address. Given \"%s\".",
-                  hostname);
-    address = std::string(hostname.begin(), hostname.begin() + split);
-    port = std::string(hostname.begin() + split + 1, hostname.end());
-
-    Connect();
-}
-
-void IPCChannel::Connect() {
-    CHECK_EQ(socketFd, INVALID_SOCKET);
-
-    LOG_VERBOSE("Trying to connect to display server");
-
-    struct addrinfo hints = {}, *addrinfo;
-    hints.ai_family = PF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    int err = getaddrinfo(address.c_str(), port.c_str(), &hints, &addrinfo);
-    if (err)
-        ErrorExit("%s", gai_strerror(err));
-
-    socketFd = INVALID_SOCKET;
-    for (struct addrinfo *ptr = addrinfo; ptr; ptr = ptr->ai_next) {
-        socketFd = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
-        if (socketFd == INVALID_SOCKET) {
-            LOG_VERBOSE("socket() failed: %s", ErrorString());
-            continue;
-        }
-
-        if (connect(socketFd, ptr->ai_addr, ptr->ai_addrlen) == SOCKET_ERROR) {
-#ifdef PBRT_IS_WINDOWS
-            int err = WSAGetLastError();
-#else
-            int err = errno;
-#endif
-            if (err == SocketError::ConnRefused)
-                LOG_VERBOSE("Connection refused. Will try again...");
-            else
-                LOG_VERBOSE("connect() failed: %s", ErrorString(err));
-
-            closeSocket(socketFd);
-            socketFd = INVALID_SOCKET;
-            continue;
-        }
-
-        break;  // success
-    }
-
-    freeaddrinfo(addrinfo);
-    if (socketFd != INVALID_SOCKET)
-        LOG_VERBOSE("Connected to display server");
-}
-
-IPCChannel::~IPCChannel() {
-    if (Connected())
-        Disconnect();
-
-    if (--numActiveChannels == 0) {
-#ifdef PBRT_IS_WINDOWS
-        WSACleanup();
-#endif
-    }
-}
-
-void IPCChannel::Disconnect() {
-    CHECK(Connected());
-
-    closeSocket(socketFd);
-    socketFd = INVALID_SOCKET;
-}
-
-bool IPCChannel::Send(pstd::span<const uint8_t> message) {
-    if (!Connected()) {
-        Connect();
-        if (!Connected())
-            return false;
-    }
-
-    // Start with the length of the message.
-    // FIXME: annoying coupling w/sending code's message buffer layout...
-    int *startPtr = (int *)message.data();
-    *startPtr = message.size();
-
-    int bytesSent = send(socketFd, (const char *)message.data(), message.size(), 0 /* flags */);
-    if (bytesSent == message.size())
-        return true;
-
-    LOG_ERROR("send to display server failed: %s", ErrorString());
-    Disconnect();
-    return false;
-}
-
 namespace {
 
 enum DisplayDirective : uint8_t {
@@ -198,19 +38,6 @@ enum DisplayDirective : uint8_t {
     CreateImage = 4,
 };
 
-void Serialize(uint8_t **ptr, const std::string &s) {
-    for (size_t i = 0; i < s.size(); ++i, *ptr += 1)
-        **ptr = s[i];
-    **ptr = '\0';
-    *ptr += 1;
-}
-
-template <typename T>
-void Serialize(uint8_t **ptr, T value) {
-    memcpy(*ptr, &value, sizeof(T));
-    *ptr += sizeof(T);
-}
-
 constexpr int tileSize = 128;
 
 }  // namespace
@@ -20,6 +20,7 @@
 namespace pbrt {
 
 static bool quiet = false;
+static thread_local bool recoverableErrors = false;
 
 void SuppressErrorMessages() {
     quiet = true;
@@ -66,11 +67,22 @@ void Error(const FileLoc *loc, const char *message) {
 }
 
 void ErrorExit(const FileLoc *loc, const char *message) {
+    if (recoverableErrors)
+        throw RecoverableError(loc ? loc->ToString() + ": " + message
+                                   : std::string(message));
     processError("Error", loc, message);
     DisconnectFromDisplayServer();
     std::quick_exit(1);
 }
 
+ScopedRecoverableErrors::ScopedRecoverableErrors() : wasRecoverable(recoverableErrors) {
+    recoverableErrors = true;
+}
+
+ScopedRecoverableErrors::~ScopedRecoverableErrors() {
+    recoverableErrors = wasRecoverable;
+}
+
 int LastError() {
 #ifdef PBRT_IS_WINDOWS
     return GetLastError();
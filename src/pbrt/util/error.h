@@ -10,6 +10,7 @@
 #include <pbrt/util/print.h>
 #include <pbrt/util/pstd.h>
 
+#include <stdexcept>
 #include <string>
 #include <string_view>
 
@@ -63,6 +64,32 @@ template <typename... Args>
     ErrorExit(loc, StringPrintf(fmt, std::forward<Args>(args)...).c_str());
 }
 
+// RecoverableError Definition
+// Thrown by ErrorExit() in place of exiting while errors are recoverable on
+// the calling thread; what() returns the formatted message.
+class RecoverableError : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+};
+
+// ScopedRecoverableErrors Definition
+// Makes ErrorExit() calls on the current thread throw a RecoverableError
+// for the lifetime of the object, so that errors in input that doesn't come
+// from the scene description (e.g., a render server request) can be
+// reported back without exiting. Calls on other threads still exit, so
+// only serial code should run while it is in scope.
+class ScopedRecoverableErrors {
+  public:
+    ScopedRecoverableErrors();
+    ~ScopedRecoverableErrors();
+
+    ScopedRecoverableErrors(const ScopedRecoverableErrors &) = delete;
+    ScopedRecoverableErrors &operator=(const ScopedRecoverableErrors &) = delete;
+
+  private:
+    bool wasRecoverable;
+};
+
 int LastError();
 std::string ErrorString(int errorId = LastError());
 
@@ -6,6 +6,7 @@
 
 #include <pbrt/util/check.h>
 #include <pbrt/util/error.h>
+#include <pbrt/util/hash.h>
 #include <pbrt/util/string.h>
 
 #include <filesystem/path.h>
@@ -16,11 +17,18 @@
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <sys/stat.h>
+#include <vector>
 #ifndef PBRT_IS_WINDOWS
 #include <dirent.h>
 #include <sys/dir.h>
 #include <sys/types.h>
 #endif
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 namespace pbrt {
 
@@ -33,6 +41,19 @@ void SetSearchDirectory(const std::string &filename) {
     searchDirectory = path;
 }
 
+std::string SearchDirectory() {
+    // Relative filenames are left as is if no search directory has been set,
+    // which makes them relative to the current directory.
+    filesystem::path path = searchDirectory;
+    if (path.empty())
+        path = filesystem::path(".");
+    return path.make_absolute().str();
+}
+
+bool IsDirectory(const std::string &filename) {
+    return filesystem::path(filename).is_directory();
+}
+
 static bool IsAbsolutePath(const std::string &filename) {
     if (filename.empty())
         return false;
@@ -172,4 +193,77 @@ bool WriteFile(const std::string &filename, const std::string &contents) {
     return true;
 }
 
+pstd::optional<int64_t> FileModificationTime(const std::string &filename) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return {};
+    // Use the full resolution of the timestamp where it's available so that
+    // changes made in quick succession are detected.
+#if defined(PBRT_IS_LINUX)
+    return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#elif defined(PBRT_IS_OSX)
+    return int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    return int64_t(st.st_mtime) * 1000000000;
+#endif
+}
+
+pstd::optional<uint64_t> HashFileContents(const std::string &filename) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f)
+        return {};
+    std::vector<char> buf(1 << 20);
+    uint64_t hash = 0;
+    size_t n;
+    while ((n = fread(buf.data(), 1, buf.size(), f)) > 0)
+        hash = HashBuffer(buf.data(), n, hash);
+    bool success = !ferror(f);
+    fclose(f);
+    if (!success)
+        return {};
+    return hash;
+}
+
+// MappedFile Method Definitions
+std::unique_ptr<MappedFile> MappedFile::Open(const std::string &filename) {
+    std::unique_ptr<MappedFile> file(new MappedFile);
+#ifdef PBRT_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    file->length = st.st_size;
+    if (file->length > 0) {
+        void *ptr = mmap(nullptr, file->length, PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr != MAP_FAILED) {
+            file->ptr = (const uint8_t *)ptr;
+            file->mapped = true;
+        }
+    }
+    close(fd);
+    if (file->mapped || file->length == 0)
+        return file;
+    // Fall back to reading the file if it couldn't be mapped
+#endif
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs)
+        return nullptr;
+    file->contents = std::string((std::istreambuf_iterator<char>(ifs)),
+                                 (std::istreambuf_iterator<char>()));
+    file->ptr = (const uint8_t *)file->contents.data();
+    file->length = file->contents.size();
+    return file;
+}
+
+MappedFile::~MappedFile() {
+#ifdef PBRT_HAVE_MMAP
+    if (mapped)
+        munmap((void *)ptr, length);
+#endif
+}
+
 }  // namespace pbrt
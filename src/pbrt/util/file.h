@@ -9,6 +9,7 @@
 
 #include <pbrt/util/pstd.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -18,16 +19,54 @@ namespace pbrt {
 std::string ReadFileContents(const std::string &filename);
 bool WriteFile(const std::string &filename, const std::string &contents);
 
+// Returns the time the file was last modified, in nanoseconds since the
+// epoch.
+pstd::optional<int64_t> FileModificationTime(const std::string &filename);
+// Returns a hash of the file's contents, which are read in chunks so that
+// large files don't need to be held in memory.
+pstd::optional<uint64_t> HashFileContents(const std::string &filename);
+
 std::vector<float> ReadFloatFile(const std::string &filename);
 
 std::string ResolveFilename(const std::string &filename);
 void SetSearchDirectory(const std::string &filename);
+// Returns the absolute path of the directory that ResolveFilename() resolves
+// relative filenames from.
+std::string SearchDirectory();
+bool IsDirectory(const std::string &filename);
 
 bool HasExtension(const std::string &filename, const std::string &ext);
 std::string RemoveExtension(const std::string &filename);
 
 std::vector<std::string> MatchingFilenames(const std::string &base);
 
+// MappedFile Definition
+// Provides read-only access to a file's contents, which are memory-mapped
+// where the system supports it so that they aren't copied into memory up
+// front; otherwise, the file is read.
+class MappedFile {
+  public:
+    // Returns nullptr if the file can't be opened.
+    static std::unique_ptr<MappedFile> Open(const std::string &filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *data() const { return ptr; }
+    size_t size() const { return length; }
+    bool IsMemoryMapped() const { return mapped; }
+
+  private:
+    MappedFile() = default;
+
+    const uint8_t *ptr = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    // Holds the file's contents when it isn't mapped
+    std::string contents;
+};
+
 }  // namespace pbrt
 
 #endif  // PBRT_UTIL_FILE_H
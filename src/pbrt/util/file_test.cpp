@@ -38,6 +38,19 @@ TEST(File, ReadWriteFile) {
     EXPECT_EQ(0, remove(fn.c_str()));
 }
 
+TEST(File, MappedFile) {
+    std::string fn = inTestDir("mapped.txt");
+    std::string str = "this is another test.";
+    EXPECT_TRUE(WriteFile(fn, str));
+    std::unique_ptr<MappedFile> file = MappedFile::Open(fn);
+    ASSERT_TRUE(file != nullptr);
+    EXPECT_EQ(str, std::string((const char *)file->data(), file->size()));
+    file.reset();
+    EXPECT_EQ(0, remove(fn.c_str()));
+
+    EXPECT_TRUE(MappedFile::Open("NO_SUCH_FILE_64622") == nullptr);
+}
+
 TEST(File, Success) {
     std::string fn = inTestDir("floatfile_good.txt");
     EXPECT_TRUE(WriteFile(fn, R"(1
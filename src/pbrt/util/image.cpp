@@ -12,7 +12,10 @@
 #include <pbrt/util/math.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/progressreporter.h>
 #include <pbrt/util/pstd.h>
+#include <pbrt/util/simd.h>
+#include <pbrt/util/stats.h>
 #include <pbrt/util/string.h>
 
 #include <lodepng/lodepng.h>
@@ -27,9 +30,12 @@
 #include <ImfMatrixAttribute.h>
 #include <ImfOutputFile.h>
 #include <ImfStringVectorAttribute.h>
+#include <ImfThreading.h>
 #endif
 
 #include <cmath>
+#include <cstring>
+#include <mutex>
 #include <numeric>
 
 // use lodepng and get 16-bit.
@@ -94,7 +100,8 @@ const RGBColorSpace *ImageMetadata::GetColorSpace() const {
 }
 
 template <typename F>
-void ForExtent(const Bounds2i &extent, WrapMode2D wrapMode, Image &image, F op) {
+void ForExtent(const Bounds2i &extent, WrapMode2D wrapMode, const Image &image,
+               F op) {
     CHECK_LT(extent.pMin.x, extent.pMax.x);
     CHECK_LT(extent.pMin.y, extent.pMax.y);
 
@@ -122,6 +129,52 @@ void ForExtent(const Bounds2i &extent, WrapMode2D wrapMode, Image &image, F op)
     }
 }
 
+// Computes a scanline of the next MIP level from two scanlines of the
+// current level, averaging each 2x2 block of pixels. _dx_ is the offset to
+// the second pixel of a block, which is zero for single-pixel scanlines.
+static void BoxDownsampleRow(const float *row0, const float *row1, int dx, int nc,
+                             int nxOut, float *out) {
+    int x = 0;
+#ifdef PBRT_HAVE_SIMD
+    using simd::Vec4f;
+    if (dx == nc && (nc == 1 || nc == 2)) {
+        // Each four output values come from eight consecutive input values
+        // in each row; split them into the first and second pixels of the
+        // blocks.
+        int n = nc * nxOut;
+        int i = 0;
+        for (; i + Vec4f::Width <= n; i += Vec4f::Width) {
+            Vec4f a0, b0, a1, b1;
+            if (nc == 1) {
+                Unzip(Vec4f::Load(row0 + 2 * i), Vec4f::Load(row0 + 2 * i + 4), &a0, &b0);
+                Unzip(Vec4f::Load(row1 + 2 * i), Vec4f::Load(row1 + 2 * i + 4), &a1, &b1);
+            } else {
+                UnzipPairs(Vec4f::Load(row0 + 2 * i), Vec4f::Load(row0 + 2 * i + 4), &a0,
+                           &b0);
+                UnzipPairs(Vec4f::Load(row1 + 2 * i), Vec4f::Load(row1 + 2 * i + 4), &a1,
+                           &b1);
+            }
+            (Vec4f(.25f) * (a0 + b0 + a1 + b1)).Store(out + i);
+        }
+        x = i / nc;
+    } else if (nc % Vec4f::Width == 0) {
+        for (; x < nxOut; ++x)
+            for (int c = 0; c < nc; c += Vec4f::Width) {
+                int offset = 2 * x * nc + c;
+                Vec4f sum = Vec4f::Load(row0 + offset) + Vec4f::Load(row0 + offset + dx) +
+                            Vec4f::Load(row1 + offset) + Vec4f::Load(row1 + offset + dx);
+                (Vec4f(.25f) * sum).Store(out + x * nc + c);
+            }
+    }
+#endif
+    for (; x < nxOut; ++x)
+        for (int c = 0; c < nc; ++c) {
+            int offset = 2 * x * nc + c;
+            out[x * nc + c] = .25f * (row0[offset] + row0[offset + dx] + row1[offset] +
+                                      row1[offset + dx]);
+        }
+}
+
 // Image Method Definitions
 pstd::vector<Image> Image::GenerateMIPMap(Image image, WrapMode2D wrapMode,
                                           Allocator alloc) {
@@ -129,86 +182,128 @@ pstd::vector<Image> Image::GenerateMIPMap(Image image, WrapMode2D wrapMode,
     int nChannels = image.NChannels();
     ColorEncodingHandle origEncoding = image.encoding;
 
-    // Set things up so we have a power-of-two sized image stored with
-    // floats.
+    // Set things up so we have a power-of-two sized image.
     if (!IsPowerOf2(image.resolution[0]) || !IsPowerOf2(image.resolution[1])) {
         // Resample image to power-of-two resolution
         image = image.FloatResize(
             {RoundUpPow2(image.resolution[0]), RoundUpPow2(image.resolution[1])},
             wrapMode);
-    } else if (!Is32Bit(image.format))
-        image = image.ConvertToFormat(PixelFormat::Float);
-    CHECK(Is32Bit(image.format));
+    }
 
     // Initialize levels of MIPMap from image
     int nLevels = 1 + Log2Int(std::max(image.resolution[0], image.resolution[1]));
     pstd::vector<Image> pyramid(alloc);
     pyramid.reserve(nLevels);
 
+    // Levels that are already in the pyramid's format are moved into it
+    // rather than copied if they can use its allocator. The levels after
+    // the first are computed with floats, so they're allocated with the
+    // pyramid's allocator if they will be moved.
+    auto isPyramidLevel = [&](const Image &level) {
+        if (level.format != origFormat)
+            return false;
+        if (Is8Bit(level.format))
+            return level.p8.get_allocator() == alloc;
+        else if (Is16Bit(level.format))
+            return level.p16.get_allocator() == alloc;
+        return level.p32.get_allocator() == alloc;
+    };
+    Allocator levelAlloc = Is32Bit(origFormat) ? alloc : Allocator();
+
     Point2i levelResolution = image.resolution;
     for (int i = 0; i < nLevels - 1; ++i) {
         // Initialize $i+1$st MIPMap level from $i$th level and also convert
         // i'th level to the internal format
-        pyramid.push_back(
-            Image(origFormat, levelResolution, image.channelNames, origEncoding, alloc));
+        bool moveLevel = isPyramidLevel(image);
+        if (!moveLevel)
+            pyramid.push_back(Image(origFormat, levelResolution, image.channelNames,
+                                    origEncoding, alloc));
 
         Point2i nextResolution(std::max(1, levelResolution[0] / 2),
                                std::max(1, levelResolution[1] / 2));
-        Image nextImage(image.format, nextResolution, image.channelNames, origEncoding);
-
-        // Offsets from the base pixel to the four neighbors that we'll
-        // downfilter.
-        int srcDeltas[4] = {0, nChannels, nChannels * levelResolution[0],
-                            nChannels * levelResolution[0] + nChannels};
-        // Clamp offsets once a dimension has a single texel.
-        if (levelResolution[0] == 1) {
-            srcDeltas[1] = 0;
-            srcDeltas[3] -= nChannels;
-        }
-        if (levelResolution[1] == 1) {
-            srcDeltas[2] = 0;
-            srcDeltas[3] -= nChannels * levelResolution[0];
-        }
+        Image nextImage(PixelFormat::Float, nextResolution, image.channelNames,
+                        origEncoding, levelAlloc);
+
+        // Offsets from the base pixel to the neighbors in x and y that
+        // we'll downfilter, clamped once a dimension has a single texel.
+        int dx = levelResolution[0] == 1 ? 0 : nChannels;
+        int dy = levelResolution[1] == 1 ? 0 : nChannels * levelResolution[0];
 
         // Work in scanlines for best cache coherence (vs 2d tiles).
         ParallelFor(0, nextResolution[1], [&](int64_t y0, int64_t y1) {
-            for (int y = y0; y < y1; ++y) {
-                // Downfilter with a box filter for the next MIP level
-                int srcOffset = image.PixelOffset({0, 2 * y});
-                int nextOffset = nextImage.PixelOffset({0, y});
-                for (int x = 0; x < nextResolution[0]; ++x) {
-                    for (int c = 0; c < nChannels; ++c) {
-                        nextImage.p32[nextOffset] =
-                            .25f *
-                            (image.p32[srcOffset] + image.p32[srcOffset + srcDeltas[1]] +
-                             image.p32[srcOffset + srcDeltas[2]] +
-                             image.p32[srcOffset + srcDeltas[3]]);
-                        ++srcOffset;
-                        ++nextOffset;
-                    }
-                    srcOffset += nChannels;
-                }
+            // Levels that aren't stored with floats are converted two
+            // scanlines at a time.
+            std::vector<float> rows;
+            if (!Is32Bit(image.format))
+                rows.resize(2 * nChannels * levelResolution[0]);
 
-                // Copy the current level out to the current pyramid level
+            for (int y = y0; y < y1; ++y) {
                 int yStart = 2 * y;
                 int yEnd = std::min(2 * y + 2, levelResolution[1]);
-                int offset = image.PixelOffset({0, yStart});
+                Bounds2i extent({0, yStart}, {levelResolution[0], yEnd});
                 size_t count = (yEnd - yStart) * nChannels * levelResolution[0];
-                pyramid[i].CopyRectIn(Bounds2i({0, yStart}, {levelResolution[0], yEnd}),
-                                      {image.p32.data() + offset, count});
+                const float *row;
+                if (Is32Bit(image.format))
+                    row = image.P32() + image.PixelOffset({0, yStart});
+                else {
+                    image.CopyRectOut(extent, pstd::MakeSpan(rows));
+                    row = rows.data();
+                }
+
+                // Replace NaNs in _Half_ images with zeros as ConvertToFormat()
+                // does, also in the level itself in case it's moved into the
+                // pyramid
+                bool anyNaN = false;
+                if (image.format == PixelFormat::Half)
+                    for (size_t j = 0; j < count; ++j)
+                        anyNaN |= rows[j] != rows[j];
+                if (anyNaN) {
+                    size_t offset = image.PixelOffset({0, yStart});
+                    for (size_t j = 0; j < count; ++j)
+                        if (std::isnan(rows[j])) {
+                            int pixel = j / nChannels;
+                            LOG_ERROR("NaN at pixel %d,%d comp %d",
+                                      pixel % levelResolution[0],
+                                      yStart + pixel / levelResolution[0],
+                                      int(j % nChannels));
+                            rows[j] = 0;
+                            image.p16[offset + j] = Half(0.f);
+                        }
+                }
+
+                // Downfilter with a box filter for the next MIP level
+                BoxDownsampleRow(row, row + dy, dx, nChannels, nextResolution[0],
+                                 nextImage.p32.data() + nextImage.PixelOffset({0, y}));
+
+                // Copy the current level out to the current pyramid level
+                if (!moveLevel)
+                    pyramid[i].CopyRectIn(extent, {row, count});
             }
         });
 
+        if (moveLevel)
+            pyramid.push_back(std::move(image));
         image = std::move(nextImage);
         levelResolution = nextResolution;
     }
 
     // Top level
     CHECK(levelResolution[0] == 1 && levelResolution[1] == 1);
-    pyramid.push_back(
-        Image(origFormat, levelResolution, image.channelNames, origEncoding, alloc));
-    pyramid[nLevels - 1].CopyRectIn({{0, 0}, {1, 1}},
-                                    {image.p32.data(), size_t(nChannels)});
+    if (image.format == PixelFormat::Half)
+        for (int c = 0; c < nChannels; ++c)
+            if (std::isnan(image.GetChannel({0, 0}, c))) {
+                LOG_ERROR("NaN at pixel 0,0 comp %d", c);
+                image.SetChannel({0, 0}, c, 0.f);
+            }
+    if (isPyramidLevel(image))
+        pyramid.push_back(std::move(image));
+    else {
+        std::vector<float> texel(nChannels);
+        image.CopyRectOut({{0, 0}, {1, 1}}, pstd::MakeSpan(texel));
+        pyramid.push_back(
+            Image(origFormat, levelResolution, image.channelNames, origEncoding, alloc));
+        pyramid[nLevels - 1].CopyRectIn({{0, 0}, {1, 1}}, texel);
+    }
 
     return pyramid;
 }
@@ -272,7 +367,7 @@ ImageChannelValues Image::GetChannels(Point2i p, const ImageChannelDesc &desc,
     }
     case PixelFormat::Float: {
         for (int i = 0; i < desc.offset.size(); ++i)
-            cv[i] = p32[pixelOffset + desc.offset[i]];
+            cv[i] = P32()[pixelOffset + desc.offset[i]];
         break;
     }
     default:
@@ -380,16 +475,17 @@ Image Image::FloatResize(Point2i newResolution, WrapMode2D wrapMode) const {
             {xWeights[outExtent[1][0] - 1].firstTexel + 4,
              yWeights[outExtent[1][1] - 1].firstTexel + 4});
 
-        if (inBuf.size() < NChannels() * inExtent.Area())
-            inBuf.resize(NChannels() * inExtent.Area());
+        // The buffers have an extra value at the end so that the x zoom can
+        // filter RGB pixels with four-wide vectors.
+        if (inBuf.size() < NChannels() * inExtent.Area() + 1)
+            inBuf.resize(NChannels() * inExtent.Area() + 1);
 
         // Copy the tile of the input image into inBuf. (The
         // main motivation for this copy is to convert it
         // into floats all at once, rather than repeatedly
         // and pixel-by-pixel during the first resampling
         // step.)
-        // FIXME CAST
-        ((Image *)this)->CopyRectOut(inExtent, pstd::MakeSpan(inBuf), wrapMode);
+        CopyRectOut(inExtent, pstd::MakeSpan(inBuf), wrapMode);
 
         // Zoom in x. We need to do this across all scanlines
         // in inExtent's y dimension so we have the border
@@ -399,9 +495,10 @@ Image Image::FloatResize(Point2i newResolution, WrapMode2D wrapMode) const {
         int nxIn = inExtent[1][0] - inExtent[0][0];
         int nyIn = inExtent[1][1] - inExtent[0][1];
 
-        if (xBuf.size() < NChannels() * nyIn * nxOut)
-            xBuf.resize(NChannels() * nyIn * nxOut);
+        if (xBuf.size() < NChannels() * nyIn * nxOut + 1)
+            xBuf.resize(NChannels() * nyIn * nxOut + 1);
 
+        int nc = NChannels();
         int xBufOffset = 0;
         for (int y = 0; y < nyIn; ++y) {
             for (int x = 0; x < nxOut; ++x) {
@@ -414,44 +511,67 @@ Image Image::FloatResize(Point2i newResolution, WrapMode2D wrapMode) const {
                 DCHECK_GE(xIn, 0);
                 DCHECK_LT(xIn + 3, nxIn);
 
-                int inOffset = NChannels() * (xIn + y * nxIn);
+                int inOffset = nc * (xIn + y * nxIn);
                 DCHECK_GE(inOffset, 0);
-                DCHECK_LT(inOffset + 3 * NChannels(), inBuf.size());
-                for (int c = 0; c < NChannels(); ++c, ++xBufOffset, ++inOffset) {
-                    xBuf[xBufOffset] =
-                        (rsw.weight[0] * inBuf[inOffset] +
-                         rsw.weight[1] * inBuf[inOffset + NChannels()] +
-                         rsw.weight[2] * inBuf[inOffset + 2 * NChannels()] +
-                         rsw.weight[3] * inBuf[inOffset + 3 * NChannels()]);
-                }
+                DCHECK_LT(inOffset + 3 * nc, inBuf.size());
+                const float *in = &inBuf[inOffset];
+                int c = 0;
+#ifdef PBRT_HAVE_SIMD
+                // Filter groups of four channels at once. RGB pixels are
+                // filtered along with the next value, which is overwritten
+                // by the next pixel or is the buffers' extra value.
+                using simd::Vec4f;
+                int ncVector = nc == 3 ? 4 : nc;
+                for (; c + Vec4f::Width <= ncVector; c += Vec4f::Width)
+                    (Vec4f(rsw.weight[0]) * Vec4f::Load(in + c) +
+                     Vec4f(rsw.weight[1]) * Vec4f::Load(in + c + nc) +
+                     Vec4f(rsw.weight[2]) * Vec4f::Load(in + c + 2 * nc) +
+                     Vec4f(rsw.weight[3]) * Vec4f::Load(in + c + 3 * nc))
+                        .Store(&xBuf[xBufOffset + c]);
+#endif
+                for (; c < nc; ++c)
+                    xBuf[xBufOffset + c] =
+                        (rsw.weight[0] * in[c] + rsw.weight[1] * in[c + nc] +
+                         rsw.weight[2] * in[c + 2 * nc] + rsw.weight[3] * in[c + 3 * nc]);
+                xBufOffset += nc;
             }
         }
 
         if (outBuf.size() < NChannels() * nxOut * nyOut)
             outBuf.resize(NChannels() * nxOut * nyOut);
 
-        // Zoom in y from xBuf to outBuf
-        for (int x = 0; x < nxOut; ++x) {
-            for (int y = 0; y < nyOut; ++y) {
-                int yOut = y + outExtent[0][1];
-                DCHECK(yOut >= 0 && yOut < yWeights.size());
-                const ResampleWeight &rsw = yWeights[yOut];
-
-                DCHECK_GE(rsw.firstTexel - inExtent[0][1], 0);
-                int xBufOffset =
-                    NChannels() * (x + nxOut * (rsw.firstTexel - inExtent[0][1]));
-                DCHECK_GE(xBufOffset, 0);
-                int step = NChannels() * nxOut;
-                DCHECK_LT(xBufOffset + 3 * step, xBuf.size());
-
-                int outOffset = NChannels() * (x + y * nxOut);
-                for (int c = 0; c < NChannels(); ++c, ++outOffset, ++xBufOffset)
-                    outBuf[outOffset] =
-                        std::max<Float>(0, (rsw.weight[0] * xBuf[xBufOffset] +
-                                            rsw.weight[1] * xBuf[xBufOffset + step] +
-                                            rsw.weight[2] * xBuf[xBufOffset + 2 * step] +
-                                            rsw.weight[3] * xBuf[xBufOffset + 3 * step]));
-            }
+        // Zoom in y from xBuf to outBuf. Each output scanline is a weighted
+        // sum of four consecutive scanlines of xBuf, so it is computed in
+        // order along the scanlines.
+        int step = nc * nxOut;
+        for (int y = 0; y < nyOut; ++y) {
+            int yOut = y + outExtent[0][1];
+            DCHECK(yOut >= 0 && yOut < yWeights.size());
+            const ResampleWeight &rsw = yWeights[yOut];
+
+            DCHECK_GE(rsw.firstTexel - inExtent[0][1], 0);
+            int xBufOffset = step * (rsw.firstTexel - inExtent[0][1]);
+            DCHECK_LE(xBufOffset + 4 * step, xBuf.size());
+            const float *in = &xBuf[xBufOffset];
+            float *out = &outBuf[step * y];
+
+            int i = 0;
+#ifdef PBRT_HAVE_SIMD
+            using simd::Vec4f;
+            Vec4f w0(rsw.weight[0]), w1(rsw.weight[1]), w2(rsw.weight[2]),
+                w3(rsw.weight[3]);
+            for (; i + Vec4f::Width <= step; i += Vec4f::Width)
+                simd::ClampZero(w0 * Vec4f::Load(in + i) +
+                                w1 * Vec4f::Load(in + i + step) +
+                                w2 * Vec4f::Load(in + i + 2 * step) +
+                                w3 * Vec4f::Load(in + i + 3 * step))
+                    .Store(out + i);
+#endif
+            for (; i < step; ++i)
+                out[i] = std::max<Float>(0, (rsw.weight[0] * in[i] +
+                                             rsw.weight[1] * in[i + step] +
+                                             rsw.weight[2] * in[i + 2 * step] +
+                                             rsw.weight[3] * in[i + 3 * step]));
         }
         // Copy out...
         resampledImage.CopyRectIn(outExtent, outBuf);
@@ -490,15 +610,46 @@ Image::Image(pstd::vector<float> p32c, Point2i resolution,
     CHECK(Is32Bit(format));
 }
 
+Image::Image(std::shared_ptr<const MappedFile> file, const float *p32c,
+             Point2i resolution, pstd::span<const std::string> channels)
+    : format(PixelFormat::Float),
+      resolution(resolution),
+      channelNames(channels.begin(), channels.end()),
+      mappedP32(p32c),
+      mappedFile(std::move(file)) {
+    CHECK(mappedFile != nullptr);
+    CHECK_LE((const uint8_t *)p32c + BytesUsed(),
+             mappedFile->data() + mappedFile->size());
+}
+
+void Image::CopyMappedPixels() {
+    size_t n = NChannels() * size_t(resolution.x) * resolution.y;
+    p32.resize(n);
+    std::memcpy(p32.data(), mappedP32, n * sizeof(float));
+    mappedP32 = nullptr;
+    mappedFile.reset();
+}
+
 Image Image::ConvertToFormat(PixelFormat newFormat, ColorEncodingHandle encoding) const {
     if (newFormat == format)
         return *this;
 
     Image newImage(newFormat, resolution, channelNames, encoding);
-    for (int y = 0; y < resolution.y; ++y)
-        for (int x = 0; x < resolution.x; ++x)
-            for (int c = 0; c < NChannels(); ++c)
-                newImage.SetChannel({x, y}, c, GetChannel({x, y}, c));
+    // Convert a scanline at a time through floats, so that the conversions
+    // in CopyRectOut() and CopyRectIn() handle whole scanlines at once.
+    std::vector<float> buf(NChannels() * resolution.x);
+    for (int y = 0; y < resolution.y && !buf.empty(); ++y) {
+        Bounds2i scanline({0, y}, {resolution.x, y + 1});
+        CopyRectOut(scanline, pstd::MakeSpan(buf));
+        for (size_t i = 0; i < buf.size(); ++i)
+            if (std::isnan(buf[i])) {
+                // As with SetChannel()
+                LOG_ERROR("NaN at pixel %d,%d comp %d", int(i) / NChannels(), y,
+                          int(i) % NChannels());
+                buf[i] = 0;
+            }
+        newImage.CopyRectIn(scanline, buf);
+    }
     return newImage;
 }
 
@@ -521,7 +672,7 @@ ImageChannelValues Image::GetChannels(Point2i p, WrapMode2D wrapMode) const {
     }
     case PixelFormat::Float: {
         for (int i = 0; i < NChannels(); ++i)
-            cv[i] = p32[pixelOffset + i];
+            cv[i] = P32()[pixelOffset + i];
         break;
     }
     default:
@@ -657,7 +808,7 @@ ImageChannelValues Image::Average(const ImageChannelDesc &desc) const {
 }
 
 void Image::CopyRectOut(const Bounds2i &extent, pstd::span<float> buf,
-                        WrapMode2D wrapMode) {
+                        WrapMode2D wrapMode) const {
     CHECK_GE(buf.size(), extent.Area() * NChannels());
 
     auto bufIter = buf.begin();
@@ -695,13 +846,30 @@ void Image::CopyRectOut(const Bounds2i &extent, pstd::span<float> buf,
         break;
 
     case PixelFormat::Half:
-        ForExtent(extent, wrapMode, *this,
-                  [&bufIter, this](int offset) { *bufIter++ = Float(p16[offset]); });
+        if (Intersect(extent, Bounds2i({0, 0}, resolution)) == extent) {
+            // All in bounds; convert scanlines all at once.
+            size_t count = NChannels() * (extent.pMax.x - extent.pMin.x);
+            for (int y = extent.pMin.y; y < extent.pMax.y; ++y) {
+                simd::HalfToFloat(&p16[PixelOffset({extent.pMin.x, y})], &*bufIter,
+                                  count);
+                bufIter += count;
+            }
+        } else
+            ForExtent(extent, wrapMode, *this,
+                      [&bufIter, this](int offset) { *bufIter++ = Float(p16[offset]); });
         break;
 
     case PixelFormat::Float:
-        ForExtent(extent, wrapMode, *this,
-                  [&bufIter, this](int offset) { *bufIter++ = Float(p32[offset]); });
+        if (Intersect(extent, Bounds2i({0, 0}, resolution)) == extent) {
+            size_t count = NChannels() * (extent.pMax.x - extent.pMin.x);
+            for (int y = extent.pMin.y; y < extent.pMax.y; ++y) {
+                const float *p = P32() + PixelOffset({extent.pMin.x, y});
+                bufIter = std::copy(p, p + count, bufIter);
+            }
+        } else
+            ForExtent(extent, wrapMode, *this, [&bufIter, this](int offset) {
+                *bufIter++ = Float(P32()[offset]);
+            });
         break;
 
     default:
@@ -711,6 +879,8 @@ void Image::CopyRectOut(const Bounds2i &extent, pstd::span<float> buf,
 
 void Image::CopyRectIn(const Bounds2i &extent, pstd::span<const float> buf) {
     CHECK_GE(buf.size(), extent.Area() * NChannels());
+    if (mappedP32)
+        CopyMappedPixels();
 
     auto bufIter = buf.begin();
     switch (format) {
@@ -739,13 +909,30 @@ void Image::CopyRectIn(const Bounds2i &extent, pstd::span<const float> buf) {
         break;
 
     case PixelFormat::Half:
-        ForExtent(extent, WrapMode::Clamp, *this,
-                  [&bufIter, this](int offset) { p16[offset] = Half(*bufIter++); });
+        if (Intersect(extent, Bounds2i({0, 0}, resolution)) == extent) {
+            // All in bounds; convert scanlines all at once.
+            size_t count = NChannels() * (extent.pMax.x - extent.pMin.x);
+            for (int y = extent.pMin.y; y < extent.pMax.y; ++y) {
+                simd::FloatToHalf(&*bufIter, &p16[PixelOffset({extent.pMin.x, y})],
+                                  count);
+                bufIter += count;
+            }
+        } else
+            ForExtent(extent, WrapMode::Clamp, *this,
+                      [&bufIter, this](int offset) { p16[offset] = Half(*bufIter++); });
         break;
 
     case PixelFormat::Float:
-        ForExtent(extent, WrapMode::Clamp, *this,
-                  [&bufIter, this](int offset) { p32[offset] = *bufIter++; });
+        if (Intersect(extent, Bounds2i({0, 0}, resolution)) == extent) {
+            size_t count = NChannels() * (extent.pMax.x - extent.pMin.x);
+            for (int y = extent.pMin.y; y < extent.pMax.y; ++y) {
+                std::copy(bufIter, bufIter + count,
+                          &p32[PixelOffset({extent.pMin.x, y})]);
+                bufIter += count;
+            }
+        } else
+            ForExtent(extent, WrapMode::Clamp, *this,
+                      [&bufIter, this](int offset) { p32[offset] = *bufIter++; });
         break;
 
     default:
@@ -797,6 +984,8 @@ void Image::SetChannels(Point2i p, pstd::span<const Float> values) {
 }
 
 void Image::FlipY() {
+    if (mappedP32)
+        CopyMappedPixels();
     for (int y = 0; y < resolution.y / 2; ++y) {
         for (int x = 0; x < resolution.x; ++x) {
             size_t o1 = PixelOffset({x, y}), o2 = PixelOffset({x, resolution.y - 1 - y});
@@ -894,10 +1083,31 @@ static ImageAndMetadata ReadPNG(const std::string &name, Allocator alloc,
                                 ColorEncodingHandle encoding);
 static ImageAndMetadata ReadPFM(const std::string &filename, Allocator alloc);
 static ImageAndMetadata ReadHDR(const std::string &filename, Allocator alloc);
+static ImageAndMetadata ReadRaw(const std::string &filename, Allocator alloc);
 
 // ImageIO Function Definitions
+STAT_COUNTER("Image I/O/Images read", nImagesRead);
+STAT_RATIO("Image I/O/Pixel MB decoded per second per thread", imageBytesDecoded,
+           imageDecodeMicroseconds);
+
+static ImageAndMetadata DecodeImage(const std::string &name, Allocator alloc,
+                                    ColorEncodingHandle encoding);
+
 ImageAndMetadata Image::Read(const std::string &name, Allocator alloc,
                              ColorEncodingHandle encoding) {
+    Timer timer;
+    ImageAndMetadata im = DecodeImage(name, alloc, encoding);
+
+    // Bytes per microsecond is the same as megabytes per second
+    size_t bytes = im.image.BytesUsed();
+    ++nImagesRead;
+    imageBytesDecoded += bytes;
+    imageDecodeMicroseconds += std::max<int64_t>(1, 1e6 * timer.ElapsedSeconds());
+    return im;
+}
+
+static ImageAndMetadata DecodeImage(const std::string &name, Allocator alloc,
+                                    ColorEncodingHandle encoding) {
     if (HasExtension(name, "exr"))
         return ReadEXR(name, alloc);
     else if (HasExtension(name, "png"))
@@ -906,6 +1116,8 @@ ImageAndMetadata Image::Read(const std::string &name, Allocator alloc,
         return ReadPFM(name, alloc);
     else if (HasExtension(name, "hdr"))
         return ReadHDR(name, alloc);
+    else if (HasExtension(name, "praw"))
+        return ReadRaw(name, alloc);
     else {
         int x, y, n;
         unsigned char *data = stbi_load(name.c_str(), &x, &y, &n, 0);
@@ -948,6 +1160,8 @@ bool Image::Write(const std::string &name, const ImageMetadata &metadata) const
 
     if (HasExtension(name, "exr"))
         return WriteEXR(name, metadata);
+    else if (HasExtension(name, "praw"))
+        return WriteRaw(name, metadata);
 
     if (NChannels() > 4) {
         Error("%s: unable to write an %d channel image in this format.", name,
@@ -1030,114 +1244,133 @@ static Imf::FrameBuffer imageToFrameBuffer(const Image &image,
     return fb;
 }
 
-static ImageAndMetadata ReadEXR(const std::string &name, Allocator alloc) {
-    try {
-        Imf::InputFile file(name.c_str());
-        Imath::Box2i dw = file.header().dataWindow();
+// Lets OpenEXR decompress an image's scanlines using as many threads as
+// pbrt is using; by default, it uses just the calling thread.
+static void InitEXRThreads() {
+    static std::once_flag flag;
+    std::call_once(flag, []() { Imf::setGlobalThreadCount(RunningThreads()); });
+}
 
-        ImageMetadata metadata;
-        const Imf::FloatAttribute *renderTimeAttrib =
-            file.header().findTypedAttribute<Imf::FloatAttribute>("renderTimeSeconds");
-        if (renderTimeAttrib != nullptr)
-            metadata.renderTimeSeconds = renderTimeAttrib->value();
-
-        const Imf::M44fAttribute *worldToCameraAttrib =
-            file.header().findTypedAttribute<Imf::M44fAttribute>("worldToCamera");
-        if (worldToCameraAttrib != nullptr) {
-            SquareMatrix<4> m;
-            for (int i = 0; i < 4; ++i)
-                for (int j = 0; j < 4; ++j)
-                    // Can't memcpy since Float may be a double...
-                    m[i][j] = worldToCameraAttrib->value().getValue()[4 * i + j];
-            metadata.cameraFromWorld = m;
-        }
+// Returns the metadata in an EXR file's header
+static ImageMetadata EXRMetadata(const Imf::Header &header) {
+    Imath::Box2i dw = header.dataWindow();
+    ImageMetadata metadata;
+    const Imf::FloatAttribute *renderTimeAttrib =
+        header.findTypedAttribute<Imf::FloatAttribute>("renderTimeSeconds");
+    if (renderTimeAttrib != nullptr)
+        metadata.renderTimeSeconds = renderTimeAttrib->value();
+
+    const Imf::M44fAttribute *worldToCameraAttrib =
+        header.findTypedAttribute<Imf::M44fAttribute>("worldToCamera");
+    if (worldToCameraAttrib != nullptr) {
+        SquareMatrix<4> m;
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                // Can't memcpy since Float may be a double...
+                m[i][j] = worldToCameraAttrib->value().getValue()[4 * i + j];
+        metadata.cameraFromWorld = m;
+    }
 
-        const Imf::M44fAttribute *worldToNDCAttrib =
-            file.header().findTypedAttribute<Imf::M44fAttribute>("worldToNDC");
-        if (worldToNDCAttrib != nullptr) {
-            SquareMatrix<4> m;
-            for (int i = 0; i < 4; ++i)
-                for (int j = 0; j < 4; ++j)
-                    m[i][j] = worldToNDCAttrib->value().getValue()[4 * i + j];
-            metadata.NDCFromWorld = m;
-        }
+    const Imf::M44fAttribute *worldToNDCAttrib =
+        header.findTypedAttribute<Imf::M44fAttribute>("worldToNDC");
+    if (worldToNDCAttrib != nullptr) {
+        SquareMatrix<4> m;
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                m[i][j] = worldToNDCAttrib->value().getValue()[4 * i + j];
+        metadata.NDCFromWorld = m;
+    }
 
-        // OpenEXR uses inclusive pixel bounds; adjust to non-inclusive
-        // (the convention pbrt uses) in the values returned.
-        metadata.pixelBounds = {{dw.min.x, dw.min.y}, {dw.max.x + 1, dw.max.y + 1}};
-
-        Imath::Box2i dispw = file.header().displayWindow();
-        metadata.fullResolution =
-            Point2i(dispw.max.x - dispw.min.x + 1, dispw.max.y - dispw.min.y + 1);
-
-        const Imf::IntAttribute *sppAttrib =
-            file.header().findTypedAttribute<Imf::IntAttribute>("samplesPerPixel");
-        if (sppAttrib != nullptr)
-            metadata.samplesPerPixel = sppAttrib->value();
-
-        const Imf::FloatAttribute *varianceAttrib =
-            file.header().findTypedAttribute<Imf::FloatAttribute>("estimatedVariance");
-        if (varianceAttrib != nullptr)
-            metadata.estimatedVariance = varianceAttrib->value();
-
-        const Imf::FloatAttribute *mseAttrib =
-            file.header().findTypedAttribute<Imf::FloatAttribute>("MSE");
-        if (mseAttrib != nullptr)
-            metadata.MSE = mseAttrib->value();
-
-        // Find any string vector attributes
-        for (auto iter = file.header().begin(); iter != file.header().end(); ++iter) {
-            if (strcmp(iter.attribute().typeName(), "stringvector") == 0) {
-                Imf::StringVectorAttribute &sv =
-                    (Imf::StringVectorAttribute &)iter.attribute();
-                metadata.stringVectors[iter.name()] = sv.value();
-            }
+    // OpenEXR uses inclusive pixel bounds; adjust to non-inclusive
+    // (the convention pbrt uses) in the values returned.
+    metadata.pixelBounds = {{dw.min.x, dw.min.y}, {dw.max.x + 1, dw.max.y + 1}};
+
+    Imath::Box2i dispw = header.displayWindow();
+    metadata.fullResolution =
+        Point2i(dispw.max.x - dispw.min.x + 1, dispw.max.y - dispw.min.y + 1);
+
+    const Imf::IntAttribute *sppAttrib =
+        header.findTypedAttribute<Imf::IntAttribute>("samplesPerPixel");
+    if (sppAttrib != nullptr)
+        metadata.samplesPerPixel = sppAttrib->value();
+
+    const Imf::FloatAttribute *varianceAttrib =
+        header.findTypedAttribute<Imf::FloatAttribute>("estimatedVariance");
+    if (varianceAttrib != nullptr)
+        metadata.estimatedVariance = varianceAttrib->value();
+
+    const Imf::FloatAttribute *mseAttrib =
+        header.findTypedAttribute<Imf::FloatAttribute>("MSE");
+    if (mseAttrib != nullptr)
+        metadata.MSE = mseAttrib->value();
+
+    // Find any string vector attributes
+    for (auto iter = header.begin(); iter != header.end(); ++iter) {
+        if (strcmp(iter.attribute().typeName(), "stringvector") == 0) {
+            Imf::StringVectorAttribute &sv =
+                (Imf::StringVectorAttribute &)iter.attribute();
+            metadata.stringVectors[iter.name()] = sv.value();
         }
+    }
 
-        // Figure out the color space
-        const RGBColorSpace *colorSpace = RGBColorSpace::sRGB;  // default
-        const Imf::ChromaticitiesAttribute *chromaticitiesAttrib =
-            file.header().findTypedAttribute<Imf::ChromaticitiesAttribute>(
-                "chromaticities");
-        if (chromaticitiesAttrib != nullptr) {
-            Imf::Chromaticities c = chromaticitiesAttrib->value();
-            const RGBColorSpace *cs = RGBColorSpace::Lookup(
-                Point2f(c.red.x, c.red.y), Point2f(c.green.x, c.green.y),
-                Point2f(c.blue.x, c.blue.y), Point2f(c.white.x, c.white.y));
-            if (!cs) {
-                Warning("Couldn't find supported color space that matches "
-                        "chromaticities: "
-                        "r (%f, %f) g (%f, %f) b (%f, %f), w (%f, %f). Using sRGB.",
-                        c.red.x, c.red.y, c.green.x, c.green.y, c.blue.x, c.blue.y,
-                        c.white.x, c.white.y);
-                metadata.colorSpace = RGBColorSpace::sRGB;
-            } else
-                metadata.colorSpace = cs;
+    // Figure out the color space
+    const RGBColorSpace *colorSpace = RGBColorSpace::sRGB;  // default
+    const Imf::ChromaticitiesAttribute *chromaticitiesAttrib =
+        header.findTypedAttribute<Imf::ChromaticitiesAttribute>("chromaticities");
+    if (chromaticitiesAttrib != nullptr) {
+        Imf::Chromaticities c = chromaticitiesAttrib->value();
+        const RGBColorSpace *cs = RGBColorSpace::Lookup(
+            Point2f(c.red.x, c.red.y), Point2f(c.green.x, c.green.y),
+            Point2f(c.blue.x, c.blue.y), Point2f(c.white.x, c.white.y));
+        if (!cs) {
+            Warning("Couldn't find supported color space that matches "
+                    "chromaticities: "
+                    "r (%f, %f) g (%f, %f) b (%f, %f), w (%f, %f). Using sRGB.",
+                    c.red.x, c.red.y, c.green.x, c.green.y, c.blue.x, c.blue.y,
+                    c.white.x, c.white.y);
+            metadata.colorSpace = RGBColorSpace::sRGB;
+        } else
+            metadata.colorSpace = cs;
+    }
+    return metadata;
+}
+
+// Returns the names of an EXR file's channels and their pixel format
+static PixelFormat EXRChannels(const Imf::Header &header,
+                               std::vector<std::string> *channelNames) {
+    int nChannels = 0;
+    Imf::PixelType pixelType;
+    const Imf::ChannelList &channels = header.channels();
+    for (auto iter = channels.begin(); iter != channels.end(); ++iter) {
+        if (nChannels++ == 0)
+            pixelType = iter.channel().type;
+        else {
+            // TODO: someday handle mixed types but seems like a
+            // bother...
+            if (pixelType != iter.channel().type)
+                LOG_FATAL("ReadEXR() doesn't currently support images with "
+                          "multiple channel types.");
         }
+        channelNames->push_back(iter.name());
+    }
+
+    CHECK(pixelType == Imf::HALF || pixelType == Imf::FLOAT);
+    return pixelType == Imf::HALF ? PixelFormat::Half : PixelFormat::Float;
+}
+
+static ImageAndMetadata ReadEXR(const std::string &name, Allocator alloc) {
+    InitEXRThreads();
+    try {
+        Imf::InputFile file(name.c_str());
+        Imath::Box2i dw = file.header().dataWindow();
+        ImageMetadata metadata = EXRMetadata(file.header());
 
         int width = dw.max.x - dw.min.x + 1;
         int height = dw.max.y - dw.min.y + 1;
 
         std::vector<std::string> channelNames;
-        int nChannels = 0;
-        Imf::PixelType pixelType;
-        const Imf::ChannelList &channels = file.header().channels();
-        for (auto iter = channels.begin(); iter != channels.end(); ++iter) {
-            if (nChannels++ == 0)
-                pixelType = iter.channel().type;
-            else {
-                // TODO: someday handle mixed types but seems like a
-                // bother...
-                if (pixelType != iter.channel().type)
-                    LOG_FATAL("ReadEXR() doesn't currently support images with "
-                              "multiple channel types.");
-            }
-            channelNames.push_back(iter.name());
-        }
-
-        CHECK(pixelType == Imf::HALF || pixelType == Imf::FLOAT);
-        Image image(pixelType == Imf::HALF ? PixelFormat::Half : PixelFormat::Float,
-                    {width, height}, channelNames, nullptr, alloc);
+        PixelFormat format = EXRChannels(file.header(), &channelNames);
+        Image image(format, {width, height}, channelNames, nullptr, alloc);
         file.setFrameBuffer(imageToFrameBuffer(image, image.AllChannelsDesc(), dw));
         file.readPixels(dw.min.y, dw.max.y);
 
@@ -1150,80 +1383,85 @@ static ImageAndMetadata ReadEXR(const std::string &name, Allocator alloc) {
     return {};
 }
 
+// Returns an EXR header for an image with the given resolution and
+// metadata; the caller adds the image's channels to it.
+static Imf::Header EXRHeader(Point2i resolution, const ImageMetadata &metadata) {
+    Imath::Box2i displayWindow, dataWindow;
+    if (metadata.fullResolution)
+        // Agan, -1 offsets to handle inclusive indexing in OpenEXR...
+        displayWindow = {Imath::V2i(0, 0),
+                         Imath::V2i(metadata.fullResolution->x - 1,
+                                    metadata.fullResolution->y - 1)};
+    else
+        displayWindow = {Imath::V2i(0, 0),
+                         Imath::V2i(resolution.x - 1, resolution.y - 1)};
+
+    if (metadata.pixelBounds)
+        dataWindow = {
+            Imath::V2i(metadata.pixelBounds->pMin.x, metadata.pixelBounds->pMin.y),
+            Imath::V2i(metadata.pixelBounds->pMax.x - 1,
+                       metadata.pixelBounds->pMax.y - 1)};
+    else
+        dataWindow = {Imath::V2i(0, 0), Imath::V2i(resolution.x - 1, resolution.y - 1)};
+
+    Imf::Header header(displayWindow, dataWindow);
+    if (metadata.renderTimeSeconds)
+        header.insert("renderTimeSeconds",
+                      Imf::FloatAttribute(*metadata.renderTimeSeconds));
+    if (metadata.cameraFromWorld) {
+        float m[4][4];
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                m[i][j] = (*metadata.cameraFromWorld)[i][j];
+        header.insert("worldToCamera", Imf::M44fAttribute(m));
+    }
+    if (metadata.NDCFromWorld) {
+        float m[4][4];
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                m[i][j] = (*metadata.NDCFromWorld)[i][j];
+        header.insert("worldToNDC", Imf::M44fAttribute(m));
+    }
+    if (metadata.samplesPerPixel)
+        header.insert("samplesPerPixel", Imf::IntAttribute(*metadata.samplesPerPixel));
+    if (metadata.estimatedVariance)
+        header.insert("estimatedVariance",
+                      Imf::FloatAttribute(*metadata.estimatedVariance));
+    if (metadata.MSE)
+        header.insert("MSE", Imf::FloatAttribute(*metadata.MSE));
+    for (const auto &iter : metadata.stringVectors)
+        header.insert(iter.first, Imf::StringVectorAttribute(iter.second));
+
+    // The OpenEXR spec says that the default is sRGB if no
+    // chromaticities are provided.  It should be innocuous to write
+    // the sRGB primaries anyway, but for completely indecipherable
+    // reasons, OSX's Preview.app decides to gamma correct the pixels
+    // in EXR files if it finds primaries.  So, we don't write them in
+    // that case in the interests of nicer looking images on the
+    // screen.
+    if (*metadata.GetColorSpace() != *RGBColorSpace::sRGB) {
+        const RGBColorSpace &cs = *metadata.GetColorSpace();
+        Imf::Chromaticities chromaticities(
+            Imath::V2f(cs.r.x, cs.r.y), Imath::V2f(cs.g.x, cs.g.y),
+            Imath::V2f(cs.b.x, cs.b.y), Imath::V2f(cs.w.x, cs.w.y));
+        header.insert("chromaticities", Imf::ChromaticitiesAttribute(chromaticities));
+    }
+    return header;
+}
+
 bool Image::WriteEXR(const std::string &name, const ImageMetadata &metadata) const {
     if (Is8Bit(format))
         return ConvertToFormat(PixelFormat::Half).WriteEXR(name, metadata);
     CHECK(Is16Bit(format) || Is32Bit(format));
 
+    InitEXRThreads();
     try {
-        Imath::Box2i displayWindow, dataWindow;
-        if (metadata.fullResolution)
-            // Agan, -1 offsets to handle inclusive indexing in OpenEXR...
-            displayWindow = {Imath::V2i(0, 0),
-                             Imath::V2i(metadata.fullResolution->x - 1,
-                                        metadata.fullResolution->y - 1)};
-        else
-            displayWindow = {Imath::V2i(0, 0),
-                             Imath::V2i(resolution.x - 1, resolution.y - 1)};
-
-        if (metadata.pixelBounds)
-            dataWindow = {
-                Imath::V2i(metadata.pixelBounds->pMin.x, metadata.pixelBounds->pMin.y),
-                Imath::V2i(metadata.pixelBounds->pMax.x - 1,
-                           metadata.pixelBounds->pMax.y - 1)};
-        else
-            dataWindow = {Imath::V2i(0, 0),
-                          Imath::V2i(resolution.x - 1, resolution.y - 1)};
-
-        Imf::FrameBuffer fb = imageToFrameBuffer(*this, AllChannelsDesc(), dataWindow);
-
-        Imf::Header header(displayWindow, dataWindow);
+        Imf::Header header = EXRHeader(resolution, metadata);
+        Imf::FrameBuffer fb =
+            imageToFrameBuffer(*this, AllChannelsDesc(), header.dataWindow());
         for (auto iter = fb.begin(); iter != fb.end(); ++iter)
             header.channels().insert(iter.name(), iter.slice().type);
 
-        if (metadata.renderTimeSeconds)
-            header.insert("renderTimeSeconds",
-                          Imf::FloatAttribute(*metadata.renderTimeSeconds));
-        if (metadata.cameraFromWorld) {
-            float m[4][4];
-            for (int i = 0; i < 4; ++i)
-                for (int j = 0; j < 4; ++j)
-                    m[i][j] = (*metadata.cameraFromWorld)[i][j];
-            header.insert("worldToCamera", Imf::M44fAttribute(m));
-        }
-        if (metadata.NDCFromWorld) {
-            float m[4][4];
-            for (int i = 0; i < 4; ++i)
-                for (int j = 0; j < 4; ++j)
-                    m[i][j] = (*metadata.NDCFromWorld)[i][j];
-            header.insert("worldToNDC", Imf::M44fAttribute(m));
-        }
-        if (metadata.samplesPerPixel)
-            header.insert("samplesPerPixel",
-                          Imf::IntAttribute(*metadata.samplesPerPixel));
-        if (metadata.estimatedVariance)
-            header.insert("estimatedVariance",
-                          Imf::FloatAttribute(*metadata.estimatedVariance));
-        if (metadata.MSE)
-            header.insert("MSE", Imf::FloatAttribute(*metadata.MSE));
-        for (const auto &iter : metadata.stringVectors)
-            header.insert(iter.first, Imf::StringVectorAttribute(iter.second));
-
-        // The OpenEXR spec says that the default is sRGB if no
-        // chromaticities are provided.  It should be innocuous to write
-        // the sRGB primaries anyway, but for completely indecipherable
-        // reasons, OSX's Preview.app decides to gamma correct the pixels
-        // in EXR files if it finds primaries.  So, we don't write them in
-        // that case in the interests of nicer looking images on the
-        // screen.
-        if (*metadata.GetColorSpace() != *RGBColorSpace::sRGB) {
-            const RGBColorSpace &cs = *metadata.GetColorSpace();
-            Imf::Chromaticities chromaticities(
-                Imath::V2f(cs.r.x, cs.r.y), Imath::V2f(cs.g.x, cs.g.y),
-                Imath::V2f(cs.b.x, cs.b.y), Imath::V2f(cs.w.x, cs.w.y));
-            header.insert("chromaticities", Imf::ChromaticitiesAttribute(chromaticities));
-        }
-
         Imf::OutputFile file(name.c_str(), header);
         file.setFrameBuffer(fb);
         file.writePixels(resolution.y);
@@ -1238,6 +1476,27 @@ bool Image::WriteEXR(const std::string &name, const ImageMetadata &metadata) con
 ///////////////////////////////////////////////////////////////////////////
 // PNG Function Definitions
 
+// Converts the decoded 16-bit values of a PNG to the image's half-precision
+// linear texels, a batch of rows at a time.
+static void Convert16BitPNG(const std::vector<unsigned char> &buf,
+                            ColorEncodingHandle encoding, Image *image) {
+    int nc = image->NChannels();
+    Point2i res = image->Resolution();
+    size_t rowBytes = 2 * nc * size_t(res.x);
+    CHECK_EQ(buf.size(), rowBytes * res.y);
+    ParallelFor(0, res.y, [&](int64_t y0, int64_t y1) {
+        for (int y = y0; y < y1; ++y) {
+            const unsigned char *p = &buf[rowBytes * y];
+            for (int x = 0; x < res.x; ++x)
+                for (int c = 0; c < nc; ++c, p += 2) {
+                    // Convert from big endian.
+                    Float v = (((int)p[0] << 8) + (int)p[1]) / 65535.f;
+                    image->SetChannel({x, y}, c, encoding.ToFloatLinear(v));
+                }
+        }
+    });
+}
+
 static ImageAndMetadata ReadPNG(const std::string &name, Allocator alloc,
                                 ColorEncodingHandle encoding) {
     std::string contents = ReadFileContents(name);
@@ -1267,15 +1526,7 @@ static ImageAndMetadata ReadPNG(const std::string &name, Allocator alloc,
 
         if (state.info_png.color.bitdepth == 16) {
             image = Image(PixelFormat::Half, Point2i(width, height), {"Y"});
-            auto bufIter = buf.begin();
-            for (unsigned int y = 0; y < height; ++y)
-                for (unsigned int x = 0; x < width; ++x, bufIter += 2) {
-                    // Convert from little endian.
-                    Float v = (((int)bufIter[0] << 8) + (int)bufIter[1]) / 65535.f;
-                    v = encoding.ToFloatLinear(v);
-                    image.SetChannel(Point2i(x, y), 0, v);
-                }
-            CHECK(bufIter == buf.end());
+            Convert16BitPNG(buf, encoding, &image);
         } else {
             image = Image(PixelFormat::U256, Point2i(width, height), {"Y"}, encoding);
             std::copy(buf.begin(), buf.end(), (uint8_t *)image.RawPointer({0, 0}));
@@ -1299,39 +1550,10 @@ static ImageAndMetadata ReadPNG(const std::string &name, Allocator alloc,
             if (hasAlpha) {
                 image = Image(PixelFormat::Half, Point2i(width, height),
                               {"R", "G", "B", "A"});
-                auto bufIter = buf.begin();
-                for (unsigned int y = 0; y < height; ++y)
-                    for (unsigned int x = 0; x < width; ++x, bufIter += 8) {
-                        CHECK(bufIter < buf.end());
-                        // Convert from little endian.
-                        Float rgba[4] = {
-                            (((int)bufIter[0] << 8) + (int)bufIter[1]) / 65535.f,
-                            (((int)bufIter[2] << 8) + (int)bufIter[3]) / 65535.f,
-                            (((int)bufIter[4] << 8) + (int)bufIter[5]) / 65535.f,
-                            (((int)bufIter[6] << 8) + (int)bufIter[7]) / 65535.f};
-                        for (int c = 0; c < 4; ++c) {
-                            rgba[c] = encoding.ToFloatLinear(rgba[c]);
-                            image.SetChannel(Point2i(x, y), c, rgba[c]);
-                        }
-                    }
-                CHECK(bufIter == buf.end());
+                Convert16BitPNG(buf, encoding, &image);
             } else {
                 image = Image(PixelFormat::Half, Point2i(width, height), {"R", "G", "B"});
-                auto bufIter = buf.begin();
-                for (unsigned int y = 0; y < height; ++y)
-                    for (unsigned int x = 0; x < width; ++x, bufIter += 6) {
-                        CHECK(bufIter < buf.end());
-                        // Convert from little endian.
-                        Float rgb[3] = {
-                            (((int)bufIter[0] << 8) + (int)bufIter[1]) / 65535.f,
-                            (((int)bufIter[2] << 8) + (int)bufIter[3]) / 65535.f,
-                            (((int)bufIter[4] << 8) + (int)bufIter[5]) / 65535.f};
-                        for (int c = 0; c < 3; ++c) {
-                            rgb[c] = encoding.ToFloatLinear(rgb[c]);
-                            image.SetChannel(Point2i(x, y), c, rgb[c]);
-                        }
-                    }
-                CHECK(bufIter == buf.end());
+                Convert16BitPNG(buf, encoding, &image);
             }
         } else if (hasAlpha) {
             image = Image(PixelFormat::U256, Point2i(width, height), {"R", "G", "B", "A"},
@@ -1468,120 +1690,130 @@ static constexpr bool hostLittleEndian =
 #endif
     ;
 
-#define BUFFER_SIZE 80
-
 static inline int isWhitespace(char c) {
     return static_cast<int>(c == ' ' || c == '\n' || c == '\t');
 }
 
-// Reads a "word" from the fp and puts it into buffer and adds a null
-// terminator.  i.e. it keeps reading until whitespace is reached.  Returns
-// the number of characters read *not* including the whitespace, and
-// returns -1 on an error.
-static int readWord(FILE *fp, char *buffer, int bufferLength) {
-    int n;
-    int c;
-
-    if (bufferLength < 1)
-        return -1;
-
-    n = 0;
-    c = fgetc(fp);
-    while (c != EOF && (isWhitespace(c) == 0) && n < bufferLength) {
-        buffer[n] = c;
-        ++n;
-        c = fgetc(fp);
-    }
-
-    if (n < bufferLength) {
-        buffer[n] = '\0';
-        return n;
-    }
-
-    return -1;
+// Reads a "word" starting at *pos, skipping the whitespace that follows it,
+// and advances *pos past it. Returns an empty string if the end of the
+// data is reached first.
+static std::string readWord(const uint8_t *data, size_t size, size_t *pos) {
+    size_t start = *pos;
+    while (*pos < size && isWhitespace(data[*pos]) == 0)
+        ++*pos;
+    if (*pos == size)
+        return {};
+    std::string word((const char *)data + start, *pos - start);
+    ++*pos;
+    return word;
 }
 
-static ImageAndMetadata ReadPFM(const std::string &filename, Allocator alloc) {
-    pstd::vector<float> rgb32(alloc);
-    char buffer[BUFFER_SIZE];
-    unsigned int nFloats;
+// PFMFile Definition
+// A mapped PFM file along with the information in its header.
+struct PFMFile {
+    std::unique_ptr<MappedFile> file;
     int nChannels, width, height;
     float scale;
-    bool fileLittleEndian;
-    ImageMetadata metadata;
+    // Offset of the first pixel in the file
+    size_t pixelOffset;
+};
+
+static PFMFile OpenPFM(const std::string &filename) {
+    PFMFile pfm;
 
-    FILE *fp = fopen(filename.c_str(), "rb");
-    if (fp == nullptr)
+    // Map the file so that the pixels can be converted directly from it
+    pfm.file = MappedFile::Open(filename);
+    if (!pfm.file)
         ErrorExit("%s: unable to open PFM file", filename);
+    const uint8_t *data = pfm.file->data();
+    size_t size = pfm.file->size(), pos = 0;
 
     // read either "Pf" or "PF"
-    if (readWord(fp, buffer, BUFFER_SIZE) == -1)
+    std::string word = readWord(data, size, &pos);
+    if (word == "Pf")
+        pfm.nChannels = 1;
+    else if (word == "PF")
+        pfm.nChannels = 3;
+    else if (word.empty())
         ErrorExit("%s: unable to read PFM file", filename);
-
-    if (strcmp(buffer, "Pf") == 0)
-        nChannels = 1;
-    else if (strcmp(buffer, "PF") == 0)
-        nChannels = 3;
     else
-        ErrorExit("%s: unable to decode PFM file type \"%c%c\"", filename, buffer[0],
-                  buffer[1]);
+        ErrorExit("%s: unable to decode PFM file type \"%s\"", filename, word);
 
     // read the rest of the header
     // read width
-    if (readWord(fp, buffer, BUFFER_SIZE) == -1)
-        goto fail;
-    if (!Atoi(buffer, &width))
-        ErrorExit("%s: unable to decode width \"%s\"", filename, buffer);
+    if ((word = readWord(data, size, &pos)).empty())
+        ErrorExit("%s: premature end of file in PFM file", filename);
+    if (!Atoi(word, &pfm.width))
+        ErrorExit("%s: unable to decode width \"%s\"", filename, word);
 
     // read height
-    if (readWord(fp, buffer, BUFFER_SIZE) == -1)
-        goto fail;
-    if (!Atoi(buffer, &height))
-        ErrorExit("%s: unable to decode height \"%s\"", filename, buffer);
+    if ((word = readWord(data, size, &pos)).empty())
+        ErrorExit("%s: premature end of file in PFM file", filename);
+    if (!Atoi(word, &pfm.height))
+        ErrorExit("%s: unable to decode height \"%s\"", filename, word);
 
     // read scale
-    if (readWord(fp, buffer, BUFFER_SIZE) == -1)
-        goto fail;
-    if (!Atof(buffer, &scale))
-        ErrorExit("%s: unable to decode scale \"%s\"", filename, buffer);
-
-    // read the data
-    nFloats = nChannels * width * height;
-    rgb32.resize(nFloats);
-    for (int y = height - 1; y >= 0; --y)
-        if (fread(&rgb32[nChannels * y * width], sizeof(float), nChannels * width, fp) !=
-            nChannels * width)
-            goto fail;
+    if ((word = readWord(data, size, &pos)).empty())
+        ErrorExit("%s: premature end of file in PFM file", filename);
+    if (!Atof(word, &pfm.scale))
+        ErrorExit("%s: unable to decode scale \"%s\"", filename, word);
+
+    size_t rowFloats = size_t(pfm.nChannels) * size_t(pfm.width);
+    if (pfm.width <= 0 || pfm.height <= 0 ||
+        (size - pos) / sizeof(float) / rowFloats < size_t(pfm.height))
+        ErrorExit("%s: premature end of file in PFM file", filename);
+    pfm.pixelOffset = pos;
+    return pfm;
+}
 
-    // apply endian conversian and scale if appropriate
-    fileLittleEndian = (scale < 0.f);
-    if (hostLittleEndian ^ fileLittleEndian) {
-        uint8_t bytes[4];
-        for (unsigned int i = 0; i < nFloats; ++i) {
-            memcpy(bytes, &rgb32[i], 4);
-            pstd::swap(bytes[0], bytes[3]);
-            pstd::swap(bytes[1], bytes[2]);
-            memcpy(&rgb32[i], bytes, 4);
+// Converts the scanlines [y0, y1) of a PFM file to _rgb32_, with y0 at the
+// top. The file's rows are stored bottom to top.
+static void ReadPFMRows(const PFMFile &pfm, int y0, int y1, float *rgb32) {
+    // Flip the rows and apply endian conversion and scale if appropriate,
+    // a batch of rows at a time
+    size_t rowFloats = size_t(pfm.nChannels) * size_t(pfm.width);
+    bool fileLittleEndian = (pfm.scale < 0.f);
+    bool swapBytes = hostLittleEndian ^ fileLittleEndian;
+    float absScale = std::abs(pfm.scale);
+    const uint8_t *pixels = pfm.file->data() + pfm.pixelOffset;
+    ParallelFor(y0, y1, [&](int64_t start, int64_t end) {
+        for (int64_t y = start; y < end; ++y) {
+            float *row = &rgb32[rowFloats * (y - y0)];
+            std::memcpy(row, pixels + (pfm.height - 1 - y) * rowFloats * sizeof(float),
+                        rowFloats * sizeof(float));
+            if (swapBytes)
+                for (size_t i = 0; i < rowFloats; ++i) {
+                    uint8_t bytes[4];
+                    std::memcpy(bytes, &row[i], 4);
+                    pstd::swap(bytes[0], bytes[3]);
+                    pstd::swap(bytes[1], bytes[2]);
+                    std::memcpy(&row[i], bytes, 4);
+                }
+            if (absScale != 1.f)
+                for (size_t i = 0; i < rowFloats; ++i)
+                    row[i] *= absScale;
         }
-    }
-    if (std::abs(scale) != 1.f)
-        for (unsigned int i = 0; i < nFloats; ++i)
-            rgb32[i] *= std::abs(scale);
+    });
+}
 
-    fclose(fp);
-    LOG_VERBOSE("Read PFM image %s (%d x %d)", filename, width, height);
+static ImageAndMetadata ReadPFM(const std::string &filename, Allocator alloc) {
+    PFMFile pfm = OpenPFM(filename);
+    int width = pfm.width, height = pfm.height;
+
+    // read the data
+    pstd::vector<float> rgb32(size_t(pfm.nChannels) * width * height, alloc);
+    ReadPFMRows(pfm, 0, height, rgb32.data());
+
+    LOG_VERBOSE("Read PFM image %s (%d x %d)%s", filename, width, height,
+                pfm.file->IsMemoryMapped() ? " from mapped file" : "");
+    ImageMetadata metadata;
     metadata.colorSpace = RGBColorSpace::sRGB;
-    if (nChannels == 1)
+    if (pfm.nChannels == 1)
         return ImageAndMetadata{Image(std::move(rgb32), {width, height}, {"Y"}),
                                 metadata};
     else
         return ImageAndMetadata{Image(std::move(rgb32), {width, height}, {"R", "G", "B"}),
                                 metadata};
-
-fail:
-    if (fp != nullptr)
-        fclose(fp);
-    ErrorExit("%s: premature end of file in PFM file", filename);
 }
 
 static ImageAndMetadata ReadHDR(const std::string &filename, Allocator alloc) {
@@ -1669,4 +1901,435 @@ fail:
     return false;
 }
 
+
+///////////////////////////////////////////////////////////////////////////
+// Raw float images
+
+// The raw format stores a header followed by 32-bit float pixels in the
+// host's byte order, with rows from top to bottom. The pixels start at a
+// multiple of the page size so that images can use them directly from the
+// mapped file.
+static constexpr char rawImageMagic[8] = {'p', 'b', 'r', 't', 'r', 'a', 'w', '1'};
+
+static size_t RawPixelOffset(size_t headerSize) {
+    constexpr size_t alignment = 4096;
+    return (headerSize + alignment - 1) / alignment * alignment;
+}
+
+template <typename T>
+static bool ReadRawValue(const uint8_t *data, size_t size, size_t *pos, T *v) {
+    if (size - *pos < sizeof(T))
+        return false;
+    std::memcpy(v, data + *pos, sizeof(T));
+    *pos += sizeof(T);
+    return true;
+}
+
+// RawImageHeader Definition
+struct RawImageHeader {
+    Point2i resolution;
+    std::vector<std::string> channelNames;
+    const RGBColorSpace *colorSpace;
+    // Offset of the first pixel in the file
+    size_t pixelOffset;
+};
+
+static RawImageHeader ReadRawHeader(const MappedFile &file, const std::string &filename) {
+    const uint8_t *data = file.data();
+    size_t size = file.size(), pos = sizeof(rawImageMagic);
+
+    // Read and validate the header
+    RawImageHeader header;
+    int byteOrder, format, nChannels;
+    Point2i &resolution = header.resolution;
+    Point2f r, g, b, w;
+    bool success = size >= sizeof(rawImageMagic) &&
+                   memcmp(data, rawImageMagic, sizeof(rawImageMagic)) == 0 &&
+                   ReadRawValue(data, size, &pos, &byteOrder) && byteOrder == 1 &&
+                   ReadRawValue(data, size, &pos, &format) &&
+                   format == int(PixelFormat::Float) &&
+                   ReadRawValue(data, size, &pos, &resolution) && resolution.x > 0 &&
+                   resolution.y > 0 && ReadRawValue(data, size, &pos, &nChannels) &&
+                   nChannels > 0 && nChannels <= 256;
+    for (int c = 0; success && c < nChannels; ++c) {
+        int length;
+        success = ReadRawValue(data, size, &pos, &length) && length >= 0 &&
+                  length <= 256 && size - pos >= size_t(length);
+        if (success) {
+            header.channelNames.push_back(std::string((const char *)data + pos, length));
+            pos += length;
+        }
+    }
+    success = success && ReadRawValue(data, size, &pos, &r) &&
+              ReadRawValue(data, size, &pos, &g) && ReadRawValue(data, size, &pos, &b) &&
+              ReadRawValue(data, size, &pos, &w);
+    header.pixelOffset = RawPixelOffset(pos);
+    size_t nFloats = size_t(nChannels) * resolution.x * resolution.y;
+    if (!success || header.pixelOffset > size ||
+        (size - header.pixelOffset) / sizeof(float) < nFloats)
+        ErrorExit("%s: raw image file is corrupt or was written on a machine with a "
+                  "different byte order.",
+                  filename);
+
+    header.colorSpace = RGBColorSpace::Lookup(r, g, b, w);
+    if (!header.colorSpace) {
+        Warning("%s: couldn't find supported color space that matches chromaticities: "
+                "r %s g %s b %s w %s. Using sRGB.",
+                filename, r, g, b, w);
+        header.colorSpace = RGBColorSpace::sRGB;
+    }
+    return header;
+}
+
+static bool WriteRawHeader(FILE *fp, Point2i resolution,
+                           pstd::span<const std::string> channelNames,
+                           const RGBColorSpace *colorSpace) {
+    int byteOrder = 1, format = int(PixelFormat::Float), nChannels = channelNames.size();
+    bool success = fwrite(rawImageMagic, sizeof(rawImageMagic), 1, fp) == 1 &&
+                   fwrite(&byteOrder, sizeof(int), 1, fp) == 1 &&
+                   fwrite(&format, sizeof(int), 1, fp) == 1 &&
+                   fwrite(&resolution, sizeof(Point2i), 1, fp) == 1 &&
+                   fwrite(&nChannels, sizeof(int), 1, fp) == 1;
+    for (const std::string &channel : channelNames) {
+        int length = channel.size();
+        success = success && fwrite(&length, sizeof(int), 1, fp) == 1 &&
+                  fwrite(channel.data(), 1, length, fp) == size_t(length);
+    }
+    for (const Point2f &p :
+         {colorSpace->r, colorSpace->g, colorSpace->b, colorSpace->w})
+        success = success && fwrite(&p, sizeof(Point2f), 1, fp) == 1;
+
+    size_t headerSize = ftell(fp);
+    std::vector<char> padding(RawPixelOffset(headerSize) - headerSize, 0);
+    return success && fwrite(padding.data(), 1, padding.size(), fp) == padding.size();
+}
+
+static ImageAndMetadata ReadRaw(const std::string &filename, Allocator alloc) {
+    std::shared_ptr<const MappedFile> file = MappedFile::Open(filename);
+    if (!file)
+        ErrorExit("%s: unable to open raw image file: %s", filename, ErrorString());
+    RawImageHeader header = ReadRawHeader(*file, filename);
+
+    ImageMetadata metadata;
+    metadata.colorSpace = header.colorSpace;
+    Point2i resolution = header.resolution;
+    const float *pixels = (const float *)(file->data() + header.pixelOffset);
+    // Memory that comes from other allocators may need to be visible to the
+    // GPU, so the pixels are only used in place with the default one.
+    if (alloc.resource() == pstd::pmr::new_delete_resource())
+        return ImageAndMetadata{Image(file, pixels, resolution, header.channelNames),
+                                metadata};
+    size_t nFloats = header.channelNames.size() * size_t(resolution.x) * resolution.y;
+    pstd::vector<float> p32(pixels, pixels + nFloats, alloc);
+    return ImageAndMetadata{Image(std::move(p32), resolution, header.channelNames),
+                            metadata};
+}
+
+bool Image::WriteRaw(const std::string &name, const ImageMetadata &metadata) const {
+    if (format != PixelFormat::Float)
+        return ConvertToFormat(PixelFormat::Float).WriteRaw(name, metadata);
+
+    FILE *fp = fopen(name.c_str(), "wb");
+    if (fp == nullptr) {
+        Error("%s: unable to open output raw image file: %s", name, ErrorString());
+        return false;
+    }
+
+    size_t nFloats = NChannels() * size_t(resolution.x) * resolution.y;
+    bool success =
+        WriteRawHeader(fp, resolution, channelNames, metadata.GetColorSpace()) &&
+        fwrite(P32(), sizeof(float), nFloats, fp) == nFloats;
+    if (fclose(fp) != 0 || !success) {
+        Error("%s: error writing raw image file: %s", name, ErrorString());
+        return false;
+    }
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+// Streaming Image I/O
+
+// Wrappers that allow the OpenEXR classes to be used without declaring
+// them in image.h
+struct EXRInputFile {
+    EXRInputFile(const std::string &filename) : file(filename.c_str()) {}
+    Imf::InputFile file;
+};
+
+struct EXROutputFile {
+    EXROutputFile(const std::string &filename, const Imf::Header &header)
+        : file(filename.c_str(), header) {}
+    Imf::OutputFile file;
+};
+
+// ImageScanlineReader Method Definitions
+std::unique_ptr<ImageScanlineReader> ImageScanlineReader::Open(
+    const std::string &filename) {
+    std::unique_ptr<ImageScanlineReader> reader(new ImageScanlineReader);
+    reader->filename = filename;
+
+    if (HasExtension(filename, "exr")) {
+        InitEXRThreads();
+        try {
+            reader->exrFile = std::make_unique<EXRInputFile>(filename);
+        } catch (const std::exception &e) {
+            Error("Unable to read image file \"%s\": %s", filename, e.what());
+            return {};
+        }
+        const Imf::Header &header = reader->exrFile->file.header();
+        reader->metadata = EXRMetadata(header);
+        reader->format = EXRChannels(header, &reader->channelNames);
+        Imath::Box2i dw = header.dataWindow();
+        reader->resolution = Point2i(dw.max.x - dw.min.x + 1, dw.max.y - dw.min.y + 1);
+    } else if (HasExtension(filename, "pfm")) {
+        // The PFM's rows are converted from the mapped file as they're read
+        reader->pfmFile = std::make_unique<PFMFile>(OpenPFM(filename));
+        reader->format = PixelFormat::Float;
+        reader->resolution = Point2i(reader->pfmFile->width, reader->pfmFile->height);
+        if (reader->pfmFile->nChannels == 1)
+            reader->channelNames = {"Y"};
+        else
+            reader->channelNames = {"R", "G", "B"};
+        reader->metadata.colorSpace = RGBColorSpace::sRGB;
+    } else if (HasExtension(filename, "praw")) {
+        reader->rawFile = MappedFile::Open(filename);
+        if (!reader->rawFile) {
+            Error("%s: unable to open raw image file: %s", filename, ErrorString());
+            return {};
+        }
+        RawImageHeader header = ReadRawHeader(*reader->rawFile, filename);
+        reader->format = PixelFormat::Float;
+        reader->resolution = header.resolution;
+        reader->channelNames = header.channelNames;
+        reader->metadata.colorSpace = header.colorSpace;
+        reader->rawPixelOffset = header.pixelOffset;
+    } else {
+        ImageAndMetadata im = Image::Read(filename);
+        reader->image = std::move(im.image);
+        reader->metadata = std::move(im.metadata);
+        reader->format = reader->image.Format();
+        reader->resolution = reader->image.Resolution();
+        reader->channelNames = reader->image.ChannelNames();
+    }
+
+    return reader;
+}
+
+bool ImageScanlineReader::ReadsIncrementally(const std::string &filename) {
+    return HasExtension(filename, "exr") || HasExtension(filename, "pfm") ||
+           HasExtension(filename, "praw");
+}
+
+ImageScanlineReader::~ImageScanlineReader() = default;
+
+Image ImageScanlineReader::ReadScanlines(int y0, int y1) {
+    CHECK(y0 >= 0 && y0 < y1 && y1 <= resolution.y);
+    Point2i bandRes(resolution.x, y1 - y0);
+
+    if (exrFile) {
+        Image band(format, bandRes, channelNames);
+        // Offset the data window so that scanline _y0_ is the band's first
+        Imath::Box2i dw = exrFile->file.header().dataWindow();
+        Imath::Box2i bandWindow(Imath::V2i(dw.min.x, dw.min.y + y0), dw.max);
+        try {
+            exrFile->file.setFrameBuffer(
+                imageToFrameBuffer(band, band.AllChannelsDesc(), bandWindow));
+            exrFile->file.readPixels(dw.min.y + y0, dw.min.y + y1 - 1);
+        } catch (const std::exception &e) {
+            ErrorExit("Unable to read image file \"%s\": %s", filename, e.what());
+        }
+        return band;
+    } else if (pfmFile) {
+        pstd::vector<float> rgb32(size_t(NChannels()) * bandRes.x * bandRes.y);
+        ReadPFMRows(*pfmFile, y0, y1, rgb32.data());
+        return Image(std::move(rgb32), bandRes, channelNames);
+    } else if (rawFile) {
+        // The band's pixels are used in place in the mapped file
+        const float *pixels = (const float *)(rawFile->data() + rawPixelOffset);
+        return Image(rawFile, pixels + size_t(y0) * NChannels() * resolution.x, bandRes,
+                     channelNames);
+    } else
+        return image.Crop(Bounds2i({0, y0}, {resolution.x, y1}));
+}
+
+std::string ImageScanlineReader::ToString() const {
+    return StringPrintf("[ ImageScanlineReader filename: %s format: %s resolution: %s "
+                        "channelNames: %s metadata: %s ]",
+                        filename, format, resolution, channelNames, metadata);
+}
+
+// ImageScanlineWriter Method Definitions
+std::unique_ptr<ImageScanlineWriter> ImageScanlineWriter::Create(
+    const std::string &filename, PixelFormat format, Point2i resolution,
+    pstd::span<const std::string> channelNames, const ImageMetadata &metadata) {
+    if (metadata.pixelBounds)
+        CHECK_EQ(metadata.pixelBounds->Area(), resolution.x * resolution.y);
+
+    std::unique_ptr<ImageScanlineWriter> writer(new ImageScanlineWriter);
+    writer->filename = filename;
+    writer->format = format;
+    writer->resolution = resolution;
+    writer->channelNames.assign(channelNames.begin(), channelNames.end());
+    writer->metadata = metadata;
+
+    bool pfm = HasExtension(filename, "pfm");
+    if (HasExtension(filename, "exr")) {
+        // As in Image::WriteEXR(), 8-bit images are written as half floats
+        if (Is8Bit(format))
+            writer->format = PixelFormat::Half;
+        Imf::PixelType pixelType =
+            writer->format == PixelFormat::Half ? Imf::HALF : Imf::FLOAT;
+
+        InitEXRThreads();
+        try {
+            Imf::Header header = EXRHeader(resolution, metadata);
+            for (const std::string &name : channelNames)
+                header.channels().insert(name, Imf::Channel(pixelType));
+            writer->exrFile = std::make_unique<EXROutputFile>(filename, header);
+        } catch (const std::exception &exc) {
+            Error("%s: error writing EXR: %s", filename, exc.what());
+            return {};
+        }
+    } else if (pfm || HasExtension(filename, "praw")) {
+        if (pfm && channelNames.size() != 1 && channelNames.size() != 3) {
+            Error("%s: unable to write an %d channel image in this format.", filename,
+                  channelNames.size());
+            return {};
+        }
+        writer->format = PixelFormat::Float;
+
+        writer->file = fopen(filename.c_str(), "wb");
+        if (!writer->file) {
+            Error("%s: unable to open output image file: %s", filename, ErrorString());
+            return {};
+        }
+        bool success;
+        if (pfm) {
+            float scale = hostLittleEndian ? -1.f : 1.f;
+            success = fprintf(writer->file, "PF\n%d %d\n%f\n", resolution.x,
+                              resolution.y, scale) > 0;
+        } else
+            success = WriteRawHeader(writer->file, resolution, channelNames,
+                                     metadata.GetColorSpace());
+        if (!success) {
+            Error("%s: error writing image file: %s", filename, ErrorString());
+            return {};
+        }
+        writer->pixelOffset = ftell(writer->file);
+    } else
+        writer->image = Image(format, resolution, channelNames);
+
+    return writer;
+}
+
+bool ImageScanlineWriter::WritesIncrementally(const std::string &filename) {
+    return HasExtension(filename, "exr") || HasExtension(filename, "pfm") ||
+           HasExtension(filename, "praw");
+}
+
+ImageScanlineWriter::~ImageScanlineWriter() {
+    if (file)
+        fclose(file);
+}
+
+bool ImageScanlineWriter::WriteScanlines(const Image &band) {
+    CHECK_EQ(band.Resolution().x, resolution.x);
+    CHECK_EQ(band.NChannels(), channelNames.size());
+    int y0 = nextY, y1 = nextY + band.Resolution().y;
+    CHECK_LE(y1, resolution.y);
+    nextY = y1;
+
+    if (!exrFile && !file) {
+        // Hold on to the scanlines until Close() writes the image
+        for (int y = y0; y < y1; ++y)
+            for (int x = 0; x < resolution.x; ++x)
+                image.SetChannels({x, y}, band.GetChannels({x, y - y0}));
+        return true;
+    }
+
+    Image converted;
+    const Image *pixels = &band;
+    if (band.Format() != format) {
+        converted = band.ConvertToFormat(format);
+        pixels = &converted;
+    }
+
+    if (exrFile) {
+        // Offset the data window so that the band's first scanline is _y0_
+        Imath::Box2i dw = exrFile->file.header().dataWindow();
+        Imath::Box2i bandWindow(Imath::V2i(dw.min.x, dw.min.y + y0), dw.max);
+        try {
+            exrFile->file.setFrameBuffer(
+                imageToFrameBuffer(*pixels, pixels->AllChannelsDesc(), bandWindow));
+            exrFile->file.writePixels(y1 - y0);
+        } catch (const std::exception &exc) {
+            Error("%s: error writing EXR: %s", filename, exc.what());
+            return false;
+        }
+        return true;
+    }
+
+    // Write the scanlines to the PFM or raw file
+    const float *data = (const float *)pixels->RawPointer({0, 0});
+    size_t nFloats = size_t(band.NChannels()) * resolution.x * (y1 - y0);
+    int64_t offset = pixelOffset + sizeof(float) * size_t(y0) * band.NChannels() *
+                                       resolution.x;
+    std::vector<float> pfmRows;
+    if (HasExtension(filename, "pfm")) {
+        // As in Image::WritePFM(), there are always three channels in RGB
+        // order, and the rows are stored from bottom to top.
+        size_t rowFloats = 3 * size_t(resolution.x);
+        ImageChannelDesc rgbDesc = pixels->GetChannelDesc({"R", "G", "B"});
+        pfmRows.resize(rowFloats * (y1 - y0));
+        for (int y = y0; y < y1; ++y) {
+            float *row = &pfmRows[rowFloats * (y1 - 1 - y)];
+            for (int x = 0; x < resolution.x; ++x)
+                for (int c = 0; c < 3; ++c) {
+                    int channel = pixels->NChannels() == 1 ? 0
+                                  : rgbDesc                ? rgbDesc.offset[c]
+                                                           : c;
+                    row[3 * x + c] = pixels->GetChannel({x, y - y0}, channel);
+                }
+        }
+        data = pfmRows.data();
+        nFloats = pfmRows.size();
+        offset = pixelOffset + sizeof(float) * rowFloats * size_t(resolution.y - y1);
+    }
+
+#ifdef PBRT_IS_WINDOWS
+    bool success = _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+    bool success = fseeko(file, offset, SEEK_SET) == 0;
+#endif
+    success = success && fwrite(data, sizeof(float), nFloats, file) == nFloats;
+    if (!success)
+        Error("%s: error writing image file: %s", filename, ErrorString());
+    return success;
+}
+
+bool ImageScanlineWriter::Close() {
+    CHECK_EQ(nextY, resolution.y);
+    if (exrFile) {
+        // The OpenEXR file is finished when it is destroyed
+        exrFile.reset();
+        return true;
+    } else if (file) {
+        int err = fclose(file);
+        file = nullptr;
+        if (err != 0) {
+            Error("%s: error writing image file: %s", filename, ErrorString());
+            return false;
+        }
+        return true;
+    } else
+        return image.Write(filename, metadata);
+}
+
+std::string ImageScanlineWriter::ToString() const {
+    return StringPrintf("[ ImageScanlineWriter filename: %s format: %s resolution: %s "
+                        "channelNames: %s metadata: %s nextY: %d ]",
+                        filename, format, resolution, channelNames, metadata, nextY);
+}
+
 }  // namespace pbrt
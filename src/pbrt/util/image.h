@@ -16,9 +16,11 @@
 #include <pbrt/util/vecmath.h>
 
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <functional>
 #include <map>
+#include <memory>
 #include <vector>
 
 namespace pbrt {
@@ -163,6 +165,7 @@ struct ImageMetadata {
 };
 
 struct ImageAndMetadata;
+class MappedFile;
 
 // ImageChannelDesc Definition
 struct ImageChannelDesc {
@@ -226,6 +229,10 @@ class Image {
           pstd::span<const std::string> channels);
     Image(pstd::vector<float> p32, Point2i resolution,
           pstd::span<const std::string> channels);
+    // Creates an image that uses float pixels stored in a mapped file
+    // without copying them; they're copied if the image is modified.
+    Image(std::shared_ptr<const MappedFile> file, const float *p32, Point2i resolution,
+          pstd::span<const std::string> channels);
     Image(PixelFormat format, Point2i resolution, pstd::span<const std::string> channels,
           ColorEncodingHandle encoding = nullptr, Allocator alloc = {});
 
@@ -267,7 +274,7 @@ class Image {
         case PixelFormat::Half:
             return Float(p16[PixelOffset(p) + c]);
         case PixelFormat::Float:
-            return p32[PixelOffset(p) + c];
+            return P32()[PixelOffset(p) + c];
         default:
             LOG_FATAL("Unhandled PixelFormat");
             return 0;
@@ -279,9 +286,8 @@ class Image {
     ImageChannelValues GetChannels(Point2i p, const ImageChannelDesc &desc,
                                    WrapMode2D wrapMode = WrapMode::Clamp) const;
 
-    // FIXME: could be / should be const...
     void CopyRectOut(const Bounds2i &extent, pstd::span<float> buf,
-                     WrapMode2D wrapMode = WrapMode::Clamp);
+                     WrapMode2D wrapMode = WrapMode::Clamp) const;
     void CopyRectIn(const Bounds2i &extent, pstd::span<const float> buf);
 
     PBRT_CPU_GPU
@@ -320,6 +326,10 @@ class Image {
 #endif
             value = 0;
         }
+#ifndef PBRT_IS_GPU_CODE
+        if (mappedP32)
+            CopyMappedPixels();
+#endif
 
         switch (format) {
         case PixelFormat::U256:
@@ -357,8 +367,14 @@ class Image {
     std::vector<std::string> ChannelNames(const ImageChannelDesc &) const;
     const ColorEncodingHandle Encoding() const { return encoding; }
 
+    // Includes the size of pixels that are stored in a mapped file
     PBRT_CPU_GPU
-    size_t BytesUsed() const { return p8.size() + 2 * p16.size() + 4 * p32.size(); }
+    size_t BytesUsed() const {
+        size_t n32 = mappedP32 ? NChannels() * size_t(resolution.x) * resolution.y
+                               : p32.size();
+        return p8.size() + 2 * p16.size() + 4 * n32;
+    }
+    bool IsMemoryMapped() const { return mappedP32 != nullptr; }
 
     ImageChannelValues Average(const ImageChannelDesc &desc) const;
     ImageChannelValues L1Error(const ImageChannelDesc &desc, const Image &ref,
@@ -371,7 +387,7 @@ class Image {
     PBRT_CPU_GPU
     size_t PixelOffset(Point2i p) const {
         DCHECK(InsideExclusive(p, Bounds2i({0, 0}, resolution)));
-        return NChannels() * (p.y * resolution.x + p.x);
+        return NChannels() * (size_t(p.y) * resolution.x + p.x);
     }
     PBRT_CPU_GPU
     const void *RawPointer(Point2i p) const {
@@ -381,11 +397,16 @@ class Image {
             return p16.data() + PixelOffset(p);
         else {
             CHECK(Is32Bit(format));
-            return p32.data() + PixelOffset(p);
+            return P32() + PixelOffset(p);
         }
     }
     PBRT_CPU_GPU
     void *RawPointer(Point2i p) {
+#ifndef PBRT_IS_GPU_CODE
+        // The caller may write to the pixels
+        if (mappedP32)
+            CopyMappedPixels();
+#endif
         return const_cast<void *>(((const Image *)this)->RawPointer(p));
     }
 
@@ -404,6 +425,10 @@ class Image {
   private:
     static std::vector<ResampleWeight> resampleWeights(int oldRes, int newRes);
 
+    PBRT_CPU_GPU
+    const float *P32() const { return mappedP32 ? mappedP32 : p32.data(); }
+    void CopyMappedPixels();
+
     PixelFormat format;
     Point2i resolution;
     InlinedVector<std::string, 4> channelNames;
@@ -414,10 +439,16 @@ class Image {
     bool WriteEXR(const std::string &name, const ImageMetadata &metadata) const;
     bool WritePFM(const std::string &name, const ImageMetadata &metadata) const;
     bool WritePNG(const std::string &name, const ImageMetadata &metadata) const;
+    bool WriteRaw(const std::string &name, const ImageMetadata &metadata) const;
 
     pstd::vector<uint8_t> p8;
     pstd::vector<Half> p16;
     pstd::vector<float> p32;
+    // Float pixels in a memory-mapped file that are used in place of _p32_
+    // until the image is modified; _mappedFile_ keeps the mapping alive
+    // for all of the images that share it.
+    const float *mappedP32 = nullptr;
+    std::shared_ptr<const MappedFile> mappedFile;
 };
 
 // ImageAndMetadata Definition
@@ -426,6 +457,99 @@ struct ImageAndMetadata {
     ImageMetadata metadata;
 };
 
+struct EXRInputFile;
+struct EXROutputFile;
+struct PFMFile;
+
+// ImageScanlineReader Definition
+// Reads an image a band of scanlines at a time so that images that are too
+// large to fit in memory can be processed. OpenEXR (scanline or tiled),
+// PFM, and raw images are read incrementally; other formats are read in
+// full when they are opened.
+class ImageScanlineReader {
+  public:
+    // Returns nullptr if the file can't be opened.
+    static std::unique_ptr<ImageScanlineReader> Open(const std::string &filename);
+    // Returns false for formats that Open() reads in full.
+    static bool ReadsIncrementally(const std::string &filename);
+    ~ImageScanlineReader();
+
+    ImageScanlineReader(const ImageScanlineReader &) = delete;
+    ImageScanlineReader &operator=(const ImageScanlineReader &) = delete;
+
+    Point2i Resolution() const { return resolution; }
+    PixelFormat Format() const { return format; }
+    int NChannels() const { return channelNames.size(); }
+    const std::vector<std::string> &ChannelNames() const { return channelNames; }
+    const ImageMetadata &Metadata() const { return metadata; }
+    size_t ScanlineBytes() const {
+        return size_t(resolution.x) * NChannels() * TexelBytes(format);
+    }
+
+    // Returns an image holding scanlines $[y_0,y_1)$ of the image, starting
+    // with scanline $y_0$.
+    Image ReadScanlines(int y0, int y1);
+
+    std::string ToString() const;
+
+  private:
+    ImageScanlineReader() = default;
+
+    std::string filename;
+    PixelFormat format;
+    Point2i resolution;
+    std::vector<std::string> channelNames;
+    ImageMetadata metadata;
+    // Exactly one of these provides the image's pixels
+    std::unique_ptr<EXRInputFile> exrFile;
+    std::unique_ptr<PFMFile> pfmFile;
+    std::shared_ptr<const MappedFile> rawFile;
+    Image image;
+    size_t rawPixelOffset = 0;
+};
+
+// ImageScanlineWriter Definition
+// Writes an image a band of scanlines at a time, from top to bottom.
+// OpenEXR, PFM, and raw images are written as the scanlines are provided;
+// other formats are buffered in memory and written by Close().
+class ImageScanlineWriter {
+  public:
+    // Returns nullptr if the file can't be created.
+    static std::unique_ptr<ImageScanlineWriter> Create(
+        const std::string &filename, PixelFormat format, Point2i resolution,
+        pstd::span<const std::string> channelNames, const ImageMetadata &metadata = {});
+    // Returns false for formats that are buffered until Close().
+    static bool WritesIncrementally(const std::string &filename);
+    ~ImageScanlineWriter();
+
+    ImageScanlineWriter(const ImageScanlineWriter &) = delete;
+    ImageScanlineWriter &operator=(const ImageScanlineWriter &) = delete;
+
+    // Writes the scanlines of _band_, which follow the scanlines that were
+    // previously written.
+    bool WriteScanlines(const Image &band);
+    // Must be called after all of the scanlines have been written.
+    bool Close();
+
+    std::string ToString() const;
+
+  private:
+    ImageScanlineWriter() = default;
+
+    std::string filename;
+    PixelFormat format;
+    Point2i resolution;
+    std::vector<std::string> channelNames;
+    ImageMetadata metadata;
+    int nextY = 0;
+    // Exactly one of these receives the image's pixels
+    std::unique_ptr<EXROutputFile> exrFile;
+    FILE *file = nullptr;
+    Image image;
+    // Offset of the first pixel in a PFM or raw file
+    size_t pixelOffset = 0;
+};
+
 }  // namespace pbrt
 
 #endif  // PBRT_UTIL_IMAGE_H
@@ -12,8 +12,11 @@
 #include <pbrt/util/float.h>
 #include <pbrt/util/image.h>
 #include <pbrt/util/mipmap.h>
+#include <pbrt/util/print.h>
 #include <pbrt/util/rng.h>
 #include <pbrt/util/sampling.h>
+#include <pbrt/util/spectrum.h>
+#include <pbrt/util/texcache.h>
 
 #include <algorithm>
 #include <array>
@@ -302,6 +305,122 @@ TEST(Image, CopyRectIn) {
     }
 }
 
+TEST(Image, ConvertHalf) {
+    // Scanlines of converted values should match conversions of the
+    // individual values, including for denormals, overflow, and infinity.
+    Point2i res(13, 5);
+    RNG rng;
+    Image image(PixelFormat::Float, res, {"R", "G", "B"});
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < 3; ++c) {
+                Float v = (rng.Uniform<Float>() - .5f) * std::pow(2.f, 40 * c - 30);
+                if (x == 3 && y == 2)
+                    v = (c == 0) ? Infinity : -1e-7f;
+                image.SetChannel({x, y}, c, v);
+            }
+
+    Image half = image.ConvertToFormat(PixelFormat::Half);
+    Image back = half.ConvertToFormat(PixelFormat::Float);
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < 3; ++c) {
+                Half h(image.GetChannel({x, y}, c));
+                EXPECT_EQ(h.Bits(), Half(half.GetChannel({x, y}, c)).Bits());
+                EXPECT_EQ(float(h), back.GetChannel({x, y}, c));
+            }
+}
+
+TEST(Image, GenerateMIPMap) {
+    // Each level should be the box-filtered version of the one before it,
+    // including when the images have a single row or column.
+    RNG rng;
+    for (int nc = 1; nc <= 4; ++nc) {
+        std::vector<std::string> channelNames;
+        for (int c = 0; c < nc; ++c)
+            channelNames.push_back(std::string(1, 'A' + c));
+
+        for (Point2i res : {Point2i(32, 8), Point2i(1, 4), Point2i(8, 1)}) {
+            Image image(PixelFormat::Float, res, channelNames);
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x)
+                    for (int c = 0; c < nc; ++c)
+                        image.SetChannel({x, y}, c, rng.Uniform<Float>());
+
+            pstd::vector<Image> pyramid = Image::GenerateMIPMap(image, WrapMode::Clamp);
+            for (size_t i = 1; i < pyramid.size(); ++i) {
+                const Image &prev = pyramid[i - 1], &level = pyramid[i];
+                for (int y = 0; y < level.Resolution().y; ++y)
+                    for (int x = 0; x < level.Resolution().x; ++x)
+                        for (int c = 0; c < nc; ++c) {
+                            Float v = .25f * (prev.GetChannel({2 * x, 2 * y}, c) +
+                                              prev.GetChannel({2 * x + 1, 2 * y}, c) +
+                                              prev.GetChannel({2 * x, 2 * y + 1}, c) +
+                                              prev.GetChannel({2 * x + 1, 2 * y + 1}, c));
+                            EXPECT_FLOAT_EQ(v, level.GetChannel({x, y}, c))
+                                << nc << " channels, level " << i << ", " << x << ", "
+                                << y;
+                        }
+            }
+        }
+    }
+}
+
+TEST(Image, GenerateMIPMapHalfNaN) {
+    // NaNs in half-float images should be replaced with zeros rather than
+    // making their way into the coarser levels.
+    for (Point2i res : {Point2i(16, 8), Point2i(1, 1)}) {
+        Image image(PixelFormat::Half, res, {"R", "G"});
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                for (int c = 0; c < 2; ++c)
+                    image.SetChannel({x, y}, c, .5f);
+        // SetChannel() itself doesn't allow NaNs.
+        ((Half *)image.RawPointer({0, 0}))[1] = Half::FromBits(0x7e00);
+        ASSERT_TRUE(std::isnan(image.GetChannel({0, 0}, 1)));
+
+        pstd::vector<Image> pyramid = Image::GenerateMIPMap(image, WrapMode::Clamp);
+        EXPECT_EQ(0, pyramid[0].GetChannel({0, 0}, 1));
+        for (const Image &level : pyramid)
+            for (int y = 0; y < level.Resolution().y; ++y)
+                for (int x = 0; x < level.Resolution().x; ++x)
+                    for (int c = 0; c < 2; ++c)
+                        EXPECT_FALSE(std::isnan(level.GetChannel({x, y}, c)))
+                            << level.Resolution() << ": " << x << ", " << y;
+    }
+}
+
+TEST(Image, FloatResize) {
+    // Resizing a multi-channel image should give the same values as
+    // resizing each of its channels separately.
+    Point2i res(13, 7), newRes(32, 16);
+    RNG rng;
+    for (int nc : {3, 5}) {
+        std::vector<std::string> channelNames;
+        for (int c = 0; c < nc; ++c)
+            channelNames.push_back(std::string(1, 'A' + c));
+        Image image(PixelFormat::Half, res, channelNames);
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                for (int c = 0; c < nc; ++c)
+                    image.SetChannel({x, y}, c, rng.Uniform<Float>());
+
+        Image resized = image.FloatResize(newRes, WrapMode::Repeat);
+        ASSERT_EQ(newRes, resized.Resolution());
+        for (int c = 0; c < nc; ++c) {
+            ImageChannelDesc desc = image.GetChannelDesc({channelNames[c]});
+            Image resizedChannel =
+                image.SelectChannels(desc).FloatResize(newRes, WrapMode::Repeat);
+            for (int y = 0; y < newRes.y; ++y)
+                for (int x = 0; x < newRes.x; ++x) {
+                    Float v = resized.GetChannel({x, y}, c);
+                    EXPECT_GE(v, 0);
+                    EXPECT_NEAR(resizedChannel.GetChannel({x, y}, 0), v, 1e-5f);
+                }
+        }
+    }
+}
+
 TEST(Image, PfmIO) {
     Point2i res(16, 49);
     pstd::vector<float> rgbPixels = GetFloatPixels(res, 3);
@@ -323,6 +442,106 @@ TEST(Image, PfmIO) {
     EXPECT_EQ(0, remove("test.pfm"));
 }
 
+TEST(Image, PfmBigEndianScaled) {
+    // Write a big-endian PFM with a scale of 2 by hand; its rows are stored
+    // from bottom to top.
+    Point2i res(5, 3);
+    std::string contents = "Pf\n5 3\n2.0\n";
+    for (int y = res.y - 1; y >= 0; --y)
+        for (int x = 0; x < res.x; ++x) {
+            uint32_t bits = FloatToBits(float(x + 10 * y));
+            for (int shift = 24; shift >= 0; shift -= 8)
+                contents.push_back(char((bits >> shift) & 0xff));
+        }
+    ASSERT_TRUE(WriteFile("test.pfm", contents));
+
+    ImageAndMetadata read = Image::Read("test.pfm");
+    EXPECT_EQ(res, read.image.Resolution());
+    EXPECT_EQ(1, read.image.NChannels());
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            EXPECT_EQ(2 * (x + 10 * y), read.image.GetChannel({x, y}, 0));
+
+    EXPECT_EQ(0, remove("test.pfm"));
+}
+
+TEST(Image, RawIO) {
+    Point2i res(29, 17);
+    pstd::vector<float> pixels = GetFloatPixels(res, 4);
+    Image image(pixels, res, {"R", "G", "B", "Z"});
+    ImageMetadata metadata;
+    metadata.colorSpace = RGBColorSpace::Rec2020;
+    EXPECT_TRUE(image.Write("test.praw", metadata));
+
+    ImageAndMetadata read = Image::Read("test.praw");
+    EXPECT_EQ(res, read.image.Resolution());
+    EXPECT_EQ(PixelFormat::Float, read.image.Format());
+    EXPECT_EQ(image.ChannelNames(), read.image.ChannelNames());
+    EXPECT_EQ(RGBColorSpace::Rec2020, read.metadata.GetColorSpace());
+    EXPECT_TRUE(read.image.IsMemoryMapped());
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < 4; ++c)
+                EXPECT_EQ(image.GetChannel({x, y}, c), read.image.GetChannel({x, y}, c));
+
+    // Modifying the image copies its pixels from the file.
+    Image copy = read.image;
+    copy.SetChannel({1, 2}, 3, -5.f);
+    EXPECT_FALSE(copy.IsMemoryMapped());
+    EXPECT_EQ(-5.f, copy.GetChannel({1, 2}, 3));
+    EXPECT_EQ(image.GetChannel({1, 2}, 3), read.image.GetChannel({1, 2}, 3));
+    EXPECT_EQ(image.GetChannel({4, 9}, 1), copy.GetChannel({4, 9}, 1));
+
+    EXPECT_EQ(0, remove("test.praw"));
+}
+
+TEST(Image, ScanlineIO) {
+    Point2i res(37, 23);
+    pstd::vector<float> rgbPixels = GetFloatPixels(res, 3);
+    Image image(rgbPixels, res, {"R", "G", "B"});
+
+    for (std::string filename : {"test.exr", "test.pfm", "test.praw"}) {
+        // Write the image a few scanlines at a time
+        std::unique_ptr<ImageScanlineWriter> writer = ImageScanlineWriter::Create(
+            filename, PixelFormat::Float, res, image.ChannelNames());
+        ASSERT_TRUE(writer != nullptr);
+        for (int y0 = 0; y0 < res.y; y0 += 5) {
+            int y1 = std::min(y0 + 5, res.y);
+            EXPECT_TRUE(
+                writer->WriteScanlines(image.Crop(Bounds2i({0, y0}, {res.x, y1}))));
+        }
+        EXPECT_TRUE(writer->Close());
+
+        ImageAndMetadata read = Image::Read(filename);
+        ASSERT_EQ(res, read.image.Resolution());
+        ASSERT_EQ(image.ChannelNames(), read.image.ChannelNames());
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                for (int c = 0; c < 3; ++c)
+                    EXPECT_EQ(image.GetChannel({x, y}, c),
+                              read.image.GetChannel({x, y}, c));
+
+        // Read it back in bands of a different size
+        std::unique_ptr<ImageScanlineReader> reader = ImageScanlineReader::Open(filename);
+        ASSERT_TRUE(reader != nullptr);
+        EXPECT_EQ(res, reader->Resolution());
+        EXPECT_EQ(image.ChannelNames(), reader->ChannelNames());
+        for (int y0 = 0; y0 < res.y; y0 += 7) {
+            int y1 = std::min(y0 + 7, res.y);
+            Image band = reader->ReadScanlines(y0, y1);
+            ASSERT_EQ(Point2i(res.x, y1 - y0), band.Resolution());
+            for (int y = y0; y < y1; ++y)
+                for (int x = 0; x < res.x; ++x)
+                    for (int c = 0; c < 3; ++c)
+                        EXPECT_EQ(image.GetChannel({x, y}, c),
+                                  band.GetChannel({x, y - y0}, c));
+        }
+
+        reader.reset();
+        EXPECT_EQ(0, remove(filename.c_str()));
+    }
+}
+
 TEST(Image, ExrIO) {
     Point2i res(16, 49);
     pstd::vector<float> rgbPixels = GetFloatPixels(res, 3);
@@ -694,3 +913,316 @@ TEST(ImageIO, RoundTripPFM) {
 TEST(ImageIO, RoundTripPNG) {
     TestRoundTrip("out.png");
 }
+
+TEST(MIPMap, PrecomputedSpectra) {
+    // Point-sampled lookups at texel centers should give the same spectra
+    // as converting the RGB value directly.
+    Point2i res(8, 8);
+    Image image(PixelFormat::Float, res, {"R", "G", "B"}, ColorEncodingHandle::Linear);
+    RNG rng;
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < 3; ++c)
+                // Include some black texels and some that aren't reflectances
+                image.SetChannel({x, y}, c, (x == y) ? 0 : 2 * rng.Uniform<Float>());
+
+    MIPMapFilterOptions options;
+    options.filter = FilterFunction::Point;
+    options.precomputeSpectra = true;
+    const RGBColorSpace &cs = *RGBColorSpace::sRGB;
+    MIPMap mipmap(image, &cs, WrapMode::Clamp, Allocator(), options);
+    ASSERT_TRUE(mipmap.HasPrecomputedSpectra());
+
+    SampledWavelengths lambda = SampledWavelengths::SampleUniform(0.3f);
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x) {
+            Point2f st((x + 0.5f) / res.x, (y + 0.5f) / res.y);
+            SigmoidPolynomialTexel texel = mipmap.Lookup<SigmoidPolynomialTexel>(st);
+            RGBSigmoidPolynomial rsp = texel.Polynomial();
+
+            RGB rgb(image.GetChannel({x, y}, 0), image.GetChannel({x, y}, 1),
+                    image.GetChannel({x, y}, 2));
+            SampledSpectrum ref = std::max({rgb.r, rgb.g, rgb.b}) > 1
+                                      ? RGBSpectrum(cs, rgb).Sample(lambda)
+                                      : RGBReflectanceSpectrum(cs, rgb).Sample(lambda);
+            SampledSpectrum illum = cs.illuminant.Sample(lambda);
+            for (int i = 0; i < NSpectrumSamples; ++i) {
+                Float v = texel.scale == 0 ? 0
+                                           : texel.scale * rsp(lambda[i]) *
+                                                 texel.IlluminantFactor(illum[i]);
+                EXPECT_LT(std::abs(v - ref[i]), 1e-4f * std::max<Float>(1, ref[i]))
+                    << x << ", " << y << ": " << v << " vs. " << ref[i];
+            }
+        }
+}
+
+TEST(MIPMap, PrecomputedSpectraFilterBlack) {
+    // Filtering between black and a reflectance should scale the
+    // reflectance's spectrum rather than change its shape.
+    Point2i res(2, 2);
+    Image image(PixelFormat::Float, res, {"R", "G", "B"}, ColorEncodingHandle::Linear);
+    RGB rgb(0.7f, 0.2f, 0.4f);
+    for (int y = 0; y < res.y; ++y)
+        for (int c = 0; c < 3; ++c)
+            image.SetChannel({1, y}, c, rgb[c]);
+
+    MIPMapFilterOptions options;
+    options.filter = FilterFunction::Bilinear;
+    options.precomputeSpectra = true;
+    const RGBColorSpace &cs = *RGBColorSpace::sRGB;
+    MIPMap mipmap(image, &cs, WrapMode::Clamp, Allocator(), options);
+
+    SigmoidPolynomialTexel texel =
+        mipmap.Lookup<SigmoidPolynomialTexel>(Point2f(0.5f, 0.5f));
+    EXPECT_FLOAT_EQ(0.5f, texel.scale);
+
+    SampledWavelengths lambda = SampledWavelengths::SampleUniform(0.6f);
+    SampledSpectrum ref = RGBReflectanceSpectrum(cs, rgb).Sample(lambda);
+    RGBSigmoidPolynomial rsp = texel.Polynomial();
+    for (int i = 0; i < NSpectrumSamples; ++i)
+        EXPECT_LT(std::abs(texel.scale * rsp(lambda[i]) - 0.5f * ref[i]), 1e-4f);
+}
+
+TEST(MIPMap, TiledPyramid) {
+    // Lookups in a MIPMap whose texels are read on demand from tiles, or
+    // directly from a memory-mapped pyramid file, should match lookups in
+    // the same MIPMap in memory. The resolution isn't a multiple of the
+    // tile size so that partial tiles are exercised.
+    Point2i res(150, 71);
+    Image image(PixelFormat::U256, res, {"R", "G", "B"}, ColorEncodingHandle::sRGB);
+    RNG rng;
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < 3; ++c)
+                image.SetChannel({x, y}, c, rng.Uniform<Float>());
+
+    const RGBColorSpace *cs = RGBColorSpace::sRGB;
+    TiledImageMetadata metadata;
+    metadata.colorSpace = cs;
+    pstd::vector<Image> pyramid = Image::GenerateMIPMap(image, WrapMode::Repeat);
+    ASSERT_TRUE(TiledImagePyramid::Write(pyramid, metadata, "test.mip"));
+
+    for (FilterFunction filter :
+         {FilterFunction::Point, FilterFunction::Trilinear, FilterFunction::EWA}) {
+        MIPMapFilterOptions options;
+        options.filter = filter;
+        // Tiled pyramids are always filtered with the general texel access
+        // code, so compare to it rather than the in-memory kernels, which
+        // sum EWA texels in a different order.
+        options.scalarFiltering = true;
+        MIPMap mipmap(image, cs, WrapMode::Repeat, Allocator(), options);
+
+        for (bool memoryMap : {false, true}) {
+            std::unique_ptr<TiledImagePyramid> tiled =
+                memoryMap ? TiledImagePyramid::Open("test.mip", true)
+                          : TiledImagePyramid::CreateTemporary(pyramid, metadata);
+            ASSERT_TRUE(tiled != nullptr);
+            EXPECT_EQ(cs, tiled->Metadata().colorSpace);
+            MIPMap tiledMIPMap(std::move(tiled), cs, WrapMode::Repeat, options);
+            ASSERT_EQ(mipmap.Levels(), tiledMIPMap.Levels());
+
+            for (int i = 0; i < 1000; ++i) {
+                // Include lookups outside [0,1]^2 to exercise wrapping
+                Point2f st(2 * rng.Uniform<Float>() - 0.5f,
+                           2 * rng.Uniform<Float>() - 0.5f);
+                Float width = std::pow(2.f, -8 * rng.Uniform<Float>());
+                Vector2f dst0(width * rng.Uniform<Float>(), 0.25f * width);
+                Vector2f dst1(-0.1f * width, width * rng.Uniform<Float>());
+
+                RGB ref = mipmap.Lookup<RGB>(st, dst0, dst1);
+                RGB v = tiledMIPMap.Lookup<RGB>(st, dst0, dst1);
+                for (int c = 0; c < 3; ++c)
+                    EXPECT_EQ(ref[c], v[c]) << st << ", filter " << ToString(filter)
+                                            << ", memoryMap " << memoryMap;
+                EXPECT_EQ(mipmap.Lookup<Float>(st, width),
+                          tiledMIPMap.Lookup<Float>(st, width));
+            }
+        }
+    }
+
+    EXPECT_EQ(0, remove("test.mip"));
+}
+
+TEST(MIPMap, FilterKernels) {
+    // Lookups with the kernels specialized for in-memory pyramids should
+    // match the general filtering code: exactly for bilinear
+    // interpolation and up to the order of summation for EWA.
+    Point2i res(67, 40);
+    std::string channels[4] = {"R", "G", "B", "A"};
+    const RGBColorSpace *cs = RGBColorSpace::sRGB;
+    RNG rng;
+    for (PixelFormat format : {PixelFormat::U256, PixelFormat::Half, PixelFormat::Float})
+        for (int nc : {1, 3, 4}) {
+            Image image(format, res, pstd::span<const std::string>(channels, nc),
+                        ColorEncodingHandle::sRGB);
+            // Go above one where the format allows it so that some of the
+            // precomputed spectra aren't reflectances.
+            Float maxValue = format == PixelFormat::U256 ? 1 : 2;
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x)
+                    for (int c = 0; c < nc; ++c)
+                        image.SetChannel({x, y}, c, maxValue * rng.Uniform<Float>());
+
+            for (WrapMode wrapMode : {WrapMode::Repeat, WrapMode::Clamp, WrapMode::Black})
+                for (FilterFunction filter :
+                     {FilterFunction::Bilinear, FilterFunction::Trilinear,
+                      FilterFunction::EWA}) {
+                    MIPMapFilterOptions options;
+                    options.filter = filter;
+                    options.precomputeSpectra = nc == 3;
+                    MIPMap mipmap(image, cs, wrapMode, Allocator(), options);
+                    options.scalarFiltering = true;
+                    MIPMap scalar(image, cs, wrapMode, Allocator(), options);
+
+                    auto check = [&](Float v, Float ref, Point2f st) {
+                        std::string where = StringPrintf("%s %d %s", format, nc, st);
+                        if (filter == FilterFunction::EWA)
+                            EXPECT_LT(std::abs(v - ref), 1e-5f * std::max<Float>(1, ref))
+                                << where;
+                        else
+                            EXPECT_EQ(v, ref) << where;
+                    };
+                    for (int i = 0; i < 200; ++i) {
+                        // Include lookups outside [0,1]^2 to exercise wrapping
+                        Point2f st(1.4f * rng.Uniform<Float>() - 0.2f,
+                                   1.4f * rng.Uniform<Float>() - 0.2f);
+                        Float width = std::pow(2.f, -8 * rng.Uniform<Float>());
+                        Vector2f dst0(width * rng.Uniform<Float>(), 0.25f * width);
+                        Vector2f dst1(-0.1f * width, width * rng.Uniform<Float>());
+
+                        RGB v = mipmap.Lookup<RGB>(st, dst0, dst1);
+                        RGB ref = scalar.Lookup<RGB>(st, dst0, dst1);
+                        for (int c = 0; c < 3; ++c)
+                            check(v[c], ref[c], st);
+                        check(mipmap.Lookup<Float>(st, dst0, dst1),
+                              scalar.Lookup<Float>(st, dst0, dst1), st);
+                        if (options.precomputeSpectra) {
+                            SigmoidPolynomialTexel t =
+                                mipmap.Lookup<SigmoidPolynomialTexel>(st, dst0, dst1);
+                            SigmoidPolynomialTexel tr =
+                                scalar.Lookup<SigmoidPolynomialTexel>(st, dst0, dst1);
+                            check(t.scale, tr.scale, st);
+                            check(t.illuminant, tr.illuminant, st);
+                        }
+                    }
+                }
+        }
+}
+
+TEST(MIPMap, LookupWithGradient) {
+    // Box filtering a linear ramp gives the same ramp at each level, so the
+    // gradient should be its slope for lookups away from the image's edges.
+    Point2i res(64, 32);
+    Float dfdx = 0.005f, dfdy = -0.0125f;
+    Image image(PixelFormat::Float, res, {"Y"});
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            image.SetChannel({x, y}, 0, 0.5f + dfdx * x + dfdy * y);
+
+    RNG rng;
+    for (FilterFunction filter : {FilterFunction::Point, FilterFunction::Bilinear,
+                                  FilterFunction::Trilinear, FilterFunction::EWA}) {
+        MIPMapFilterOptions options;
+        options.filter = filter;
+        MIPMap mipmap(image, RGBColorSpace::sRGB, WrapMode::Clamp, Allocator(),
+                      options);
+        for (int i = 0; i < 200; ++i) {
+            Point2f st(0.3f + 0.4f * rng.Uniform<Float>(),
+                       0.3f + 0.4f * rng.Uniform<Float>());
+            Float width = std::pow(2.f, -10 + 6 * rng.Uniform<Float>());
+            Vector2f dst0(width, 0), dst1(0, width * rng.Uniform<Float>());
+
+            Vector2f dfdst;
+            Float v = mipmap.LookupWithGradient(st, dst0, dst1, &dfdst);
+            EXPECT_EQ(mipmap.Lookup<Float>(st, dst0, dst1), v);
+            EXPECT_NEAR(dfdx * res.x, dfdst.x, 1e-4f) << st << " " << width;
+            EXPECT_NEAR(dfdy * res.y, dfdst.y, 1e-4f) << st << " " << width;
+        }
+    }
+}
+
+TEST(MIPMap, LookupWithGradientLevel) {
+    // Alternating columns only vary at the finest level; all coarser
+    // levels are constant.
+    Point2i res(64, 32);
+    Float delta = 0.25f;
+    Image image(PixelFormat::Float, res, {"Y"});
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            image.SetChannel({x, y}, 0, 0.5f + ((x & 1) ? delta : 0.f));
+
+    // Between columns 10 and 11 of level 0, which bilinear interpolation
+    // ramps up across
+    Point2f st(11.f / res.x, 0.5f);
+    // An anisotropic footprint: EWA filters level 0 along its minor axis,
+    // while trilinear filtering uses a coarse level for the major axis.
+    Vector2f dst0(1.f / 16, 0), dst1(0, 1.f / 128);
+    for (FilterFunction filter : {FilterFunction::Trilinear, FilterFunction::EWA}) {
+        MIPMapFilterOptions options;
+        options.filter = filter;
+        MIPMap mipmap(image, RGBColorSpace::sRGB, WrapMode::Clamp, Allocator(),
+                      options);
+        Vector2f dfdst;
+        mipmap.LookupWithGradient(st, dst0, dst1, &dfdst);
+        Float expected = filter == FilterFunction::EWA ? delta * res.x : 0.f;
+        EXPECT_NEAR(expected, dfdst.x, 1e-4f) << ToString(filter);
+        EXPECT_NEAR(0.f, dfdst.y, 1e-4f) << ToString(filter);
+    }
+}
+
+TEST(MIPMap, PyramidFileSource) {
+    // A pyramid file should only match the version of the image that it
+    // was made from.
+    Image image(PixelFormat::Float, {20, 10}, {"Y"});
+    for (int y = 0; y < 10; ++y)
+        for (int x = 0; x < 20; ++x)
+            image.SetChannel({x, y}, 0, x + y);
+    ASSERT_TRUE(image.Write("test.pfm"));
+    ASSERT_TRUE(MIPMap::WriteTiledPyramid("test.pfm", WrapMode::Clamp,
+                                          ColorEncodingHandle::Linear, "test.pfm.mip"));
+
+    std::unique_ptr<TiledImagePyramid> tiled =
+        TiledImagePyramid::Open("test.pfm.mip", false);
+    ASSERT_TRUE(tiled != nullptr);
+    EXPECT_EQ(WrapMode::Clamp, tiled->Metadata().wrapMode);
+    EXPECT_EQ(1, tiled->NChannels());
+    EXPECT_EQ(6, tiled->Levels());
+    EXPECT_TRUE(tiled->MatchesSource("test.pfm"));
+
+    // Rewriting the image with the same contents changes its modification
+    // time, which should be recorded in the pyramid file.
+    ASSERT_TRUE(image.Write("test.pfm"));
+    EXPECT_TRUE(tiled->MatchesSource("test.pfm"));
+    pstd::optional<int64_t> mtime = FileModificationTime("test.pfm");
+    ASSERT_TRUE(mtime.has_value());
+    EXPECT_EQ(*mtime, tiled->Metadata().sourceModificationTime);
+    std::unique_ptr<TiledImagePyramid> reopened =
+        TiledImagePyramid::Open("test.pfm.mip", false);
+    ASSERT_TRUE(reopened != nullptr);
+    EXPECT_EQ(*mtime, reopened->Metadata().sourceModificationTime);
+
+    // Changing the image invalidates the pyramid
+    image.SetChannel({3, 4}, 0, -1.f);
+    ASSERT_TRUE(image.Write("test.pfm"));
+    EXPECT_FALSE(tiled->MatchesSource("test.pfm"));
+
+    EXPECT_EQ(0, remove("test.pfm"));
+    EXPECT_EQ(0, remove("test.pfm.mip"));
+}
+
+TEST(MIPMap, PyramidFileBadEncoding) {
+    Image image(PixelFormat::Float, {8, 8}, {"Y"});
+    pstd::vector<Image> pyramid = {image};
+    ASSERT_TRUE(TiledImagePyramid::Write(pyramid, TiledImageMetadata(), "test.mip"));
+
+    // Corrupt the color encoding's name; opening the file should fail
+    // rather than exiting.
+    std::string contents = ReadFileContents("test.mip");
+    size_t offset = contents.find("linear");
+    ASSERT_NE(std::string::npos, offset);
+    contents[offset] = 'X';
+    ASSERT_TRUE(WriteFile("test.mip", contents));
+    EXPECT_TRUE(TiledImagePyramid::Open("test.mip", false) == nullptr);
+
+    EXPECT_EQ(0, remove("test.mip"));
+}
@@ -0,0 +1,325 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/util/ipc.h>
+
+#include <pbrt/util/check.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/log.h>
+
+#include <atomic>
+
+#ifdef PBRT_IS_WINDOWS
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Ws2tcpip.h>
+#include <winsock2.h>
+#undef NOMINMAX
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define SOCKET_ERROR (-1)
+#define INVALID_SOCKET (-1)
+#endif
+
+namespace pbrt {
+
+enum SocketError : int {
+#ifdef PBRT_IS_WINDOWS
+    Again = EAGAIN,
+    ConnRefused = WSAECONNREFUSED,
+    WouldBlock = WSAEWOULDBLOCK,
+#else
+    Again = EAGAIN,
+    ConnRefused = ECONNREFUSED,
+    WouldBlock = EWOULDBLOCK,
+#endif
+};
+
+static int closeSocket(IPCSocket socket) {
+#ifdef PBRT_IS_WINDOWS
+    return closesocket(socket);
+#else
+    return close(socket);
+#endif
+}
+
+static std::atomic<int> numActiveChannels{0};
+
+static void InitSockets() {
+    if (numActiveChannels++ == 0) {
+#ifdef PBRT_IS_WINDOWS
+        WSADATA wsaData;
+        int err = WSAStartup(MAKEWORD(2, 2), &wsaData);
+        if (err != NO_ERROR)
+            LOG_FATAL("Unable to initialize WinSock: %s", ErrorString(err));
+#else
+        // We don't care about getting a SIGPIPE if the other end of the
+        // connection goes away...
+        signal(SIGPIPE, SIG_IGN);
+#endif
+    }
+}
+
+static void CleanupSockets() {
+    if (--numActiveChannels == 0) {
+#ifdef PBRT_IS_WINDOWS
+        WSACleanup();
+#endif
+    }
+}
+
+#ifndef PBRT_IS_WINDOWS
+// Returns the path given in a "unix:<path>" address and fills in _addr_.
+static std::string UnixSocketAddress(const std::string &address, sockaddr_un *addr) {
+    std::string path = address.substr(5);
+    if (path.empty() || path.size() >= sizeof(addr->sun_path))
+        ErrorExit("%s: invalid Unix domain socket path.", address);
+    *addr = {};
+    addr->sun_family = AF_UNIX;
+    strncpy(addr->sun_path, path.c_str(), sizeof(addr->sun_path) - 1);
+    return path;
+}
+
+// Removes the file at _path_ if it is a socket; other files are left alone.
+// Returns false if something other than a socket is there.
+static bool RemoveSocketFile(const std::string &path) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0)
+        return errno == ENOENT;
+    if (!S_ISSOCK(st.st_mode))
+        return false;
+    unlink(path.c_str());
+    return true;
+}
+#endif  // !PBRT_IS_WINDOWS
+
+// IPCChannel Method Definitions
+IPCChannel::IPCChannel(const std::string &hostname) : socketFd(INVALID_SOCKET) {
+    InitSockets();
+
+    if (hostname.compare(0, 5, "unix:") == 0) {
+#ifdef PBRT_IS_WINDOWS
+        ErrorExit("%s: Unix domain sockets aren't supported on Windows.", hostname);
+#endif
+        unixSocket = true;
+        address = hostname;
+    } else {
+        size_t split = hostname.find_last_of(':');
+        if (split == std::string::npos)
+            ErrorExit("Expected \"host:port\" or \"unix:<path>\" for address. "
+                      "Given \"%s\".",
+                      hostname);
+        address = std::string(hostname.begin(), hostname.begin() + split);
+        port = std::string(hostname.begin() + split + 1, hostname.end());
+    }
+
+    Connect();
+}
+
+IPCChannel::IPCChannel(IPCSocket socketFd) : socketFd(socketFd) {
+    InitSockets();
+}
+
+bool IPCChannel::Connected() const {
+    return socketFd != INVALID_SOCKET;
+}
+
+void IPCChannel::Connect() {
+    CHECK_EQ(socketFd, INVALID_SOCKET);
+
+    LOG_VERBOSE("Trying to connect to %s", address);
+
+#ifndef PBRT_IS_WINDOWS
+    if (unixSocket) {
+        sockaddr_un addr;
+        UnixSocketAddress(address, &addr);
+        socketFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (socketFd == INVALID_SOCKET) {
+            LOG_VERBOSE("socket() failed: %s", ErrorString());
+            return;
+        }
+        if (connect(socketFd, (const sockaddr *)&addr, sizeof(addr)) == SOCKET_ERROR) {
+            LOG_VERBOSE("connect() failed: %s", ErrorString());
+            closeSocket(socketFd);
+            socketFd = INVALID_SOCKET;
+            return;
+        }
+        LOG_VERBOSE("Connected to %s", address);
+        return;
+    }
+#endif  // !PBRT_IS_WINDOWS
+
+    struct addrinfo hints = {}, *addrinfo;
+    hints.ai_family = PF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int err = getaddrinfo(address.c_str(), port.c_str(), &hints, &addrinfo);
+    if (err)
+        ErrorExit("%s", gai_strerror(err));
+
+    socketFd = INVALID_SOCKET;
+    for (struct addrinfo *ptr = addrinfo; ptr; ptr = ptr->ai_next) {
+        socketFd = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
+        if (socketFd == INVALID_SOCKET) {
+            LOG_VERBOSE("socket() failed: %s", ErrorString());
+            continue;
+        }
+
+        if (connect(socketFd, ptr->ai_addr, ptr->ai_addrlen) == SOCKET_ERROR) {
+#ifdef PBRT_IS_WINDOWS
+            int err = WSAGetLastError();
+#else
+            int err = errno;
+#endif
+            if (err == SocketError::ConnRefused)
+                LOG_VERBOSE("Connection refused. Will try again...");
+            else
+                LOG_VERBOSE("connect() failed: %s", ErrorString(err));
+
+            closeSocket(socketFd);
+            socketFd = INVALID_SOCKET;
+            continue;
+        }
+
+        break;  // success
+    }
+
+    freeaddrinfo(addrinfo);
+    if (socketFd != INVALID_SOCKET)
+        LOG_VERBOSE("Connected to %s:%s", address, port);
+}
+
+IPCChannel::~IPCChannel() {
+    if (Connected())
+        Disconnect();
+
+    CleanupSockets();
+}
+
+void IPCChannel::Disconnect() {
+    CHECK(Connected());
+
+    closeSocket(socketFd);
+    socketFd = INVALID_SOCKET;
+}
+
+bool IPCChannel::Send(pstd::span<const uint8_t> message) {
+    if (!Connected()) {
+        // Channels returned by IPCListener::Accept() can't reconnect
+        if (address.empty())
+            return false;
+        Connect();
+        if (!Connected())
+            return false;
+    }
+
+    // Start with the length of the message.
+    // FIXME: annoying coupling w/sending code's message buffer layout...
+    int *startPtr = (int *)message.data();
+    *startPtr = message.size();
+
+    size_t offset = 0;
+    while (offset < message.size()) {
+        int bytesSent = send(socketFd, (const char *)message.data() + offset,
+                             message.size() - offset, 0 /* flags */);
+        if (bytesSent <= 0) {
+            LOG_ERROR("send to %s failed: %s",
+                      address.empty() ? std::string("client") : address, ErrorString());
+            Disconnect();
+            return false;
+        }
+        offset += bytesSent;
+    }
+    return true;
+}
+
+bool IPCChannel::Receive(std::vector<uint8_t> *message) {
+    if (!Connected())
+        return false;
+
+    auto receive = [&](uint8_t *ptr, size_t size) {
+        while (size > 0) {
+            int bytesReceived = recv(socketFd, (char *)ptr, size, 0 /* flags */);
+            if (bytesReceived <= 0)
+                return false;
+            ptr += bytesReceived;
+            size -= bytesReceived;
+        }
+        return true;
+    };
+
+    // Read the message length and then the rest of the message
+    int length;
+    if (!receive((uint8_t *)&length, sizeof(int)) || length < int(sizeof(int))) {
+        Disconnect();
+        return false;
+    }
+    if (length > MaxMessageSize) {
+        LOG_ERROR("%d byte message exceeds maximum size of %d bytes", length,
+                  MaxMessageSize);
+        Disconnect();
+        return false;
+    }
+    message->resize(length);
+    memcpy(message->data(), &length, sizeof(int));
+    if (!receive(message->data() + sizeof(int), length - sizeof(int))) {
+        Disconnect();
+        return false;
+    }
+    return true;
+}
+
+// IPCListener Method Definitions
+IPCListener::IPCListener(const std::string &address) : socketFd(INVALID_SOCKET) {
+#ifdef PBRT_IS_WINDOWS
+    ErrorExit("%s: Unix domain sockets aren't supported on Windows.", address);
+#else
+    if (address.compare(0, 5, "unix:") != 0)
+        ErrorExit("%s: expected \"unix:<path>\" address to listen on.", address);
+    InitSockets();
+
+    sockaddr_un addr;
+    path = UnixSocketAddress(address, &addr);
+    socketFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socketFd == INVALID_SOCKET)
+        ErrorExit("socket: %s", ErrorString());
+
+    // Remove a stale socket file left behind by an earlier server
+    if (!RemoveSocketFile(path))
+        ErrorExit("%s: file exists and isn't a socket.", path);
+    if (bind(socketFd, (const sockaddr *)&addr, sizeof(addr)) == SOCKET_ERROR)
+        ErrorExit("%s: bind: %s", path, ErrorString());
+    if (listen(socketFd, 8) == SOCKET_ERROR)
+        ErrorExit("%s: listen: %s", path, ErrorString());
+#endif  // PBRT_IS_WINDOWS
+}
+
+IPCListener::~IPCListener() {
+#ifndef PBRT_IS_WINDOWS
+    if (socketFd != INVALID_SOCKET) {
+        closeSocket(socketFd);
+        RemoveSocketFile(path);
+    }
+    CleanupSockets();
+#endif  // !PBRT_IS_WINDOWS
+}
+
+std::unique_ptr<IPCChannel> IPCListener::Accept() {
+    IPCSocket clientFd = accept(socketFd, nullptr, nullptr);
+    if (clientFd == INVALID_SOCKET) {
+        LOG_ERROR("%s: accept failed: %s", path, ErrorString());
+        return nullptr;
+    }
+    return std::unique_ptr<IPCChannel>(new IPCChannel(clientFd));
+}
+
+}  // namespace pbrt
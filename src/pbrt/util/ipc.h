@@ -0,0 +1,117 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_UTIL_IPC_H
+#define PBRT_UTIL_IPC_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/pstd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pbrt {
+
+#ifdef PBRT_IS_WINDOWS
+using IPCSocket = uintptr_t;
+#else
+using IPCSocket = int;
+#endif
+
+// IPCChannel Definition
+// Messages sent and received over an IPCChannel start with an int that
+// gives the total length of the message in bytes, including the length
+// itself.
+class IPCChannel {
+  public:
+    // Receive() fails and disconnects if the peer sends a longer message.
+    static constexpr int MaxMessageSize = 16 * 1024 * 1024;
+
+    // IPCChannel Public Methods
+    // _address_ is either "host:port" for a TCP connection or
+    // "unix:<path>" for a Unix domain socket.
+    IPCChannel(const std::string &address);
+    ~IPCChannel();
+
+    IPCChannel(const IPCChannel &) = delete;
+    IPCChannel &operator=(const IPCChannel &) = delete;
+
+    bool Send(pstd::span<const uint8_t> message);
+    bool Receive(std::vector<uint8_t> *message);
+
+    bool Connected() const;
+
+  private:
+    friend class IPCListener;
+    // IPCChannel Private Methods
+    IPCChannel(IPCSocket socketFd);
+
+    void Connect();
+    void Disconnect();
+
+    // IPCChannel Private Members
+    std::string address, port;
+    bool unixSocket = false;
+    IPCSocket socketFd;
+};
+
+// IPCListener Definition
+class IPCListener {
+  public:
+    // IPCListener Public Methods
+    // Only "unix:<path>" addresses are supported; the socket file is
+    // removed when the listener is destroyed.
+    IPCListener(const std::string &address);
+    ~IPCListener();
+
+    IPCListener(const IPCListener &) = delete;
+    IPCListener &operator=(const IPCListener &) = delete;
+
+    std::unique_ptr<IPCChannel> Accept();
+
+  private:
+    // IPCListener Private Members
+    std::string path;
+    IPCSocket socketFd;
+};
+
+// IPC Message Serialization Inline Functions
+inline void Serialize(uint8_t **ptr, const std::string &s) {
+    for (size_t i = 0; i < s.size(); ++i, *ptr += 1)
+        **ptr = s[i];
+    **ptr = '\0';
+    *ptr += 1;
+}
+
+template <typename T>
+inline void Serialize(uint8_t **ptr, T value) {
+    memcpy(*ptr, &value, sizeof(T));
+    *ptr += sizeof(T);
+}
+
+inline bool Deserialize(const uint8_t **ptr, const uint8_t *end, std::string *s) {
+    const uint8_t *nul = (const uint8_t *)memchr(*ptr, '\0', end - *ptr);
+    if (!nul)
+        return false;
+    *s = std::string((const char *)*ptr, nul - *ptr);
+    *ptr = nul + 1;
+    return true;
+}
+
+template <typename T>
+inline bool Deserialize(const uint8_t **ptr, const uint8_t *end, T *value) {
+    if (end - *ptr < sizeof(T))
+        return false;
+    memcpy(value, *ptr, sizeof(T));
+    *ptr += sizeof(T);
+    return true;
+}
+
+}  // namespace pbrt
+
+#endif  // PBRT_UTIL_IPC_H
@@ -0,0 +1,100 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/util/ipc.h>
+
+#include <cstdio>
+#include <thread>
+
+using namespace pbrt;
+
+TEST(IPC, Serialize) {
+    uint8_t buffer[64];
+    uint8_t *ptr = buffer;
+    Serialize(&ptr, int(12));
+    Serialize(&ptr, std::string("pbrt"));
+    Serialize(&ptr, 0.5f);
+
+    const uint8_t *readPtr = buffer, *end = ptr;
+    int i;
+    std::string s;
+    float f;
+    EXPECT_TRUE(Deserialize(&readPtr, end, &i));
+    EXPECT_TRUE(Deserialize(&readPtr, end, &s));
+    EXPECT_TRUE(Deserialize(&readPtr, end, &f));
+    EXPECT_EQ(12, i);
+    EXPECT_EQ("pbrt", s);
+    EXPECT_EQ(0.5f, f);
+    EXPECT_EQ(end, readPtr);
+    EXPECT_FALSE(Deserialize(&readPtr, end, &i));
+    EXPECT_FALSE(Deserialize(&readPtr, end, &s));
+}
+
+#ifndef PBRT_IS_WINDOWS
+TEST(IPC, UnixSocket) {
+    std::string address = "unix:pbrt-ipc-test.sock";
+    IPCListener listener(address);
+
+    std::thread client([&]() {
+        IPCChannel channel(address);
+        ASSERT_TRUE(channel.Connected());
+
+        std::vector<uint8_t> message(sizeof(int) + 1000);
+        for (size_t i = sizeof(int); i < message.size(); ++i)
+            message[i] = i & 0xff;
+        EXPECT_TRUE(channel.Send(pstd::MakeSpan(message)));
+    });
+
+    std::unique_ptr<IPCChannel> server = listener.Accept();
+    ASSERT_TRUE(server != nullptr);
+    std::vector<uint8_t> received;
+    EXPECT_TRUE(server->Receive(&received));
+    client.join();
+
+    ASSERT_EQ(sizeof(int) + 1000, received.size());
+    for (size_t i = sizeof(int); i < received.size(); ++i)
+        EXPECT_EQ(i & 0xff, received[i]);
+
+    // The client has closed the connection
+    EXPECT_FALSE(server->Receive(&received));
+}
+
+TEST(IPC, MaxMessageSize) {
+    std::string address = "unix:pbrt-ipc-max-test.sock";
+    IPCListener listener(address);
+
+    std::thread client([&]() {
+        IPCChannel channel(address);
+        ASSERT_TRUE(channel.Connected());
+        std::vector<uint8_t> message(IPCChannel::MaxMessageSize + 1);
+        // The server hangs up after reading the length, so this may fail.
+        channel.Send(pstd::MakeSpan(message));
+    });
+
+    std::unique_ptr<IPCChannel> server = listener.Accept();
+    ASSERT_TRUE(server != nullptr);
+    std::vector<uint8_t> received;
+    EXPECT_FALSE(server->Receive(&received));
+    EXPECT_FALSE(server->Connected());
+    client.join();
+}
+
+TEST(IPC, ListenerKeepsRegularFile) {
+    const char *path = "pbrt-ipc-not-a-socket";
+    FILE *f = fopen(path, "w");
+    ASSERT_TRUE(f != nullptr);
+    fclose(f);
+
+    EXPECT_DEATH(IPCListener(std::string("unix:") + path), "isn't a socket");
+
+    f = fopen(path, "r");
+    EXPECT_TRUE(f != nullptr);
+    if (f)
+        fclose(f);
+    remove(path);
+}
+#endif  // !PBRT_IS_WINDOWS
@@ -197,6 +197,22 @@ inline uint32_t SobolSampleBits32(int64_t a, int dimension) {
     return v;
 }
 
+// Computes the sample bits for _v.size()_ consecutive dimensions starting
+// at _dimension_. The walk over the bits of _a_ is shared by all of the
+// dimensions and the inner loop is branch-free, so it vectorizes.
+PBRT_CPU_GPU
+inline void SobolSampleBits32(int64_t a, int dimension, pstd::span<uint32_t> v) {
+    DCHECK_LE(dimension + v.size(), NSobolDimensions);
+    for (uint32_t &vd : v)
+        vd = 0;
+    const uint32_t *C = &SobolMatrices32[dimension * SobolMatrixSize];
+    for (int i = 0; a != 0; a >>= 1, i++) {
+        uint32_t mask = -uint32_t(a & 1);
+        for (size_t d = 0; d < v.size(); ++d)
+            v[d] ^= C[d * SobolMatrixSize + i] & mask;
+    }
+}
+
 // CranleyPattersonRotator Definition
 struct CranleyPattersonRotator {
     PBRT_CPU_GPU
@@ -4,22 +4,31 @@
 
 #include <pbrt/util/mipmap.h>
 
+#include <pbrt/options.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/color.h>
 #include <pbrt/util/colorspace.h>
 #include <pbrt/util/error.h>
 #include <pbrt/util/file.h>
+#include <pbrt/util/hash.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/math.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/simd.h>
 #include <pbrt/util/stats.h>
 
 #include <algorithm>
 #include <cmath>
+#include <type_traits>
 
 namespace pbrt {
 
 STAT_MEMORY_COUNTER("Memory/Image maps", imageMapBytes);
+STAT_MEMORY_COUNTER("Memory/Image map bytes saved by compression", compressionBytesSaved);
+STAT_INT_DISTRIBUTION("Texture/Compressed image map PSNR (dB)", compressionPSNR);
+STAT_COUNTER("Texture/MIP pyramid files used", pyramidFilesUsed);
+STAT_COUNTER("Texture/MIP pyramid files written", pyramidFilesWritten);
 
 ///////////////////////////////////////////////////////////////////////////
 // MIPMap Helper Declarations
@@ -41,8 +50,16 @@ std::string ToString(FilterFunction f) {
 }
 
 std::string MIPMapFilterOptions::ToString() const {
-    return StringPrintf("[ MIPMapFilterOptions filter: %s maxAnisotropy: %f ]", filter,
-                        maxAnisotropy);
+    return StringPrintf("[ MIPMapFilterOptions filter: %s maxAnisotropy: %f "
+                        "precomputeSpectra: %s compression: %s scalarFiltering: %s ]",
+                        filter, maxAnisotropy, precomputeSpectra, compression,
+                        scalarFiltering);
+}
+
+std::string SigmoidPolynomialTexel::ToString() const {
+    return StringPrintf(
+        "[ SigmoidPolynomialTexel c: [ %f %f %f ] scale: %f illuminant: %f ]", c[0],
+        c[1], c[2], scale, illuminant);
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -190,37 +207,318 @@ static PBRT_CONST Float weightLut[WeightLUTSize] = {
 
 };
 
-// MIPMap Method Definitions
-MIPMap::MIPMap(Image image, const RGBColorSpace *colorSpace, WrapMode wrapMode,
-               Allocator alloc, const MIPMapFilterOptions &options)
-    : colorSpace(colorSpace), wrapMode(wrapMode), options(options) {
-    CHECK(colorSpace != nullptr);
-    pyramid = Image::GenerateMIPMap(std::move(image), wrapMode, alloc);
-    std::for_each(pyramid.begin(), pyramid.end(),
-                  [](const Image &im) { imageMapBytes += im.BytesUsed(); });
+// MIPMap Filtering Kernel Definitions
+// The kernels filter the texels of in-memory pyramid levels. They are
+// specialized for the level's pixel format and number of channels so that
+// texels are read directly rather than through Image::GetChannel(), which
+// dispatches on the format for each texel. Texel coordinates are only
+// remapped for the wrap mode if the filter footprint extends past the
+// level's edges.
+template <PixelFormat format>
+class LevelTexels {
+  public:
+    LevelTexels(const Image &image, const Float *u256ToLinear)
+        : data(image.RawPointer({0, 0})),
+          resolution(image.Resolution()),
+          nChannels(image.NChannels()),
+          u256ToLinear(u256ToLinear) {}
+
+    Float Get(Point2i p, int c) const {
+        size_t offset = (size_t(p.y) * resolution.x + p.x) * nChannels + c;
+        if constexpr (format == PixelFormat::U256)
+            return u256ToLinear[((const uint8_t *)data)[offset]];
+        else if constexpr (format == PixelFormat::Half)
+            return Float(((const Half *)data)[offset]);
+        else
+            return ((const float *)data)[offset];
+    }
+
+  private:
+    const void *data;
+    Point2i resolution;
+    int nChannels;
+    const Float *u256ToLinear;
+};
+
+template <PixelFormat format, int NC>
+static void BilerpKernel(const Image &image, WrapMode2D wrapMode,
+                         const Float *u256ToLinear, Point2f st, Float *result) {
+    // Follow Image::BilerpChannel() for the first _NC_ channels
+    Point2i res = image.Resolution();
+    Float x = st[0] * res.x - 0.5f, y = st[1] * res.y - 0.5f;
+    int xi = std::floor(x), yi = std::floor(y);
+    Float dx = x - xi, dy = y - yi;
+    bool inside = xi >= 0 && yi >= 0 && xi + 1 < res.x && yi + 1 < res.y;
+
+    LevelTexels<format> texels(image, u256ToLinear);
+    pstd::array<Float, 4> v[NC];
+    for (int i = 0; i < 4; ++i) {
+        Point2i p(xi + (i & 1), yi + (i >> 1));
+        bool valid = inside || RemapPixelCoords(&p, res, wrapMode);
+        for (int c = 0; c < NC; ++c)
+            v[c][i] = valid ? texels.Get(p, c) : 0;
+    }
+    for (int c = 0; c < NC; ++c)
+        result[c] = pbrt::Bilerp({dx, dy}, v[c]);
+}
+
+// Widest ellipse bounding box that EWAKernel() handles; the ellipse's
+// width is limited by the maximum anisotropy, so only extreme settings
+// exceed it.
+static constexpr int EWAKernelMaxWidth = 64;
+
+template <PixelFormat format, int NC>
+static bool EWAKernel(const Image &image, WrapMode2D wrapMode, const Float *u256ToLinear,
+                      Point2f st, Float A, Float B, Float C, int s0, int s1, int t0,
+                      int t1, Float *result) {
+    // Follow the loop in MIPMap::EWA() for the first _NC_ channels, one row
+    // of the ellipse's bounding box at a time
+    int n = s1 - s0 + 1;
+    if (n > EWAKernelMaxWidth)
+        return false;
+    Point2i res = image.Resolution();
+    bool inside = s0 >= 0 && t0 >= 0 && s1 < res.x && t1 < res.y;
+
+    LevelTexels<format> texels(image, u256ToLinear);
+    Float sum[NC] = {}, sumWts = 0;
+#ifdef PBRT_HAVE_SIMD
+    simd::Vec4f vSum[NC], vSumWts(0.f);
+    for (int c = 0; c < NC; ++c)
+        vSum[c] = simd::Vec4f(0.f);
+#endif
+    for (int it = t0; it <= t1; ++it) {
+        // Compute the filter weights of the row's texels
+        Float tt = it - st[1];
+        Float weights[EWAKernelMaxWidth];
+        for (int i = 0; i < n; ++i) {
+            Float ss = s0 + i - st[0];
+            Float r2 = A * ss * ss + B * ss * tt + C * tt * tt;
+            weights[i] =
+                r2 < 1 ? weightLut[std::min<int>(r2 * WeightLUTSize, WeightLUTSize - 1)]
+                       : 0;
+        }
+
+        // Read the row's texels inside the ellipse into per-channel arrays
+        Float values[NC][EWAKernelMaxWidth];
+        for (int i = 0; i < n; ++i) {
+            Point2i p(s0 + i, it);
+            bool valid =
+                weights[i] != 0 && (inside || RemapPixelCoords(&p, res, wrapMode));
+            for (int c = 0; c < NC; ++c)
+                values[c][i] = valid ? texels.Get(p, c) : 0;
+        }
+
+        // Accumulate the row's weighted texels
+        int i = 0;
+#ifdef PBRT_HAVE_SIMD
+        for (; i + simd::Vec4f::Width <= n; i += simd::Vec4f::Width) {
+            simd::Vec4f w = simd::Vec4f::Load(&weights[i]);
+            vSumWts = vSumWts + w;
+            for (int c = 0; c < NC; ++c)
+                vSum[c] = vSum[c] + w * simd::Vec4f::Load(&values[c][i]);
+        }
+#endif
+        for (; i < n; ++i) {
+            sumWts += weights[i];
+            for (int c = 0; c < NC; ++c)
+                sum[c] += weights[i] * values[c][i];
+        }
+    }
+
+#ifdef PBRT_HAVE_SIMD
+    sumWts += ReduceAdd(vSumWts);
+    for (int c = 0; c < NC; ++c)
+        sum[c] += ReduceAdd(vSum[c]);
+#endif
+    for (int c = 0; c < NC; ++c)
+        result[c] = sum[c] / sumWts;
+    return true;
+}
+
+// Calls _func_ with the kernel's pixel format and channel count as
+// _std::integral_constant_ values; returns false for unsupported counts.
+template <typename F>
+static bool DispatchFilterKernel(PixelFormat format, int nChannels, F func) {
+    auto withFormat = [&](auto format) {
+        switch (nChannels) {
+        case 1:
+            return func(format, std::integral_constant<int, 1>());
+        case 3:
+            return func(format, std::integral_constant<int, 3>());
+        case 4:
+            return func(format, std::integral_constant<int, 4>());
+        case 5:
+            return func(format, std::integral_constant<int, 5>());
+        default:
+            return false;
+        }
+    };
+    switch (format) {
+    case PixelFormat::U256:
+        return withFormat(std::integral_constant<PixelFormat, PixelFormat::U256>());
+    case PixelFormat::Half:
+        return withFormat(std::integral_constant<PixelFormat, PixelFormat::Half>());
+    case PixelFormat::Float:
+        return withFormat(std::integral_constant<PixelFormat, PixelFormat::Float>());
+    default:
+        return false;
+    }
+}
+
+// These follow MIPMap::Texel(): they return the number of leading channels
+// of an image that T texels are made from and convert their values to T.
+template <typename T>
+static int TexelChannels(int nChannels);
+template <typename T>
+static T TexelFromChannels(const Float *v, int nChannels);
+
+template <>
+int TexelChannels<Float>(int nChannels) {
+    return 1;
+}
+template <>
+Float TexelFromChannels(const Float *v, int nChannels) {
+    return v[0];
 }
 
+template <>
+int TexelChannels<RGB>(int nChannels) {
+    return nChannels == 1 ? 1 : 3;
+}
+template <>
+RGB TexelFromChannels(const Float *v, int nChannels) {
+    return nChannels == 1 ? RGB(v[0], v[0], v[0]) : RGB(v[0], v[1], v[2]);
+}
+
+template <>
+int TexelChannels<SigmoidPolynomialTexel>(int nChannels) {
+    return 5;
+}
+template <>
+SigmoidPolynomialTexel TexelFromChannels(const Float *v, int nChannels) {
+    return {v[0], v[1], v[2], v[3], v[4]};
+}
+
+// MIPMap Method Definitions
 template <>
 Float MIPMap::Texel(int level, Point2i st) const {
-    CHECK(level >= 0 && level < pyramid.size());
-    return pyramid[level].GetChannel(st, 0, wrapMode);
+    return GetChannel(level, st, 0);
 }
 
 template <>
 RGB MIPMap::Texel(int level, Point2i st) const {
-    CHECK(level >= 0 && level < pyramid.size());
-    if (pyramid[level].NChannels() == 3 || pyramid[level].NChannels() == 4) {
+    if (NChannels() == 3 || NChannels() == 4) {
         RGB rgb;
         for (int c = 0; c < 3; ++c)
-            rgb[c] = pyramid[level].GetChannel(st, c, wrapMode);
+            rgb[c] = GetChannel(level, st, c);
         return rgb;
     } else {
-        CHECK_EQ(1, pyramid[level].NChannels());
-        Float v = pyramid[level].GetChannel(st, 0, wrapMode);
+        CHECK_EQ(1, NChannels());
+        Float v = GetChannel(level, st, 0);
         return RGB(v, v, v);
     }
 }
 
+MIPMap::MIPMap(Image image, const RGBColorSpace *colorSpace, WrapMode wrapMode,
+               Allocator alloc, const MIPMapFilterOptions &options)
+    : colorSpace(colorSpace), wrapMode(wrapMode), options(options) {
+    CHECK(colorSpace != nullptr);
+    pyramid = Image::GenerateMIPMap(std::move(image), wrapMode, alloc);
+    if (pyramid[0].Format() == PixelFormat::U256) {
+        uint8_t values[256];
+        for (int i = 0; i < 256; ++i)
+            values[i] = i;
+        pyramid[0].Encoding().ToLinear({values, 256}, {u256ToLinear.data(), 256});
+    }
+
+    if (options.precomputeSpectra) {
+        // Convert each level's RGB texels to _SigmoidPolynomialTexel_s
+        std::string channels[5] = {"c0", "c1", "c2", "scale", "illuminant"};
+        for (int level = 0; level < Levels(); ++level) {
+            Point2i res = LevelResolution(level);
+            Image texels(PixelFormat::Float, res, channels, nullptr, alloc);
+            ParallelFor(0, res.y, [&](int64_t y) {
+                for (int x = 0; x < res.x; ++x) {
+                    SigmoidPolynomialTexel t =
+                        ToSigmoidPolynomialTexel(Texel<RGB>(level, {x, int(y)}));
+                    for (int c = 0; c < 3; ++c)
+                        texels.SetChannel({x, int(y)}, c, t.c[c]);
+                    texels.SetChannel({x, int(y)}, 3, t.scale);
+                    texels.SetChannel({x, int(y)}, 4, t.illuminant);
+                }
+            });
+            sigmoidPyramid.push_back(std::move(texels));
+        }
+    }
+
+    TextureCompression compression = options.compression;
+    if (compression == TextureCompression::Auto)
+        compression = CompressedImage::SelectCompression(pyramid[0]);
+    this->options.compression = compression;
+    if (compression != TextureCompression::None) {
+        // Compress each level and then free the uncompressed texels
+        CHECK(CompressedImage::CanCompress(pyramid[0], compression));
+        size_t uncompressedBytes = 0;
+        for (const Image &level : pyramid) {
+            compressedPyramid.push_back(CompressedImage(level, compression, alloc));
+            uncompressedBytes += level.BytesUsed();
+        }
+
+        TextureCompressionError error =
+            CompressionError(pyramid[0], compressedPyramid[0]);
+        // Lossless compression has infinite PSNR; record it as 100 dB
+        int psnr = std::isinf(error.PSNR()) ? 100 : int(error.PSNR());
+        ReportValue(compressionPSNR, psnr);
+        LOG_VERBOSE("Compressed %s MIPMap with %s: %s", pyramid[0].Resolution(),
+                    compression, error);
+        pyramid.clear();
+        // Precomputed sigmoid texels may make the compressed MIPMap larger
+        size_t compressedBytes = BytesUsed();
+        if (uncompressedBytes > compressedBytes)
+            compressionBytesSaved += uncompressedBytes - compressedBytes;
+    }
+
+    imageMapBytes += BytesUsed();
+}
+
+MIPMap::MIPMap(std::unique_ptr<TiledImagePyramid> tiled,
+               const RGBColorSpace *colorSpace, WrapMode wrapMode,
+               const MIPMapFilterOptions &options)
+    : tiledPyramid(std::move(tiled)),
+      colorSpace(colorSpace),
+      wrapMode(wrapMode),
+      options(options) {
+    CHECK(colorSpace != nullptr && tiledPyramid != nullptr);
+    // Converting each texel would require reading the entire pyramid
+    CHECK(!options.precomputeSpectra);
+    CHECK(options.compression == TextureCompression::None);
+}
+
+SigmoidPolynomialTexel MIPMap::ToSigmoidPolynomialTexel(RGB rgb) const {
+    // Use the same spectra as _SpectrumImageTexture_ does for RGB lookups
+    rgb = ClampZero(rgb);
+    Float m = std::max({rgb.r, rgb.g, rgb.b});
+    if (m == 0)
+        return {};
+    Float scale = 1, illuminant = 0;
+    if (m > 1) {
+        // Follow _RGBSpectrum_ for RGB values that aren't reflectances
+        scale = illuminant = 2 * m;
+        rgb /= scale;
+    }
+    pstd::array<Float, 3> c = colorSpace->ToRGBCoeffs(rgb).Coefficients();
+    return {scale * c[0], scale * c[1], scale * c[2], scale, illuminant};
+}
+
+template <>
+SigmoidPolynomialTexel MIPMap::Texel(int level, Point2i st) const {
+    CHECK(level >= 0 && level < sigmoidPyramid.size());
+    const Image &image = sigmoidPyramid[level];
+    return {image.GetChannel(st, 0, wrapMode), image.GetChannel(st, 1, wrapMode),
+            image.GetChannel(st, 2, wrapMode), image.GetChannel(st, 3, wrapMode),
+            image.GetChannel(st, 4, wrapMode)};
+}
+
 template <typename T>
 T MIPMap::Lookup(const Point2f &st, Float width) const {
     // Compute MIPMap level
@@ -258,18 +556,7 @@ T MIPMap::Lookup(const Point2f &st, Vector2f dst0, Vector2f dst1) const {
             {std::abs(dst0[0]), std::abs(dst0[1]), std::abs(dst1[0]), std::abs(dst1[1])});
         return Lookup<T>(st, 2 * width);
     }
-    // Compute ellipse minor and major axes
-    if (LengthSquared(dst0) < LengthSquared(dst1))
-        pstd::swap(dst0, dst1);
-    Float majorLength = Length(dst0);
-    Float minorLength = Length(dst1);
-
-    // Clamp ellipse eccentricity if too large
-    if (minorLength * options.maxAnisotropy < majorLength && minorLength > 0) {
-        Float scale = majorLength / (minorLength * options.maxAnisotropy);
-        dst1 *= scale;
-        minorLength *= scale;
-    }
+    Float minorLength = EWAMinorAxis(&dst0, &dst1);
     if (minorLength == 0)
         return Bilerp<T>(0, st);
 
@@ -283,6 +570,81 @@ T MIPMap::Lookup(const Point2f &st, Vector2f dst0, Vector2f dst1) const {
             (lod - ilod) * EWA<T>(ilod + 1, st, dst0, dst1));
 }
 
+Float MIPMap::EWAMinorAxis(Vector2f *dst0, Vector2f *dst1) const {
+    // Compute ellipse minor and major axes
+    if (LengthSquared(*dst0) < LengthSquared(*dst1))
+        pstd::swap(*dst0, *dst1);
+    Float majorLength = Length(*dst0);
+    Float minorLength = Length(*dst1);
+
+    // Clamp ellipse eccentricity if too large
+    if (minorLength * options.maxAnisotropy < majorLength && minorLength > 0) {
+        Float scale = majorLength / (minorLength * options.maxAnisotropy);
+        *dst1 *= scale;
+        minorLength *= scale;
+    }
+    return minorLength;
+}
+
+Float MIPMap::LookupWithGradient(const Point2f &st, Vector2f dst0, Vector2f dst1,
+                                 Vector2f *dfdst) const {
+    // Differentiate the bilinear interpolation of the levels that Lookup()
+    // filters; levels past the top one are constant.
+    auto gradient = [&](int level) {
+        return level < Levels() - 1 ? BilerpGradient(level, st) : Vector2f(0, 0);
+    };
+    if (options.filter == FilterFunction::EWA) {
+        // Choose levels from the ellipse's minor axis, as Lookup() does
+        Vector2f e0 = dst0, e1 = dst1;
+        Float minorLength = EWAMinorAxis(&e0, &e1);
+        if (minorLength == 0)
+            *dfdst = gradient(0);
+        else {
+            Float lod = std::max<Float>(0, Levels() - 1 + Log2(minorLength));
+            int ilod = std::floor(lod);
+            *dfdst = Lerp(lod - ilod, gradient(ilod), gradient(ilod + 1));
+        }
+    } else {
+        // Choose levels from the filter width, as Lookup() does
+        Float width = 2 * std::max({std::abs(dst0[0]), std::abs(dst0[1]),
+                                    std::abs(dst1[0]), std::abs(dst1[1])});
+        Float level = Levels() - 1 + Log2(std::max<Float>(width, 1e-8));
+        int iLevel = std::max(0, int(std::floor(level)));
+        if (level >= Levels() - 1)
+            *dfdst = Vector2f(0, 0);
+        else if (options.filter == FilterFunction::Trilinear && iLevel > 0)
+            *dfdst = Lerp(level - iLevel, gradient(iLevel), gradient(iLevel + 1));
+        else
+            // Point sampling is differentiated as if it were bilinear
+            *dfdst = gradient(iLevel);
+    }
+    return Lookup<Float>(st, dst0, dst1);
+}
+
+Vector2f MIPMap::BilerpGradient(int level, Point2f st) const {
+    // Return the texel values that Bilerp<Float>() interpolates
+    int nc = NChannels();
+    auto texel = [&](int x, int y) {
+        if (nc == 1)
+            return GetChannel(level, {x, y}, 0);
+        else if (nc == 3)
+            return (GetChannel(level, {x, y}, 0) + GetChannel(level, {x, y}, 1) +
+                    GetChannel(level, {x, y}, 2)) /
+                   3;
+        CHECK_EQ(4, nc);
+        return GetChannel(level, {x, y}, 3);
+    };
+
+    Point2i res = LevelResolution(level);
+    Float x = st[0] * res[0] - 0.5f, y = st[1] * res[1] - 0.5f;
+    int xi = std::floor(x), yi = std::floor(y);
+    Float dx = x - xi, dy = y - yi;
+    Float v00 = texel(xi, yi), v10 = texel(xi + 1, yi);
+    Float v01 = texel(xi, yi + 1), v11 = texel(xi + 1, yi + 1);
+    return Vector2f(res[0] * Lerp(dy, v10 - v00, v11 - v01),
+                    res[1] * Lerp(dx, v01 - v00, v11 - v10));
+}
+
 template <typename T>
 T MIPMap::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
     if (level >= Levels())
@@ -315,6 +677,18 @@ T MIPMap::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
     int t0 = std::ceil(st[1] - 2 * invDet * vSqrt);
     int t1 = std::floor(st[1] + 2 * invDet * vSqrt);
 
+    if (const Image *image = KernelImage<T>(level)) {
+        // Filter the texels with the kernel specialized for the level
+        int nc = TexelChannels<T>(image->NChannels());
+        Float v[5];
+        auto ewa = [&](auto format, auto NC) {
+            return EWAKernel<decltype(format)::value, decltype(NC)::value>(
+                *image, wrapMode, u256ToLinear.data(), st, A, B, C, s0, s1, t0, t1, v);
+        };
+        if (DispatchFilterKernel(image->Format(), nc, ewa))
+            return TexelFromChannels<T>(v, nc);
+    }
+
     // Scan over ellipse bound and compute quadratic equation
     T sum{};
     Float sumWts = 0;
@@ -335,12 +709,11 @@ T MIPMap::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
     return sum / sumWts;
 }
 
-std::unique_ptr<MIPMap> MIPMap::CreateFromFile(const std::string &filename,
-                                               const MIPMapFilterOptions &options,
-                                               WrapMode wrapMode,
-                                               ColorEncodingHandle encoding,
-                                               Allocator alloc) {
+// Reads the image for a MIPMap and returns its channels in a canonical order
+static Image ReadMIPMapImage(const std::string &filename, ColorEncodingHandle encoding,
+                             Allocator alloc, const RGBColorSpace **colorSpace) {
     ImageAndMetadata imageAndMetadata = Image::Read(filename, alloc, encoding);
+    *colorSpace = imageAndMetadata.metadata.GetColorSpace();
 
     Image &image = imageAndMetadata.image;
     if (image.NChannels() != 1) {
@@ -365,10 +738,145 @@ std::unique_ptr<MIPMap> MIPMap::CreateFromFile(const std::string &filename,
                 ErrorExit("%s: image doesn't have R, G, and B channels", filename);
         }
     }
+    return std::move(image);
+}
+
+// Returns the name of the file in the texture cache directory that holds
+// the pyramid for the given image and parameters.
+static std::string CachedPyramidFilename(const std::string &filename, WrapMode wrapMode,
+                                         ColorEncodingHandle encoding) {
+    std::string encodingName = encoding ? encoding.Name() : std::string("linear");
+    uint64_t hash = Hash(HashBuffer(filename.data(), filename.size()), wrapMode,
+                         HashBuffer(encodingName.data(), encodingName.size()));
+    std::string base = filename.substr(filename.find_last_of("/\\") + 1);
+    return StringPrintf("%s/%s-%s.mip", Options->textureCacheDir, base,
+                        std::to_string(hash));
+}
+
+// Returns a tiled pyramid for the given image file if there is a current
+// preprocessed one.
+static std::unique_ptr<TiledImagePyramid> OpenTiledPyramid(const std::string &filename,
+                                                           WrapMode wrapMode,
+                                                           ColorEncodingHandle encoding) {
+    // Texels are read directly from the mapped file unless the texture
+    // cache's memory budget should apply.
+    bool memoryMap = Options->textureCacheMB == 0;
+    if (HasExtension(filename, "mip")) {
+        std::unique_ptr<TiledImagePyramid> tiled =
+            TiledImagePyramid::Open(filename, memoryMap);
+        if (!tiled)
+            ErrorExit("%s: unable to read MIP pyramid file.", filename);
+        if (tiled->Metadata().wrapMode != wrapMode)
+            Warning("%s: pyramid was filtered with \"%s\" wrap mode rather than "
+                    "\"%s\".",
+                    filename, tiled->Metadata().wrapMode, wrapMode);
+        return tiled;
+    }
+
+    // Look for a pyramid file next to the image and then in the cache
+    std::vector<std::string> tiledFilenames = {filename + ".mip"};
+    if (!Options->textureCacheDir.empty())
+        tiledFilenames.push_back(CachedPyramidFilename(filename, wrapMode, encoding));
+    for (const std::string &tiledFilename : tiledFilenames) {
+        std::unique_ptr<TiledImagePyramid> tiled =
+            TiledImagePyramid::Open(tiledFilename, memoryMap);
+        if (!tiled)
+            continue;
+        if (tiled->Metadata().wrapMode != wrapMode ||
+            (tiled->Format() == PixelFormat::U256 && encoding &&
+             tiled->Encoding() != encoding)) {
+            LOG_VERBOSE("%s: ignoring pyramid made with different parameters",
+                        tiledFilename);
+            continue;
+        }
+        if (!tiled->MatchesSource(filename)) {
+            Warning("%s: ignoring out-of-date MIP pyramid file.", tiledFilename);
+            continue;
+        }
+        ++pyramidFilesUsed;
+        return tiled;
+    }
+    return {};
+}
+
+bool MIPMap::WriteTiledPyramid(const std::string &filename, WrapMode wrapMode,
+                               ColorEncodingHandle encoding,
+                               const std::string &tiledFilename) {
+    // Record the image's state before it's read so that changes made while
+    // the pyramid is being created aren't missed.
+    pstd::optional<int64_t> mtime = FileModificationTime(filename);
+    pstd::optional<uint64_t> hash = HashFileContents(filename);
+    if (!mtime || !hash) {
+        Warning("%s: %s", filename, ErrorString());
+        return false;
+    }
+
+    TiledImageMetadata metadata;
+    Image image = ReadMIPMapImage(filename, encoding, {}, &metadata.colorSpace);
+    pstd::vector<Image> pyramid = Image::GenerateMIPMap(std::move(image), wrapMode);
+    metadata.wrapMode = wrapMode;
+    metadata.sourceModificationTime = *mtime;
+    metadata.sourceHash = *hash;
+    return TiledImagePyramid::Write(pyramid, metadata, tiledFilename);
+}
+
+std::unique_ptr<MIPMap> MIPMap::CreateFromFile(const std::string &filename,
+                                               const MIPMapFilterOptions &options,
+                                               WrapMode wrapMode,
+                                               ColorEncodingHandle encoding,
+                                               Allocator alloc) {
+    // Use a preprocessed pyramid for the image if there is a current one
+    std::unique_ptr<TiledImagePyramid> tiled =
+        OpenTiledPyramid(filename, wrapMode, encoding);
+    if (!tiled && !Options->textureCacheDir.empty()) {
+        // Create one in the cache directory for later runs to use
+        std::string tiledFilename = CachedPyramidFilename(filename, wrapMode, encoding);
+        if (WriteTiledPyramid(filename, wrapMode, encoding, tiledFilename)) {
+            ++pyramidFilesWritten;
+            tiled = TiledImagePyramid::Open(tiledFilename, Options->textureCacheMB == 0);
+        }
+    }
 
-    const RGBColorSpace *colorSpace = imageAndMetadata.metadata.GetColorSpace();
+    TiledImageMetadata metadata;
+    if (!tiled && Options->textureCacheMB > 0) {
+        // Store the pyramid in temporary tiles that are read back through the
+        // texture tile cache; only the tiles that are accessed will be in
+        // memory.
+        Image image = ReadMIPMapImage(filename, encoding, alloc, &metadata.colorSpace);
+        pstd::vector<Image> pyramid =
+            Image::GenerateMIPMap(std::move(image), wrapMode, alloc);
+        metadata.wrapMode = wrapMode;
+        tiled = TiledImagePyramid::CreateTemporary(pyramid, metadata);
+    }
+
+    if (tiled) {
+        MIPMapFilterOptions tiledOptions = options;
+        if (options.precomputeSpectra) {
+            Warning("%s: spectra can't be precomputed for tiled textures.", filename);
+            tiledOptions.precomputeSpectra = false;
+        }
+        if (options.compression != TextureCompression::None) {
+            Warning("%s: tiled textures can't be compressed.", filename);
+            tiledOptions.compression = TextureCompression::None;
+        }
+        const RGBColorSpace *colorSpace = tiled->Metadata().colorSpace;
+        return std::make_unique<MIPMap>(std::move(tiled), colorSpace, wrapMode,
+                                        tiledOptions);
+    }
+
+    const RGBColorSpace *colorSpace;
+    Image image = ReadMIPMapImage(filename, encoding, alloc, &colorSpace);
+    MIPMapFilterOptions imageOptions = options;
+    if (options.compression != TextureCompression::None &&
+        options.compression != TextureCompression::Auto &&
+        !CompressedImage::CanCompress(image, options.compression)) {
+        Warning("%s: %s compression isn't supported for %s images with %d channels. "
+                "Leaving texture uncompressed.",
+                filename, options.compression, image.Format(), image.NChannels());
+        imageOptions.compression = TextureCompression::None;
+    }
     return std::make_unique<MIPMap>(std::move(image), colorSpace, wrapMode, alloc,
-                                    options);
+                                    imageOptions);
 }
 
 template <typename T>
@@ -381,41 +889,116 @@ T MIPMap::Bilerp(int level, Point2f st) const {
     T::unimplemented_function;
 }
 
+template <>
+const Image *MIPMap::KernelImage<Float>(int level) const {
+    return (pyramid.empty() || options.scalarFiltering) ? nullptr : &pyramid[level];
+}
+
+template <>
+const Image *MIPMap::KernelImage<RGB>(int level) const {
+    return KernelImage<Float>(level);
+}
+
+template <>
+const Image *MIPMap::KernelImage<SigmoidPolynomialTexel>(int level) const {
+    return (sigmoidPyramid.empty() || options.scalarFiltering) ? nullptr
+                                                                : &sigmoidPyramid[level];
+}
+
 template <>
 Float MIPMap::Bilerp(int level, Point2f st) const {
-    CHECK(level >= 0 && level < pyramid.size());
-    switch (pyramid[level].NChannels()) {
+    if (const Image *image = KernelImage<Float>(level)) {
+        int nc = image->NChannels();
+        Float v[5];
+        auto bilerp = [&](auto format, auto NC) {
+            BilerpKernel<decltype(format)::value, decltype(NC)::value>(
+                *image, wrapMode, u256ToLinear.data(), st, v);
+            return true;
+        };
+        if (DispatchFilterKernel(image->Format(), nc, bilerp))
+            // Average RGB and return alpha, as below
+            return nc == 1 ? v[0] : (nc == 3 ? (v[0] + v[1] + v[2]) / 3 : v[3]);
+    }
+
+    switch (NChannels()) {
     case 1:
-        return pyramid[level].BilerpChannel(st, 0, wrapMode);
+        return BilerpChannel(level, st, 0);
     case 3:
-        return pyramid[level].Bilerp(st, wrapMode).Average();
+        return (BilerpChannel(level, st, 0) + BilerpChannel(level, st, 1) +
+                BilerpChannel(level, st, 2)) /
+               3;
     case 4:
         // Return alpha
-        return pyramid[level].BilerpChannel(st, 3, wrapMode);
+        return BilerpChannel(level, st, 3);
     default:
-        LOG_FATAL("Unexpected number of image channels: %d", pyramid[level].NChannels());
+        LOG_FATAL("Unexpected number of image channels: %d", NChannels());
     }
 }
 
 template <>
 RGB MIPMap::Bilerp(int level, Point2f st) const {
-    CHECK(level >= 0 && level < pyramid.size());
-    if (pyramid[level].NChannels() == 3 || pyramid[level].NChannels() == 4) {
+    if (const Image *image = KernelImage<RGB>(level)) {
+        int nc = TexelChannels<RGB>(image->NChannels());
+        Float v[3];
+        auto bilerp = [&](auto format, auto NC) {
+            BilerpKernel<decltype(format)::value, decltype(NC)::value>(
+                *image, wrapMode, u256ToLinear.data(), st, v);
+            return true;
+        };
+        if (DispatchFilterKernel(image->Format(), nc, bilerp))
+            return TexelFromChannels<RGB>(v, nc);
+    }
+
+    if (NChannels() == 3 || NChannels() == 4) {
         RGB rgb;
         for (int c = 0; c < 3; ++c)
-            rgb[c] = pyramid[level].BilerpChannel(st, c, wrapMode);
+            rgb[c] = BilerpChannel(level, st, c);
         return rgb;
     } else {
-        CHECK_EQ(1, pyramid[level].NChannels());
-        Float v = pyramid[level].BilerpChannel(st, 0, wrapMode);
+        CHECK_EQ(1, NChannels());
+        Float v = BilerpChannel(level, st, 0);
         return RGB(v, v, v);
     }
 }
 
+template <>
+SigmoidPolynomialTexel MIPMap::Bilerp(int level, Point2f st) const {
+    CHECK(level >= 0 && level < sigmoidPyramid.size());
+    if (const Image *image = KernelImage<SigmoidPolynomialTexel>(level)) {
+        Float v[5];
+        auto bilerp = [&](auto format, auto NC) {
+            BilerpKernel<decltype(format)::value, decltype(NC)::value>(
+                *image, wrapMode, u256ToLinear.data(), st, v);
+            return true;
+        };
+        if (DispatchFilterKernel(image->Format(), 5, bilerp))
+            return TexelFromChannels<SigmoidPolynomialTexel>(v, 5);
+    }
+    const Image &image = sigmoidPyramid[level];
+    return {image.BilerpChannel(st, 0, wrapMode), image.BilerpChannel(st, 1, wrapMode),
+            image.BilerpChannel(st, 2, wrapMode), image.BilerpChannel(st, 3, wrapMode),
+            image.BilerpChannel(st, 4, wrapMode)};
+}
+
+size_t MIPMap::BytesUsed() const {
+    // Tiles of tiled pyramids are owned by the texture tile cache or the
+    // file mapping and aren't included.
+    size_t bytes = 0;
+    for (const Image &image : pyramid)
+        bytes += image.BytesUsed();
+    for (const CompressedImage &image : compressedPyramid)
+        bytes += image.BytesUsed();
+    for (const Image &image : sigmoidPyramid)
+        bytes += image.BytesUsed();
+    return bytes;
+}
+
 std::string MIPMap::ToString() const {
-    return StringPrintf("[ MIPMap pyramid: %s colorSpace: %s wrapMode: %s "
-                        "options: %s ]",
-                        pyramid, colorSpace->ToString(), wrapMode, options);
+    std::string tiled = tiledPyramid ? tiledPyramid->ToString() : "(nullptr)";
+    return StringPrintf("[ MIPMap pyramid: %s tiledPyramid: %s compressedPyramid: %s "
+                        "colorSpace: %s wrapMode: %s options: %s ]",
+                        pyramid, tiled, compressedPyramid, colorSpace->ToString(),
+                        wrapMode, options);
 }
 
 // Explicit template instantiation..
@@ -423,5 +1006,8 @@ template Float MIPMap::Lookup(const Point2f &st, Float width) const;
 template RGB MIPMap::Lookup(const Point2f &st, Float width) const;
 template Float MIPMap::Lookup(const Point2f &st, Vector2f, Vector2f) const;
 template RGB MIPMap::Lookup(const Point2f &st, Vector2f, Vector2f) const;
+template SigmoidPolynomialTexel MIPMap::Lookup(const Point2f &st, Float width) const;
+template SigmoidPolynomialTexel MIPMap::Lookup(const Point2f &st, Vector2f,
+                                               Vector2f) const;
 
 }  // namespace pbrt
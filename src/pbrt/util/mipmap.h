@@ -9,6 +9,8 @@
 
 #include <pbrt/util/image.h>
 #include <pbrt/util/pstd.h>
+#include <pbrt/util/texcache.h>
+#include <pbrt/util/texcompress.h>
 #include <pbrt/util/vecmath.h>
 
 #include <memory>
@@ -38,44 +40,180 @@ std::string ToString(FilterFunction f);
 struct MIPMapFilterOptions {
     FilterFunction filter = FilterFunction::EWA;
     Float maxAnisotropy = 8.f;
+    // If set, RGB texels are also converted to sigmoid polynomial
+    // coefficients when the MIPMap is created so that spectral lookups
+    // don't need to convert each filtered RGB value.
+    bool precomputeSpectra = false;
+    // Stores the pyramid's texels in a compressed format that is decoded
+    // as texels are accessed.
+    TextureCompression compression = TextureCompression::None;
+    // Filters in-memory pyramids with the general texel access code rather
+    // than the kernels that are specialized for each pixel format; the
+    // results are the reference that the kernels are tested against.
+    bool scalarFiltering = false;
     std::string ToString() const;
 };
 
+// SigmoidPolynomialTexel Definition
+// Stores the coefficients of an RGBSigmoidPolynomial premultiplied by the
+// scale factor of the spectrum it represents, along with that scale.
+// Filtering premultiplied texels gives the scale-weighted average of their
+// coefficients. Black texels are all zero, so they only lower the filtered
+// scale, and a texel with zero scale is black. Texels for RGB values that
+// aren't reflectances also store their scale in _illuminant_: as with
+// _RGBSpectrum_, their spectra are multiplied by the color space's
+// illuminant, and filtering gives the scale-weighted fraction of them.
+struct SigmoidPolynomialTexel {
+    SigmoidPolynomialTexel() = default;
+    SigmoidPolynomialTexel(Float c0, Float c1, Float c2, Float scale,
+                           Float illuminant = 0)
+        : c{c0, c1, c2}, scale(scale), illuminant(illuminant) {}
+
+    SigmoidPolynomialTexel operator+(const SigmoidPolynomialTexel &t) const {
+        return {c[0] + t.c[0], c[1] + t.c[1], c[2] + t.c[2], scale + t.scale,
+                illuminant + t.illuminant};
+    }
+    SigmoidPolynomialTexel &operator+=(const SigmoidPolynomialTexel &t) {
+        return *this = *this + t;
+    }
+    SigmoidPolynomialTexel operator/(Float d) const {
+        return {c[0] / d, c[1] / d, c[2] / d, scale / d, illuminant / d};
+    }
+    friend SigmoidPolynomialTexel operator*(Float w, const SigmoidPolynomialTexel &t) {
+        return {w * t.c[0], w * t.c[1], w * t.c[2], w * t.scale, w * t.illuminant};
+    }
+
+    RGBSigmoidPolynomial Polynomial() const {
+        if (scale == 0)
+            return RGBSigmoidPolynomial(0, 0, -Infinity);
+        return RGBSigmoidPolynomial(c[0] / scale, c[1] / scale, c[2] / scale);
+    }
+    // Returns the factor that the polynomial's values are multiplied by
+    // given the illuminant's value at the same wavelength.
+    Float IlluminantFactor(Float illum) const {
+        if (scale == 0)
+            return 1;
+        return Lerp(illuminant / scale, 1, illum);
+    }
+
+    std::string ToString() const;
+
+    Float c[3] = {0, 0, 0}, scale = 0, illuminant = 0;
+};
+
+inline SigmoidPolynomialTexel Lerp(Float t, const SigmoidPolynomialTexel &a,
+                                   const SigmoidPolynomialTexel &b) {
+    return (1 - t) * a + t * b;
+}
+
 // MIPMap Definition
 class MIPMap {
   public:
     MIPMap(Image image, const RGBColorSpace *colorSpace, WrapMode wrapMode,
            Allocator alloc, const MIPMapFilterOptions &options);
+    // Creates a MIPMap whose texels are read on demand from a tiled pyramid
+    MIPMap(std::unique_ptr<TiledImagePyramid> tiledPyramid,
+           const RGBColorSpace *colorSpace, WrapMode wrapMode,
+           const MIPMapFilterOptions &options);
     static std::unique_ptr<MIPMap> CreateFromFile(const std::string &filename,
                                                   const MIPMapFilterOptions &options,
                                                   WrapMode wrapMode,
                                                   ColorEncodingHandle encoding,
                                                   Allocator alloc);
+    // Filters the image into a pyramid and writes it to a tiled file that
+    // CreateFromFile() will use in place of the image while the image is
+    // unchanged.
+    static bool WriteTiledPyramid(const std::string &filename, WrapMode wrapMode,
+                                  ColorEncodingHandle encoding,
+                                  const std::string &tiledFilename);
 
     template <typename T>
     T Lookup(const Point2f &st, Float width = 0.f) const;
     template <typename T>
     T Lookup(const Point2f &st, Vector2f dstdx, Vector2f dstdy) const;
+    // Returns the same value as Lookup<Float>() and also the gradient of the
+    // texture with respect to $(s,t)$, which is found by differentiating
+    // the bilinear interpolation of the MIP levels that Lookup() filters.
+    Float LookupWithGradient(const Point2f &st, Vector2f dstdx, Vector2f dstdy,
+                             Vector2f *dfdst) const;
 
     Point2i LevelResolution(int level) const {
+        if (tiledPyramid)
+            return tiledPyramid->LevelResolution(level);
+        if (!compressedPyramid.empty()) {
+            CHECK(level >= 0 && level < compressedPyramid.size());
+            return compressedPyramid[level].Resolution();
+        }
         CHECK(level >= 0 && level < pyramid.size());
         return pyramid[level].Resolution();
     }
-    int Levels() const { return int(pyramid.size()); }
+    int Levels() const {
+        if (tiledPyramid)
+            return tiledPyramid->Levels();
+        return compressedPyramid.empty() ? int(pyramid.size())
+                                         : int(compressedPyramid.size());
+    }
+    // Returns the number of bytes used for texels held in memory
+    size_t BytesUsed() const;
 
     const RGBColorSpace *GetRGBColorSpace() const { return colorSpace; }
+    bool HasPrecomputedSpectra() const { return !sigmoidPyramid.empty(); }
 
     std::string ToString() const;
 
   private:
+    SigmoidPolynomialTexel ToSigmoidPolynomialTexel(RGB rgb) const;
+
+    int NChannels() const {
+        if (tiledPyramid)
+            return tiledPyramid->NChannels();
+        return compressedPyramid.empty() ? pyramid[0].NChannels()
+                                         : compressedPyramid[0].NChannels();
+    }
+    Float GetChannel(int level, Point2i st, int c) const {
+        if (tiledPyramid)
+            return tiledPyramid->GetChannel(level, st, c, wrapMode);
+        if (!compressedPyramid.empty()) {
+            CHECK(level >= 0 && level < compressedPyramid.size());
+            return compressedPyramid[level].GetChannel(st, c, wrapMode);
+        }
+        CHECK(level >= 0 && level < pyramid.size());
+        return pyramid[level].GetChannel(st, c, wrapMode);
+    }
+    Float BilerpChannel(int level, Point2f st, int c) const {
+        if (tiledPyramid)
+            return tiledPyramid->BilerpChannel(level, st, c, wrapMode);
+        if (!compressedPyramid.empty()) {
+            CHECK(level >= 0 && level < compressedPyramid.size());
+            return compressedPyramid[level].BilerpChannel(st, c, wrapMode);
+        }
+        CHECK(level >= 0 && level < pyramid.size());
+        return pyramid[level].BilerpChannel(st, c, wrapMode);
+    }
+
     template <typename T>
     T Texel(int level, Point2i st) const;
     template <typename T>
     T Bilerp(int level, Point2f st) const;
+    Vector2f BilerpGradient(int level, Point2f st) const;
+    // Makes _dst0_ the ellipse's major axis, clamps its eccentricity, and
+    // returns the length of its minor axis.
+    Float EWAMinorAxis(Vector2f *dst0, Vector2f *dst1) const;
     template <typename T>
     T EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const;
+    // Returns the in-memory image that T lookups at the level filter with
+    // the specialized kernels, or nullptr if the general code must be used.
+    template <typename T>
+    const Image *KernelImage(int level) const;
 
+    // Exactly one of these stores the image pyramid
     pstd::vector<Image> pyramid;
+    std::unique_ptr<TiledImagePyramid> tiledPyramid;
+    pstd::vector<CompressedImage> compressedPyramid;
+    // Only initialized if MIPMapFilterOptions::precomputeSpectra is set
+    pstd::vector<Image> sigmoidPyramid;
+    // Linear values of 8-bit texels, which all levels encode in the same way
+    pstd::array<Float, 256> u256ToLinear;
     const RGBColorSpace *colorSpace;
     WrapMode wrapMode;
     MIPMapFilterOptions options;
@@ -0,0 +1,331 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_UTIL_SIMD_H
+#define PBRT_UTIL_SIMD_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/float.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// SIMD vector types are only provided for 32-bit floats in CPU code; GPU
+// code and double-precision builds use the scalar fallbacks.
+#if !defined(PBRT_IS_GPU_CODE) && !defined(PBRT_FLOAT_AS_DOUBLE)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PBRT_HAVE_SSE2
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#define PBRT_HAVE_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__F16C__)
+#define PBRT_HAVE_F16C
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define PBRT_HAVE_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+#if defined(PBRT_HAVE_SSE2) || defined(PBRT_HAVE_NEON)
+#define PBRT_HAVE_SIMD
+#endif
+
+namespace pbrt {
+namespace simd {
+
+// Scalar SIMD Function Definitions
+// These allow code to be written once for both Float and the vector types.
+PBRT_CPU_GPU inline Float Sqrt(Float v) {
+    return std::sqrt(v);
+}
+PBRT_CPU_GPU inline Float Exp(Float v) {
+    return std::exp(v);
+}
+PBRT_CPU_GPU inline Float Min(Float a, Float b) {
+    return std::min(a, b);
+}
+PBRT_CPU_GPU inline Float Max(Float a, Float b) {
+    return std::max(a, b);
+}
+PBRT_CPU_GPU inline Float SafeDiv(Float a, Float b) {
+    return b != 0 ? a / b : 0;
+}
+PBRT_CPU_GPU inline Float ClampZero(Float v) {
+    return std::max<Float>(0, v);
+}
+
+#ifdef PBRT_HAVE_SIMD
+// Vec4f Definition
+class Vec4f {
+  public:
+    // Vec4f Public Methods
+    static constexpr int Width = 4;
+
+#ifdef PBRT_HAVE_SSE2
+    using Native = __m128;
+    Vec4f() = default;
+    Vec4f(Native v) : v(v) {}
+    explicit Vec4f(float f) : v(_mm_set1_ps(f)) {}
+    static Vec4f Load(const float *p) { return _mm_loadu_ps(p); }
+    void Store(float *p) const { _mm_storeu_ps(p, v); }
+
+    Vec4f operator+(Vec4f b) const { return _mm_add_ps(v, b.v); }
+    Vec4f operator-(Vec4f b) const { return _mm_sub_ps(v, b.v); }
+    Vec4f operator*(Vec4f b) const { return _mm_mul_ps(v, b.v); }
+    Vec4f operator/(Vec4f b) const { return _mm_div_ps(v, b.v); }
+    Vec4f operator-() const { return _mm_xor_ps(v, _mm_set1_ps(-0.f)); }
+
+    friend Vec4f Min(Vec4f a, Vec4f b) { return _mm_min_ps(a.v, b.v); }
+    friend Vec4f Max(Vec4f a, Vec4f b) { return _mm_max_ps(a.v, b.v); }
+    friend Vec4f Sqrt(Vec4f a) { return _mm_sqrt_ps(a.v); }
+    // Returns a/b where b is non-zero and zero elsewhere
+    friend Vec4f SafeDiv(Vec4f a, Vec4f b) {
+        __m128 nonZero = _mm_cmpneq_ps(b.v, _mm_setzero_ps());
+        return _mm_and_ps(nonZero, _mm_div_ps(a.v, b.v));
+    }
+    // Note that NaNs become zero, as with std::max(0, v)
+    friend Vec4f ClampZero(Vec4f a) { return _mm_max_ps(a.v, _mm_setzero_ps()); }
+    friend Vec4f Floor(Vec4f a) {
+        // Truncate and then correct negative non-integers
+        __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.f)));
+    }
+    // Returns 2^n for integer-valued _n_ in [-126, 127]
+    friend Vec4f Exp2Int(Vec4f n) {
+        __m128i e = _mm_add_epi32(_mm_cvttps_epi32(n.v), _mm_set1_epi32(127));
+        return _mm_castsi128_ps(_mm_slli_epi32(e, 23));
+    }
+    // Comparisons return masks with all bits set in the elements where
+    // they're true, for use with Select()
+    friend Vec4f Less(Vec4f a, Vec4f b) { return _mm_cmplt_ps(a.v, b.v); }
+    friend Vec4f IsNaN(Vec4f a) { return _mm_cmpunord_ps(a.v, a.v); }
+    // Returns the elements of _a_ where _mask_ is set and of _b_ elsewhere
+    friend Vec4f Select(Vec4f mask, Vec4f a, Vec4f b) {
+        return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+    }
+    // Returns the sum of the elements
+    friend float ReduceAdd(Vec4f a) {
+        __m128 s = _mm_add_ps(a.v, _mm_movehl_ps(a.v, a.v));
+        return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+    }
+    // Splits the elements of _a_ followed by _b_ into the even- and
+    // odd-indexed ones
+    friend void Unzip(Vec4f a, Vec4f b, Vec4f *even, Vec4f *odd) {
+        even->v = _mm_shuffle_ps(a.v, b.v, _MM_SHUFFLE(2, 0, 2, 0));
+        odd->v = _mm_shuffle_ps(a.v, b.v, _MM_SHUFFLE(3, 1, 3, 1));
+    }
+    // As Unzip(), but for pairs of elements
+    friend void UnzipPairs(Vec4f a, Vec4f b, Vec4f *even, Vec4f *odd) {
+        even->v = _mm_movelh_ps(a.v, b.v);
+        odd->v = _mm_movehl_ps(b.v, a.v);
+    }
+#else
+    using Native = float32x4_t;
+    Vec4f() = default;
+    Vec4f(Native v) : v(v) {}
+    explicit Vec4f(float f) : v(vdupq_n_f32(f)) {}
+    static Vec4f Load(const float *p) { return vld1q_f32(p); }
+    void Store(float *p) const { vst1q_f32(p, v); }
+
+    Vec4f operator+(Vec4f b) const { return vaddq_f32(v, b.v); }
+    Vec4f operator-(Vec4f b) const { return vsubq_f32(v, b.v); }
+    Vec4f operator*(Vec4f b) const { return vmulq_f32(v, b.v); }
+    Vec4f operator/(Vec4f b) const { return vdivq_f32(v, b.v); }
+    Vec4f operator-() const { return vnegq_f32(v); }
+
+    friend Vec4f Min(Vec4f a, Vec4f b) { return vminq_f32(a.v, b.v); }
+    friend Vec4f Max(Vec4f a, Vec4f b) { return vmaxq_f32(a.v, b.v); }
+    friend Vec4f Sqrt(Vec4f a) { return vsqrtq_f32(a.v); }
+    friend Vec4f SafeDiv(Vec4f a, Vec4f b) {
+        uint32x4_t zero = vceqq_f32(b.v, vdupq_n_f32(0.f));
+        return vreinterpretq_f32_u32(
+            vbicq_u32(vreinterpretq_u32_f32(vdivq_f32(a.v, b.v)), zero));
+    }
+    friend Vec4f ClampZero(Vec4f a) {
+        // vmaxq_f32() propagates NaNs, so select zero unless a > 0
+        uint32x4_t positive = vcgtq_f32(a.v, vdupq_n_f32(0.f));
+        return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a.v), positive));
+    }
+    friend Vec4f Floor(Vec4f a) { return vrndmq_f32(a.v); }
+    friend Vec4f Exp2Int(Vec4f n) {
+        int32x4_t e = vaddq_s32(vcvtq_s32_f32(n.v), vdupq_n_s32(127));
+        return vreinterpretq_f32_s32(vshlq_n_s32(e, 23));
+    }
+    friend Vec4f Less(Vec4f a, Vec4f b) {
+        return vreinterpretq_f32_u32(vcltq_f32(a.v, b.v));
+    }
+    friend Vec4f IsNaN(Vec4f a) {
+        return vreinterpretq_f32_u32(vmvnq_u32(vceqq_f32(a.v, a.v)));
+    }
+    friend Vec4f Select(Vec4f mask, Vec4f a, Vec4f b) {
+        return vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v);
+    }
+    friend float ReduceAdd(Vec4f a) { return vaddvq_f32(a.v); }
+    friend void Unzip(Vec4f a, Vec4f b, Vec4f *even, Vec4f *odd) {
+        even->v = vuzp1q_f32(a.v, b.v);
+        odd->v = vuzp2q_f32(a.v, b.v);
+    }
+    friend void UnzipPairs(Vec4f a, Vec4f b, Vec4f *even, Vec4f *odd) {
+        even->v = vcombine_f32(vget_low_f32(a.v), vget_low_f32(b.v));
+        odd->v = vcombine_f32(vget_high_f32(a.v), vget_high_f32(b.v));
+    }
+#endif
+
+  private:
+    Native v;
+};
+
+// Declare the Vec4f friend functions at namespace scope so that they can be
+// called with qualified names, as with the scalar versions.
+Vec4f Min(Vec4f a, Vec4f b);
+Vec4f Max(Vec4f a, Vec4f b);
+Vec4f Sqrt(Vec4f a);
+Vec4f SafeDiv(Vec4f a, Vec4f b);
+Vec4f ClampZero(Vec4f a);
+Vec4f Floor(Vec4f a);
+Vec4f Exp2Int(Vec4f n);
+Vec4f Less(Vec4f a, Vec4f b);
+Vec4f IsNaN(Vec4f a);
+Vec4f Select(Vec4f mask, Vec4f a, Vec4f b);
+float ReduceAdd(Vec4f a);
+void Unzip(Vec4f a, Vec4f b, Vec4f *even, Vec4f *odd);
+void UnzipPairs(Vec4f a, Vec4f b, Vec4f *even, Vec4f *odd);
+
+#ifdef PBRT_HAVE_AVX2
+// Vec8f Definition
+class Vec8f {
+  public:
+    // Vec8f Public Methods
+    static constexpr int Width = 8;
+
+    Vec8f() = default;
+    Vec8f(__m256 v) : v(v) {}
+    explicit Vec8f(float f) : v(_mm256_set1_ps(f)) {}
+    static Vec8f Load(const float *p) { return _mm256_loadu_ps(p); }
+    void Store(float *p) const { _mm256_storeu_ps(p, v); }
+
+    Vec8f operator+(Vec8f b) const { return _mm256_add_ps(v, b.v); }
+    Vec8f operator-(Vec8f b) const { return _mm256_sub_ps(v, b.v); }
+    Vec8f operator*(Vec8f b) const { return _mm256_mul_ps(v, b.v); }
+    Vec8f operator/(Vec8f b) const { return _mm256_div_ps(v, b.v); }
+    Vec8f operator-() const { return _mm256_xor_ps(v, _mm256_set1_ps(-0.f)); }
+
+    friend Vec8f Min(Vec8f a, Vec8f b) { return _mm256_min_ps(a.v, b.v); }
+    friend Vec8f Max(Vec8f a, Vec8f b) { return _mm256_max_ps(a.v, b.v); }
+    friend Vec8f Sqrt(Vec8f a) { return _mm256_sqrt_ps(a.v); }
+    friend Vec8f SafeDiv(Vec8f a, Vec8f b) {
+        __m256 nonZero = _mm256_cmp_ps(b.v, _mm256_setzero_ps(), _CMP_NEQ_UQ);
+        return _mm256_and_ps(nonZero, _mm256_div_ps(a.v, b.v));
+    }
+    friend Vec8f ClampZero(Vec8f a) { return _mm256_max_ps(a.v, _mm256_setzero_ps()); }
+    friend Vec8f Floor(Vec8f a) { return _mm256_floor_ps(a.v); }
+    friend Vec8f Exp2Int(Vec8f n) {
+        __m256i e = _mm256_add_epi32(_mm256_cvttps_epi32(n.v), _mm256_set1_epi32(127));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+    }
+    friend Vec8f Less(Vec8f a, Vec8f b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+    friend Vec8f IsNaN(Vec8f a) { return _mm256_cmp_ps(a.v, a.v, _CMP_UNORD_Q); }
+    friend Vec8f Select(Vec8f mask, Vec8f a, Vec8f b) {
+        return _mm256_blendv_ps(b.v, a.v, mask.v);
+    }
+    friend float ReduceAdd(Vec8f a) {
+        return ReduceAdd(Vec4f(_mm_add_ps(_mm256_castps256_ps128(a.v),
+                                          _mm256_extractf128_ps(a.v, 1))));
+    }
+
+  private:
+    __m256 v;
+};
+
+Vec8f Min(Vec8f a, Vec8f b);
+Vec8f Max(Vec8f a, Vec8f b);
+Vec8f Sqrt(Vec8f a);
+Vec8f SafeDiv(Vec8f a, Vec8f b);
+Vec8f ClampZero(Vec8f a);
+Vec8f Floor(Vec8f a);
+Vec8f Exp2Int(Vec8f n);
+Vec8f Less(Vec8f a, Vec8f b);
+Vec8f IsNaN(Vec8f a);
+Vec8f Select(Vec8f mask, Vec8f a, Vec8f b);
+float ReduceAdd(Vec8f a);
+#endif  // PBRT_HAVE_AVX2
+
+// SIMD Function Definitions
+// Computes e^x using the Cephes single-precision polynomial, which has a
+// relative error of about 1e-7 where the result is a normal float. As with
+// std::exp(), NaNs are propagated, results that overflow are infinite and
+// ones that underflow are denormal or zero.
+template <typename V>
+inline V Exp(V v) {
+    V x = Min(Max(v, V(-103.972084f)), V(88.7228391f));
+    // Split x into n log(2) + r with |r| <= log(2)/2
+    V n = Floor(x * V(1.44269504088896341f) + V(0.5f));
+    V r = x - n * V(0.693359375f) - n * V(-2.12194440e-4f);
+
+    // Evaluate the polynomial approximation of e^r
+    V p = V(1.9875691500E-4f);
+    p = p * r + V(1.3981999507E-3f);
+    p = p * r + V(8.3334519073E-3f);
+    p = p * r + V(4.1665795894E-2f);
+    p = p * r + V(1.6666665459E-1f);
+    p = p * r + V(5.0000001201E-1f);
+    p = p * (r * r) + r + V(1.f);
+
+    // Scale by 2^n in two steps, since 2^n isn't a normal float at the
+    // ends of the range
+    V n0 = Floor(n * V(0.5f));
+    V e = p * Exp2Int(n0) * Exp2Int(n - n0);
+
+    // Handle the inputs that were clamped above
+    e = Select(Less(v, V(-103.972084f)), V(0.f), e);
+    e = Select(Less(V(88.7228391f), v), V(Infinity), e);
+    return Select(IsNaN(v), v, e);
+}
+#endif  // PBRT_HAVE_SIMD
+
+// Converts _n_ half-precision values to floats and vice versa, with the
+// hardware conversion instructions where they are available. Both round
+// to nearest even, so the results match Half's conversions other than in
+// the payloads of NaNs.
+inline void HalfToFloat(const Half *h, float *f, size_t n) {
+    size_t i = 0;
+#if defined(PBRT_HAVE_F16C)
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(f + i,
+                         _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(h + i))));
+#elif defined(PBRT_HAVE_NEON)
+    for (; i + 4 <= n; i += 4)
+        vst1q_f32(f + i, vcvt_f32_f16(vreinterpret_f16_u16(
+                             vld1_u16((const uint16_t *)(h + i)))));
+#endif
+    for (; i < n; ++i)
+        f[i] = float(h[i]);
+}
+
+inline void FloatToHalf(const float *f, Half *h, size_t n) {
+    size_t i = 0;
+#if defined(PBRT_HAVE_F16C)
+    for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128((__m128i *)(h + i),
+                         _mm256_cvtps_ph(_mm256_loadu_ps(f + i),
+                                         _MM_FROUND_TO_NEAREST_INT));
+#elif defined(PBRT_HAVE_NEON)
+    for (; i + 4 <= n; i += 4)
+        vst1_u16((uint16_t *)(h + i),
+                 vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(f + i))));
+#endif
+    for (; i < n; ++i)
+        h[i] = Half(f[i]);
+}
+
+}  // namespace simd
+}  // namespace pbrt
+
+#endif  // PBRT_UTIL_SIMD_H
@@ -206,6 +206,67 @@ std::string DenselySampledSpectrum::ToString() const {
     return s;
 }
 
+// SpectrumPool Method Definitions
+STAT_PERCENT("Memory/Spectrum pool hits", nSpectrumPoolHits, nSpectrumPoolLookups);
+STAT_MEMORY_COUNTER("Memory/Redundant densely-sampled spectra", redundantSpectrumBytes);
+
+const DenselySampledSpectrum *SpectrumPool::LookupOrAdd(SpectrumHandle s) {
+    // Sample and hash _s_ before acquiring the lock
+    DenselySampledSpectrum dense(s);
+    uint64_t hash = dense.Hash();
+
+    ++nSpectrumPoolLookups;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto range = pool.equal_range(hash);
+    for (auto iter = range.first; iter != range.second; ++iter)
+        if (*iter->second == dense) {
+            ++nSpectrumPoolHits;
+            redundantSpectrumBytes += dense.BytesUsed();
+            return iter->second;
+        }
+
+    DenselySampledSpectrum *ds = alloc.new_object<DenselySampledSpectrum>(dense, alloc);
+    pool.insert({hash, ds});
+    return ds;
+}
+
+size_t SpectrumPool::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pool.size();
+}
+
+size_t SpectrumPool::BytesUsed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t sum = 0;
+    for (const auto &item : pool)
+        sum += item.second->BytesUsed();
+    return sum;
+}
+
+void SpectrumPool::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &item : pool)
+        alloc.delete_object(item.second);
+    pool.clear();
+}
+
+std::string SpectrumPool::ToString() const {
+    return StringPrintf("[ SpectrumPool size(): %d BytesUsed(): %d ]", size(),
+                        BytesUsed());
+}
+
+static SpectrumPool *spectrumPool;
+
+void InitSpectrumPool(Allocator alloc) {
+    CHECK(spectrumPool == nullptr);
+    spectrumPool = alloc.new_object<SpectrumPool>(alloc);
+}
+
+const DenselySampledSpectrum *LookupSpectrum(SpectrumHandle s) {
+    CHECK(spectrumPool != nullptr);
+    return spectrumPool->LookupOrAdd(s);
+}
+
 std::string DenselySampledSpectrum::ParameterType() const {
     LOG_FATAL("Shouldn't be called");
     return {};
@@ -14,15 +14,20 @@
 #include <pbrt/util/check.h>
 #include <pbrt/util/color.h>
 #include <pbrt/util/float.h>
+#include <pbrt/util/hash.h>
 #include <pbrt/util/math.h>
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/sampling.h>
+#include <pbrt/util/simd.h>
 #include <pbrt/util/taggedptr.h>
 
 #include <cmath>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 namespace pbrt {
@@ -30,7 +35,25 @@ namespace pbrt {
 // Spectrum Constants
 constexpr Float Lambda_min = 360, Lambda_max = 830;
 
+// The number of wavelengths carried along each path is set at build time
+// via the PBRT_NSPECTRUM_SAMPLES CMake option.
+#ifdef PBRT_NSPECTRUM_SAMPLES
+static constexpr int NSpectrumSamples = PBRT_NSPECTRUM_SAMPLES;
+#else
 static constexpr int NSpectrumSamples = 4;
+#endif
+static_assert(NSpectrumSamples % 4 == 0,
+              "NSpectrumSamples must be a multiple of 4 for the SOA layout.");
+
+#ifdef PBRT_HAVE_SIMD
+// SpectrumVector Definition
+#ifdef PBRT_HAVE_AVX2
+using SpectrumVector =
+    std::conditional_t<NSpectrumSamples % 8 == 0, simd::Vec8f, simd::Vec4f>;
+#else
+using SpectrumVector = simd::Vec4f;
+#endif
+#endif  // PBRT_HAVE_SIMD
 
 static constexpr Float CIE_Y_integral = 106.856895;
 static constexpr Float K_m = 683;
@@ -88,9 +111,7 @@ class SampledSpectrum {
 
     PBRT_CPU_GPU
     SampledSpectrum &operator-=(const SampledSpectrum &s) {
-        for (int i = 0; i < NSpectrumSamples; ++i)
-            values[i] -= s.values[i];
-        return *this;
+        return *this = Map(*this, s, [](auto x, auto y) { return x - y; });
     }
     PBRT_CPU_GPU
     SampledSpectrum operator-(const SampledSpectrum &s) const {
@@ -100,17 +121,12 @@ class SampledSpectrum {
     PBRT_CPU_GPU
     friend SampledSpectrum operator-(Float a, const SampledSpectrum &s) {
         DCHECK(!std::isnan(a));
-        SampledSpectrum ret;
-        for (int i = 0; i < NSpectrumSamples; ++i)
-            ret.values[i] = a - s.values[i];
-        return ret;
+        return Map(SampledSpectrum(a), s, [](auto x, auto y) { return x - y; });
     }
 
     PBRT_CPU_GPU
     SampledSpectrum &operator*=(const SampledSpectrum &s) {
-        for (int i = 0; i < NSpectrumSamples; ++i)
-            values[i] *= s.values[i];
-        return *this;
+        return *this = Map(*this, s, [](auto x, auto y) { return x * y; });
     }
     PBRT_CPU_GPU
     SampledSpectrum operator*(const SampledSpectrum &s) const {
@@ -120,28 +136,22 @@ class SampledSpectrum {
     PBRT_CPU_GPU
     SampledSpectrum operator*(Float a) const {
         DCHECK(!std::isnan(a));
-        SampledSpectrum ret = *this;
-        for (int i = 0; i < NSpectrumSamples; ++i)
-            ret.values[i] *= a;
-        return ret;
+        return Map(*this, SampledSpectrum(a), [](auto x, auto y) { return x * y; });
     }
     PBRT_CPU_GPU
     SampledSpectrum &operator*=(Float a) {
         DCHECK(!std::isnan(a));
-        for (int i = 0; i < NSpectrumSamples; ++i)
-            values[i] *= a;
-        return *this;
+        return *this =
+                   Map(*this, SampledSpectrum(a), [](auto x, auto y) { return x * y; });
     }
     PBRT_CPU_GPU
     friend SampledSpectrum operator*(Float a, const SampledSpectrum &s) { return s * a; }
 
     PBRT_CPU_GPU
     SampledSpectrum &operator/=(const SampledSpectrum &s) {
-        for (int i = 0; i < NSpectrumSamples; ++i) {
+        for (int i = 0; i < NSpectrumSamples; ++i)
             DCHECK_NE(0, s.values[i]);
-            values[i] /= s.values[i];
-        }
-        return *this;
+        return *this = Map(*this, s, [](auto x, auto y) { return x / y; });
     }
     PBRT_CPU_GPU
     SampledSpectrum operator/(const SampledSpectrum &s) const {
@@ -152,9 +162,8 @@ class SampledSpectrum {
     SampledSpectrum &operator/=(Float a) {
         DCHECK_NE(a, 0);
         DCHECK(!std::isnan(a));
-        for (int i = 0; i < NSpectrumSamples; ++i)
-            values[i] /= a;
-        return *this;
+        return *this =
+                   Map(*this, SampledSpectrum(a), [](auto x, auto y) { return x / y; });
     }
     PBRT_CPU_GPU
     SampledSpectrum operator/(Float a) const {
@@ -164,10 +173,7 @@ class SampledSpectrum {
 
     PBRT_CPU_GPU
     SampledSpectrum operator-() const {
-        SampledSpectrum ret;
-        for (int i = 0; i < NSpectrumSamples; ++i)
-            ret.values[i] = -values[i];
-        return ret;
+        return Map(*this, [](auto v) { return -v; });
     }
     PBRT_CPU_GPU
     bool operator==(const SampledSpectrum &s) const { return values == s.values; }
@@ -222,9 +228,37 @@ class SampledSpectrum {
 
     PBRT_CPU_GPU
     SampledSpectrum &operator+=(const SampledSpectrum &s) {
+        return *this = Map(*this, s, [](auto x, auto y) { return x + y; });
+    }
+
+    // Returns the spectrum given by applying _f_ to each of the values of
+    // _s_. On the CPU, _f_ is called with SIMD vectors of values, so it
+    // should be generic and use the functions in the simd namespace.
+    template <typename F>
+    PBRT_CPU_GPU static SampledSpectrum Map(const SampledSpectrum &s, F f) {
+        SampledSpectrum ret;
+#ifdef PBRT_HAVE_SIMD
+        for (int i = 0; i < NSpectrumSamples; i += SpectrumVector::Width)
+            f(SpectrumVector::Load(&s.values[i])).Store(&ret.values[i]);
+#else
+        for (int i = 0; i < NSpectrumSamples; ++i)
+            ret.values[i] = f(s.values[i]);
+#endif
+        return ret;
+    }
+    template <typename F>
+    PBRT_CPU_GPU static SampledSpectrum Map(const SampledSpectrum &s1,
+                                            const SampledSpectrum &s2, F f) {
+        SampledSpectrum ret;
+#ifdef PBRT_HAVE_SIMD
+        for (int i = 0; i < NSpectrumSamples; i += SpectrumVector::Width)
+            f(SpectrumVector::Load(&s1.values[i]), SpectrumVector::Load(&s2.values[i]))
+                .Store(&ret.values[i]);
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
-            values[i] += s.values[i];
-        return *this;
+            ret.values[i] = f(s1.values[i], s2.values[i]);
+#endif
+        return ret;
     }
 
     PBRT_CPU_GPU
@@ -394,6 +428,21 @@ class DenselySampledSpectrum {
     std::string ParameterType() const;
     std::string ParameterString() const;
 
+    DenselySampledSpectrum(const DenselySampledSpectrum &s, Allocator alloc)
+        : lambda_min(s.lambda_min),
+          lambda_max(s.lambda_max),
+          values(s.values.begin(), s.values.end(), alloc) {}
+
+    bool operator==(const DenselySampledSpectrum &s) const {
+        return lambda_min == s.lambda_min && lambda_max == s.lambda_max &&
+               std::equal(values.begin(), values.end(), s.values.begin());
+    }
+
+    uint64_t Hash() const {
+        return HashBuffer(values.data(), values.size() * sizeof(Float), lambda_min);
+    }
+    size_t BytesUsed() const { return sizeof(*this) + values.size() * sizeof(Float); }
+
     DenselySampledSpectrum(SpectrumHandle spec, int lambda_min = Lambda_min,
                            int lambda_max = Lambda_max, Allocator alloc = {})
         : lambda_min(lambda_min),
@@ -596,10 +645,8 @@ class BlackbodySpectrum {
 // SampledSpectrum Inline Functions
 PBRT_CPU_GPU
 inline SampledSpectrum SafeDiv(const SampledSpectrum &s1, const SampledSpectrum &s2) {
-    SampledSpectrum r;
-    for (int i = 0; i < NSpectrumSamples; ++i)
-        r[i] = (s2[i] != 0) ? s1[i] / s2[i] : 0.;
-    return r;
+    return SampledSpectrum::Map(s1, s2,
+                                [](auto x, auto y) { return simd::SafeDiv(x, y); });
 }
 
 template <typename U, typename V>
@@ -613,18 +660,15 @@ PBRT_CPU_GPU inline SampledSpectrum Clamp(const SampledSpectrum &s, U low, V hig
 
 PBRT_CPU_GPU
 inline SampledSpectrum ClampZero(const SampledSpectrum &s) {
-    SampledSpectrum ret;
-    for (int i = 0; i < NSpectrumSamples; ++i)
-        ret[i] = std::max<Float>(0, s[i]);
+    SampledSpectrum ret =
+        SampledSpectrum::Map(s, [](auto v) { return simd::ClampZero(v); });
     DCHECK(!ret.HasNaNs());
     return ret;
 }
 
 PBRT_CPU_GPU
 inline SampledSpectrum Sqrt(const SampledSpectrum &s) {
-    SampledSpectrum ret;
-    for (int i = 0; i < NSpectrumSamples; ++i)
-        ret[i] = std::sqrt(s[i]);
+    SampledSpectrum ret = SampledSpectrum::Map(s, [](auto v) { return simd::Sqrt(v); });
     DCHECK(!ret.HasNaNs());
     return ret;
 }
@@ -639,9 +683,7 @@ inline SampledSpectrum Pow(const SampledSpectrum &s, Float e) {
 
 PBRT_CPU_GPU
 inline SampledSpectrum Exp(const SampledSpectrum &s) {
-    SampledSpectrum ret;
-    for (int i = 0; i < NSpectrumSamples; ++i)
-        ret[i] = std::exp(s[i]);
+    SampledSpectrum ret = SampledSpectrum::Map(s, [](auto v) { return simd::Exp(v); });
     DCHECK(!ret.HasNaNs());
     return ret;
 }
@@ -708,7 +750,35 @@ inline const DenselySampledSpectrum &Z() {
 
 }  // namespace Spectra
 
+// SpectrumPool Definition
+// SpectrumPool stores a single copy of each distinct DenselySampledSpectrum
+// that it is given, so that the many lights that often share an emission
+// spectrum don't each need their own.
+class SpectrumPool {
+  public:
+    // SpectrumPool Public Methods
+    SpectrumPool(Allocator alloc) : alloc(alloc) {}
+    ~SpectrumPool() { Clear(); }
+
+    const DenselySampledSpectrum *LookupOrAdd(SpectrumHandle s);
+
+    size_t size() const;
+    size_t BytesUsed() const;
+    void Clear();
+
+    std::string ToString() const;
+
+  private:
+    // SpectrumPool Private Members
+    Allocator alloc;
+    mutable std::mutex mutex;
+    std::unordered_multimap<uint64_t, DenselySampledSpectrum *> pool;
+};
+
 // Spectral Function Declarations
+void InitSpectrumPool(Allocator alloc);
+const DenselySampledSpectrum *LookupSpectrum(SpectrumHandle s);
+
 SpectrumHandle GetNamedSpectrum(const std::string &name);
 
 std::string FindMatchingNamedSpectrum(SpectrumHandle s);
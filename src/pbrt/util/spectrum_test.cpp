@@ -157,3 +157,84 @@ TEST(Spectrum, SamplingPdfXYZ) {
     EXPECT_LT(std::abs((impInt - unifInt) / unifInt), 1e-3)
         << impInt << " vs. " << unifInt;
 }
+
+TEST(SampledSpectrum, Exp) {
+    // The vectorized exp() should be accurate over the range where it
+    // returns normal floats.
+    RNG rng;
+    for (int i = 0; i < 1000; ++i) {
+        SampledSpectrum s;
+        for (int j = 0; j < NSpectrumSamples; ++j)
+            s[j] = Lerp(rng.Uniform<Float>(), -80, 80);
+
+        SampledSpectrum e = Exp(s);
+        for (int j = 0; j < NSpectrumSamples; ++j) {
+            Float ref = std::exp(s[j]);
+            EXPECT_LT(std::abs((e[j] - ref) / ref), 2e-6)
+                << "exp(" << s[j] << "): " << e[j] << " vs. " << ref;
+        }
+    }
+}
+
+TEST(SampledSpectrum, ExpSpecialValues) {
+    // Outside of that range, it should match std::exp(). (Exp() checks for
+    // NaNs, so call simd::Exp() directly.)
+    Float values[] = {std::numeric_limits<Float>::quiet_NaN(),
+                      -Infinity,
+                      Infinity,
+                      -120,
+                      -95,
+                      88.5,
+                      89,
+                      0};
+    SampledSpectrum s;
+    for (int i = 0; i < NSpectrumSamples; ++i)
+        s[i] = values[i % 8];
+
+    SampledSpectrum e = SampledSpectrum::Map(s, [](auto v) { return simd::Exp(v); });
+    for (int i = 0; i < NSpectrumSamples; ++i) {
+        Float ref = std::exp(s[i]);
+        if (std::isnan(ref))
+            EXPECT_TRUE(std::isnan(e[i]));
+        else if (ref == 0 || std::isinf(ref))
+            EXPECT_EQ(ref, e[i]) << "exp(" << s[i] << ")";
+        else
+            EXPECT_LT(std::abs((e[i] - ref) / ref), 1e-3)
+                << "exp(" << s[i] << "): " << e[i] << " vs. " << ref;
+    }
+}
+
+TEST(SampledSpectrum, SafeDiv) {
+    SampledSpectrum num, denom;
+    for (int i = 0; i < NSpectrumSamples; ++i) {
+        num[i] = i + 1;
+        denom[i] = (i & 1) ? 0 : 2;
+    }
+
+    SampledSpectrum q = SafeDiv(num, denom);
+    for (int i = 0; i < NSpectrumSamples; ++i) {
+        if (i & 1)
+            EXPECT_EQ(0, q[i]);
+        else
+            EXPECT_EQ(Float(i + 1) / 2, q[i]);
+    }
+    EXPECT_FALSE(q.HasNaNs());
+}
+
+TEST(SpectrumPool, Deduplicate) {
+    SpectrumPool pool(Allocator{});
+    ConstantSpectrum c1(0.5f), c2(0.5f), c3(0.25f);
+    BlackbodySpectrum bb(3000);
+
+    const DenselySampledSpectrum *d1 = pool.LookupOrAdd(&c1);
+    EXPECT_EQ(d1, pool.LookupOrAdd(&c2));
+    EXPECT_NE(d1, pool.LookupOrAdd(&c3));
+    const DenselySampledSpectrum *dbb = pool.LookupOrAdd(&bb);
+    EXPECT_EQ(dbb, pool.LookupOrAdd(&bb));
+    EXPECT_EQ(3, int(pool.size()));
+
+    for (Float lambda = Lambda_min; lambda <= Lambda_max; lambda += 10) {
+        EXPECT_EQ(0.5f, (*d1)(lambda));
+        EXPECT_EQ(bb(lambda), (*dbb)(lambda));
+    }
+}
@@ -0,0 +1,510 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/util/texcache.h>
+
+#include <pbrt/util/bits.h>
+#include <pbrt/util/check.h>
+#include <pbrt/util/colorspace.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/log.h>
+#include <pbrt/util/print.h>
+#include <pbrt/util/progressreporter.h>
+#include <pbrt/util/stats.h>
+#include <pbrt/util/string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#ifdef PBRT_IS_WINDOWS
+#include <process.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace pbrt {
+
+STAT_PERCENT("Texture/Tile lookups handled by per-thread caches", microCacheHits,
+             microCacheLookups);
+STAT_PERCENT("Texture/Tile cache hits", tileCacheHits, tileCacheLookups);
+STAT_COUNTER("Texture/Tiles read", tilesRead);
+STAT_COUNTER("Texture/Tiles evicted", tilesEvicted);
+STAT_MEMORY_COUNTER("Memory/Texture tile data read", tileBytesRead);
+STAT_COUNTER("Texture/Total tile read time (microseconds)", tileReadTotalMicroseconds);
+STAT_INT_DISTRIBUTION("Texture/Tile read time (microseconds)", tileReadMicroseconds);
+
+// The tile cache is created when the first tile is read, so that it isn't
+// allocated for scenes without tiled textures or with memory-mapped ones.
+static int64_t tileCacheMaxBytes;
+static std::once_flag tileCacheInitFlag;
+static std::atomic<TextureTileCache *> tileCache{nullptr};
+
+// Used to give the files that are written unique names
+static std::atomic<int> fileCounter{0};
+
+static int ProcessId() {
+#ifdef PBRT_IS_WINDOWS
+    return _getpid();
+#else
+    return getpid();
+#endif
+}
+
+void InitTextureTileCache(int64_t maxBytes) {
+    CHECK_EQ(tileCacheMaxBytes, 0);
+    CHECK_GT(maxBytes, 0);
+    tileCacheMaxBytes = maxBytes;
+}
+
+static TextureTileCache *GetTextureTileCache() {
+    std::call_once(tileCacheInitFlag,
+                   []() { tileCache = new TextureTileCache(tileCacheMaxBytes); });
+    return tileCache;
+}
+
+// TextureTileCache Local Definitions
+// Tile keys pack the pyramid id into the upper 24 bits, followed by the
+// level and then the tile's y and x coordinates.
+static uint64_t TileKey(int pyramidId, int level, Point2i tile) {
+    return (uint64_t(pyramidId) << 40) | (uint64_t(level) << 32) |
+           (uint64_t(tile.y) << 16) | uint64_t(tile.x);
+}
+
+// Each thread's cache of recently used tiles holds references to the tiles
+// so that they remain valid even if they are evicted from the shared cache.
+struct MicroCacheEntry {
+    uint64_t key = ~uint64_t(0);
+    std::shared_ptr<const Image> tile;
+};
+static constexpr int MicroCacheSize = 64;
+static thread_local MicroCacheEntry microCache[MicroCacheSize];
+
+// TextureTileCache Method Definitions
+TextureTileCache::TextureTileCache(int64_t maxBytes)
+    : maxShardBytes(std::max<int64_t>(1, maxBytes / NShards)),
+      shards(new Shard[NShards]) {}
+
+const Image *TextureTileCache::Lookup(const TiledImagePyramid *pyramid, int level,
+                                      Point2i tile) {
+    uint64_t key = TileKey(pyramid->Id(), level, tile);
+    uint64_t hash = MixBits(key);
+
+    // Return the tile from the thread's cache if it's there
+    ++microCacheLookups;
+    MicroCacheEntry &entry = microCache[hash % MicroCacheSize];
+    if (entry.key == key) {
+        ++microCacheHits;
+        return entry.tile.get();
+    }
+
+    // Look for the tile in the shared cache, reading it if necessary
+    ++tileCacheLookups;
+    Shard &shard = shards[(hash >> 32) % NShards];
+    std::shared_ptr<const Image> t;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto iter = shard.tiles.find(key);
+        if (iter != shard.tiles.end()) {
+            ++tileCacheHits;
+            shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+            t = iter->second->second;
+        }
+    }
+    if (!t) {
+        // The lock isn't held while the tile is read, so another thread may
+        // read the same tile concurrently; the first one to finish wins.
+        auto newTile = std::make_shared<const Image>(pyramid->ReadTile(level, tile));
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto iter = shard.tiles.find(key);
+        if (iter != shard.tiles.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+            t = iter->second->second;
+        } else {
+            shard.lru.push_front({key, newTile});
+            shard.tiles[key] = shard.lru.begin();
+            shard.bytes += newTile->BytesUsed();
+            t = std::move(newTile);
+
+            // Evict least recently used tiles until the shard is within budget
+            while (shard.bytes > maxShardBytes && shard.lru.size() > 1) {
+                const auto &lru = shard.lru.back();
+                shard.bytes -= lru.second->BytesUsed();
+                shard.tiles.erase(lru.first);
+                shard.lru.pop_back();
+                ++tilesEvicted;
+            }
+        }
+    }
+
+    entry.key = key;
+    entry.tile = std::move(t);
+    return entry.tile.get();
+}
+
+void TextureTileCache::Evict(int pyramidId) {
+    for (int i = 0; i < NShards; ++i) {
+        Shard &shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto iter = shard.lru.begin(); iter != shard.lru.end();) {
+            if (int(iter->first >> 40) == pyramidId) {
+                shard.bytes -= iter->second->BytesUsed();
+                shard.tiles.erase(iter->first);
+                iter = shard.lru.erase(iter);
+            } else
+                ++iter;
+        }
+    }
+}
+
+int64_t TextureTileCache::BytesUsed() const {
+    int64_t bytes = 0;
+    for (int i = 0; i < NShards; ++i) {
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        bytes += shards[i].bytes;
+    }
+    return bytes;
+}
+
+std::string TextureTileCache::ToString() const {
+    return StringPrintf("[ TextureTileCache maxBytes: %d bytesUsed: %d ]", MaxBytes(),
+                        BytesUsed());
+}
+
+// TiledImagePyramid Local Definitions
+static constexpr char tiledPyramidMagic[8] = {'p', 'b', 'r', 't', 'm', 'i', 'p', '1'};
+// Tile data starts at a multiple of the page size so that the tiles are
+// page-aligned when the file is mapped.
+static int64_t TileDataOffset(int64_t headerSize) {
+    constexpr int64_t alignment = 4096;
+    return (headerSize + alignment - 1) / alignment * alignment;
+}
+
+template <typename T>
+static bool WriteValues(FILE *f, const T *v, size_t n = 1) {
+    return fwrite(v, sizeof(T), n, f) == n;
+}
+
+template <typename T>
+static bool ReadValues(FILE *f, T *v, size_t n = 1) {
+    return fread(v, sizeof(T), n, f) == n;
+}
+
+static bool WriteString(FILE *f, const std::string &str) {
+    int length = str.size();
+    return WriteValues(f, &length) && WriteValues(f, str.data(), length);
+}
+
+static bool ReadString(FILE *f, std::string *str) {
+    int length;
+    if (!ReadValues(f, &length) || length < 0 || length > 256)
+        return false;
+    str->resize(length);
+    return ReadValues(f, &(*str)[0], length);
+}
+
+// ColorEncodingHandle::Get() exits on names it can't parse, so an encoding
+// read from a file is checked first.
+static bool IsValidEncodingName(const std::string &name) {
+    if (name == "linear" || name == "sRGB")
+        return true;
+    std::vector<std::string> params = SplitStringsFromWhitespace(name);
+    return params.size() == 2 && params[0] == "gamma" && atof(params[1].c_str()) > 0;
+}
+
+static std::atomic<int> nextPyramidId{0};
+
+// TiledImagePyramid Method Definitions
+std::string TiledImageMetadata::ToString() const {
+    return StringPrintf("[ TiledImageMetadata colorSpace: %s wrapMode: %s "
+                        "sourceModificationTime: %d sourceHash: %d ]",
+                        colorSpace ? colorSpace->ToString() : std::string("(nullptr)"),
+                        wrapMode, sourceModificationTime, sourceHash);
+}
+
+bool TiledImagePyramid::Write(pstd::span<const Image> pyramid,
+                              const TiledImageMetadata &metadata,
+                              const std::string &filename) {
+    CHECK(!pyramid.empty());
+    // Write to a temporary file that is then renamed so that other processes
+    // never see a partially-written pyramid.
+    std::string tempFilename =
+        StringPrintf("%s.%d.%d.tmp", filename, ProcessId(), fileCounter++);
+    FILE *f = fopen(tempFilename.c_str(), "wb");
+    if (!f) {
+        Warning("%s: unable to open tiled texture file: %s", tempFilename,
+                ErrorString());
+        return false;
+    }
+
+    // Write the header
+    const Image &image = pyramid[0];
+    const RGBColorSpace *colorSpace =
+        metadata.colorSpace ? metadata.colorSpace : RGBColorSpace::sRGB;
+    std::string encodingName =
+        image.Encoding() ? image.Encoding().Name() : std::string("linear");
+    int wrapMode = int(metadata.wrapMode), format = int(image.Format());
+    int tileSize = TileSize, nChannels = image.NChannels(), nLevels = pyramid.size();
+    bool success = WriteValues(f, tiledPyramidMagic, sizeof(tiledPyramidMagic)) &&
+                   WriteValues(f, &metadata.sourceModificationTime) &&
+                   WriteValues(f, &metadata.sourceHash) && WriteValues(f, &wrapMode) &&
+                   WriteValues(f, &colorSpace->r) && WriteValues(f, &colorSpace->g) &&
+                   WriteValues(f, &colorSpace->b) && WriteValues(f, &colorSpace->w) &&
+                   WriteString(f, encodingName) && WriteValues(f, &format) &&
+                   WriteValues(f, &tileSize) && WriteValues(f, &nChannels);
+    for (const std::string &name : image.ChannelNames())
+        success &= WriteString(f, name);
+    success &= WriteValues(f, &nLevels);
+    for (const Image &level : pyramid) {
+        CHECK(level.Format() == image.Format() && level.NChannels() == nChannels);
+        Point2i res = level.Resolution();
+        success &= WriteValues(f, &res);
+    }
+
+    int64_t headerSize = ftell(f);
+    std::vector<char> padding(TileDataOffset(headerSize) - headerSize, 0);
+    success &= WriteValues(f, padding.data(), padding.size());
+
+    // Write each level's tiles, in scanline order
+    size_t texelBytes = TexelBytes(image.Format()) * nChannels;
+    for (const Image &level : pyramid) {
+        Point2i res = level.Resolution();
+        for (int y0 = 0; y0 < res.y && success; y0 += TileSize)
+            for (int x0 = 0; x0 < res.x && success; x0 += TileSize) {
+                int x1 = std::min(x0 + TileSize, res.x);
+                int y1 = std::min(y0 + TileSize, res.y);
+                for (int y = y0; y < y1; ++y)
+                    success &= fwrite(level.RawPointer({x0, y}), texelBytes, x1 - x0,
+                                      f) == size_t(x1 - x0);
+            }
+    }
+
+    if (fclose(f) != 0 || !success) {
+        Warning("%s: error writing tiled texture file: %s", tempFilename, ErrorString());
+        std::remove(tempFilename.c_str());
+        return false;
+    }
+#ifdef PBRT_IS_WINDOWS
+    // rename() fails on Windows if the destination exists
+    std::remove(filename.c_str());
+#endif
+    if (std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+        Warning("%s: unable to rename tiled texture file: %s", tempFilename,
+                ErrorString());
+        std::remove(tempFilename.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<TiledImagePyramid> TiledImagePyramid::Open(const std::string &filename,
+                                                           bool memoryMap) {
+    CHECK_GT(tileCacheMaxBytes, 0);
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f)
+        return {};
+
+    std::unique_ptr<TiledImagePyramid> pyramid(new TiledImagePyramid);
+    pyramid->filename = filename;
+    pyramid->file = f;
+
+    // Read and validate the header
+    char magic[sizeof(tiledPyramidMagic)];
+    int wrapMode, format, tileSize, nChannels, nLevels;
+    Point2f r, g, b, w;
+    std::string encodingName;
+    TiledImageMetadata &metadata = pyramid->metadata;
+    bool success = ReadValues(f, magic, sizeof(magic)) &&
+                   memcmp(magic, tiledPyramidMagic, sizeof(magic)) == 0 &&
+                   ReadValues(f, &metadata.sourceModificationTime) &&
+                   ReadValues(f, &metadata.sourceHash) && ReadValues(f, &wrapMode) &&
+                   ReadValues(f, &r) && ReadValues(f, &g) && ReadValues(f, &b) &&
+                   ReadValues(f, &w) && ReadString(f, &encodingName) &&
+                   IsValidEncodingName(encodingName) && ReadValues(f, &format) &&
+                   ReadValues(f, &tileSize) && tileSize == TileSize &&
+                   ReadValues(f, &nChannels) && nChannels > 0 && nChannels <= 4;
+    for (int c = 0; success && c < nChannels; ++c) {
+        std::string name;
+        success = ReadString(f, &name);
+        pyramid->channelNames.push_back(name);
+    }
+    success = success && ReadValues(f, &nLevels) && nLevels > 0 && nLevels < 256;
+    if (success) {
+        pyramid->levelResolution.resize(nLevels);
+        success = ReadValues(f, pyramid->levelResolution.data(), nLevels);
+    }
+    if (!success || wrapMode < int(WrapMode::Repeat) ||
+        wrapMode > int(WrapMode::OctahedralSphere) ||
+        (format != int(PixelFormat::U256) && format != int(PixelFormat::Half) &&
+         format != int(PixelFormat::Float))) {
+        Warning("%s: tiled texture file is corrupt or from another version of pbrt.",
+                filename);
+        return {};
+    }
+    metadata.wrapMode = WrapMode(wrapMode);
+    metadata.colorSpace = RGBColorSpace::Lookup(r, g, b, w);
+    if (!metadata.colorSpace) {
+        Warning("%s: color space in tiled texture file unknown. Using sRGB.", filename);
+        metadata.colorSpace = RGBColorSpace::sRGB;
+    }
+    pyramid->format = PixelFormat(format);
+    pyramid->encoding = ColorEncodingHandle::Get(encodingName);
+
+    // Compute the file offset of each level's tiles
+    int64_t offset = TileDataOffset(ftell(f));
+    int64_t texelBytes = TexelBytes(pyramid->format) * nChannels;
+    for (Point2i res : pyramid->levelResolution) {
+        if (res.x <= 0 || res.y <= 0 || res.x > 65536 * TileSize ||
+            res.y > 65536 * TileSize) {
+            Warning("%s: invalid level resolution in tiled texture file.", filename);
+            return {};
+        }
+        pyramid->levelOffset.push_back(offset);
+        offset += int64_t(res.x) * int64_t(res.y) * texelBytes;
+    }
+
+#ifndef PBRT_IS_WINDOWS
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 || st.st_size < offset) {
+        Warning("%s: tiled texture file is truncated.", filename);
+        return {};
+    }
+    if (memoryMap) {
+        // Map the file so that texels can be read from it directly
+        void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fileno(f), 0);
+        if (ptr == MAP_FAILED)
+            Warning("%s: unable to map tiled texture file: %s. Tiles will be read "
+                    "into the cache instead.",
+                    filename, ErrorString());
+        else {
+            pyramid->mapping = (const uint8_t *)ptr;
+            pyramid->mappingSize = st.st_size;
+        }
+    }
+#endif
+
+    pyramid->id = nextPyramidId++;
+    CHECK_LT(pyramid->id, 1 << 24);
+    return pyramid;
+}
+
+std::unique_ptr<TiledImagePyramid> TiledImagePyramid::CreateTemporary(
+    pstd::span<const Image> pyramid, const TiledImageMetadata &metadata) {
+    CHECK(!pyramid.empty());
+    // Choose a file name that is unique to this process
+#ifdef PBRT_IS_WINDOWS
+    const char *tmp = getenv("TEMP");
+    std::string dir = tmp ? tmp : ".";
+#else
+    const char *tmp = getenv("TMPDIR");
+    std::string dir = tmp ? tmp : "/tmp";
+#endif
+    std::string filename =
+        StringPrintf("%s/pbrt-%d-%d.mip", dir, ProcessId(), fileCounter++);
+
+    if (!Write(pyramid, metadata, filename))
+        ErrorExit("%s: unable to create tiled texture file.", filename);
+    std::unique_ptr<TiledImagePyramid> tiled = Open(filename, false);
+    if (!tiled)
+        ErrorExit("%s: unable to open tiled texture file: %s", filename, ErrorString());
+#ifdef PBRT_IS_WINDOWS
+    tiled->removeOnClose = true;
+#else
+    // The file remains readable through the open handle after it's removed
+    std::remove(filename.c_str());
+#endif
+    return tiled;
+}
+
+TiledImagePyramid::~TiledImagePyramid() {
+    // Only pyramids that Open() finished and that have read tiles have any
+    // to evict
+    if (TextureTileCache *cache = tileCache; cache && id >= 0)
+        cache->Evict(id);
+#ifndef PBRT_IS_WINDOWS
+    if (mapping)
+        munmap((void *)mapping, mappingSize);
+#endif
+    fclose(file);
+    if (removeOnClose)
+        std::remove(filename.c_str());
+}
+
+bool TiledImagePyramid::MatchesSource(const std::string &sourceFilename) {
+    // Check the modification time first, since it's much cheaper than
+    // hashing the file. Files that have been copied or touched will have a
+    // new modification time but still match if their contents haven't
+    // changed.
+    pstd::optional<int64_t> mtime = FileModificationTime(sourceFilename);
+    if (!mtime)
+        return false;
+    if (*mtime == metadata.sourceModificationTime)
+        return true;
+    pstd::optional<uint64_t> hash = HashFileContents(sourceFilename);
+    if (!hash || *hash != metadata.sourceHash)
+        return false;
+
+    // Record the new modification time in the file's header so that the
+    // source doesn't need to be hashed again next time.
+    metadata.sourceModificationTime = *mtime;
+    FILE *f = fopen(filename.c_str(), "r+b");
+    bool updated = f && fseek(f, sizeof(tiledPyramidMagic), SEEK_SET) == 0 &&
+                   WriteValues(f, &metadata.sourceModificationTime);
+    if (f)
+        updated &= fclose(f) == 0;
+    if (!updated)
+        LOG_VERBOSE("%s: unable to update source modification time: %s", filename,
+                    ErrorString());
+    return true;
+}
+
+const Image *TiledImagePyramid::GetTile(int level, Point2i tile) const {
+    return GetTextureTileCache()->Lookup(this, level, tile);
+}
+
+Image TiledImagePyramid::ReadTile(int level, Point2i tile) const {
+    CHECK(level >= 0 && level < Levels());
+    Point2i tileRes = TileResolution(level, tile);
+    CHECK(tileRes.x > 0 && tileRes.y > 0);
+    Image image(format, tileRes, channelNames, encoding);
+    int64_t offset = TileOffset(level, tile);
+    size_t nBytes = image.BytesUsed();
+    void *buf = image.RawPointer({0, 0});
+
+    Timer timer;
+#ifdef PBRT_IS_WINDOWS
+    bool success;
+    {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        success = _fseeki64(file, offset, SEEK_SET) == 0 &&
+                  fread(buf, 1, nBytes, file) == nBytes;
+    }
+#else
+    bool success = pread(fileno(file), buf, nBytes, offset) == ssize_t(nBytes);
+#endif
+    if (!success)
+        ErrorExit("%s: error reading texture tile: %s", filename, ErrorString());
+    int64_t elapsedMicroseconds = 1000000 * timer.ElapsedSeconds();
+    ReportValue(tileReadMicroseconds, elapsedMicroseconds);
+    tileReadTotalMicroseconds += elapsedMicroseconds;
+    ++tilesRead;
+    tileBytesRead += nBytes;
+
+    return image;
+}
+
+std::string TiledImagePyramid::ToString() const {
+    return StringPrintf("[ TiledImagePyramid filename: %s id: %d format: %s "
+                        "encoding: %s metadata: %s channelNames: %s "
+                        "levelResolution: %s memoryMapped: %s ]",
+                        filename, id, format, encoding, metadata, channelNames,
+                        levelResolution, IsMemoryMapped());
+}
+
+}  // namespace pbrt
@@ -0,0 +1,217 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_UTIL_TEXCACHE_H
+#define PBRT_UTIL_TEXCACHE_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/image.h>
+#include <pbrt/util/pstd.h>
+#include <pbrt/util/vecmath.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pbrt {
+
+class TiledImagePyramid;
+
+// TextureTileCache Definition
+// TextureTileCache holds the most recently used tiles of all open
+// TiledImagePyramids, up to a fixed memory budget. Tiles are spread over
+// independently locked shards, each of which evicts its least recently
+// used tiles when it exceeds its share of the budget. Each thread also
+// keeps a small direct-mapped cache of the tiles it last used so that
+// most lookups don't need to take a lock.
+class TextureTileCache {
+  public:
+    // TextureTileCache Public Methods
+    TextureTileCache(int64_t maxBytes);
+
+    const Image *Lookup(const TiledImagePyramid *pyramid, int level, Point2i tile);
+    void Evict(int pyramidId);
+
+    int64_t BytesUsed() const;
+    int64_t MaxBytes() const { return NShards * maxShardBytes; }
+
+    std::string ToString() const;
+
+  private:
+    // TextureTileCache Private Members
+    static constexpr int NShards = 64;
+    struct Shard {
+        std::mutex mutex;
+        // Most recently used tiles are at the front
+        std::list<std::pair<uint64_t, std::shared_ptr<const Image>>> lru;
+        std::unordered_map<uint64_t, decltype(lru)::iterator> tiles;
+        int64_t bytes = 0;
+    };
+
+    int64_t maxShardBytes;
+    std::unique_ptr<Shard[]> shards;
+};
+
+// TiledImageMetadata Definition
+// TiledImageMetadata records how a tiled pyramid was made and which version
+// of its source image it was made from, so that out-of-date pyramid files
+// can be detected.
+struct TiledImageMetadata {
+    const RGBColorSpace *colorSpace = nullptr;
+    WrapMode wrapMode = WrapMode::Repeat;
+    int64_t sourceModificationTime = 0;
+    uint64_t sourceHash = 0;
+
+    std::string ToString() const;
+};
+
+// TiledImagePyramid Definition
+// TiledImagePyramid provides access to the levels of an image pyramid that
+// is stored on disk in square tiles. The file is either memory-mapped, in
+// which case texels are read directly from the mapping, or tiles are read
+// when they are first accessed and are then kept in the global
+// TextureTileCache.
+class TiledImagePyramid {
+  public:
+    // TiledImagePyramid Public Methods
+    static constexpr int TileSize = 64;
+
+    static bool Write(pstd::span<const Image> pyramid,
+                      const TiledImageMetadata &metadata, const std::string &filename);
+    static std::unique_ptr<TiledImagePyramid> Open(const std::string &filename,
+                                                   bool memoryMap);
+    // Writes the pyramid to a file in the temporary directory that is
+    // removed when the returned TiledImagePyramid is destroyed.
+    static std::unique_ptr<TiledImagePyramid> CreateTemporary(
+        pstd::span<const Image> pyramid, const TiledImageMetadata &metadata);
+
+    ~TiledImagePyramid();
+
+    int Levels() const { return int(levelResolution.size()); }
+    Point2i LevelResolution(int level) const {
+        CHECK(level >= 0 && level < Levels());
+        return levelResolution[level];
+    }
+    int NChannels() const { return int(channelNames.size()); }
+    PixelFormat Format() const { return format; }
+    ColorEncodingHandle Encoding() const { return encoding; }
+    const TiledImageMetadata &Metadata() const { return metadata; }
+    bool IsMemoryMapped() const { return mapping != nullptr; }
+    int Id() const { return id; }
+    const std::string &Filename() const { return filename; }
+
+    // Returns true if the pyramid was made from the current contents of
+    // the given image file. If the file's contents match but its
+    // modification time has changed, the new time is stored in the
+    // pyramid file.
+    bool MatchesSource(const std::string &sourceFilename);
+
+    Float GetChannel(int level, Point2i p, int c, WrapMode2D wrapMode) const {
+        CHECK(level >= 0 && level < Levels());
+        if (!RemapPixelCoords(&p, levelResolution[level], wrapMode))
+            return 0;
+        Point2i tile(p.x / TileSize, p.y / TileSize);
+        Point2i pTile(p.x % TileSize, p.y % TileSize);
+        if (mapping)
+            return MappedChannel(level, tile, pTile, c);
+        return GetTile(level, tile)->GetChannel(pTile, c);
+    }
+
+    Float BilerpChannel(int level, Point2f p, int c, WrapMode2D wrapMode) const {
+        // Follow Image::BilerpChannel()
+        Point2i res = LevelResolution(level);
+        Float x = p[0] * res.x - 0.5f, y = p[1] * res.y - 0.5f;
+        int xi = std::floor(x), yi = std::floor(y);
+        Float dx = x - xi, dy = y - yi;
+        pstd::array<Float, 4> v = {GetChannel(level, {xi, yi}, c, wrapMode),
+                                   GetChannel(level, {xi + 1, yi}, c, wrapMode),
+                                   GetChannel(level, {xi, yi + 1}, c, wrapMode),
+                                   GetChannel(level, {xi + 1, yi + 1}, c, wrapMode)};
+        return pbrt::Bilerp({dx, dy}, v);
+    }
+
+    Image ReadTile(int level, Point2i tile) const;
+
+    std::string ToString() const;
+
+  private:
+    // TiledImagePyramid Private Methods
+    TiledImagePyramid() = default;
+    const Image *GetTile(int level, Point2i tile) const;
+    Point2i TileResolution(int level, Point2i tile) const {
+        Point2i res = levelResolution[level];
+        return {std::min(TileSize, res.x - tile.x * TileSize),
+                std::min(TileSize, res.y - tile.y * TileSize)};
+    }
+    // Returns the file offset of the given tile. All of the rows of tiles
+    // above it and the tiles to its left in its row are full-sized.
+    int64_t TileOffset(int level, Point2i tile) const {
+        int tileHeight = TileResolution(level, tile).y;
+        return levelOffset[level] +
+               (int64_t(tile.y) * TileSize * levelResolution[level].x +
+                int64_t(tile.x) * TileSize * tileHeight) *
+                   TexelBytes(format) * NChannels();
+    }
+    Float MappedChannel(int level, Point2i tile, Point2i pTile, int c) const {
+        int tileWidth = TileResolution(level, tile).x;
+        int64_t offset = TileOffset(level, tile) +
+                         (int64_t(pTile.y * tileWidth + pTile.x) * NChannels() + c) *
+                             TexelBytes(format);
+        const uint8_t *p = mapping + offset;
+        switch (format) {
+        case PixelFormat::U256: {
+            Float v;
+            encoding.ToLinear({p, 1}, {&v, 1});
+            return v;
+        }
+        case PixelFormat::Half: {
+            uint16_t bits;
+            std::memcpy(&bits, p, sizeof(bits));
+            return Float(Half::FromBits(bits));
+        }
+        case PixelFormat::Float: {
+            float v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+        default:
+            LOG_FATAL("Unhandled PixelFormat");
+            return 0;
+        }
+    }
+
+    // TiledImagePyramid Private Members
+    std::string filename;
+    bool removeOnClose = false;
+    // Set once Open() has validated the file; -1 until then
+    int id = -1;
+    PixelFormat format;
+    ColorEncodingHandle encoding;
+    TiledImageMetadata metadata;
+    std::vector<std::string> channelNames;
+    std::vector<Point2i> levelResolution;
+    // File offset of the first tile of each level
+    std::vector<int64_t> levelOffset;
+    FILE *file = nullptr;
+    // Only used on systems without pread(), where reads must seek first
+    mutable std::mutex fileMutex;
+    const uint8_t *mapping = nullptr;
+    size_t mappingSize = 0;
+};
+
+// Texture Tile Cache Function Declarations
+void InitTextureTileCache(int64_t maxBytes);
+
+}  // namespace pbrt
+
+#endif  // PBRT_UTIL_TEXCACHE_H
@@ -0,0 +1,293 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/util/texcompress.h>
+
+#include <pbrt/util/check.h>
+#include <pbrt/util/math.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/print.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace pbrt {
+
+pstd::optional<TextureCompression> ParseTextureCompression(const std::string &name) {
+    if (name == "none")
+        return TextureCompression::None;
+    else if (name == "auto")
+        return TextureCompression::Auto;
+    else if (name == "bc1")
+        return TextureCompression::BC1;
+    else if (name == "bc4")
+        return TextureCompression::BC4;
+    else if (name == "rgb9e5")
+        return TextureCompression::RGB9E5;
+    else
+        return {};
+}
+
+std::string ToString(TextureCompression compression) {
+    switch (compression) {
+    case TextureCompression::None:
+        return "none";
+    case TextureCompression::Auto:
+        return "auto";
+    case TextureCompression::BC1:
+        return "bc1";
+    case TextureCompression::BC4:
+        return "bc4";
+    case TextureCompression::RGB9E5:
+        return "rgb9e5";
+    default:
+        LOG_FATAL("Unhandled TextureCompression");
+        return {};
+    }
+}
+
+// BC1 Encoding Functions
+static uint16_t QuantizeRGB565(const Float rgb[3]) {
+    auto quantize = [](Float v, int maxValue) {
+        return uint16_t(Clamp(int(std::round(v * maxValue / 255)), 0, maxValue));
+    };
+    return (quantize(rgb[0], 31) << 11) | (quantize(rgb[1], 63) << 5) |
+           quantize(rgb[2], 31);
+}
+
+// Returns the BC1 block that best represents the texels using the given
+// endpoints, along with its squared error.
+static uint64_t MakeBC1Block(uint16_t c0, uint16_t c1, const uint8_t rgb[16][3],
+                             int *error) {
+    // Order the endpoints so that the block uses four colors
+    if (c0 < c1)
+        std::swap(c0, c1);
+    uint64_t block = uint64_t(c0) | (uint64_t(c1) << 16);
+
+    int palette[4][3];
+    for (int i = 0; i < 4; ++i)
+        for (int c = 0; c < 3; ++c)
+            palette[i][c] = CompressedImage::DecodeBC1(block | (uint64_t(i) << 32), 0, c);
+
+    *error = 0;
+    for (int t = 0; t < 16; ++t) {
+        int bestIndex = 0, bestError = std::numeric_limits<int>::max();
+        for (int i = 0; i < 4; ++i) {
+            int e = Sqr(palette[i][0] - rgb[t][0]) + Sqr(palette[i][1] - rgb[t][1]) +
+                    Sqr(palette[i][2] - rgb[t][2]);
+            if (e < bestError) {
+                bestIndex = i;
+                bestError = e;
+            }
+        }
+        block |= uint64_t(bestIndex) << (32 + 2 * t);
+        *error += bestError;
+    }
+    return block;
+}
+
+uint64_t CompressedImage::EncodeBC1(const uint8_t rgb[16][3]) {
+    // Compute the mean and covariance of the block's colors
+    Float mean[3] = {0, 0, 0};
+    for (int t = 0; t < 16; ++t)
+        for (int c = 0; c < 3; ++c)
+            mean[c] += rgb[t][c] / Float(16);
+    Float cov[3][3] = {};
+    for (int t = 0; t < 16; ++t)
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j)
+                cov[i][j] += (rgb[t][i] - mean[i]) * (rgb[t][j] - mean[j]);
+
+    // Find the principal axis of the colors with power iteration, starting
+    // with the covariance of the channel that varies the most
+    int maxChannel = 0;
+    for (int c = 1; c < 3; ++c)
+        if (cov[c][c] > cov[maxChannel][maxChannel])
+            maxChannel = c;
+    Float axis[3] = {cov[maxChannel][0], cov[maxChannel][1], cov[maxChannel][2]};
+    if (axis[maxChannel] == 0)
+        axis[0] = axis[1] = axis[2] = 1;
+    for (int iter = 0; iter < 8; ++iter) {
+        Float next[3];
+        for (int i = 0; i < 3; ++i)
+            next[i] = cov[i][0] * axis[0] + cov[i][1] * axis[1] + cov[i][2] * axis[2];
+        Float m = std::max({std::abs(next[0]), std::abs(next[1]), std::abs(next[2])});
+        if (m == 0)
+            break;
+        for (int i = 0; i < 3; ++i)
+            axis[i] = next[i] / m;
+    }
+
+    // Choose initial endpoints at the extent of the colors along the axis
+    Float tMin = Infinity, tMax = -Infinity;
+    Float axisLengthSquared = Sqr(axis[0]) + Sqr(axis[1]) + Sqr(axis[2]);
+    for (int t = 0; t < 16; ++t) {
+        Float d = 0;
+        for (int c = 0; c < 3; ++c)
+            d += (rgb[t][c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, d / axisLengthSquared);
+        tMax = std::max(tMax, d / axisLengthSquared);
+    }
+    Float e0[3], e1[3];
+    for (int c = 0; c < 3; ++c) {
+        e0[c] = mean[c] + tMax * axis[c];
+        e1[c] = mean[c] + tMin * axis[c];
+    }
+    int error;
+    uint64_t block = MakeBC1Block(QuantizeRGB565(e0), QuantizeRGB565(e1), rgb, &error);
+
+    // Refine the endpoints with least squares fits to the chosen palette
+    // entries
+    for (int iter = 0; iter < 2 && error > 0; ++iter) {
+        static const Float weights[4] = {1, 0, Float(2) / 3, Float(1) / 3};
+        Float a2 = 0, ab = 0, b2 = 0, ax[3] = {0, 0, 0}, bx[3] = {0, 0, 0};
+        for (int t = 0; t < 16; ++t) {
+            Float a = weights[(block >> (32 + 2 * t)) & 3], b = 1 - a;
+            a2 += a * a;
+            ab += a * b;
+            b2 += b * b;
+            for (int c = 0; c < 3; ++c) {
+                ax[c] += a * rgb[t][c];
+                bx[c] += b * rgb[t][c];
+            }
+        }
+        Float det = a2 * b2 - ab * ab;
+        if (std::abs(det) < 1e-6f)
+            break;
+        for (int c = 0; c < 3; ++c) {
+            e0[c] = (b2 * ax[c] - ab * bx[c]) / det;
+            e1[c] = (a2 * bx[c] - ab * ax[c]) / det;
+        }
+        int refinedError;
+        uint64_t refined =
+            MakeBC1Block(QuantizeRGB565(e0), QuantizeRGB565(e1), rgb, &refinedError);
+        if (refinedError >= error)
+            break;
+        block = refined;
+        error = refinedError;
+    }
+    return block;
+}
+
+uint64_t CompressedImage::EncodeBC4(const uint8_t v[16]) {
+    // Use the extreme values as endpoints and interpolate the other six
+    uint8_t vMin = *std::min_element(v, v + 16), vMax = *std::max_element(v, v + 16);
+    uint64_t block = uint64_t(vMax) | (uint64_t(vMin) << 8);
+    if (vMin == vMax)
+        return block;
+
+    int palette[8];
+    for (int i = 0; i < 8; ++i)
+        palette[i] = DecodeBC4(block | (uint64_t(i) << 16), 0);
+    for (int t = 0; t < 16; ++t) {
+        int bestIndex = 0;
+        for (int i = 1; i < 8; ++i)
+            if (std::abs(palette[i] - v[t]) < std::abs(palette[bestIndex] - v[t]))
+                bestIndex = i;
+        block |= uint64_t(bestIndex) << (16 + 3 * t);
+    }
+    return block;
+}
+
+// CompressedImage Method Definitions
+CompressedImage::CompressedImage(const Image &image, TextureCompression compression,
+                                 Allocator alloc)
+    : compression(compression),
+      resolution(image.Resolution()),
+      encoding(image.Encoding()),
+      blocks(alloc),
+      texels(alloc) {
+    CHECK(CanCompress(image, compression));
+    if (compression == TextureCompression::RGB9E5) {
+        texels.resize(size_t(resolution.x) * resolution.y);
+        ParallelFor(0, resolution.y, [&](int64_t y) {
+            for (int x = 0; x < resolution.x; ++x) {
+                Point2i p(x, y);
+                texels[y * resolution.x + x] =
+                    EncodeRGB9E5(image.GetChannel(p, 0), image.GetChannel(p, 1),
+                                 image.GetChannel(p, 2));
+            }
+        });
+        return;
+    }
+
+    // Encode each 4x4 block; texels past the edges of the image are
+    // replicated from the last row and column.
+    int blocksPerRow = (resolution.x + 3) / 4, blockRows = (resolution.y + 3) / 4;
+    blocks.resize(size_t(blocksPerRow) * blockRows);
+    ParallelFor(0, blockRows, [&](int64_t by) {
+        for (int bx = 0; bx < blocksPerRow; ++bx) {
+            uint8_t rgb[16][3], v[16];
+            for (int t = 0; t < 16; ++t) {
+                Point2i p(std::min(4 * bx + t % 4, resolution.x - 1),
+                          std::min(4 * int(by) + t / 4, resolution.y - 1));
+                const uint8_t *texel = (const uint8_t *)image.RawPointer(p);
+                if (compression == TextureCompression::BC1)
+                    std::copy(texel, texel + 3, rgb[t]);
+                else
+                    v[t] = texel[0];
+            }
+            blocks[by * blocksPerRow + bx] =
+                compression == TextureCompression::BC1 ? EncodeBC1(rgb) : EncodeBC4(v);
+        }
+    });
+}
+
+bool CompressedImage::CanCompress(const Image &image, TextureCompression compression) {
+    switch (compression) {
+    case TextureCompression::BC1:
+        return image.Format() == PixelFormat::U256 && image.NChannels() == 3;
+    case TextureCompression::BC4:
+        return image.Format() == PixelFormat::U256 && image.NChannels() == 1;
+    case TextureCompression::RGB9E5:
+        return image.NChannels() == 3;
+    default:
+        return false;
+    }
+}
+
+TextureCompression CompressedImage::SelectCompression(const Image &image) {
+    // Prefer the block formats, which are smaller, for 8-bit images
+    for (TextureCompression compression :
+         {TextureCompression::BC1, TextureCompression::BC4, TextureCompression::RGB9E5})
+        if (CanCompress(image, compression))
+            return compression;
+    return TextureCompression::None;
+}
+
+std::string CompressedImage::ToString() const {
+    return StringPrintf("[ CompressedImage compression: %s resolution: %s "
+                        "encoding: %s bytes: %d ]",
+                        compression, resolution,
+                        encoding ? encoding.ToString() : std::string("(nullptr)"),
+                        BytesUsed());
+}
+
+std::string TextureCompressionError::ToString() const {
+    return StringPrintf("[ TextureCompressionError rmsError: %f maxError: %f "
+                        "PSNR: %f ]",
+                        rmsError, maxError, PSNR());
+}
+
+TextureCompressionError CompressionError(const Image &image,
+                                         const CompressedImage &compressed) {
+    CHECK(image.Resolution() == compressed.Resolution());
+    CHECK_EQ(image.NChannels(), compressed.NChannels());
+    double sumSquaredError = 0;
+    TextureCompressionError error;
+    for (int y = 0; y < image.Resolution().y; ++y)
+        for (int x = 0; x < image.Resolution().x; ++x)
+            for (int c = 0; c < image.NChannels(); ++c) {
+                Float e = std::abs(image.GetChannel({x, y}, c) -
+                                   compressed.GetChannel({x, y}, c));
+                sumSquaredError += Sqr(e);
+                error.maxError = std::max(error.maxError, e);
+            }
+    size_t n = size_t(image.Resolution().x) * image.Resolution().y * image.NChannels();
+    error.rmsError = std::sqrt(sumSquaredError / n);
+    return error;
+}
+
+}  // namespace pbrt
@@ -0,0 +1,182 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_UTIL_TEXCOMPRESS_H
+#define PBRT_UTIL_TEXCOMPRESS_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/color.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/pstd.h>
+#include <pbrt/util/vecmath.h>
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+namespace pbrt {
+
+// TextureCompression Definition
+// BC1 and BC4 store 4x4 blocks of 8-bit RGB and single-channel texels,
+// respectively, in 8 bytes. RGB9E5 stores each RGB texel with 9-bit
+// mantissas and a shared 5-bit exponent. Auto selects the one that suits
+// the image, if any.
+enum class TextureCompression { None, Auto, BC1, BC4, RGB9E5 };
+
+pstd::optional<TextureCompression> ParseTextureCompression(const std::string &name);
+std::string ToString(TextureCompression compression);
+
+// RGB9E5 Inline Functions
+inline uint32_t EncodeRGB9E5(Float r, Float g, Float b) {
+    // Follow the EXT_texture_shared_exponent specification
+    constexpr int MantissaBits = 9, ExponentBias = 15;
+    constexpr Float MaxValue = Float(511) / 512 * 65536;
+    Float rgb[3] = {r, g, b};
+    for (Float &v : rgb)
+        v = std::isnan(v) ? 0 : Clamp(v, 0, MaxValue);
+    Float maxc = std::max({rgb[0], rgb[1], rgb[2]});
+    if (maxc == 0)
+        return 0;
+
+    int exponent = std::max(-ExponentBias - 1, int(std::floor(std::log2(maxc)))) + 1 +
+                   ExponentBias;
+    if (int(std::floor(std::ldexp(maxc, MantissaBits + ExponentBias - exponent) +
+                       0.5f)) == (1 << MantissaBits))
+        ++exponent;
+    uint32_t bits = uint32_t(exponent) << 27;
+    for (int c = 0; c < 3; ++c) {
+        int scaleExponent = MantissaBits + ExponentBias - exponent;
+        uint32_t m = std::floor(std::ldexp(rgb[c], scaleExponent) + 0.5f);
+        bits |= std::min<uint32_t>(m, 511) << (9 * c);
+    }
+    return bits;
+}
+
+inline Float DecodeRGB9E5(uint32_t bits, int c) {
+    int exponent = int(bits >> 27) - 15 - 9;
+    return std::ldexp(Float((bits >> (9 * c)) & 511), exponent);
+}
+
+// CompressedImage Definition
+// CompressedImage stores a block-compressed copy of an image. It is
+// immutable and its texels are decoded as they are accessed.
+class CompressedImage {
+  public:
+    // CompressedImage Public Methods
+    CompressedImage(Allocator alloc = {}) : blocks(alloc), texels(alloc) {}
+    CompressedImage(const Image &image, TextureCompression compression,
+                    Allocator alloc = {});
+
+    // Returns true if the image can be stored with the given compression
+    static bool CanCompress(const Image &image, TextureCompression compression);
+    // Returns the compression that Auto selects for the image
+    static TextureCompression SelectCompression(const Image &image);
+
+    Point2i Resolution() const { return resolution; }
+    int NChannels() const { return compression == TextureCompression::BC4 ? 1 : 3; }
+    TextureCompression Compression() const { return compression; }
+    size_t BytesUsed() const {
+        return sizeof(uint64_t) * blocks.size() + sizeof(uint32_t) * texels.size();
+    }
+
+    Float GetChannel(Point2i p, int c, WrapMode2D wrapMode = WrapMode::Clamp) const {
+        if (!RemapPixelCoords(&p, resolution, wrapMode))
+            return 0;
+        if (compression == TextureCompression::RGB9E5)
+            return DecodeRGB9E5(texels[p.y * resolution.x + p.x], c);
+
+        // Decode the texel's value from its block
+        int blocksPerRow = (resolution.x + 3) / 4;
+        uint64_t block = blocks[(p.y / 4) * blocksPerRow + p.x / 4];
+        int index = (p.y % 4) * 4 + p.x % 4;
+        uint8_t v = compression == TextureCompression::BC1 ? DecodeBC1(block, index, c)
+                                                           : DecodeBC4(block, index);
+        Float r;
+        encoding.ToLinear({&v, 1}, {&r, 1});
+        return r;
+    }
+
+    Float BilerpChannel(Point2f p, int c, WrapMode2D wrapMode = WrapMode::Clamp) const {
+        // Follow Image::BilerpChannel()
+        Float x = p[0] * resolution.x - 0.5f, y = p[1] * resolution.y - 0.5f;
+        int xi = std::floor(x), yi = std::floor(y);
+        Float dx = x - xi, dy = y - yi;
+        pstd::array<Float, 4> v = {GetChannel({xi, yi}, c, wrapMode),
+                                   GetChannel({xi + 1, yi}, c, wrapMode),
+                                   GetChannel({xi, yi + 1}, c, wrapMode),
+                                   GetChannel({xi + 1, yi + 1}, c, wrapMode)};
+        return pbrt::Bilerp({dx, dy}, v);
+    }
+
+    std::string ToString() const;
+
+    // BC1 and BC4 blocks store texels in scanline order within the block
+    static uint64_t EncodeBC1(const uint8_t rgb[16][3]);
+    static uint8_t DecodeBC1(uint64_t block, int index, int c) {
+        uint16_t c0 = block & 0xffff, c1 = (block >> 16) & 0xffff;
+        int e0 = Expand565(c0, c), e1 = Expand565(c1, c);
+        switch ((block >> (32 + 2 * index)) & 3) {
+        case 0:
+            return e0;
+        case 1:
+            return e1;
+        case 2:
+            return c0 > c1 ? (2 * e0 + e1 + 1) / 3 : (e0 + e1 + 1) / 2;
+        default:
+            return c0 > c1 ? (e0 + 2 * e1 + 1) / 3 : 0;
+        }
+    }
+    static uint64_t EncodeBC4(const uint8_t v[16]);
+    static uint8_t DecodeBC4(uint64_t block, int index) {
+        int e0 = block & 0xff, e1 = (block >> 8) & 0xff;
+        int i = (block >> (16 + 3 * index)) & 7;
+        if (i < 2)
+            return i == 0 ? e0 : e1;
+        if (e0 > e1)
+            return ((8 - i) * e0 + (i - 1) * e1 + 3) / 7;
+        if (i >= 6)
+            return i == 6 ? 0 : 255;
+        return ((6 - i) * e0 + (i - 1) * e1 + 2) / 5;
+    }
+
+  private:
+    // CompressedImage Private Methods
+    static int Expand565(uint16_t color, int c) {
+        if (c == 1) {
+            int g = (color >> 5) & 63;
+            return (g << 2) | (g >> 4);
+        }
+        int v = c == 0 ? color >> 11 : color & 31;
+        return (v << 3) | (v >> 2);
+    }
+
+    // CompressedImage Private Members
+    TextureCompression compression = TextureCompression::None;
+    Point2i resolution;
+    ColorEncodingHandle encoding;
+    // BC1 and BC4 blocks, in scanline order
+    pstd::vector<uint64_t> blocks;
+    // RGB9E5 texels
+    pstd::vector<uint32_t> texels;
+};
+
+// TextureCompressionError Definition
+// Differences between an image's linear texel values and those of its
+// compressed version; PSNR is measured with respect to a peak value of one.
+struct TextureCompressionError {
+    Float rmsError = 0, maxError = 0;
+
+    Float PSNR() const {
+        return rmsError > 0 ? -20 * std::log10(rmsError) : Infinity;
+    }
+    std::string ToString() const;
+};
+
+TextureCompressionError CompressionError(const Image &image,
+                                         const CompressedImage &compressed);
+
+}  // namespace pbrt
+
+#endif  // PBRT_UTIL_TEXCOMPRESS_H
@@ -0,0 +1,162 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/util/colorspace.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/mipmap.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/texcompress.h>
+
+#include <cmath>
+
+using namespace pbrt;
+
+TEST(TextureCompression, RGB9E5) {
+    EXPECT_EQ(0, EncodeRGB9E5(0, 0, 0));
+    EXPECT_EQ(0, EncodeRGB9E5(-1, 0, 0));
+
+    // Powers of two and the largest representable value are exact
+    for (Float v : {Float(1), Float(0.25), Float(1024)}) {
+        uint32_t bits = EncodeRGB9E5(v, v / 2, 0);
+        EXPECT_EQ(v, DecodeRGB9E5(bits, 0));
+        EXPECT_EQ(v / 2, DecodeRGB9E5(bits, 1));
+        EXPECT_EQ(0, DecodeRGB9E5(bits, 2));
+    }
+    EXPECT_EQ(65408, DecodeRGB9E5(EncodeRGB9E5(65408, 0, 0), 0));
+    EXPECT_EQ(65408, DecodeRGB9E5(EncodeRGB9E5(1e10f, 0, 0), 0));
+
+    // Otherwise, errors are at most half of the spacing of mantissa values
+    // for the largest component.
+    RNG rng;
+    for (int i = 0; i < 10000; ++i) {
+        Float rgb[3];
+        for (Float &v : rgb)
+            v = std::pow(10.f, -3 + 6 * rng.Uniform<Float>());
+        uint32_t bits = EncodeRGB9E5(rgb[0], rgb[1], rgb[2]);
+        Float maxc = std::max({rgb[0], rgb[1], rgb[2]});
+        for (int c = 0; c < 3; ++c)
+            EXPECT_LE(std::abs(DecodeRGB9E5(bits, c) - rgb[c]), maxc / 512)
+                << rgb[c] << " " << maxc;
+    }
+}
+
+TEST(TextureCompression, BC1Block) {
+    // Blocks with a single color that is exactly representable in RGB565
+    // should be reproduced exactly.
+    uint8_t rgb[16][3];
+    for (int t = 0; t < 16; ++t) {
+        rgb[t][0] = 255;
+        rgb[t][1] = 0;
+        rgb[t][2] = 132;
+    }
+    uint64_t block = CompressedImage::EncodeBC1(rgb);
+    for (int t = 0; t < 16; ++t)
+        for (int c = 0; c < 3; ++c)
+            EXPECT_EQ(rgb[t][c], CompressedImage::DecodeBC1(block, t, c));
+
+    // Two colors should be represented by the endpoints.
+    for (int t = 0; t < 16; ++t) {
+        rgb[t][0] = (t & 1) ? 255 : 0;
+        rgb[t][1] = (t & 1) ? 0 : 255;
+        rgb[t][2] = 0;
+    }
+    block = CompressedImage::EncodeBC1(rgb);
+    for (int t = 0; t < 16; ++t)
+        for (int c = 0; c < 3; ++c)
+            EXPECT_EQ(rgb[t][c], CompressedImage::DecodeBC1(block, t, c));
+}
+
+TEST(TextureCompression, BC4Block) {
+    // Values evenly spaced between the extremes are exact.
+    uint8_t v[16];
+    for (int t = 0; t < 16; ++t)
+        v[t] = 7 + 35 * (t % 8);
+    uint64_t block = CompressedImage::EncodeBC4(v);
+    for (int t = 0; t < 16; ++t)
+        EXPECT_EQ(v[t], CompressedImage::DecodeBC4(block, t));
+
+    // Otherwise, errors are at most half the spacing of the interpolated
+    // values.
+    RNG rng;
+    for (int i = 0; i < 1000; ++i) {
+        for (int t = 0; t < 16; ++t)
+            v[t] = rng.Uniform<uint32_t>() & 0xff;
+        block = CompressedImage::EncodeBC4(v);
+        int range = *std::max_element(v, v + 16) - *std::min_element(v, v + 16);
+        for (int t = 0; t < 16; ++t)
+            EXPECT_LE(std::abs(int(CompressedImage::DecodeBC4(block, t)) - v[t]),
+                      (range + 13) / 14);
+    }
+}
+
+static Image TestImage(PixelFormat format, int nChannels, Point2i res) {
+    std::string rgb[3] = {"R", "G", "B"}, y[1] = {"Y"};
+    pstd::span<const std::string> channels =
+        nChannels == 1 ? pstd::span<const std::string>(y) : rgb;
+    ColorEncodingHandle encoding =
+        format == PixelFormat::U256 ? ColorEncodingHandle::sRGB : nullptr;
+    Image image(format, res, channels, encoding);
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < nChannels; ++c)
+                image.SetChannel({x, y}, c,
+                                 0.5f + 0.4f * std::sin(0.05f * x + 0.07f * y + c));
+    return image;
+}
+
+TEST(TextureCompression, Images) {
+    // The resolution isn't a multiple of the block size so that partial
+    // blocks are exercised.
+    Point2i res(37, 22);
+    struct {
+        PixelFormat format;
+        int nChannels;
+        TextureCompression compression;
+        Float minPSNR;
+    } cases[] = {{PixelFormat::U256, 3, TextureCompression::BC1, 32},
+                 {PixelFormat::U256, 1, TextureCompression::BC4, 40},
+                 {PixelFormat::Half, 3, TextureCompression::RGB9E5, 45}};
+    for (const auto &tc : cases) {
+        Image image = TestImage(tc.format, tc.nChannels, res);
+        EXPECT_EQ(tc.compression, CompressedImage::SelectCompression(image));
+        CompressedImage compressed(image, tc.compression);
+        EXPECT_EQ(res, compressed.Resolution());
+        EXPECT_EQ(tc.nChannels, compressed.NChannels());
+        EXPECT_LT(compressed.BytesUsed(), image.BytesUsed());
+
+        TextureCompressionError error = CompressionError(image, compressed);
+        EXPECT_GT(error.PSNR(), tc.minPSNR) << ToString(tc.compression);
+    }
+
+    EXPECT_EQ(TextureCompression::None,
+              CompressedImage::SelectCompression(TestImage(PixelFormat::Float, 1, res)));
+    EXPECT_FALSE(CompressedImage::CanCompress(TestImage(PixelFormat::Half, 3, res),
+                                              TextureCompression::BC1));
+}
+
+TEST(TextureCompression, MIPMap) {
+    // Filtered lookups in compressed MIPMaps should be close to the
+    // uncompressed ones.
+    Image image = TestImage(PixelFormat::U256, 3, {128, 64});
+    const RGBColorSpace *cs = RGBColorSpace::sRGB;
+    MIPMapFilterOptions options;
+    MIPMap mipmap(image, cs, WrapMode::Repeat, Allocator(), options);
+    options.compression = TextureCompression::Auto;
+    MIPMap compressed(image, cs, WrapMode::Repeat, Allocator(), options);
+    EXPECT_EQ(mipmap.Levels(), compressed.Levels());
+    EXPECT_LE(6 * compressed.BytesUsed(), mipmap.BytesUsed());
+
+    RNG rng;
+    for (int i = 0; i < 1000; ++i) {
+        Point2f st(rng.Uniform<Float>(), rng.Uniform<Float>());
+        Float width = std::pow(2.f, -8 * rng.Uniform<Float>());
+        RGB ref = mipmap.Lookup<RGB>(st, width);
+        RGB v = compressed.Lookup<RGB>(st, width);
+        for (int c = 0; c < 3; ++c)
+            EXPECT_LT(std::abs(ref[c] - v[c]), 0.06f) << st << " " << width;
+    }
+}